@@ -0,0 +1,391 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <unistd.h>
+
+#include "cjdc.h"
+
+/*
+ * A stable hash of the part of a class that its dependents compile
+ * against: class access flags, this_class, super_class, interfaces and
+ * the fields and methods that are neither private nor synthetic.  Names
+ * are hashed as strings, never as constant pool indexes, and interfaces
+ * and members are hashed in sorted order, so recompiling a class whose
+ * API did not change gives the same fingerprint.  Method bodies, debug
+ * info, private members and the synthetic ones javac derives from method
+ * bodies do not contribute.
+ *
+ * Besides descriptors, a member contributes its ConstantValue (javac
+ * inlines static final constants into dependents), its generic Signature
+ * and its Exceptions.  Flags with no effect on callers (ACC_SUPER,
+ * synchronized, native, strictfp) are masked out.
+ *
+ * The class is skimmed, not read: nothing is decoded into class_file_t.
+ */
+#define FNV_OFFSET_BASIS    (0xcbf29ce484222325ULL)
+#define FNV_PRIME           (0x00000100000001b3ULL)
+
+#define CLASS_ABI_FLAGS     (~0x0020)                   /* ACC_SUPER */
+#define METHOD_ABI_FLAGS    (~(0x0020 | 0x0100 | 0x0800)) /* synchronized, native, strictfp */
+
+static int hash_members(class_skim_t *skim, uint64_t *hash, int is_method);
+static int hash_member(class_skim_t *skim, int is_method, uint64_t *hash);
+static int hash_constant_value(class_skim_t *skim, u2_t index, uint64_t *hash);
+static int hash_class_names(class_skim_t *skim, uint64_t *hash);
+static uint64_t hash_sorted(uint64_t hash, uint64_t *hashes, u4_t count);
+static int compare_hashes(const void *a, const void *b);
+
+static uint64_t hash_bytes(uint64_t hash, const u1_t *bytes, u4_t length);
+static uint64_t hash_u2(uint64_t hash, u2_t value);
+static uint64_t hash_u8(uint64_t hash, uint64_t value);
+static uint64_t hash_string(uint64_t hash, const u1_t *bytes, u2_t length);
+
+static int print_fingerprint(const u1_t *bytes, u4_t length, const char *name, int name_length);
+static int fingerprint_jar(const char *jar_file_name);
+static int fingerprint_class(const char *class_file_name);
+
+int abi_fingerprint(const u1_t *bytes, u4_t length, uint64_t *fingerprint) {
+    class_skim_t class_skim;
+    class_skim_t *skim = &class_skim;
+    uint64_t hash = FNV_OFFSET_BASIS;
+    const u1_t *name;
+    u2_t name_length;
+    u2_t access_flags;
+    u2_t index;
+    u2_t count;
+    int result = -1;
+    int i;
+
+    if (skim_class_bytes(skim, bytes, length) < 0) {
+        return -1;
+    }
+
+    if (skim_u2(skim, &access_flags) < 0) {
+        goto RETURN;
+    }
+    hash = hash_u2(hash, access_flags & CLASS_ABI_FLAGS);
+    for (i = 0; i < 2; i++) {
+        /* this_class, super_class; only java.lang.Object has no super class */
+        if (skim_u2(skim, &index) < 0) {
+            goto RETURN;
+        }
+        name = NULL;
+        name_length = 0;
+        if (index && (skim_class_name(skim, index, &name, &name_length) < 0)) {
+            goto RETURN;
+        }
+        hash = hash_string(hash, name, name_length);
+    }
+    if ((hash_class_names(skim, &hash) < 0) ||
+        (hash_members(skim, &hash, 0) < 0) ||
+        (hash_members(skim, &hash, 1) < 0)) {
+        goto RETURN;
+    }
+
+    /* a generic superclass or interface is part of the API as well */
+    if (skim_u2(skim, &count) < 0) {
+        goto RETURN;
+    }
+    for (i = 0; i < count; i++) {
+        u4_t attribute_length;
+        if ((skim_u2(skim, &index) < 0) || (skim_u4(skim, &attribute_length) < 0)) {
+            goto RETURN;
+        }
+        if (skim_utf8_is(skim, index, "Signature") && (attribute_length == 2)) {
+            if ((skim_u2(skim, &index) < 0) || (skim_utf8(skim, index, &name, &name_length) < 0)) {
+                goto RETURN;
+            }
+            hash = hash_string(hash_u2(hash, 'S'), name, name_length);
+        }
+        else if (skim_skip(skim, attribute_length) < 0) {
+            goto RETURN;
+        }
+    }
+
+    *fingerprint = hash;
+    result = 0;
+
+RETURN:
+    skim_free(skim);
+    return result;
+}
+
+static int hash_class_names(class_skim_t *skim, uint64_t *hash) {
+    u2_t count;
+    if (skim_u2(skim, &count) < 0) {
+        return -1;
+    }
+    uint64_t *hashes = malloc((count ? count : 1) * sizeof(uint64_t));
+    if (hashes == NULL) {
+        fprintf(stderr, "%s: failed to allocate %u hashes\n", program, count);
+        return -1;
+    }
+    int i;
+    for (i = 0; i < count; i++) {
+        const u1_t *name;
+        u2_t name_length;
+        u2_t index;
+        if ((skim_u2(skim, &index) < 0) || (skim_class_name(skim, index, &name, &name_length) < 0)) {
+            free(hashes);
+            return -1;
+        }
+        hashes[i] = hash_string(FNV_OFFSET_BASIS, name, name_length);
+    }
+    *hash = hash_sorted(*hash, hashes, count);
+    free(hashes);
+    return 0;
+}
+
+static int hash_members(class_skim_t *skim, uint64_t *hash, int is_method) {
+    u2_t count;
+    if (skim_u2(skim, &count) < 0) {
+        return -1;
+    }
+    uint64_t *hashes = malloc((count ? count : 1) * sizeof(uint64_t));
+    if (hashes == NULL) {
+        fprintf(stderr, "%s: failed to allocate %u hashes\n", program, count);
+        return -1;
+    }
+    u4_t kept = 0;
+    int i;
+    for (i = 0; i < count; i++) {
+        int included = hash_member(skim, is_method, &hashes[kept]);
+        if (included < 0) {
+            free(hashes);
+            return -1;
+        }
+        kept += included;
+    }
+    *hash = hash_sorted(hash_u2(*hash, is_method ? 'M' : 'F'), hashes, kept);
+    free(hashes);
+    return 0;
+}
+
+/* returns 1 if the member is part of the ABI, 0 if it is not */
+static int hash_member(class_skim_t *skim, int is_method, uint64_t *hash) {
+    const u1_t *name;
+    const u1_t *descriptor;
+    u2_t name_length;
+    u2_t descriptor_length;
+    u2_t access_flags;
+    u2_t name_index;
+    u2_t descriptor_index;
+    u2_t count;
+
+    if ((skim_u2(skim, &access_flags) < 0) ||
+        (skim_u2(skim, &name_index) < 0) ||
+        (skim_u2(skim, &descriptor_index) < 0) ||
+        (skim_utf8(skim, name_index, &name, &name_length) < 0) ||
+        (skim_utf8(skim, descriptor_index, &descriptor, &descriptor_length) < 0) ||
+        (skim_u2(skim, &count) < 0)) {
+        return -1;
+    }
+    /* synthetic members ($assertionsDisabled, access$000, lambda bodies) follow the method bodies */
+    int included = !ACC_PRIVATE(access_flags) && !ACC_SYNTHETIC(access_flags) &&
+        !(is_method && (name_length == 8) && (memcmp(name, "<clinit>", 8) == 0));
+
+    uint64_t constant_value = 0;
+    uint64_t signature = 0;
+    uint64_t exceptions = 0;
+    int i;
+    for (i = 0; i < count; i++) {
+        const u1_t *bytes;
+        u2_t length;
+        u2_t index;
+        u4_t attribute_length;
+        if ((skim_u2(skim, &index) < 0) || (skim_u4(skim, &attribute_length) < 0)) {
+            return -1;
+        }
+        u4_t end = skim->position + attribute_length;
+        if (!included) {
+            /* skipped below */
+        }
+        else if (!is_method && skim_utf8_is(skim, index, "ConstantValue") && (attribute_length == 2)) {
+            if ((skim_u2(skim, &index) < 0) || (hash_constant_value(skim, index, &constant_value) < 0)) {
+                return -1;
+            }
+        }
+        else if (skim_utf8_is(skim, index, "Signature") && (attribute_length == 2)) {
+            if ((skim_u2(skim, &index) < 0) || (skim_utf8(skim, index, &bytes, &length) < 0)) {
+                return -1;
+            }
+            signature = hash_string(FNV_OFFSET_BASIS, bytes, length);
+        }
+        else if (is_method && skim_utf8_is(skim, index, "Exceptions")) {
+            if (hash_class_names(skim, &exceptions) < 0) {
+                return -1;
+            }
+        }
+        if ((end < skim->position) || (skim_skip(skim, end - skim->position) < 0)) {
+            fprintf(stderr, "%s: malformed attribute of %.*s\n", program, name_length, name);
+            return -1;
+        }
+    }
+    if (!included) {
+        return 0;
+    }
+
+    uint64_t member_hash = FNV_OFFSET_BASIS;
+    member_hash = hash_u2(member_hash, access_flags & (is_method ? METHOD_ABI_FLAGS : 0xffff));
+    member_hash = hash_string(member_hash, name, name_length);
+    member_hash = hash_string(member_hash, descriptor, descriptor_length);
+    member_hash = hash_u8(member_hash, constant_value);
+    member_hash = hash_u8(member_hash, signature);
+    member_hash = hash_u8(member_hash, exceptions);
+    *hash = member_hash;
+    return 1;
+}
+
+static int hash_constant_value(class_skim_t *skim, u2_t index, uint64_t *hash) {
+    const u1_t *bytes;
+    u2_t length;
+
+    const u1_t *entry = skim_entry(skim, index);
+    if (entry == NULL) {
+        fprintf(stderr, "%s: invalid constant value index %u\n", program, index);
+        return -1;
+    }
+    switch (entry[0]) {
+    case CONSTANT_INTEGER:
+    case CONSTANT_FLOAT:
+        *hash = hash_bytes(FNV_OFFSET_BASIS, entry, 5);
+        return 0;
+    case CONSTANT_LONG:
+    case CONSTANT_DOUBLE:
+        *hash = hash_bytes(FNV_OFFSET_BASIS, entry, 9);
+        return 0;
+    case CONSTANT_STRING:
+        if (skim_utf8(skim, (entry[1] << 8) | entry[2], &bytes, &length) < 0) {
+            return -1;
+        }
+        *hash = hash_string(hash_u2(FNV_OFFSET_BASIS, CONSTANT_STRING), bytes, length);
+        return 0;
+    default:
+        fprintf(stderr, "%s: constant value index %u has tag %u\n", program, index, entry[0]);
+        return -1;
+    }
+}
+
+/* folds hashes in ascending order, so the order they were found in does not matter */
+static uint64_t hash_sorted(uint64_t hash, uint64_t *hashes, u4_t count) {
+    qsort(hashes, count, sizeof(uint64_t), compare_hashes);
+    hash = hash_u8(hash, count);
+    u4_t i;
+    for (i = 0; i < count; i++) {
+        hash = hash_u8(hash, hashes[i]);
+    }
+    return hash;
+}
+
+static int compare_hashes(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *) a;
+    uint64_t y = *(const uint64_t *) b;
+    return (x > y) - (x < y);
+}
+
+/* FNV-1a */
+static uint64_t hash_bytes(uint64_t hash, const u1_t *bytes, u4_t length) {
+    u4_t i;
+    for (i = 0; i < length; i++) {
+        hash ^= bytes[i];
+        hash *= FNV_PRIME;
+    }
+    return hash;
+}
+
+static uint64_t hash_u2(uint64_t hash, u2_t value) {
+    u1_t bytes[2] = {value >> 8, value};
+    return hash_bytes(hash, bytes, 2);
+}
+
+static uint64_t hash_u8(uint64_t hash, uint64_t value) {
+    u1_t bytes[8];
+    int i;
+    for (i = 0; i < 8; i++) {
+        bytes[i] = value >> (56 - 8 * i);
+    }
+    return hash_bytes(hash, bytes, 8);
+}
+
+/* length-prefixed, so adjacent strings cannot run into each other */
+static uint64_t hash_string(uint64_t hash, const u1_t *bytes, u2_t length) {
+    return hash_bytes(hash_u2(hash, length), bytes, length);
+}
+
+static int print_fingerprint(const u1_t *bytes, u4_t length, const char *name, int name_length) {
+    uint64_t fingerprint;
+    if (abi_fingerprint(bytes, length, &fingerprint) < 0) {
+        fprintf(stderr, "%s: failed to fingerprint '%.*s'\n", program, name_length, name);
+        return -1;
+    }
+    printf("%016" PRIx64 "  %.*s\n", fingerprint, name_length, name);
+    return 0;
+}
+
+static int fingerprint_jar(const char *jar_file_name) {
+    jar_file_t *jar_file = open_jar_file(jar_file_name);
+    if (jar_file == NULL) {
+        return -1;
+    }
+    int result = 0;
+    u4_t i;
+    for (i = 0; i < jar_file->entries_count; i++) {
+        jar_entry_t *entry = &jar_file->entries[i];
+        if (!is_class_entry(entry)) {
+            continue;
+        }
+        u1_t *bytes = read_jar_entry(jar_file, entry);
+        if ((bytes == NULL) ||
+            (print_fingerprint(bytes, entry->uncompressed_size, entry->name, entry->name_length) < 0)) {
+            result = -1;
+        }
+        free(bytes);
+    }
+    close_jar_file(jar_file);
+    return result;
+}
+
+static int fingerprint_class(const char *class_file_name) {
+    int fd = open(class_file_name, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "%s: failed to open '%s': %s\n", program, class_file_name, strerror(errno));
+        return -1;
+    }
+    u4_t length;
+    u1_t *bytes = read_fd_bytes(fd, &length);
+    close(fd);
+    if (bytes == NULL) {
+        return -1;
+    }
+    int result = print_fingerprint(bytes, length, class_file_name, strlen(class_file_name));
+    free(bytes);
+    return result;
+}
+
+/* prints one "fingerprint  name" line per class, jars are expanded */
+int abi_main(int ac, char **av) {
+    if (ac < 2) {
+        fprintf(stderr, "usage: %s abi {.class-or-.jar-file}...\n", program);
+        return 1;
+    }
+
+    int failed = 0;
+    int i;
+    for (i = 1; i < ac; i++) {
+        size_t length = strlen(av[i]);
+        int result;
+        if (has_suffix(av[i], length, ".jar") || has_suffix(av[i], length, ".zip")) {
+            result = fingerprint_jar(av[i]);
+        }
+        else {
+            result = fingerprint_class(av[i]);
+        }
+        if (result < 0) {
+            failed = 1;
+        }
+    }
+    return failed;
+}
@@ -0,0 +1,686 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#include "cjdc.h"
+
+/*
+ * Annotation index: maps each annotation type found in the
+ * RuntimeVisibleAnnotations and RuntimeInvisibleAnnotations of classes,
+ * fields and methods to the elements it annotates.
+ *
+ * Classes are skimmed in place and only the attribute tables are walked;
+ * the annotations attributes are the only ones read, every other
+ * attribute is skipped by its length.  Each thread collects its records
+ * with the strings they name, the records are sorted by type, class and
+ * member, and the index is written with every distinct string stored
+ * once.  A lookup is a binary search over the sorted types.
+ */
+
+#define ANNOTATIONS_MAX_DEPTH   (64)
+
+typedef struct annotation_record_s {
+    const u1_t *strings;        /* the worker's strings, once the run is over */
+    u4_t type_offset;
+    u4_t class_offset;
+    u4_t member_offset;
+    u4_t member_length;
+    u2_t type_length;
+    u2_t class_length;
+    u1_t kind;
+    u1_t visible;
+} annotation_record_t;
+
+typedef struct annotations_worker_s {
+    buffer_t strings;
+    annotation_record_t *records;
+    u4_t records_count;
+    u4_t records_capacity;
+} annotations_worker_t;
+
+/* the element whose annotations are being read; its member text is copied when first needed */
+typedef struct annotated_s {
+    u1_t kind;
+    u4_t class_offset;
+    u2_t class_length;
+    u2_t name_index;
+    u2_t descriptor_index;
+    u4_t member_offset;
+    u4_t member_length;
+    int member_copied;
+} annotated_t;
+
+static int annotations_class(void *context, const u1_t *bytes, u4_t length);
+static int annotations_attributes(annotations_worker_t *worker, class_skim_t *skim, annotated_t *annotated);
+static int read_annotations(annotations_worker_t *worker, class_skim_t *skim, u4_t end, int visible, annotated_t *annotated);
+static int add_record(annotations_worker_t *worker, class_skim_t *skim, u2_t type_index, int visible, annotated_t *annotated);
+static int skip_element_value(class_skim_t *skim, int depth);
+static int skip_annotation(class_skim_t *skim, int depth);
+static int compare_records(const void *a, const void *b);
+static int compare_strings(const u1_t *a, u4_t a_length, const u1_t *b, u4_t b_length);
+static u4_t intern_string(table_t *strings, buffer_t *out, const u1_t *bytes, u4_t length, int *failed);
+static int write_annotation_index(const char *index_file_name, annotation_record_t **records, u4_t count);
+
+annotation_index_t *open_annotation_index(const char *index_file_name) {
+    annotation_index_t *index = calloc(1, sizeof(annotation_index_t));
+    if (index == NULL) {
+        fprintf(stderr, "%s: failed to malloc %zu bytes.\n", program, sizeof(annotation_index_t));
+        return NULL;
+    }
+    int fd = open(index_file_name, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "%s: failed to open '%s': %s.\n", program, index_file_name, strerror(errno));
+        goto ERR_RETURN;
+    }
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        fprintf(stderr, "%s: failed to stat '%s': %s.\n", program, index_file_name, strerror(errno));
+        close(fd);
+        goto ERR_RETURN;
+    }
+    if ((st.st_size < (off_t) sizeof(annotation_index_header_t)) || (st.st_size > UINT32_MAX)) {
+        fprintf(stderr, "%s: '%s' is not an annotation index\n", program, index_file_name);
+        close(fd);
+        goto ERR_RETURN;
+    }
+    index->size = st.st_size;
+    index->map = mmap(NULL, index->size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (index->map == MAP_FAILED) {
+        index->map = NULL;
+        fprintf(stderr, "%s: failed to map '%s': %s.\n", program, index_file_name, strerror(errno));
+        goto ERR_RETURN;
+    }
+
+    annotation_index_header_t *header = (annotation_index_header_t *) index->map;
+    if ((header->magic != ANNOTATION_INDEX_MAGIC) || (header->version != ANNOTATION_INDEX_VERSION)) {
+        fprintf(stderr, "%s: '%s' is not an annotation index of version %d\n", program, index_file_name, ANNOTATION_INDEX_VERSION);
+        goto ERR_RETURN;
+    }
+    uint64_t size = index->size;
+    if (((uint64_t) header->types_offset + (uint64_t) header->types_count * sizeof(annotation_index_type_t) > size) ||
+        ((uint64_t) header->elements_offset + (uint64_t) header->elements_count * sizeof(annotation_index_element_t) > size) ||
+        ((uint64_t) header->strings_offset + header->strings_length > size) ||
+        (header->types_offset % 4) || (header->elements_offset % 4)) {
+        fprintf(stderr, "%s: '%s' is a corrupt annotation index\n", program, index_file_name);
+        goto ERR_RETURN;
+    }
+    index->header = header;
+    index->types = (annotation_index_type_t *) (index->map + header->types_offset);
+    index->elements = (annotation_index_element_t *) (index->map + header->elements_offset);
+    index->strings = (const char *) index->map + header->strings_offset;
+    return index;
+
+ERR_RETURN:
+    close_annotation_index(index);
+    return NULL;
+}
+
+void close_annotation_index(annotation_index_t *index) {
+    if (index == NULL) {
+        return;
+    }
+    if (index->map) {
+        munmap(index->map, index->size);
+    }
+    free(index);
+}
+
+/* the elements annotated with the type name, NULL when there are none */
+annotation_index_element_t *annotation_index_lookup(annotation_index_t *index, const char *name, size_t length, u4_t *count) {
+    u4_t low = 0;
+    u4_t high = index->header->types_count;
+    *count = 0;
+    while (low < high) {
+        u4_t middle = low + (high - low) / 2;
+        annotation_index_type_t *type = &index->types[middle];
+        const char *type_name = annotation_index_string(index, type->name_offset, type->name_length);
+        if (type_name == NULL) {
+            return NULL;
+        }
+        int order = compare_strings((const u1_t *) type_name, type->name_length, (const u1_t *) name, length);
+        if (order < 0) {
+            low = middle + 1;
+        }
+        else if (order > 0) {
+            high = middle;
+        }
+        else {
+            if ((uint64_t) type->first_element + type->elements_count > index->header->elements_count) {
+                return NULL;
+            }
+            *count = type->elements_count;
+            return &index->elements[type->first_element];
+        }
+    }
+    return NULL;
+}
+
+/* NULL when the string is not inside the index */
+const char *annotation_index_string(annotation_index_t *index, u4_t offset, u4_t length) {
+    if ((uint64_t) offset + length > index->header->strings_length) {
+        return NULL;
+    }
+    return index->strings + offset;
+}
+
+static int annotations_class(void *context, const u1_t *bytes, u4_t length) {
+    annotations_worker_t *worker = context;
+    class_skim_t skim;
+    annotated_t annotated;
+    const u1_t *name;
+    u2_t name_length;
+    u2_t count;
+    u4_t records_count = worker->records_count;
+    size_t strings_length = worker->strings.length;
+    u4_t i;
+
+    if (skim_class_bytes(&skim, bytes, length) < 0) {
+        return -1;
+    }
+    memset(&annotated, 0, sizeof(annotated));
+    if ((skim_this_class(&skim, &name, &name_length) < 0) ||
+        (buffer_put_bytes(&worker->strings, name, name_length) < 0) ||
+        (skim_u2(&skim, &count) < 0) ||
+        (skim_skip(&skim, 2 * (u4_t) count) < 0)) {
+        goto ERR_RETURN;
+    }
+    annotated.class_offset = worker->strings.length - name_length;
+    annotated.class_length = name_length;
+
+    int members;
+    for (members = 0; members < 2; members++) {
+        if (skim_u2(&skim, &count) < 0) {
+            goto ERR_RETURN;
+        }
+        annotated.kind = members ? ANNOTATED_METHOD : ANNOTATED_FIELD;
+        for (i = 0; i < count; i++) {
+            annotated.member_copied = 0;
+            if ((skim_skip(&skim, 2) < 0) ||
+                (skim_u2(&skim, &annotated.name_index) < 0) ||
+                (skim_u2(&skim, &annotated.descriptor_index) < 0) ||
+                (annotations_attributes(worker, &skim, &annotated) < 0)) {
+                goto ERR_RETURN;
+            }
+        }
+    }
+    annotated.kind = ANNOTATED_CLASS;
+    annotated.member_copied = 1;
+    annotated.member_offset = 0;
+    annotated.member_length = 0;
+    if (annotations_attributes(worker, &skim, &annotated) < 0) {
+        goto ERR_RETURN;
+    }
+    if (worker->records_count == records_count) {
+        worker->strings.length = strings_length;    /* nothing annotated, drop the name */
+    }
+    skim_free(&skim);
+    return 0;
+
+ERR_RETURN:
+    /* a class is indexed whole or not at all */
+    worker->records_count = records_count;
+    worker->strings.length = strings_length;
+    skim_free(&skim);
+    return -1;
+}
+
+static int annotations_attributes(annotations_worker_t *worker, class_skim_t *skim, annotated_t *annotated) {
+    u2_t count;
+    u2_t i;
+    if (skim_u2(skim, &count) < 0) {
+        return -1;
+    }
+    for (i = 0; i < count; i++) {
+        u2_t name_index;
+        u4_t length;
+        const u1_t *name;
+        u2_t name_length;
+        if ((skim_u2(skim, &name_index) < 0) ||
+            (skim_u4(skim, &length) < 0) ||
+            (skim_utf8(skim, name_index, &name, &name_length) < 0)) {
+            return -1;
+        }
+        if ((length > skim->length - skim->position)) {
+            fprintf(stderr, "%s: truncated class file at offset %u\n", program, skim->position);
+            return -1;
+        }
+        u4_t end = skim->position + length;
+        if ((name_length == 25) && (memcmp(name, "RuntimeVisibleAnnotations", 25) == 0)) {
+            if (read_annotations(worker, skim, end, 1, annotated) < 0) {
+                return -1;
+            }
+        }
+        else if ((name_length == 27) && (memcmp(name, "RuntimeInvisibleAnnotations", 27) == 0)) {
+            if (read_annotations(worker, skim, end, 0, annotated) < 0) {
+                return -1;
+            }
+        }
+        skim->position = end;
+    }
+    return 0;
+}
+
+static int read_annotations(annotations_worker_t *worker, class_skim_t *skim, u4_t end, int visible, annotated_t *annotated) {
+    u2_t count;
+    u2_t i;
+    if (skim_u2(skim, &count) < 0) {
+        return -1;
+    }
+    for (i = 0; i < count; i++) {
+        u2_t type_index;
+        if ((skim_u2(skim, &type_index) < 0) ||
+            (add_record(worker, skim, type_index, visible, annotated) < 0)) {
+            return -1;
+        }
+        skim->position -= 2;
+        if (skip_annotation(skim, 0) < 0) {
+            return -1;
+        }
+    }
+    if (skim->position != end) {
+        fprintf(stderr, "%s: annotations attribute ends at offset %u instead of %u\n", program, skim->position, end);
+        return -1;
+    }
+    return 0;
+}
+
+static int add_record(annotations_worker_t *worker, class_skim_t *skim, u2_t type_index, int visible, annotated_t *annotated) {
+    const u1_t *type;
+    u2_t type_length;
+    if (skim_utf8(skim, type_index, &type, &type_length) < 0) {
+        return -1;
+    }
+    /* the type is a field descriptor, Lcom/foo/Bar; */
+    if ((type_length >= 3) && (type[0] == 'L') && (type[type_length - 1] == ';')) {
+        type++;
+        type_length -= 2;
+    }
+
+    if (!annotated->member_copied) {
+        const u1_t *name;
+        const u1_t *descriptor;
+        u2_t name_length;
+        u2_t descriptor_length;
+        if ((skim_utf8(skim, annotated->name_index, &name, &name_length) < 0) ||
+            (skim_utf8(skim, annotated->descriptor_index, &descriptor, &descriptor_length) < 0)) {
+            return -1;
+        }
+        size_t start = worker->strings.length;
+        if ((buffer_put_bytes(&worker->strings, name, name_length) < 0) ||
+            ((annotated->kind == ANNOTATED_FIELD) && (buffer_put_u1(&worker->strings, ':') < 0)) ||
+            (buffer_put_bytes(&worker->strings, descriptor, descriptor_length) < 0)) {
+            return -1;
+        }
+        annotated->member_offset = start;
+        annotated->member_length = worker->strings.length - start;
+        annotated->member_copied = 1;
+    }
+
+    if (worker->records_count == worker->records_capacity) {
+        u4_t capacity = worker->records_capacity ? 2 * worker->records_capacity : 256;
+        annotation_record_t *records = realloc(worker->records, capacity * sizeof(annotation_record_t));
+        if (records == NULL) {
+            fprintf(stderr, "%s: failed to grow the list of annotations to %u\n", program, capacity);
+            return -1;
+        }
+        worker->records = records;
+        worker->records_capacity = capacity;
+    }
+    if (buffer_put_bytes(&worker->strings, type, type_length) < 0) {
+        return -1;
+    }
+    annotation_record_t *record = &worker->records[worker->records_count++];
+    memset(record, 0, sizeof(*record));
+    record->type_offset = worker->strings.length - type_length;
+    record->type_length = type_length;
+    record->class_offset = annotated->class_offset;
+    record->class_length = annotated->class_length;
+    record->member_offset = annotated->member_offset;
+    record->member_length = annotated->member_length;
+    record->kind = annotated->kind;
+    record->visible = visible;
+    return 0;
+}
+
+/* element_value, JVMS 4.7.16.1; depth counts nested arrays as well as nested annotations */
+static int skip_element_value(class_skim_t *skim, int depth) {
+    u2_t count;
+    u2_t i;
+    if (depth > ANNOTATIONS_MAX_DEPTH) {
+        fprintf(stderr, "%s: annotations nested deeper than %d at offset %u\n", program, ANNOTATIONS_MAX_DEPTH, skim->position);
+        return -1;
+    }
+    if (skim->position >= skim->length) {
+        fprintf(stderr, "%s: truncated class file at offset %u\n", program, skim->position);
+        return -1;
+    }
+    u1_t tag = skim->data[skim->position++];
+    switch (tag) {
+    case 'B':
+    case 'C':
+    case 'D':
+    case 'F':
+    case 'I':
+    case 'J':
+    case 'S':
+    case 'Z':
+    case 's':
+    case 'c':
+        return skim_skip(skim, 2);
+    case 'e':
+        return skim_skip(skim, 4);
+    case '@':
+        return skip_annotation(skim, depth + 1);
+    case '[':
+        if (skim_u2(skim, &count) < 0) {
+            return -1;
+        }
+        for (i = 0; i < count; i++) {
+            if (skip_element_value(skim, depth + 1) < 0) {
+                return -1;
+            }
+        }
+        return 0;
+    default:
+        fprintf(stderr, "%s: unknown element value tag %d at offset %u\n", program, tag, skim->position - 1);
+        return -1;
+    }
+}
+
+static int skip_annotation(class_skim_t *skim, int depth) {
+    u2_t count;
+    u2_t i;
+    if ((skim_skip(skim, 2) < 0) || (skim_u2(skim, &count) < 0)) {
+        return -1;
+    }
+    for (i = 0; i < count; i++) {
+        if ((skim_skip(skim, 2) < 0) || (skip_element_value(skim, depth) < 0)) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static int compare_strings(const u1_t *a, u4_t a_length, const u1_t *b, u4_t b_length) {
+    int order = memcmp(a, b, (a_length < b_length) ? a_length : b_length);
+    if (order) {
+        return order;
+    }
+    return (a_length > b_length) - (a_length < b_length);
+}
+
+static int compare_records(const void *a, const void *b) {
+    const annotation_record_t *x = *(annotation_record_t * const *) a;
+    const annotation_record_t *y = *(annotation_record_t * const *) b;
+    int order = compare_strings(x->strings + x->type_offset, x->type_length, y->strings + y->type_offset, y->type_length);
+    if (order == 0) {
+        order = compare_strings(x->strings + x->class_offset, x->class_length, y->strings + y->class_offset, y->class_length);
+    }
+    if (order == 0) {
+        order = (int) x->kind - (int) y->kind;
+    }
+    if (order == 0) {
+        order = compare_strings(x->strings + x->member_offset, x->member_length, y->strings + y->member_offset, y->member_length);
+    }
+    if (order == 0) {
+        order = (int) y->visible - (int) x->visible;
+    }
+    return order;
+}
+
+/* the offset of bytes in out, added on first use */
+static u4_t intern_string(table_t *strings, buffer_t *out, const u1_t *bytes, u4_t length, int *failed) {
+    void **slot = table_insert(strings, bytes, length);
+    if (slot == NULL) {
+        *failed = 1;
+        return 0;
+    }
+    if (*slot == NULL) {
+        if (buffer_put_bytes(out, bytes, length) < 0) {
+            *failed = 1;
+            return 0;
+        }
+        *slot = (void *) (uintptr_t) (out->length - length + 1);
+    }
+    return (u4_t) ((uintptr_t) *slot - 1);
+}
+
+/* records are sorted with duplicates removed; written to a temporary file and renamed */
+static int write_annotation_index(const char *index_file_name, annotation_record_t **records, u4_t count) {
+    buffer_t out = {NULL, 0, 0};
+    buffer_t strings = {NULL, 0, 0};
+    table_t interned;
+    annotation_index_type_t *types = NULL;
+    annotation_index_element_t *elements = calloc(count ? count : 1, sizeof(annotation_index_element_t));
+    char *temporary_name = NULL;
+    u4_t types_count = 0;
+    int failed = 0;
+    int result = -1;
+    u4_t i;
+
+    memset(&interned, 0, sizeof(interned));
+    types = calloc(count ? count : 1, sizeof(annotation_index_type_t));
+    if ((types == NULL) || (elements == NULL)) {
+        fprintf(stderr, "%s: failed to allocate index tables for %u annotations\n", program, count);
+        goto RETURN;
+    }
+    for (i = 0; i < count; i++) {
+        annotation_record_t *record = records[i];
+        if ((i == 0) ||
+            (compare_strings(record->strings + record->type_offset, record->type_length,
+                             records[i - 1]->strings + records[i - 1]->type_offset, records[i - 1]->type_length) != 0)) {
+            annotation_index_type_t *type = &types[types_count++];
+            type->name_offset = intern_string(&interned, &strings, record->strings + record->type_offset, record->type_length, &failed);
+            type->name_length = record->type_length;
+            type->first_element = i;
+        }
+        types[types_count - 1].elements_count++;
+        annotation_index_element_t *element = &elements[i];
+        element->class_offset = intern_string(&interned, &strings, record->strings + record->class_offset, record->class_length, &failed);
+        element->class_length = record->class_length;
+        element->member_offset = intern_string(&interned, &strings, record->strings + record->member_offset, record->member_length, &failed);
+        element->member_length = record->member_length;
+        element->kind = record->kind;
+        element->visible = record->visible;
+    }
+    if (failed) {
+        goto RETURN;
+    }
+
+    annotation_index_header_t header;
+    memset(&header, 0, sizeof(header));
+    header.magic = ANNOTATION_INDEX_MAGIC;
+    header.version = ANNOTATION_INDEX_VERSION;
+    header.types_count = types_count;
+    header.elements_count = count;
+    header.types_offset = sizeof(header);
+    header.elements_offset = header.types_offset + types_count * sizeof(annotation_index_type_t);
+    header.strings_offset = header.elements_offset + count * sizeof(annotation_index_element_t);
+    header.strings_length = strings.length;
+    if ((buffer_put_bytes(&out, &header, sizeof(header)) < 0) ||
+        (buffer_put_bytes(&out, types, types_count * sizeof(annotation_index_type_t)) < 0) ||
+        (buffer_put_bytes(&out, elements, count * sizeof(annotation_index_element_t)) < 0) ||
+        (buffer_put_bytes(&out, strings.data, strings.length) < 0)) {
+        goto RETURN;
+    }
+    if (out.length > UINT32_MAX) {
+        fprintf(stderr, "%s: index of %zu bytes is too large\n", program, out.length);
+        goto RETURN;
+    }
+
+    size_t name_length = strlen(index_file_name);
+    temporary_name = malloc(name_length + 32);
+    if (temporary_name == NULL) {
+        fprintf(stderr, "%s: failed to malloc %zu bytes.\n", program, name_length + 32);
+        goto RETURN;
+    }
+    snprintf(temporary_name, name_length + 32, "%s.%d.tmp", index_file_name, (int) getpid());
+    if (write_file(temporary_name, out.data, out.length) < 0) {
+        unlink(temporary_name);
+        goto RETURN;
+    }
+    if (rename(temporary_name, index_file_name) < 0) {
+        fprintf(stderr, "%s: failed to rename '%s' to '%s': %s\n", program, temporary_name, index_file_name, strerror(errno));
+        unlink(temporary_name);
+        goto RETURN;
+    }
+    fprintf(stderr, "%s: indexed %u annotations of %u types\n", program, count, types_count);
+    result = 0;
+
+RETURN:
+    free(temporary_name);
+    table_free(&interned, NULL);
+    buffer_free(&strings);
+    buffer_free(&out);
+    free(types);
+    free(elements);
+    return result;
+}
+
+int annotations_main(int ac, char **av) {
+    corpus_t corpus;
+    int threads = sysconf(_SC_NPROCESSORS_ONLN);
+    int result = 1;
+    int c;
+    int i;
+
+    memset(&corpus, 0, sizeof(corpus));
+    while ((c = getopt(ac, av, "j:V:")) != -1) {
+        switch (c) {
+        case 'j':
+            threads = atoi(optarg);
+            break;
+        case 'V':
+            if (corpus_set_versions(&corpus, optarg) < 0) {
+                return 1;
+            }
+            break;
+        default:
+            fprintf(stderr, "usage: %s annotations [-j threads] [-V versions] {index} {.class-file|directory|jar}...\n", program);
+            return 1;
+        }
+    }
+    if (ac - optind < 2) {
+        fprintf(stderr, "usage: %s annotations [-j threads] [-V versions] {index} {.class-file|directory|jar}...\n", program);
+        return 1;
+    }
+    if (threads < 1) {
+        threads = 1;
+    }
+
+    annotation_record_t **records = NULL;
+    annotations_worker_t *workers = calloc(threads, sizeof(annotations_worker_t));
+    void **contexts = calloc(threads, sizeof(void *));
+    if ((workers == NULL) || (contexts == NULL)) {
+        fprintf(stderr, "%s: failed to allocate %d workers\n", program, threads);
+        goto RETURN;
+    }
+    for (i = optind + 1; i < ac; i++) {
+        if (corpus_add(&corpus, av[i]) < 0) {
+            goto RETURN;
+        }
+    }
+    for (i = 0; i < threads; i++) {
+        contexts[i] = &workers[i];
+    }
+    if (corpus_run(&corpus, threads, annotations_class, contexts) < 0) {
+        goto RETURN;
+    }
+
+    size_t total = 0;
+    for (i = 0; i < threads; i++) {
+        total += workers[i].records_count;
+    }
+    if (total >= UINT32_MAX) {
+        fprintf(stderr, "%s: %zu annotations are too many for one index\n", program, total);
+        goto RETURN;
+    }
+    records = malloc((total ? total : 1) * sizeof(annotation_record_t *));
+    if (records == NULL) {
+        fprintf(stderr, "%s: failed to allocate %zu annotations\n", program, total);
+        goto RETURN;
+    }
+    u4_t count = 0;
+    for (i = 0; i < threads; i++) {
+        u4_t j;
+        for (j = 0; j < workers[i].records_count; j++) {
+            workers[i].records[j].strings = workers[i].strings.data;
+            records[count++] = &workers[i].records[j];
+        }
+    }
+    qsort(records, count, sizeof(annotation_record_t *), compare_records);
+
+    /* a class found in more than one place is indexed once */
+    u4_t kept = 0;
+    u4_t j;
+    for (j = 0; j < count; j++) {
+        if ((kept == 0) || (compare_records(&records[j], &records[kept - 1]) != 0)) {
+            records[kept++] = records[j];
+        }
+    }
+    if (write_annotation_index(av[optind], records, kept) < 0) {
+        goto RETURN;
+    }
+    result = corpus.unreadable ? 1 : 0;
+
+RETURN:
+    free(records);
+    if (workers) {
+        for (i = 0; i < threads; i++) {
+            buffer_free(&workers[i].strings);
+            free(workers[i].records);
+        }
+    }
+    free(workers);
+    free(contexts);
+    corpus_free(&corpus);
+    return result;
+}
+
+/* prints "annotation kind class [member]" for each element annotated with the given types */
+int annotated_main(int ac, char **av) {
+    static const char *kinds[] = {"class", "field", "method"};
+    if (ac < 3) {
+        fprintf(stderr, "usage: %s annotated {index} {annotation}...\n", program);
+        return 1;
+    }
+    annotation_index_t *index = open_annotation_index(av[1]);
+    if (index == NULL) {
+        return 1;
+    }
+    int result = 0;
+    int i;
+    for (i = 2; i < ac; i++) {
+        u4_t count;
+        annotation_index_element_t *elements = annotation_index_lookup(index, av[i], strlen(av[i]), &count);
+        if (elements == NULL) {
+            fprintf(stderr, "%s: nothing is annotated with '%s'\n", program, av[i]);
+            result = 1;
+            continue;
+        }
+        u4_t j;
+        for (j = 0; j < count; j++) {
+            annotation_index_element_t *element = &elements[j];
+            const char *class_name = annotation_index_string(index, element->class_offset, element->class_length);
+            const char *member = annotation_index_string(index, element->member_offset, element->member_length);
+            if ((class_name == NULL) || (member == NULL) || (element->kind > ANNOTATED_METHOD)) {
+                fprintf(stderr, "%s: '%s' is a corrupt annotation index\n", program, av[1]);
+                result = 1;
+                break;
+            }
+            printf("%s %s %.*s", av[i], kinds[element->kind], (int) element->class_length, class_name);
+            if (element->kind != ANNOTATED_CLASS) {
+                printf(" %.*s", (int) element->member_length, member);
+            }
+            printf("\n");
+        }
+    }
+    close_annotation_index(index);
+    return result;
+}
@@ -0,0 +1,111 @@
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "cjdc.h"
+
+int buffer_reserve(buffer_t *buffer, size_t extra) {
+    if (buffer->length + extra <= buffer->capacity) {
+        return 0;
+    }
+    size_t capacity = buffer->capacity ? buffer->capacity : 4096;
+    while (capacity < buffer->length + extra) {
+        capacity *= 2;
+    }
+    u1_t *data = realloc(buffer->data, capacity);
+    if (data == NULL) {
+        fprintf(stderr, "%s: failed to grow buffer to %zu bytes\n", program, capacity);
+        return -1;
+    }
+    buffer->data = data;
+    buffer->capacity = capacity;
+    return 0;
+}
+
+int buffer_put_u1(buffer_t *buffer, u1_t value) {
+    if (buffer_reserve(buffer, 1) < 0) {
+        return -1;
+    }
+    buffer->data[buffer->length++] = value;
+    return 0;
+}
+
+/* class files are big-endian */
+int buffer_put_u2(buffer_t *buffer, u2_t value) {
+    if (buffer_reserve(buffer, 2) < 0) {
+        return -1;
+    }
+    buffer->data[buffer->length++] = value >> 8;
+    buffer->data[buffer->length++] = value;
+    return 0;
+}
+
+int buffer_put_u4(buffer_t *buffer, u4_t value) {
+    if (buffer_reserve(buffer, 4) < 0) {
+        return -1;
+    }
+    buffer->data[buffer->length++] = value >> 24;
+    buffer->data[buffer->length++] = value >> 16;
+    buffer->data[buffer->length++] = value >> 8;
+    buffer->data[buffer->length++] = value;
+    return 0;
+}
+
+int buffer_put_bytes(buffer_t *buffer, const void *bytes, size_t length) {
+    if (length == 0) {
+        return 0;
+    }
+    if (buffer_reserve(buffer, length) < 0) {
+        return -1;
+    }
+    memcpy(buffer->data + buffer->length, bytes, length);
+    buffer->length += length;
+    return 0;
+}
+
+int buffer_printf(buffer_t *buffer, const char *format, ...) {
+    va_list ap;
+    va_start(ap, format);
+    int length = vsnprintf(NULL, 0, format, ap);
+    va_end(ap);
+    if ((length < 0) || (buffer_reserve(buffer, length + 1) < 0)) {
+        return -1;
+    }
+    va_start(ap, format);
+    vsnprintf((char *) buffer->data + buffer->length, length + 1, format, ap);
+    va_end(ap);
+    buffer->length += length;
+    return 0;
+}
+
+/* keeps a constant on one line and free of NULs */
+int buffer_put_escaped(buffer_t *buffer, const u1_t *bytes, size_t length) {
+    size_t i;
+    for (i = 0; i < length; i++) {
+        int result;
+        if (bytes[i] == '\n') {
+            result = buffer_put_bytes(buffer, "\\n", 2);
+        }
+        else if (bytes[i] == '\\') {
+            result = buffer_put_bytes(buffer, "\\\\", 2);
+        }
+        else if (bytes[i] == '\0') {
+            result = buffer_put_bytes(buffer, "\\0", 2);
+        }
+        else {
+            result = buffer_put_u1(buffer, bytes[i]);
+        }
+        if (result < 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+void buffer_free(buffer_t *buffer) {
+    free(buffer->data);
+    buffer->data = NULL;
+    buffer->length = 0;
+    buffer->capacity = 0;
+}
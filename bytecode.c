@@ -0,0 +1,107 @@
+#include <stdio.h>
+
+#include "cjdc.h"
+
+/* instruction lengths including the opcode; 0 for variable length or unused opcodes */
+static const u1_t opcode_lengths[256] = {
+    /* 0x00 */ 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    /* 0x10 */ 2, 3, 2, 3, 3, 2, 2, 2, 2, 2, 1, 1, 1, 1, 1, 1,
+    /* 0x20 */ 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    /* 0x30 */ 1, 1, 1, 1, 1, 1, 2, 2, 2, 2, 2, 1, 1, 1, 1, 1,
+    /* 0x40 */ 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    /* 0x50 */ 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    /* 0x60 */ 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    /* 0x70 */ 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    /* 0x80 */ 1, 1, 1, 1, 3, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    /* 0x90 */ 1, 1, 1, 1, 1, 1, 1, 1, 1, 3, 3, 3, 3, 3, 3, 3,
+    /* 0xa0 */ 3, 3, 3, 3, 3, 3, 3, 3, 3, 2, 0, 0, 1, 1, 1, 1,
+    /* 0xb0 */ 1, 1, 3, 3, 3, 3, 3, 3, 3, 5, 5, 3, 2, 3, 1, 1,
+    /* 0xc0 */ 3, 3, 1, 1, 0, 4, 3, 3, 5, 5, 0, 0, 0, 0, 0, 0,
+};
+
+/* mnemonics, NULL for unused opcodes */
+static const char *opcode_names[256] = {
+    /* 0x00 */ "nop", "aconst_null", "iconst_m1", "iconst_0", "iconst_1", "iconst_2", "iconst_3", "iconst_4",
+    /* 0x08 */ "iconst_5", "lconst_0", "lconst_1", "fconst_0", "fconst_1", "fconst_2", "dconst_0", "dconst_1",
+    /* 0x10 */ "bipush", "sipush", "ldc", "ldc_w", "ldc2_w", "iload", "lload", "fload",
+    /* 0x18 */ "dload", "aload", "iload_0", "iload_1", "iload_2", "iload_3", "lload_0", "lload_1",
+    /* 0x20 */ "lload_2", "lload_3", "fload_0", "fload_1", "fload_2", "fload_3", "dload_0", "dload_1",
+    /* 0x28 */ "dload_2", "dload_3", "aload_0", "aload_1", "aload_2", "aload_3", "iaload", "laload",
+    /* 0x30 */ "faload", "daload", "aaload", "baload", "caload", "saload", "istore", "lstore",
+    /* 0x38 */ "fstore", "dstore", "astore", "istore_0", "istore_1", "istore_2", "istore_3", "lstore_0",
+    /* 0x40 */ "lstore_1", "lstore_2", "lstore_3", "fstore_0", "fstore_1", "fstore_2", "fstore_3", "dstore_0",
+    /* 0x48 */ "dstore_1", "dstore_2", "dstore_3", "astore_0", "astore_1", "astore_2", "astore_3", "iastore",
+    /* 0x50 */ "lastore", "fastore", "dastore", "aastore", "bastore", "castore", "sastore", "pop",
+    /* 0x58 */ "pop2", "dup", "dup_x1", "dup_x2", "dup2", "dup2_x1", "dup2_x2", "swap",
+    /* 0x60 */ "iadd", "ladd", "fadd", "dadd", "isub", "lsub", "fsub", "dsub",
+    /* 0x68 */ "imul", "lmul", "fmul", "dmul", "idiv", "ldiv", "fdiv", "ddiv",
+    /* 0x70 */ "irem", "lrem", "frem", "drem", "ineg", "lneg", "fneg", "dneg",
+    /* 0x78 */ "ishl", "lshl", "ishr", "lshr", "iushr", "lushr", "iand", "land",
+    /* 0x80 */ "ior", "lor", "ixor", "lxor", "iinc", "i2l", "i2f", "i2d",
+    /* 0x88 */ "l2i", "l2f", "l2d", "f2i", "f2l", "f2d", "d2i", "d2l",
+    /* 0x90 */ "d2f", "i2b", "i2c", "i2s", "lcmp", "fcmpl", "fcmpg", "dcmpl",
+    /* 0x98 */ "dcmpg", "ifeq", "ifne", "iflt", "ifge", "ifgt", "ifle", "if_icmpeq",
+    /* 0xa0 */ "if_icmpne", "if_icmplt", "if_icmpge", "if_icmpgt", "if_icmple", "if_acmpeq", "if_acmpne", "goto",
+    /* 0xa8 */ "jsr", "ret", "tableswitch", "lookupswitch", "ireturn", "lreturn", "freturn", "dreturn",
+    /* 0xb0 */ "areturn", "return", "getstatic", "putstatic", "getfield", "putfield", "invokevirtual", "invokespecial",
+    /* 0xb8 */ "invokestatic", "invokeinterface", "invokedynamic", "new", "newarray", "anewarray", "arraylength", "athrow",
+    /* 0xc0 */ "checkcast", "instanceof", "monitorenter", "monitorexit", "wide", "multianewarray", "ifnull", "ifnonnull",
+    /* 0xc8 */ "goto_w", "jsr_w",
+};
+
+static int32_t s4_from_be(const u1_t *p);
+
+/*
+ * Returns the length of the instruction at pc, or -1 if the opcode is
+ * not valid or the instruction runs past the end of the code.
+ */
+int instruction_length(const u1_t *code, u4_t code_length, u4_t pc) {
+    u1_t opcode = code[pc];
+    int64_t length = opcode_lengths[opcode];
+
+    if (opcode == OPCODE_TABLESWITCH || opcode == OPCODE_LOOKUPSWITCH) {
+        /* operands are 4-byte aligned relative to the start of the code */
+        u4_t operands = (pc + 4) & ~3u;
+        if (opcode == OPCODE_TABLESWITCH) {
+            if (operands + 12 > code_length) {
+                return -1;
+            }
+            int32_t low = s4_from_be(code + operands + 4);
+            int32_t high = s4_from_be(code + operands + 8);
+            if (high < low) {
+                return -1;
+            }
+            length = operands + 12 + 4 * ((int64_t) high - low + 1) - pc;
+        }
+        else {
+            if (operands + 8 > code_length) {
+                return -1;
+            }
+            int32_t npairs = s4_from_be(code + operands + 4);
+            if (npairs < 0) {
+                return -1;
+            }
+            length = operands + 8 + 8 * (int64_t) npairs - pc;
+        }
+    }
+    else if (opcode == OPCODE_WIDE) {
+        if (pc + 1 >= code_length) {
+            return -1;
+        }
+        /* wide iinc has a 2-byte index and a 2-byte constant */
+        length = (code[pc + 1] == 0x84) ? 6 : 4;
+    }
+
+    if ((length <= 0) || (length > (int64_t) code_length - pc)) {
+        return -1;
+    }
+    return length;
+}
+
+const char *opcode_name(u1_t opcode) {
+    return opcode_names[opcode];
+}
+
+static int32_t s4_from_be(const u1_t *p) {
+    return (int32_t) (((u4_t) p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3]);
+}
@@ -0,0 +1,368 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <limits.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/mman.h>
+
+#include "cjdc.h"
+
+/*
+ * Parsed classes of a classpath, numbered by index slot, held under a
+ * memory budget.  Resident classes are kept on an LRU list; when the
+ * footprint of their trees goes over the budget the least recently used
+ * ones that no request holds are freed.  A class_file_t is rebuilt from
+ * its class file bytes, so the bytes are all an evicted class leaves
+ * behind: they are appended to an unlinked spill file, and the class is
+ * parsed again in place from a mapping of that file when it is next
+ * asked for, with nothing inflated or copied.  Mapped bytes belong to
+ * the page cache and are not charged to the budget.
+ *
+ * The spill file is mapped in segments; a class never straddles two, the
+ * few bytes lost at the end of a segment are a hole in the file.  A
+ * class too big for a segment, or one that failed to spill, is simply
+ * read from its jar again.  A budget of 0 keeps every class, as before.
+ */
+
+#define CLASS_CACHE_SEGMENT     (64 * 1024 * 1024)
+#define CLASS_CACHE_NONE        (0xffffffff)
+
+typedef struct cached_class_s {
+    class_file_t *class_file;   /* NULL unless resident */
+    uint64_t spill_offset;
+    u4_t spill_length;          /* 0 until spilled */
+    u4_t footprint;
+    u4_t pins;                  /* requests using the class, it stays resident meanwhile */
+    u4_t newer;                 /* LRU neighbours by number */
+    u4_t older;
+} cached_class_t;
+
+struct class_cache_s {
+    cached_class_t *classes;    /* [classes_count] */
+    u4_t classes_count;
+    u4_t newest;
+    u4_t oldest;
+    uint64_t budget;
+    const char *spill_directory;
+    int spill_fd;               /* -1 until the first spill */
+    int spill_failed;
+    uint64_t spill_end;
+    u1_t **segments;            /* [segments_count], mapped on first reload */
+    u4_t segments_count;
+    pthread_mutex_t lock;       /* everything */
+    class_cache_stats_t stats;
+};
+
+static class_file_t *reload_class(class_cache_t *cache, u4_t number);
+static void make_newest(class_cache_t *cache, u4_t number);
+static void unlink_class(class_cache_t *cache, u4_t number);
+static void evict_classes(class_cache_t *cache);
+static void spill_class(class_cache_t *cache, cached_class_t *cached);
+static const u1_t *spill_segment(class_cache_t *cache, u4_t segment);
+static u4_t class_footprint(class_file_t *class_file);
+
+class_cache_t *open_class_cache(u4_t classes_count, uint64_t budget, const char *spill_directory) {
+    class_cache_t *cache = calloc(1, sizeof(class_cache_t));
+    if (cache == NULL) {
+        fprintf(stderr, "%s: failed to malloc %zu bytes.\n", program, sizeof(class_cache_t));
+        return NULL;
+    }
+    cache->classes = calloc(classes_count ? classes_count : 1, sizeof(cached_class_t));
+    if (cache->classes == NULL) {
+        fprintf(stderr, "%s: failed to allocate cache of %u classes\n", program, classes_count);
+        free(cache);
+        return NULL;
+    }
+    cache->classes_count = classes_count;
+    u4_t i;
+    for (i = 0; i < classes_count; i++) {
+        cache->classes[i].newer = CLASS_CACHE_NONE;
+        cache->classes[i].older = CLASS_CACHE_NONE;
+    }
+    cache->newest = CLASS_CACHE_NONE;
+    cache->oldest = CLASS_CACHE_NONE;
+    cache->budget = budget;
+    cache->spill_directory = spill_directory;
+    cache->spill_fd = -1;
+    pthread_mutex_init(&cache->lock, NULL);
+    return cache;
+}
+
+void close_class_cache(class_cache_t *cache) {
+    if (cache == NULL) {
+        return;
+    }
+    u4_t i;
+    for (i = 0; i < cache->classes_count; i++) {
+        free_class_file(cache->classes[i].class_file);
+    }
+    for (i = 0; i < cache->segments_count; i++) {
+        if (cache->segments[i]) {
+            munmap(cache->segments[i], CLASS_CACHE_SEGMENT);
+        }
+    }
+    if (cache->spill_fd >= 0) {
+        close(cache->spill_fd);
+    }
+    free(cache->segments);
+    free(cache->classes);
+    pthread_mutex_destroy(&cache->lock);
+    free(cache);
+}
+
+/* the class pinned until class_cache_release(), NULL when it has to be read from its jar */
+class_file_t *class_cache_acquire(class_cache_t *cache, u4_t number) {
+    if (number >= cache->classes_count) {
+        return NULL;
+    }
+    pthread_mutex_lock(&cache->lock);
+    cached_class_t *cached = &cache->classes[number];
+    class_file_t *class_file = cached->class_file;
+    int spilled = cached->spill_length != 0;
+    if (class_file) {
+        cached->pins++;
+        make_newest(cache, number);
+        cache->stats.hits++;
+    }
+    else if (!spilled) {
+        cache->stats.misses++;
+    }
+    pthread_mutex_unlock(&cache->lock);
+    if (class_file || !spilled) {
+        return class_file;
+    }
+    return reload_class(cache, number);
+}
+
+/* parses bytes, taking them over, and adds the class pinned; when another thread got there first its copy is used */
+class_file_t *class_cache_insert(class_cache_t *cache, u4_t number, u1_t *bytes, u4_t length) {
+    if (number >= cache->classes_count) {
+        free(bytes);
+        return NULL;
+    }
+    class_file_t *class_file = read_class_bytes(bytes, length);
+    if (class_file == NULL) {
+        return NULL;
+    }
+    u4_t footprint = class_footprint(class_file);
+
+    pthread_mutex_lock(&cache->lock);
+    cached_class_t *cached = &cache->classes[number];
+    if (cached->class_file == NULL) {
+        cached->class_file = class_file;
+        cached->footprint = footprint;
+        cache->stats.resident_classes++;
+        cache->stats.resident_bytes += footprint;
+        class_file = NULL;
+    }
+    cached->pins++;
+    make_newest(cache, number);
+    class_file_t *result = cached->class_file;
+    evict_classes(cache);
+    pthread_mutex_unlock(&cache->lock);
+    free_class_file(class_file);
+    return result;
+}
+
+void class_cache_release(class_cache_t *cache, u4_t number) {
+    if (number >= cache->classes_count) {
+        return;
+    }
+    pthread_mutex_lock(&cache->lock);
+    cached_class_t *cached = &cache->classes[number];
+    if (cached->pins) {
+        cached->pins--;
+    }
+    evict_classes(cache);
+    pthread_mutex_unlock(&cache->lock);
+}
+
+void class_cache_stats(class_cache_t *cache, class_cache_stats_t *stats) {
+    pthread_mutex_lock(&cache->lock);
+    *stats = cache->stats;
+    pthread_mutex_unlock(&cache->lock);
+}
+
+/* parsing happens outside the lock, as in class_cache_insert() */
+static class_file_t *reload_class(class_cache_t *cache, u4_t number) {
+    pthread_mutex_lock(&cache->lock);
+    cached_class_t *cached = &cache->classes[number];
+    u4_t length = cached->spill_length;
+    const u1_t *segment = length ? spill_segment(cache, cached->spill_offset / CLASS_CACHE_SEGMENT) : NULL;
+    const u1_t *bytes = segment ? segment + cached->spill_offset % CLASS_CACHE_SEGMENT : NULL;
+    pthread_mutex_unlock(&cache->lock);
+
+    class_file_t *class_file = bytes ? read_class_mapped(bytes, length) : NULL;
+    u4_t footprint = class_file ? class_footprint(class_file) : 0;
+
+    pthread_mutex_lock(&cache->lock);
+    if (class_file == NULL) {
+        /* back to the jar from now on */
+        cached->spill_length = 0;
+        cache->stats.misses++;
+        pthread_mutex_unlock(&cache->lock);
+        return NULL;
+    }
+    if (cached->class_file == NULL) {
+        cached->class_file = class_file;
+        cached->footprint = footprint;
+        cache->stats.resident_classes++;
+        cache->stats.resident_bytes += footprint;
+        cache->stats.reloads++;
+        class_file = NULL;
+    }
+    else {
+        cache->stats.hits++;
+    }
+    cached->pins++;
+    make_newest(cache, number);
+    class_file_t *result = cached->class_file;
+    evict_classes(cache);
+    pthread_mutex_unlock(&cache->lock);
+    free_class_file(class_file);
+    return result;
+}
+
+static void make_newest(class_cache_t *cache, u4_t number) {
+    if (cache->newest == number) {
+        return;
+    }
+    cached_class_t *cached = &cache->classes[number];
+    /* on the list and not the newest, so it has a newer neighbour */
+    if (cached->newer != CLASS_CACHE_NONE) {
+        unlink_class(cache, number);
+    }
+    cached->newer = CLASS_CACHE_NONE;
+    cached->older = cache->newest;
+    if (cache->newest != CLASS_CACHE_NONE) {
+        cache->classes[cache->newest].newer = number;
+    }
+    cache->newest = number;
+    if (cache->oldest == CLASS_CACHE_NONE) {
+        cache->oldest = number;
+    }
+}
+
+static void unlink_class(class_cache_t *cache, u4_t number) {
+    cached_class_t *cached = &cache->classes[number];
+    if (cached->newer != CLASS_CACHE_NONE) {
+        cache->classes[cached->newer].older = cached->older;
+    }
+    else {
+        cache->newest = cached->older;
+    }
+    if (cached->older != CLASS_CACHE_NONE) {
+        cache->classes[cached->older].newer = cached->newer;
+    }
+    else {
+        cache->oldest = cached->newer;
+    }
+    cached->newer = CLASS_CACHE_NONE;
+    cached->older = CLASS_CACHE_NONE;
+}
+
+/* pinned classes are passed over, so the budget can be exceeded while requests hold them */
+static void evict_classes(class_cache_t *cache) {
+    if (cache->stats.resident_bytes > cache->stats.peak_bytes) {
+        cache->stats.peak_bytes = cache->stats.resident_bytes;
+    }
+    if (cache->budget == 0) {
+        return;
+    }
+    u4_t number = cache->oldest;
+    while ((cache->stats.resident_bytes > cache->budget) && (number != CLASS_CACHE_NONE)) {
+        cached_class_t *cached = &cache->classes[number];
+        u4_t newer = cached->newer;
+        if (cached->pins == 0) {
+            if (cached->spill_length == 0) {
+                spill_class(cache, cached);
+            }
+            unlink_class(cache, number);
+            cache->stats.resident_classes--;
+            cache->stats.resident_bytes -= cached->footprint;
+            cache->stats.evictions++;
+            free_class_file(cached->class_file);
+            cached->class_file = NULL;
+            cached->footprint = 0;
+        }
+        number = newer;
+    }
+}
+
+/* on failure the class is left unspilled and will be read from its jar */
+static void spill_class(class_cache_t *cache, cached_class_t *cached) {
+    class_file_t *class_file = cached->class_file;
+    u4_t length = class_file->source_length;
+    if (cache->spill_failed || (length == 0) || (length > CLASS_CACHE_SEGMENT)) {
+        return;
+    }
+    if (cache->spill_fd < 0) {
+        char path[PATH_MAX];
+        snprintf(path, sizeof(path), "%s/cjdc-spill-XXXXXX", cache->spill_directory);
+        cache->spill_fd = mkstemp(path);
+        if (cache->spill_fd < 0) {
+            fprintf(stderr, "%s: failed to create a spill file in '%s': %s\n", program, cache->spill_directory, strerror(errno));
+            cache->spill_failed = 1;
+            return;
+        }
+        unlink(path);
+    }
+    uint64_t offset = cache->spill_end;
+    if (offset % CLASS_CACHE_SEGMENT + length > CLASS_CACHE_SEGMENT) {
+        offset += CLASS_CACHE_SEGMENT - offset % CLASS_CACHE_SEGMENT;
+    }
+    if (write_fully_at(cache->spill_fd, class_file->source, length, offset) < 0) {
+        cache->spill_failed = 1;
+        return;
+    }
+    cached->spill_offset = offset;
+    cached->spill_length = length;
+    cache->spill_end = offset + length;
+    cache->stats.spills++;
+    cache->stats.spill_bytes += length;
+}
+
+static const u1_t *spill_segment(class_cache_t *cache, u4_t segment) {
+    if (segment >= cache->segments_count) {
+        u1_t **segments = realloc(cache->segments, (segment + 1) * sizeof(u1_t *));
+        if (segments == NULL) {
+            fprintf(stderr, "%s: failed to allocate %u spill segments\n", program, segment + 1);
+            return NULL;
+        }
+        memset(segments + cache->segments_count, 0, (segment + 1 - cache->segments_count) * sizeof(u1_t *));
+        cache->segments = segments;
+        cache->segments_count = segment + 1;
+    }
+    if (cache->segments[segment] == NULL) {
+        void *map = mmap(NULL, CLASS_CACHE_SEGMENT, PROT_READ, MAP_SHARED, cache->spill_fd, (off_t) segment * CLASS_CACHE_SEGMENT);
+        if (map == MAP_FAILED) {
+            fprintf(stderr, "%s: failed to map spill segment %u: %s\n", program, segment, strerror(errno));
+            return NULL;
+        }
+        cache->segments[segment] = map;
+    }
+    return cache->segments[segment];
+}
+
+/* the heap a parsed class holds, Code attributes aside since they are decoded on demand */
+static u4_t class_footprint(class_file_t *class_file) {
+    uint64_t bytes = sizeof(class_file_t);
+    int i;
+    bytes += (uint64_t) class_file->constant_pool_count * sizeof(cp_info_t);
+    bytes += (uint64_t) class_file->interfaces_count * sizeof(u2_t);
+    bytes += (uint64_t) class_file->fields_count * sizeof(field_info_t);
+    bytes += (uint64_t) class_file->methods_count * sizeof(method_info_t);
+    bytes += (uint64_t) class_file->attributes_count * sizeof(attribute_info_t);
+    for (i = 0; i < class_file->fields_count; i++) {
+        bytes += (uint64_t) class_file->fields[i].attributes_count * sizeof(attribute_info_t);
+    }
+    for (i = 0; i < class_file->methods_count; i++) {
+        bytes += (uint64_t) class_file->methods[i].attributes_count * sizeof(attribute_info_t);
+    }
+    if (!class_file->source_mapped) {
+        bytes += class_file->source_length;
+    }
+    return (bytes > UINT32_MAX) ? UINT32_MAX : bytes;
+}
@@ -2,38 +2,108 @@
 #include <string.h>
 #include <unistr.h>
 #include <stdlib.h>
+#include <unistd.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <errno.h>
+#include <pthread.h>
 #include <arpa/inet.h>
 #include <unistdio.h>
 
 #include "cjdc.h"
 
-static char *program = NULL;
+char *program = NULL;
+
+/* cursor over the bytes of a class file being read */
+typedef struct class_input_s {
+    u1_t *data;
+    u4_t position;
+    u4_t end;
+} class_input_t;
+
+typedef struct cjdc_command_s {
+    const char *name;
+    int (*run)(int ac, char **av);
+} cjdc_command_t;
+
+/* decoding work for read_class_bytes_parallel() */
+#define DECODE_TASK_CONSTANTS   (4096)
+#define DECODE_TASK_FIELDS      (1024)
+#define DECODE_TASK_BYTES       (64 * 1024)
+
+typedef enum decode_task_kind_e {
+    DECODE_CONSTANTS,
+    DECODE_FIELDS,
+    DECODE_METHODS
+} decode_task_kind_t;
+
+typedef struct decode_task_s {
+    decode_task_kind_t kind;
+    u4_t first;
+    u4_t count;
+} decode_task_t;
+
+typedef struct class_decode_s {
+    class_file_t *class_file;
+    class_skim_t *skim;         /* constant pool offsets */
+    u4_t *field_offsets;
+    u4_t *method_offsets;       /* [methods_count + 1], the last is the end of the methods */
+    decode_task_t *tasks;
+    u4_t tasks_count;
+    u4_t next_task;             /* claimed with __atomic_fetch_add() */
+    int failed;
+} class_decode_t;
+
+static cjdc_command_t commands[] = {
+    {"strip", strip_main},
+    {"compact", compact_main},
+    {"abi", abi_main},
+    {"index", index_main},
+    {"lookup", lookup_main},
+    {"serve", serve_main},
+    {"query", query_main},
+    {"watch", watch_main},
+    {"stats", stats_main},
+    {"deps", deps_main},
+    {"search", search_main},
+    {"annotations", annotations_main},
+    {"annotated", annotated_main},
+    {"export", export_main},
+    {NULL, NULL}
+};
 
 static char *get_basename(char *path); 
 static int open_class_file(const char *class_file_name);
-static class_file_t *read_class_file(int fd);
-
-static int read_constant_pool_element(int fd, cp_info_t *constant_pool_element);
-static int read_constant_class(int fd, cp_info_t *constant_pool_element);
-static int read_constant_fieldref(int fd, cp_info_t *constant_pool_element);
-static int read_constant_methodref(int fd, cp_info_t *constant_pool_element);
-static int read_constant_interface_methodref(int fd, cp_info_t *constant_pool_element);
-static int read_constant_string(int fd, cp_info_t *constant_pool_element);
-static int read_constant_integer(int fd, cp_info_t *constant_pool_element);
-static int read_constant_float(int fd, cp_info_t *constant_pool_element);
-static int read_constant_long(int fd, cp_info_t *constant_pool_element);
-static int read_constant_double(int fd, cp_info_t *constant_pool_element);
-static int read_constant_name_and_type(int fd, cp_info_t *constant_pool_element);
-static int read_constant_utf8(int fd, cp_info_t *constant_pool_element);
-static int read_constant_method_handle(int fd, cp_info_t *constant_pool_element);
-static int read_constant_method_type(int fd, cp_info_t *constant_pool_element);
-static int read_constant_invoke_dynamic(int fd, cp_info_t *constant_pool_element);
-static int read_field_info_element(int fd, field_info_t *field_info_element);
-static int read_attributes(int fd, attribute_info_t *attribute_info, int count);
+static class_file_t *read_class(u1_t *bytes, u4_t length, int mapped);
+
+static int read_constant_pool_element(class_input_t *in, cp_info_t *constant_pool_element);
+static int read_constant_class(class_input_t *in, cp_info_t *constant_pool_element);
+static int read_constant_fieldref(class_input_t *in, cp_info_t *constant_pool_element);
+static int read_constant_methodref(class_input_t *in, cp_info_t *constant_pool_element);
+static int read_constant_interface_methodref(class_input_t *in, cp_info_t *constant_pool_element);
+static int read_constant_string(class_input_t *in, cp_info_t *constant_pool_element);
+static int read_constant_integer(class_input_t *in, cp_info_t *constant_pool_element);
+static int read_constant_float(class_input_t *in, cp_info_t *constant_pool_element);
+static int read_constant_long(class_input_t *in, cp_info_t *constant_pool_element);
+static int read_constant_double(class_input_t *in, cp_info_t *constant_pool_element);
+static int read_constant_name_and_type(class_input_t *in, cp_info_t *constant_pool_element);
+static int read_constant_utf8(class_input_t *in, cp_info_t *constant_pool_element);
+static int read_constant_method_handle(class_input_t *in, cp_info_t *constant_pool_element);
+static int read_constant_method_type(class_input_t *in, cp_info_t *constant_pool_element);
+static int read_constant_dynamic(class_input_t *in, cp_info_t *constant_pool_element);
+static int read_constant_invoke_dynamic(class_input_t *in, cp_info_t *constant_pool_element);
+static int read_constant_module(class_input_t *in, cp_info_t *constant_pool_element);
+static int read_constant_package(class_input_t *in, cp_info_t *constant_pool_element);
+static int read_field_info_element(class_input_t *in, field_info_t *field_info_element);
+static int read_method_info_element(class_input_t *in, method_info_t *method_info_element);
+static int read_attributes(class_input_t *in, attribute_info_t *attribute_info, int count);
+static int skim_members(class_skim_t *skim, u2_t count, u4_t *offsets);
+static int plan_decode(class_decode_t *decode);
+static int run_decode(class_decode_t *decode, int threads);
+static void *decode_worker(void *arg);
+static int decode_task(class_decode_t *decode, decode_task_t *task);
+static void free_attributes(u2_t attributes_count, attribute_info_t *attributes);
 
 static void print_class_file (class_file_t *class_file);
 static void print_constant_pool(class_file_t *class_file);
@@ -48,15 +118,41 @@ static void print_fields(class_file_t *class_file);
 static void print_field(field_info_t *field_info_element);
 static void print_attributes(u2_t attributes_count, attribute_info_t *attribute);
 
-static int read_bytes(int fd, void *buffer, int requested);
+static int read_bytes(class_input_t *in, void *buffer, int requested);
 static int read_bytes_or_error(int fd, void *buffer, int requested, int so_far);
 
+static void usage(void) {
+    fprintf(stderr, "usage: %s {.class-file-name}\n", program);
+    fprintf(stderr, "       %s strip [-a attribute[,attribute...]] [-c] [-l level] {input} {output}\n", program);
+    fprintf(stderr, "       %s compact [-l level] {input} {output}\n", program);
+    fprintf(stderr, "       %s abi {.class-or-.jar-file}...\n", program);
+    fprintf(stderr, "       %s index [-f] [-j threads] {index} {jar}...\n", program);
+    fprintf(stderr, "       %s lookup {index} {class-name}...\n", program);
+    fprintf(stderr, "       %s serve [-j threads] [-m budget] [-T spill-directory] {socket} {index} {jar}...\n", program);
+    fprintf(stderr, "       %s query {socket} {dump|supers|references|constants|stats} {class-name}...\n", program);
+    fprintf(stderr, "       %s watch [-i] {class-directory|jar}...\n", program);
+    fprintf(stderr, "       %s stats [-j threads] [-V versions] {.class-file|directory|jar}...\n", program);
+    fprintf(stderr, "       %s deps [-p] [-j threads] [-V versions] {.class-file|directory|jar}...\n", program);
+    fprintf(stderr, "       %s search [-s] [-n] [-j threads] [-V versions] {-e pattern|-f pattern-file}... {.class-file|directory|jar}...\n", program);
+    fprintf(stderr, "       %s annotations [-j threads] [-V versions] {index} {.class-file|directory|jar}...\n", program);
+    fprintf(stderr, "       %s annotated {index} {annotation}...\n", program);
+    fprintf(stderr, "       %s export [-j threads] [-l level] [-V versions] {directory} {.class-file|directory|jar}...\n", program);
+}
+
 int main(int ac, char **av) {
     program = get_basename(av[0]);
     if (ac < 2) {
-	fprintf(stderr, "usage: %s {.class-file-name}\n", program);
+        usage();
 	exit(1);
     }
+
+    cjdc_command_t *command;
+    for (command = commands; command->name; command++) {
+        if (strcmp(av[1], command->name) == 0) {
+            return command->run(ac - 1, av + 1);
+        }
+    }
+
     char *class_file_name = av[1];
 
     int fd = open_class_file(class_file_name);
@@ -78,8 +174,7 @@ int main(int ac, char **av) {
     }
 
     print_class_file(class_file);
-
-    uint8_t *utf8_str = NULL;
+    free_class_file(class_file);
 
     return 0;
 }
@@ -92,33 +187,114 @@ static int open_class_file(const char *class_file_name) {
     return result;
 }
 
-static class_file_t *read_class_file(int fd) {
+/* reads the whole file into memory, then parses it, on every CPU if it is huge */
+class_file_t *read_class_file(int fd) {
+    /* turned away before reading it all; a pipe is left to read_class_bytes() to check */
+    u1_t head[SNIFF_LENGTH];
+    ssize_t head_length = pread(fd, head, sizeof(head), 0);
+    if ((head_length >= 0) && (sniff_input(head, head_length, 0, 0xffff) != INPUT_CLASS)) {
+        fprintf(stderr, "%s: not a class file\n", program);
+        return NULL;
+    }
+
+    u4_t length;
+    u1_t *bytes = read_fd_bytes(fd, &length);
+    if (bytes == NULL) {
+        return NULL;
+    }
+    return read_class_bytes_parallel(bytes, length, sysconf(_SC_NPROCESSORS_ONLN));
+}
+
+/* reads all of fd into a malloc'd buffer */
+u1_t *read_fd_bytes(int fd, u4_t *length) {
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        fprintf(stderr, "%s: failed to stat fd %d: %s\n", program, fd, strerror(errno));
+        return NULL;
+    }
+    if (st.st_size > 0x7fffffff) {
+        fprintf(stderr, "%s: class file of %lld bytes is too large\n", program, (long long) st.st_size);
+        return NULL;
+    }
+
+    u1_t *bytes = malloc(st.st_size ? st.st_size : 1);
+    if (bytes == NULL) {
+        fprintf(stderr, "%s: failed to malloc %lld bytes.\n", program, (long long) st.st_size);
+        return NULL;
+    }
+
+    int so_far = 0;
+    while (so_far < st.st_size) {
+        int bytes_read = read_bytes_or_error(fd, bytes, st.st_size, so_far);
+        if (bytes_read < 0) {
+            free(bytes);
+            return NULL;
+        }
+        if (bytes_read == 0) {
+            break;
+        }
+        so_far += bytes_read;
+    }
+
+    *length = so_far;
+    return bytes;
+}
+
+/* takes ownership of bytes, which must come from malloc() */
+class_file_t *read_class_bytes(u1_t *bytes, u4_t length) {
+    return read_class(bytes, length, 0);
+}
+
+/* bytes stay with the caller, who keeps them mapped until the class is freed */
+class_file_t *read_class_mapped(const u1_t *bytes, u4_t length) {
+    return read_class((u1_t *) bytes, length, 1);
+}
+
+static class_file_t *read_class(u1_t *bytes, u4_t length, int mapped) {
+    class_input_t input = {bytes, 0, length};
+    class_input_t *in = &input;
+    u4_t start;
+
+    if (sniff_input(bytes, length, 0, 0xffff) != INPUT_CLASS) {
+        fprintf(stderr, "%s: not a class file\n", program);
+        if (!mapped) {
+            free(bytes);
+        }
+        return NULL;
+    }
+
     class_file_t *result = malloc(sizeof(class_file_t));
     if (result == NULL) {
-	fprintf(stderr, "%s: failed to malloc %d bytes.", program, sizeof(class_file_t));
+	fprintf(stderr, "%s: failed to malloc %zu bytes.", program, sizeof(class_file_t));
+        if (!mapped) {
+            free(bytes);
+        }
 	goto ERR_RETURN;
     }
     memset(result, 0, sizeof(class_file_t));
+    result->source = bytes;
+    result->source_length = length;
+    result->source_mapped = mapped;
 
-    if (read_bytes(fd, &(result->magic), sizeof(result->magic)) < 0) {
+    if (read_bytes(in, &(result->magic), sizeof(result->magic)) < 0) {
 	fprintf(stderr, "%s: failed to read magic number\n", program);
 	goto ERR_RETURN;
     }
     result->magic = ntohl(result->magic);
 
-    if (read_bytes(fd, &(result->minor_version), sizeof(result->minor_version)) < 0) {
+    if (read_bytes(in, &(result->minor_version), sizeof(result->minor_version)) < 0) {
 	fprintf(stderr, "%s: failed to read minor version\n", program);
 	goto ERR_RETURN;
     }
     result->minor_version = ntohs(result->minor_version);
 
-    if (read_bytes(fd, &(result->major_version), sizeof(result->major_version)) < 0) {
+    if (read_bytes(in, &(result->major_version), sizeof(result->major_version)) < 0) {
 	fprintf(stderr, "%s: failed to read major version\n", program);
 	goto ERR_RETURN;
     }
     result->major_version = ntohs(result->major_version);
 
-    if (read_bytes(fd, &(result->constant_pool_count), sizeof(result->constant_pool_count)) < 0) {
+    if (read_bytes(in, &(result->constant_pool_count), sizeof(result->constant_pool_count)) < 0) {
 	fprintf(stderr, "%s: failed to read constant_pool_count\n", program);
 	goto ERR_RETURN;
     }
@@ -126,39 +302,43 @@ static class_file_t *read_class_file(int fd) {
     if (result->constant_pool_count) {
 	result->constant_pool = calloc(result->constant_pool_count, sizeof(cp_info_t));
 	if (result->constant_pool == NULL) {
-	    fprintf(stderr, "%s: failed to allocate array of %ud constant pool elements", program, result->constant_pool_count);
+	    fprintf(stderr, "%s: failed to allocate array of %u constant pool elements", program, result->constant_pool_count);
 	    goto ERR_RETURN;
 	}
     }
 
     cp_info_t *constant_pool_element = result->constant_pool;
     int i;
-    for (i = 1; i < result->constant_pool_count; i++) {
-	if (read_constant_pool_element(fd, constant_pool_element++) < 0) {
+    for (i = 1; i < result->constant_pool_count; i++, constant_pool_element++) {
+	if (read_constant_pool_element(in, constant_pool_element) < 0) {
 	    fprintf(stderr, "%s: failed to read constant pool element %d\n", program, i);
 	    goto ERR_RETURN;
 	}
+        if ((constant_pool_element->tag == CONSTANT_LONG) || (constant_pool_element->tag == CONSTANT_DOUBLE)) {
+            i++;
+            constant_pool_element++;
+        }
     }
     
-    if (read_bytes(fd, &(result->access_flags), sizeof(result->access_flags)) < 0) {
+    if (read_bytes(in, &(result->access_flags), sizeof(result->access_flags)) < 0) {
 	fprintf(stderr, "%s: failed to read access_flags\n", program);
 	goto ERR_RETURN;
     }
     result->access_flags = ntohs(result->access_flags);
 
-    if (read_bytes(fd, &(result->this_class), sizeof(result->this_class)) < 0) {
+    if (read_bytes(in, &(result->this_class), sizeof(result->this_class)) < 0) {
 	fprintf(stderr, "%s: failed to read this_class\n", program);
 	goto ERR_RETURN;
     }
     result->this_class = ntohs(result->this_class);
 
-    if (read_bytes(fd, &(result->super_class), sizeof(result->super_class)) < 0) {
+    if (read_bytes(in, &(result->super_class), sizeof(result->super_class)) < 0) {
 	fprintf(stderr, "%s: failed to read super_class\n", program);
 	goto ERR_RETURN;
     }
     result->super_class = ntohs(result->super_class);
 
-    if (read_bytes(fd, &(result->interfaces_count), sizeof(result->interfaces_count)) < 0) {
+    if (read_bytes(in, &(result->interfaces_count), sizeof(result->interfaces_count)) < 0) {
 	fprintf(stderr, "%s: failed to read interfaces_count\n", program);
 	goto ERR_RETURN;
     }
@@ -166,16 +346,23 @@ static class_file_t *read_class_file(int fd) {
 
     if (result->interfaces_count) {
         result->interfaces = calloc(result->interfaces_count, sizeof(u2_t));
+        if (result->interfaces == NULL) {
+            fprintf(stderr, "%s: failed to allocate array of %u interfaces\n", program, result->interfaces_count);
+            goto ERR_RETURN;
+        }
     }
     for (i = 0; i < result->interfaces_count; i++) {
-        if (read_bytes(fd, &(result->interfaces[i]), sizeof(result->interfaces[i])) < 0) {
+        if (read_bytes(in, &(result->interfaces[i]), sizeof(result->interfaces[i])) < 0) {
             fprintf(stderr, "%s: failed to read interfaces[%d]\n", program, i);
             goto ERR_RETURN;
         }
         result->interfaces[i] = ntohs(result->interfaces[i]);
     }
+    result->header_range.offset = 0;
+    result->header_range.length = in->position;
 
-    if (read_bytes(fd, &(result->fields_count), sizeof(result->fields_count)) < 0) {
+    start = in->position;
+    if (read_bytes(in, &(result->fields_count), sizeof(result->fields_count)) < 0) {
 	fprintf(stderr, "%s: failed to read fields_count\n", program);
 	goto ERR_RETURN;
     }
@@ -183,29 +370,359 @@ static class_file_t *read_class_file(int fd) {
 
     if (result->fields_count) {
         result->fields = calloc(result->fields_count, sizeof(field_info_t));
+        if (result->fields == NULL) {
+            fprintf(stderr, "%s: failed to allocate array of %u fields\n", program, result->fields_count);
+            goto ERR_RETURN;
+        }
     }
     field_info_t *field_info_element = result->fields;
     for (i = 0; i < result->fields_count; i++) {
-        if (read_field_info_element(fd, field_info_element++) < 0) {
+        if (read_field_info_element(in, field_info_element++) < 0) {
             fprintf(stderr, "%s: failed to read fields[%d]\n", program, i);
             goto ERR_RETURN;
         }
     }
+    result->fields_range.offset = start;
+    result->fields_range.length = in->position - start;
+
+    start = in->position;
+    if (read_bytes(in, &(result->methods_count), sizeof(result->methods_count)) < 0) {
+	fprintf(stderr, "%s: failed to read methods_count\n", program);
+	goto ERR_RETURN;
+    }
+    result->methods_count = ntohs(result->methods_count);
+
+    if (result->methods_count) {
+        result->methods = calloc(result->methods_count, sizeof(method_info_t));
+        if (result->methods == NULL) {
+            fprintf(stderr, "%s: failed to allocate array of %u methods\n", program, result->methods_count);
+            goto ERR_RETURN;
+        }
+    }
+    method_info_t *method_info_element = result->methods;
+    for (i = 0; i < result->methods_count; i++) {
+        if (read_method_info_element(in, method_info_element++) < 0) {
+            fprintf(stderr, "%s: failed to read methods[%d]\n", program, i);
+            goto ERR_RETURN;
+        }
+    }
+    result->methods_range.offset = start;
+    result->methods_range.length = in->position - start;
+
+    start = in->position;
+    if (read_bytes(in, &(result->attributes_count), sizeof(result->attributes_count)) < 0) {
+	fprintf(stderr, "%s: failed to read attributes_count\n", program);
+	goto ERR_RETURN;
+    }
+    result->attributes_count = ntohs(result->attributes_count);
+
+    if (result->attributes_count) {
+        result->attributes = calloc(result->attributes_count, sizeof(attribute_info_t));
+        if (result->attributes == NULL) {
+            fprintf(stderr, "%s: failed to allocate array of %u attributes\n", program, result->attributes_count);
+            goto ERR_RETURN;
+        }
+    }
+    if (read_attributes(in, result->attributes, result->attributes_count) < 0) {
+        fprintf(stderr, "%s: failed to read %d attributes of class\n", program, result->attributes_count);
+        goto ERR_RETURN;
+    }
+    result->attributes_range.offset = start;
+    result->attributes_range.length = in->position - start;
+
+    result->range.offset = 0;
+    result->range.length = in->position;
 
     return result;
 
 ERR_RETURN:
-    if (result) {
-	if (result->constant_pool) {
-	    free(result->constant_pool);
-	}
-	free(result);
+    free_class_file(result);
+    return NULL;
+}
+
+/*
+ * A huge class (generated parsers, big enums) is read in two phases: a
+ * skim that only records where each constant, field and method starts,
+ * then the decoding of those ranges, method bodies included, spread over
+ * threads.  Every task writes its own slots of the one class_file_t, so
+ * there is nothing to merge afterwards.  Smaller classes are not worth
+ * the threads and go to read_class_bytes().  Takes over bytes, as
+ * read_class_bytes() does.
+ */
+class_file_t *read_class_bytes_parallel(u1_t *bytes, u4_t length, int threads) {
+    if ((threads < 2) || (length < PARALLEL_CLASS_MIN_LENGTH)) {
+        return read_class_bytes(bytes, length);
+    }
+
+    class_skim_t skim;
+    if (skim_class_bytes(&skim, bytes, length) < 0) {
+        free(bytes);
+        return NULL;
+    }
+    class_decode_t decode;
+    memset(&decode, 0, sizeof(decode));
+    decode.skim = &skim;
+
+    class_file_t *result = calloc(1, sizeof(class_file_t));
+    if (result == NULL) {
+        fprintf(stderr, "%s: failed to malloc %zu bytes.\n", program, sizeof(class_file_t));
+        free(bytes);
+        goto ERR_RETURN;
+    }
+    decode.class_file = result;
+    result->source = bytes;
+    result->source_length = length;
+    result->magic = CLASS_FILE_MAGIC;
+    result->minor_version = skim.minor_version;
+    result->major_version = skim.major_version;
+    result->constant_pool_count = skim.constant_pool_count;
+    if (result->constant_pool_count) {
+        result->constant_pool = calloc(result->constant_pool_count, sizeof(cp_info_t));
+        if (result->constant_pool == NULL) {
+            fprintf(stderr, "%s: failed to allocate array of %u constant pool elements\n", program, result->constant_pool_count);
+            goto ERR_RETURN;
+        }
+    }
+
+    if ((skim_u2(&skim, &result->access_flags) < 0) ||
+        (skim_u2(&skim, &result->this_class) < 0) ||
+        (skim_u2(&skim, &result->super_class) < 0) ||
+        (skim_u2(&skim, &result->interfaces_count) < 0)) {
+        goto ERR_RETURN;
     }
+    if (result->interfaces_count) {
+        result->interfaces = calloc(result->interfaces_count, sizeof(u2_t));
+        if (result->interfaces == NULL) {
+            fprintf(stderr, "%s: failed to allocate array of %u interfaces\n", program, result->interfaces_count);
+            goto ERR_RETURN;
+        }
+    }
+    int i;
+    for (i = 0; i < result->interfaces_count; i++) {
+        if (skim_u2(&skim, &result->interfaces[i]) < 0) {
+            goto ERR_RETURN;
+        }
+    }
+    result->header_range.offset = 0;
+    result->header_range.length = skim.position;
+
+    result->fields_range.offset = skim.position;
+    if ((skim_u2(&skim, &result->fields_count) < 0) ||
+        ((result->fields = calloc(result->fields_count ? result->fields_count : 1, sizeof(field_info_t))) == NULL) ||
+        ((decode.field_offsets = calloc(result->fields_count ? result->fields_count : 1, sizeof(u4_t))) == NULL) ||
+        (skim_members(&skim, result->fields_count, decode.field_offsets) < 0)) {
+        fprintf(stderr, "%s: failed to skim %u fields\n", program, result->fields_count);
+        goto ERR_RETURN;
+    }
+    result->fields_range.length = skim.position - result->fields_range.offset;
+
+    result->methods_range.offset = skim.position;
+    if ((skim_u2(&skim, &result->methods_count) < 0) ||
+        ((result->methods = calloc(result->methods_count ? result->methods_count : 1, sizeof(method_info_t))) == NULL) ||
+        ((decode.method_offsets = calloc(result->methods_count + 1, sizeof(u4_t))) == NULL) ||
+        (skim_members(&skim, result->methods_count, decode.method_offsets) < 0)) {
+        fprintf(stderr, "%s: failed to skim %u methods\n", program, result->methods_count);
+        goto ERR_RETURN;
+    }
+    decode.method_offsets[result->methods_count] = skim.position;
+    result->methods_range.length = skim.position - result->methods_range.offset;
+
+    /* the class attributes are few, they are read here */
+    class_input_t input = {bytes, skim.position, length};
+    result->attributes_range.offset = skim.position;
+    if (read_bytes(&input, &result->attributes_count, sizeof(result->attributes_count)) < 0) {
+        fprintf(stderr, "%s: failed to read attributes_count\n", program);
+        goto ERR_RETURN;
+    }
+    result->attributes_count = ntohs(result->attributes_count);
+    if (result->attributes_count) {
+        result->attributes = calloc(result->attributes_count, sizeof(attribute_info_t));
+        if (result->attributes == NULL) {
+            fprintf(stderr, "%s: failed to allocate array of %u attributes\n", program, result->attributes_count);
+            goto ERR_RETURN;
+        }
+    }
+    if (read_attributes(&input, result->attributes, result->attributes_count) < 0) {
+        fprintf(stderr, "%s: failed to read %d attributes of class\n", program, result->attributes_count);
+        goto ERR_RETURN;
+    }
+    result->attributes_range.length = input.position - result->attributes_range.offset;
+    result->range.offset = 0;
+    result->range.length = input.position;
+
+    if ((plan_decode(&decode) < 0) || (run_decode(&decode, threads) < 0)) {
+        goto ERR_RETURN;
+    }
+    free(decode.tasks);
+    free(decode.field_offsets);
+    free(decode.method_offsets);
+    skim_free(&skim);
+    return result;
+
+ERR_RETURN:
+    free(decode.tasks);
+    free(decode.field_offsets);
+    free(decode.method_offsets);
+    skim_free(&skim);
+    free_class_file(result);
     return NULL;
 }
 
-static int read_constant_pool_element(int fd, cp_info_t *constant_pool_element) {
-    if (read_bytes(fd, &(constant_pool_element->tag), sizeof(constant_pool_element->tag)) < 0) {
+/* records where each of count fields or methods starts and skips over it */
+static int skim_members(class_skim_t *skim, u2_t count, u4_t *offsets) {
+    u2_t i;
+    for (i = 0; i < count; i++) {
+        u2_t attributes_count;
+        offsets[i] = skim->position;
+        if ((skim_skip(skim, 6) < 0) || (skim_u2(skim, &attributes_count) < 0)) {
+            return -1;
+        }
+        u2_t j;
+        for (j = 0; j < attributes_count; j++) {
+            u4_t attribute_length;
+            if ((skim_skip(skim, 2) < 0) ||
+                (skim_u4(skim, &attribute_length) < 0) ||
+                (skim_skip(skim, attribute_length) < 0)) {
+                return -1;
+            }
+        }
+    }
+    return 0;
+}
+
+/* constants and fields go in fixed-size runs, methods in runs of about DECODE_TASK_BYTES */
+static int plan_decode(class_decode_t *decode) {
+    class_file_t *class_file = decode->class_file;
+    u4_t capacity = class_file->constant_pool_count / DECODE_TASK_CONSTANTS +
+        class_file->fields_count / DECODE_TASK_FIELDS + class_file->methods_count + 3;
+    decode->tasks = calloc(capacity, sizeof(decode_task_t));
+    if (decode->tasks == NULL) {
+        fprintf(stderr, "%s: failed to allocate %u decoding tasks\n", program, capacity);
+        return -1;
+    }
+
+    u4_t first;
+    for (first = 1; first < class_file->constant_pool_count; first += DECODE_TASK_CONSTANTS) {
+        decode_task_t *task = &decode->tasks[decode->tasks_count++];
+        task->kind = DECODE_CONSTANTS;
+        task->first = first;
+        task->count = class_file->constant_pool_count - first;
+        if (task->count > DECODE_TASK_CONSTANTS) {
+            task->count = DECODE_TASK_CONSTANTS;
+        }
+    }
+    for (first = 0; first < class_file->fields_count; first += DECODE_TASK_FIELDS) {
+        decode_task_t *task = &decode->tasks[decode->tasks_count++];
+        task->kind = DECODE_FIELDS;
+        task->first = first;
+        task->count = class_file->fields_count - first;
+        if (task->count > DECODE_TASK_FIELDS) {
+            task->count = DECODE_TASK_FIELDS;
+        }
+    }
+    first = 0;
+    while (first < class_file->methods_count) {
+        u4_t last = first + 1;
+        while ((last < class_file->methods_count) &&
+               (decode->method_offsets[last] - decode->method_offsets[first] < DECODE_TASK_BYTES)) {
+            last++;
+        }
+        decode_task_t *task = &decode->tasks[decode->tasks_count++];
+        task->kind = DECODE_METHODS;
+        task->first = first;
+        task->count = last - first;
+        first = last;
+    }
+    return 0;
+}
+
+static int run_decode(class_decode_t *decode, int threads) {
+    if ((u4_t) threads > decode->tasks_count) {
+        threads = decode->tasks_count;
+    }
+    pthread_t *workers = calloc(threads ? threads : 1, sizeof(pthread_t));
+    int started = 0;
+    while (workers && (started < threads - 1)) {
+        if (pthread_create(&workers[started], NULL, decode_worker, decode) != 0) {
+            break;
+        }
+        started++;
+    }
+    /* this thread takes its share too, and everything if no threads could be had */
+    decode_worker(decode);
+    int i;
+    for (i = 0; i < started; i++) {
+        pthread_join(workers[i], NULL);
+    }
+    free(workers);
+    return decode->failed ? -1 : 0;
+}
+
+static void *decode_worker(void *arg) {
+    class_decode_t *decode = arg;
+    for (;;) {
+        u4_t task = __atomic_fetch_add(&decode->next_task, 1, __ATOMIC_RELAXED);
+        if (task >= decode->tasks_count) {
+            return NULL;
+        }
+        if (decode_task(decode, &decode->tasks[task]) < 0) {
+            __atomic_store_n(&decode->failed, 1, __ATOMIC_RELAXED);
+        }
+    }
+}
+
+/* Code attributes are recognized through the skim, so methods need not wait for the constant pool */
+static int decode_task(class_decode_t *decode, decode_task_t *task) {
+    class_file_t *class_file = decode->class_file;
+    class_input_t input = {class_file->source, 0, class_file->source_length};
+    u4_t i;
+
+    switch (task->kind) {
+    case DECODE_CONSTANTS:
+        for (i = task->first; i < task->first + task->count; i++) {
+            /* the second slot of a long or double has no offset of its own */
+            if (decode->skim->constant_pool[i] == 0) {
+                continue;
+            }
+            input.position = decode->skim->constant_pool[i];
+            if (read_constant_pool_element(&input, &class_file->constant_pool[i - 1]) < 0) {
+                fprintf(stderr, "%s: failed to read constant pool element %u\n", program, i);
+                return -1;
+            }
+        }
+        break;
+    case DECODE_FIELDS:
+        for (i = task->first; i < task->first + task->count; i++) {
+            input.position = decode->field_offsets[i];
+            if (read_field_info_element(&input, &class_file->fields[i]) < 0) {
+                fprintf(stderr, "%s: failed to read fields[%u]\n", program, i);
+                return -1;
+            }
+        }
+        break;
+    case DECODE_METHODS:
+        for (i = task->first; i < task->first + task->count; i++) {
+            method_info_t *method = &class_file->methods[i];
+            input.position = decode->method_offsets[i];
+            if (read_method_info_element(&input, method) < 0) {
+                fprintf(stderr, "%s: failed to read methods[%u]\n", program, i);
+                return -1;
+            }
+            /* a body that does not decode is left for read_code_attribute() to report when it is used */
+            int j;
+            for (j = 0; j < method->attributes_count; j++) {
+                if (skim_utf8_is(decode->skim, method->attributes[j].attribute_name_index, "Code")) {
+                    read_code_attribute(class_file, &method->attributes[j]);
+                }
+            }
+        }
+        break;
+    }
+    return 0;
+}
+
+static int read_constant_pool_element(class_input_t *in, cp_info_t *constant_pool_element) {
+    if (read_bytes(in, &(constant_pool_element->tag), sizeof(constant_pool_element->tag)) < 0) {
 	fprintf(stderr, "%s: failed to read constant pool element tag", program);
 	return -1;
     }
@@ -213,46 +730,55 @@ static int read_constant_pool_element(int fd, cp_info_t *constant_pool_element)
     int result = 0;
     switch (constant_pool_element->tag) {
     case CONSTANT_CLASS:
-	result = read_constant_class(fd, constant_pool_element);
+	result = read_constant_class(in, constant_pool_element);
 	break;
     case CONSTANT_FIELDREF:
-	result = read_constant_fieldref(fd, constant_pool_element);
+	result = read_constant_fieldref(in, constant_pool_element);
 	break;
     case CONSTANT_METHODREF:
-	result = read_constant_methodref(fd, constant_pool_element);
+	result = read_constant_methodref(in, constant_pool_element);
 	break;
     case CONSTANT_INTERFACE_METHODREF:
-	result = read_constant_interface_methodref(fd, constant_pool_element);
+	result = read_constant_interface_methodref(in, constant_pool_element);
 	break;
     case CONSTANT_STRING:
-	result = read_constant_string(fd, constant_pool_element);
+	result = read_constant_string(in, constant_pool_element);
 	break;
     case CONSTANT_INTEGER:
-	result = read_constant_integer(fd, constant_pool_element);
+	result = read_constant_integer(in, constant_pool_element);
 	break;
     case CONSTANT_FLOAT:
-	result = read_constant_float(fd, constant_pool_element);
+	result = read_constant_float(in, constant_pool_element);
 	break;
     case CONSTANT_LONG:
-	result = read_constant_long(fd, constant_pool_element);
+	result = read_constant_long(in, constant_pool_element);
 	break;
     case CONSTANT_DOUBLE:
-	result = read_constant_double(fd, constant_pool_element);
+	result = read_constant_double(in, constant_pool_element);
 	break;
     case CONSTANT_NAME_AND_TYPE:
-	result = read_constant_name_and_type(fd, constant_pool_element);
+	result = read_constant_name_and_type(in, constant_pool_element);
 	break;
     case CONSTANT_UTF8:
-	result = read_constant_utf8(fd, constant_pool_element);
+	result = read_constant_utf8(in, constant_pool_element);
 	break;
     case CONSTANT_METHOD_HANDLE:
-	result = read_constant_method_handle(fd, constant_pool_element);
+	result = read_constant_method_handle(in, constant_pool_element);
 	break;
     case CONSTANT_METHOD_TYPE:
-	result = read_constant_method_type(fd, constant_pool_element);
+	result = read_constant_method_type(in, constant_pool_element);
+	break;
+    case CONSTANT_DYNAMIC:
+	result = read_constant_dynamic(in, constant_pool_element);
 	break;
     case CONSTANT_INVOKE_DYNAMIC:
-	result = read_constant_invoke_dynamic(fd, constant_pool_element);
+	result = read_constant_invoke_dynamic(in, constant_pool_element);
+	break;
+    case CONSTANT_MODULE:
+	result = read_constant_module(in, constant_pool_element);
+	break;
+    case CONSTANT_PACKAGE:
+	result = read_constant_package(in, constant_pool_element);
 	break;
     default:
 	fprintf(stderr, "%s: unknown constant pool tag %d\n", program, constant_pool_element->tag);
@@ -262,26 +788,28 @@ static int read_constant_pool_element(int fd, cp_info_t *constant_pool_element)
     return result;
 }
 
-static int read_field_info_element(int fd, field_info_t *field_info_element) {
-    if (read_bytes(fd, &field_info_element->access_flags, sizeof(field_info_element->access_flags))) {
+static int read_field_info_element(class_input_t *in, field_info_t *field_info_element) {
+    field_info_element->range.offset = in->position;
+
+    if (read_bytes(in, &field_info_element->access_flags, sizeof(field_info_element->access_flags))) {
 	fprintf(stderr, "%s: could not read field info access_flags\n", program);
 	return -1;
     }
     field_info_element->access_flags = ntohs(field_info_element->access_flags);
 
-    if (read_bytes(fd, &field_info_element->name_index, sizeof(field_info_element->name_index))) {
+    if (read_bytes(in, &field_info_element->name_index, sizeof(field_info_element->name_index))) {
 	fprintf(stderr, "%s: could not read field info name_index\n", program);
 	return -1;
     }
     field_info_element->name_index = ntohs(field_info_element->name_index);
 
-    if (read_bytes(fd, &field_info_element->descriptor_index, sizeof(field_info_element->descriptor_index))) {
+    if (read_bytes(in, &field_info_element->descriptor_index, sizeof(field_info_element->descriptor_index))) {
 	fprintf(stderr, "%s: could not read field info descriptor_index\n", program);
 	return -1;
     }
     field_info_element->descriptor_index = ntohs(field_info_element->descriptor_index);
 
-    if (read_bytes(fd, &field_info_element->attributes_count, sizeof(field_info_element->attributes_count))) {
+    if (read_bytes(in, &field_info_element->attributes_count, sizeof(field_info_element->attributes_count))) {
 	fprintf(stderr, "%s: could not read field info attributes_count\n", program);
 	return -1;
     }
@@ -289,48 +817,346 @@ static int read_field_info_element(int fd, field_info_t *field_info_element) {
 
     if (field_info_element->attributes_count) {
         field_info_element->attributes = calloc(field_info_element->attributes_count, sizeof(attribute_info_t));
+        if (field_info_element->attributes == NULL) {
+            fprintf(stderr, "%s: could not allocate %d attributes of field\n", program, field_info_element->attributes_count);
+            return -1;
+        }
     }
     attribute_info_t *attribute_info = field_info_element->attributes;
 
-    if (read_attributes(fd, attribute_info, field_info_element->attributes_count) < 0) {
+    if (read_attributes(in, attribute_info, field_info_element->attributes_count) < 0) {
         fprintf(stderr, "%s: failed to read %d attributes of field\n" , program, field_info_element->attributes_count);
         return -1;
     }
 
+    field_info_element->range.length = in->position - field_info_element->range.offset;
+    return 0;
+}
+
+static int read_method_info_element(class_input_t *in, method_info_t *method_info_element) {
+    method_info_element->range.offset = in->position;
+
+    if (read_bytes(in, &method_info_element->access_flags, sizeof(method_info_element->access_flags))) {
+	fprintf(stderr, "%s: could not read method info access_flags\n", program);
+	return -1;
+    }
+    method_info_element->access_flags = ntohs(method_info_element->access_flags);
+
+    if (read_bytes(in, &method_info_element->name_index, sizeof(method_info_element->name_index))) {
+	fprintf(stderr, "%s: could not read method info name_index\n", program);
+	return -1;
+    }
+    method_info_element->name_index = ntohs(method_info_element->name_index);
+
+    if (read_bytes(in, &method_info_element->descriptor_index, sizeof(method_info_element->descriptor_index))) {
+	fprintf(stderr, "%s: could not read method info descriptor_index\n", program);
+	return -1;
+    }
+    method_info_element->descriptor_index = ntohs(method_info_element->descriptor_index);
+
+    if (read_bytes(in, &method_info_element->attributes_count, sizeof(method_info_element->attributes_count))) {
+	fprintf(stderr, "%s: could not read method info attributes_count\n", program);
+	return -1;
+    }
+    method_info_element->attributes_count = ntohs(method_info_element->attributes_count);
+
+    if (method_info_element->attributes_count) {
+        method_info_element->attributes = calloc(method_info_element->attributes_count, sizeof(attribute_info_t));
+        if (method_info_element->attributes == NULL) {
+            fprintf(stderr, "%s: could not allocate %d attributes of method\n", program, method_info_element->attributes_count);
+            return -1;
+        }
+    }
+
+    if (read_attributes(in, method_info_element->attributes, method_info_element->attributes_count) < 0) {
+        fprintf(stderr, "%s: failed to read %d attributes of method\n" , program, method_info_element->attributes_count);
+        return -1;
+    }
+
+    method_info_element->range.length = in->position - method_info_element->range.offset;
     return 0;
 }
 
-static int read_attributes(int fd, attribute_info_t *attribute_info, int count) {
+/* attribute info is not copied, it points into the input */
+static int read_attributes(class_input_t *in, attribute_info_t *attribute_info, int count) {
     int i;
-    for (i = 0; i < count; i++) {
-        if (read_bytes(fd, &attribute_info->attribute_name_index, sizeof(attribute_info->attribute_name_index))) {
+    for (i = 0; i < count; i++, attribute_info++) {
+        attribute_info->range.offset = in->position;
+
+        if (read_bytes(in, &attribute_info->attribute_name_index, sizeof(attribute_info->attribute_name_index))) {
             fprintf(stderr, "%s: could not read attribute info name index %d\n", program, i);
             return -1;
         }
         attribute_info->attribute_name_index = ntohs(attribute_info->attribute_name_index);
 
-        if (read_bytes(fd, &attribute_info->attribute_length, sizeof(attribute_info->attribute_length))) {
+        if (read_bytes(in, &attribute_info->attribute_length, sizeof(attribute_info->attribute_length))) {
             fprintf(stderr, "%s: could not read attribute info length %d\n", program, i);
             return -1;
         }
         attribute_info->attribute_length = ntohl(attribute_info->attribute_length);
 
-        if (attribute_info->attribute_length) {
-            attribute_info->info = malloc(attribute_info->attribute_length + 1);
-            if (read_bytes(fd, attribute_info->info, attribute_info->attribute_length)) {
-                fprintf(stderr, "%s: could not read attribute info %d\n", program, i);
-                return -1;
-            }
-            attribute_info->info[attribute_info->attribute_length] = '\0';
+        if (attribute_info->attribute_length > in->end - in->position) {
+            fprintf(stderr, "%s: attribute info %d of %u bytes runs past the end of the class\n", program, i, attribute_info->attribute_length);
+            return -1;
+        }
+        attribute_info->info = in->data + in->position;
+        in->position += attribute_info->attribute_length;
+
+        attribute_info->range.length = in->position - attribute_info->range.offset;
+    }
+    return 0;
+}
+
+/* decodes a Code attribute into attribute->code; its nested attributes keep
+ * source ranges as long as the Code attribute itself was not re-encoded */
+int read_code_attribute(class_file_t *class_file, attribute_info_t *attribute) {
+    if (attribute->code) {
+        return 0;
+    }
+
+    class_input_t input = {attribute->info, 0, attribute->attribute_length};
+    int in_source = attribute->range.length != 0;
+    if (in_source) {
+        input.data = class_file->source;
+        input.position = attribute->info - class_file->source;
+        input.end = input.position + attribute->attribute_length;
+    }
+    class_input_t *in = &input;
+
+    code_attribute_t *code = calloc(1, sizeof(code_attribute_t));
+    if (code == NULL) {
+        fprintf(stderr, "%s: could not allocate code attribute\n", program);
+        return -1;
+    }
+
+    if (read_bytes(in, &code->max_stack, sizeof(code->max_stack))) {
+        fprintf(stderr, "%s: could not read code max_stack\n", program);
+        goto ERR_RETURN;
+    }
+    code->max_stack = ntohs(code->max_stack);
+
+    if (read_bytes(in, &code->max_locals, sizeof(code->max_locals))) {
+        fprintf(stderr, "%s: could not read code max_locals\n", program);
+        goto ERR_RETURN;
+    }
+    code->max_locals = ntohs(code->max_locals);
+
+    if (read_bytes(in, &code->code_length, sizeof(code->code_length))) {
+        fprintf(stderr, "%s: could not read code code_length\n", program);
+        goto ERR_RETURN;
+    }
+    code->code_length = ntohl(code->code_length);
+
+    if (code->code_length > in->end - in->position) {
+        fprintf(stderr, "%s: code of %u bytes runs past the end of the attribute\n", program, code->code_length);
+        goto ERR_RETURN;
+    }
+    code->code = in->data + in->position;
+    in->position += code->code_length;
+
+    if (read_bytes(in, &code->exception_table_length, sizeof(code->exception_table_length))) {
+        fprintf(stderr, "%s: could not read code exception_table_length\n", program);
+        goto ERR_RETURN;
+    }
+    code->exception_table_length = ntohs(code->exception_table_length);
+
+    if (code->exception_table_length) {
+        code->exception_table = calloc(code->exception_table_length, sizeof(exception_table_entry_t));
+        if (code->exception_table == NULL) {
+            fprintf(stderr, "%s: could not allocate %d exception table entries\n", program, code->exception_table_length);
+            goto ERR_RETURN;
+        }
+    }
+    int i;
+    for (i = 0; i < code->exception_table_length; i++) {
+        exception_table_entry_t *entry = &code->exception_table[i];
+        if (read_bytes(in, entry, sizeof(*entry))) {
+            fprintf(stderr, "%s: could not read exception table entry %d\n", program, i);
+            goto ERR_RETURN;
         }
+        entry->start_pc = ntohs(entry->start_pc);
+        entry->end_pc = ntohs(entry->end_pc);
+        entry->handler_pc = ntohs(entry->handler_pc);
+        entry->catch_type = ntohs(entry->catch_type);
+    }
+
+    if (read_bytes(in, &code->attributes_count, sizeof(code->attributes_count))) {
+        fprintf(stderr, "%s: could not read code attributes_count\n", program);
+        goto ERR_RETURN;
     }
+    code->attributes_count = ntohs(code->attributes_count);
+
+    if (code->attributes_count) {
+        code->attributes = calloc(code->attributes_count, sizeof(attribute_info_t));
+        if (code->attributes == NULL) {
+            fprintf(stderr, "%s: could not allocate %d attributes of code\n", program, code->attributes_count);
+            goto ERR_RETURN;
+        }
+    }
+    if (read_attributes(in, code->attributes, code->attributes_count) < 0) {
+        fprintf(stderr, "%s: failed to read %d attributes of code\n", program, code->attributes_count);
+        goto ERR_RETURN;
+    }
+    if (!in_source) {
+        for (i = 0; i < code->attributes_count; i++) {
+            code->attributes[i].range.length = 0;
+        }
+    }
+
+    attribute->code = code;
     return 0;
+
+ERR_RETURN:
+    free_code_attribute(code);
+    return -1;
+}
+
+void free_code_attribute(code_attribute_t *code) {
+    if (code == NULL) {
+        return;
+    }
+    free(code->exception_table);
+    free_attributes(code->attributes_count, code->attributes);
+    free(code);
+}
+
+static void free_attributes(u2_t attributes_count, attribute_info_t *attributes) {
+    if (attributes == NULL) {
+        return;
+    }
+    int i;
+    for (i = 0; i < attributes_count; i++) {
+        free_code_attribute(attributes[i].code);
+    }
+    free(attributes);
 }
 
-static int read_constant_class(int fd, cp_info_t *constant_pool_element){
+void free_class_file(class_file_t *class_file) {
+    if (class_file == NULL) {
+        return;
+    }
+    int i;
+    for (i = 0; i < class_file->fields_count && class_file->fields; i++) {
+        free_attributes(class_file->fields[i].attributes_count, class_file->fields[i].attributes);
+    }
+    for (i = 0; i < class_file->methods_count && class_file->methods; i++) {
+        free_attributes(class_file->methods[i].attributes_count, class_file->methods[i].attributes);
+    }
+    free_attributes(class_file->attributes_count, class_file->attributes);
+    free(class_file->fields);
+    free(class_file->methods);
+    free(class_file->interfaces);
+    free(class_file->constant_pool);
+    if (!class_file->source_mapped) {
+        free(class_file->source);
+    }
+    free(class_file);
+}
+
+/* returns the constant pool entry at index, or NULL if there is none */
+cp_info_t *cp_entry(class_file_t *class_file, u2_t index) {
+    if ((index == 0) || (index >= class_file->constant_pool_count)) {
+        return NULL;
+    }
+    return &class_file->constant_pool[index - 1];
+}
+
+int cp_utf8_equals(class_file_t *class_file, u2_t index, const char *s) {
+    cp_info_t *entry = cp_entry(class_file, index);
+    if ((entry == NULL) || (entry->tag != CONSTANT_UTF8)) {
+        return 0;
+    }
+    size_t length = strlen(s);
+    return (entry->u.cp_utf8.length == length) && (memcmp(entry->u.cp_utf8.bytes, s, length) == 0);
+}
+
+int cp_utf8(class_file_t *class_file, u2_t index, const u1_t **bytes, u2_t *length) {
+    cp_info_t *entry = cp_entry(class_file, index);
+    if ((entry == NULL) || (entry->tag != CONSTANT_UTF8)) {
+        return -1;
+    }
+    *bytes = entry->u.cp_utf8.bytes;
+    *length = entry->u.cp_utf8.length;
+    return 0;
+}
+
+int cp_class_name(class_file_t *class_file, u2_t index, const u1_t **bytes, u2_t *length) {
+    cp_info_t *entry = cp_entry(class_file, index);
+    if ((entry == NULL) || (entry->tag != CONSTANT_CLASS)) {
+        return -1;
+    }
+    return cp_utf8(class_file, entry->u.cp_class_info.name_index, bytes, length);
+}
+
+static const char *attribute_kind_names[ATTRIBUTE_KIND_COUNT] = {
+    [ATTRIBUTE_UNKNOWN] = "(unknown)",
+    [ATTRIBUTE_CONSTANT_VALUE] = "ConstantValue",
+    [ATTRIBUTE_CODE] = "Code",
+    [ATTRIBUTE_STACK_MAP_TABLE] = "StackMapTable",
+    [ATTRIBUTE_EXCEPTIONS] = "Exceptions",
+    [ATTRIBUTE_INNER_CLASSES] = "InnerClasses",
+    [ATTRIBUTE_ENCLOSING_METHOD] = "EnclosingMethod",
+    [ATTRIBUTE_SYNTHETIC] = "Synthetic",
+    [ATTRIBUTE_SIGNATURE] = "Signature",
+    [ATTRIBUTE_SOURCE_FILE] = "SourceFile",
+    [ATTRIBUTE_SOURCE_DEBUG_EXTENSION] = "SourceDebugExtension",
+    [ATTRIBUTE_LINE_NUMBER_TABLE] = "LineNumberTable",
+    [ATTRIBUTE_LOCAL_VARIABLE_TABLE] = "LocalVariableTable",
+    [ATTRIBUTE_LOCAL_VARIABLE_TYPE_TABLE] = "LocalVariableTypeTable",
+    [ATTRIBUTE_DEPRECATED] = "Deprecated",
+    [ATTRIBUTE_RUNTIME_VISIBLE_ANNOTATIONS] = "RuntimeVisibleAnnotations",
+    [ATTRIBUTE_RUNTIME_INVISIBLE_ANNOTATIONS] = "RuntimeInvisibleAnnotations",
+    [ATTRIBUTE_RUNTIME_VISIBLE_PARAMETER_ANNOTATIONS] = "RuntimeVisibleParameterAnnotations",
+    [ATTRIBUTE_RUNTIME_INVISIBLE_PARAMETER_ANNOTATIONS] = "RuntimeInvisibleParameterAnnotations",
+    [ATTRIBUTE_RUNTIME_VISIBLE_TYPE_ANNOTATIONS] = "RuntimeVisibleTypeAnnotations",
+    [ATTRIBUTE_RUNTIME_INVISIBLE_TYPE_ANNOTATIONS] = "RuntimeInvisibleTypeAnnotations",
+    [ATTRIBUTE_ANNOTATION_DEFAULT] = "AnnotationDefault",
+    [ATTRIBUTE_BOOTSTRAP_METHODS] = "BootstrapMethods",
+    [ATTRIBUTE_METHOD_PARAMETERS] = "MethodParameters",
+    [ATTRIBUTE_MODULE] = "Module",
+    [ATTRIBUTE_MODULE_PACKAGES] = "ModulePackages",
+    [ATTRIBUTE_MODULE_MAIN_CLASS] = "ModuleMainClass",
+    [ATTRIBUTE_NEST_HOST] = "NestHost",
+    [ATTRIBUTE_NEST_MEMBERS] = "NestMembers",
+    [ATTRIBUTE_RECORD] = "Record",
+    [ATTRIBUTE_PERMITTED_SUBCLASSES] = "PermittedSubclasses",
+};
+
+attribute_kind_t attribute_kind(class_file_t *class_file, u2_t name_index) {
+    cp_info_t *entry = cp_entry(class_file, name_index);
+    if ((entry == NULL) || (entry->tag != CONSTANT_UTF8)) {
+        return ATTRIBUTE_UNKNOWN;
+    }
+    return attribute_kind_of_name(entry->u.cp_utf8.bytes, entry->u.cp_utf8.length);
+}
+
+attribute_kind_t attribute_kind_of_name(const u1_t *bytes, u2_t length) {
+    if (length == 0) {
+        return ATTRIBUTE_UNKNOWN;
+    }
+    int kind;
+    for (kind = ATTRIBUTE_UNKNOWN + 1; kind < ATTRIBUTE_KIND_COUNT; kind++) {
+        const char *name = attribute_kind_names[kind];
+        if ((bytes[0] == name[0]) && (strlen(name) == length) && (memcmp(bytes, name, length) == 0)) {
+            return kind;
+        }
+    }
+    return ATTRIBUTE_UNKNOWN;
+}
+
+const char *attribute_kind_name(attribute_kind_t kind) {
+    return attribute_kind_names[kind];
+}
+
+int has_suffix(const char *s, size_t length, const char *suffix) {
+    size_t suffix_length = strlen(suffix);
+    return (length >= suffix_length) && (memcmp(s + length - suffix_length, suffix, suffix_length) == 0);
+}
+
+static int read_constant_class(class_input_t *in, cp_info_t *constant_pool_element){
     constant_pool_class_t* cp_class_info = &constant_pool_element->u.cp_class_info;
 
-    if (read_bytes(fd, &cp_class_info->name_index, sizeof(cp_class_info->name_index))) {
+    if (read_bytes(in, &cp_class_info->name_index, sizeof(cp_class_info->name_index))) {
 	fprintf(stderr, "%s: could not read class constant name index\n", program);
 	return -1;
     }
@@ -338,16 +1164,16 @@ static int read_constant_class(int fd, cp_info_t *constant_pool_element){
 
     return 0;
 }
-static int read_constant_fieldref(int fd, cp_info_t *constant_pool_element){
+static int read_constant_fieldref(class_input_t *in, cp_info_t *constant_pool_element){
     constant_pool_ref_t* cp_fieldref = &constant_pool_element->u.cp_fieldref;
 
-    if (read_bytes(fd, &cp_fieldref->class_index, sizeof(cp_fieldref->class_index))) {
+    if (read_bytes(in, &cp_fieldref->class_index, sizeof(cp_fieldref->class_index))) {
 	fprintf(stderr, "%s: could not read fieldref constant class index\n", program);
 	return -1;
     }
     cp_fieldref->class_index = ntohs(cp_fieldref->class_index);
 
-    if (read_bytes(fd, &cp_fieldref->name_and_type_index, sizeof(cp_fieldref->name_and_type_index))) {
+    if (read_bytes(in, &cp_fieldref->name_and_type_index, sizeof(cp_fieldref->name_and_type_index))) {
 	fprintf(stderr, "%s: could not read fieldref constant name-and-type index\n", program);
 	return -1;
     }
@@ -355,16 +1181,16 @@ static int read_constant_fieldref(int fd, cp_info_t *constant_pool_element){
 
     return 0;
 }
-static int read_constant_methodref(int fd, cp_info_t *constant_pool_element){
+static int read_constant_methodref(class_input_t *in, cp_info_t *constant_pool_element){
     constant_pool_ref_t* cp_methodref = &constant_pool_element->u.cp_methodref;
 
-    if (read_bytes(fd, &cp_methodref->class_index, sizeof(cp_methodref->class_index))) {
+    if (read_bytes(in, &cp_methodref->class_index, sizeof(cp_methodref->class_index))) {
 	fprintf(stderr, "%s: could not read methodref constant class index\n", program);
 	return -1;
     }
     cp_methodref->class_index = ntohs(cp_methodref->class_index);
 
-    if (read_bytes(fd, &cp_methodref->name_and_type_index, sizeof(cp_methodref->name_and_type_index))) {
+    if (read_bytes(in, &cp_methodref->name_and_type_index, sizeof(cp_methodref->name_and_type_index))) {
 	fprintf(stderr, "%s: could not read methodref constant name-and-type index\n", program);
 	return -1;
     }
@@ -372,16 +1198,16 @@ static int read_constant_methodref(int fd, cp_info_t *constant_pool_element){
 
     return 0;
 }
-static int read_constant_interface_methodref(int fd, cp_info_t *constant_pool_element){
+static int read_constant_interface_methodref(class_input_t *in, cp_info_t *constant_pool_element){
     constant_pool_ref_t* cp_interface_methodref = &constant_pool_element->u.cp_interface_methodref;
 
-    if (read_bytes(fd, &cp_interface_methodref->class_index, sizeof(cp_interface_methodref->class_index))) {
+    if (read_bytes(in, &cp_interface_methodref->class_index, sizeof(cp_interface_methodref->class_index))) {
 	fprintf(stderr, "%s: could not read interface-methodref constant class index\n", program);
 	return -1;
     }
     cp_interface_methodref->class_index = ntohs(cp_interface_methodref->class_index);
 
-    if (read_bytes(fd, &cp_interface_methodref->name_and_type_index, sizeof(cp_interface_methodref->name_and_type_index))) {
+    if (read_bytes(in, &cp_interface_methodref->name_and_type_index, sizeof(cp_interface_methodref->name_and_type_index))) {
 	fprintf(stderr, "%s: could not read interface-methodref constant name-and-type index\n", program);
 	return -1;
     }
@@ -389,10 +1215,10 @@ static int read_constant_interface_methodref(int fd, cp_info_t *constant_pool_el
 
     return 0;
 }
-static int read_constant_string(int fd, cp_info_t *constant_pool_element){
+static int read_constant_string(class_input_t *in, cp_info_t *constant_pool_element){
     constant_pool_string_t* cp_string = &constant_pool_element->u.cp_string;
 
-    if (read_bytes(fd, &cp_string->name_index, sizeof(cp_string->name_index))) {
+    if (read_bytes(in, &cp_string->name_index, sizeof(cp_string->name_index))) {
 	fprintf(stderr, "%s: could not read string constant name index\n", program);
 	return -1;
     }
@@ -400,16 +1226,10 @@ static int read_constant_string(int fd, cp_info_t *constant_pool_element){
 
     return 0;
 }
-static int read_constant_integer(int fd, cp_info_t *constant_pool_element){
+static int read_constant_integer(class_input_t *in, cp_info_t *constant_pool_element){
     constant_pool_number4_t* cp_integer = &constant_pool_element->u.cp_integer;
 
-    if (read_bytes(fd, &cp_integer->name_index, sizeof(cp_integer->name_index))) {
-	fprintf(stderr, "%s: could not read integer constant name index\n", program);
-	return -1;
-    }
-    cp_integer->name_index = ntohs(cp_integer->name_index);
-
-    if (read_bytes(fd, &cp_integer->bytes, sizeof(cp_integer->bytes))) {
+    if (read_bytes(in, &cp_integer->bytes, sizeof(cp_integer->bytes))) {
 	fprintf(stderr, "%s: could not read integer constant bytes\n", program);
 	return -1;
     }
@@ -417,16 +1237,10 @@ static int read_constant_integer(int fd, cp_info_t *constant_pool_element){
 
     return 0;
 }
-static int read_constant_float(int fd, cp_info_t *constant_pool_element){
+static int read_constant_float(class_input_t *in, cp_info_t *constant_pool_element){
     constant_pool_number4_t* cp_float = &constant_pool_element->u.cp_float;
 
-    if (read_bytes(fd, &cp_float->name_index, sizeof(cp_float->name_index))) {
-	fprintf(stderr, "%s: could not read float constant name index\n", program);
-	return -1;
-    }
-    cp_float->name_index = ntohs(cp_float->name_index);
-
-    if (read_bytes(fd, &cp_float->bytes, sizeof(cp_float->bytes))) {
+    if (read_bytes(in, &cp_float->bytes, sizeof(cp_float->bytes))) {
 	fprintf(stderr, "%s: could not read float constant bytes\n", program);
 	return -1;
     }
@@ -434,22 +1248,16 @@ static int read_constant_float(int fd, cp_info_t *constant_pool_element){
 
     return 0;
 }
-static int read_constant_long(int fd, cp_info_t *constant_pool_element){
+static int read_constant_long(class_input_t *in, cp_info_t *constant_pool_element){
     constant_pool_number8_t* cp_long = &constant_pool_element->u.cp_long;
 
-    if (read_bytes(fd, &cp_long->name_index, sizeof(cp_long->name_index))) {
-	fprintf(stderr, "%s: could not read long constant name index\n", program);
-	return -1;
-    }
-    cp_long->name_index = ntohs(cp_long->name_index);
-
-    if (read_bytes(fd, &cp_long->high_bytes, sizeof(cp_long->high_bytes))) {
+    if (read_bytes(in, &cp_long->high_bytes, sizeof(cp_long->high_bytes))) {
 	fprintf(stderr, "%s: could not read long constant high-bytes\n", program);
 	return -1;
     }
     cp_long->high_bytes = ntohl(cp_long->high_bytes);
 
-    if (read_bytes(fd, &cp_long->low_bytes, sizeof(cp_long->low_bytes))) {
+    if (read_bytes(in, &cp_long->low_bytes, sizeof(cp_long->low_bytes))) {
 	fprintf(stderr, "%s: could not read long constant low-bytes\n", program);
 	return -1;
     }
@@ -457,22 +1265,16 @@ static int read_constant_long(int fd, cp_info_t *constant_pool_element){
 
     return 0;
 }
-static int read_constant_double(int fd, cp_info_t *constant_pool_element){
+static int read_constant_double(class_input_t *in, cp_info_t *constant_pool_element){
     constant_pool_number8_t* cp_double = &constant_pool_element->u.cp_double;
 
-    if (read_bytes(fd, &cp_double->name_index, sizeof(cp_double->name_index))) {
-	fprintf(stderr, "%s: could not read double constant name index\n", program);
-	return -1;
-    }
-    cp_double->name_index = ntohs(cp_double->name_index);
-
-    if (read_bytes(fd, &cp_double->high_bytes, sizeof(cp_double->high_bytes))) {
+    if (read_bytes(in, &cp_double->high_bytes, sizeof(cp_double->high_bytes))) {
 	fprintf(stderr, "%s: could not read double constant high-bytes\n", program);
 	return -1;
     }
     cp_double->high_bytes = ntohl(cp_double->high_bytes);
 
-    if (read_bytes(fd, &cp_double->low_bytes, sizeof(cp_double->low_bytes))) {
+    if (read_bytes(in, &cp_double->low_bytes, sizeof(cp_double->low_bytes))) {
 	fprintf(stderr, "%s: could not read double constant low-bytes\n", program);
 	return -1;
     }
@@ -480,16 +1282,16 @@ static int read_constant_double(int fd, cp_info_t *constant_pool_element){
 
     return 0;
 }
-static int read_constant_name_and_type(int fd, cp_info_t *constant_pool_element){
+static int read_constant_name_and_type(class_input_t *in, cp_info_t *constant_pool_element){
     constant_pool_name_and_type_t* cp_name_and_type = &constant_pool_element->u.cp_name_and_type;
 
-    if (read_bytes(fd, &cp_name_and_type->name_index, sizeof(cp_name_and_type->name_index))) {
+    if (read_bytes(in, &cp_name_and_type->name_index, sizeof(cp_name_and_type->name_index))) {
 	fprintf(stderr, "%s: could not read name-and-type constant name index\n", program);
 	return -1;
     }
     cp_name_and_type->name_index = ntohs(cp_name_and_type->name_index);
 
-    if (read_bytes(fd, &cp_name_and_type->descriptor_index, sizeof(cp_name_and_type->descriptor_index))) {
+    if (read_bytes(in, &cp_name_and_type->descriptor_index, sizeof(cp_name_and_type->descriptor_index))) {
 	fprintf(stderr, "%s: could not read name-and-type constant descriptor index\n", program);
 	return -1;
     }
@@ -497,37 +1299,33 @@ static int read_constant_name_and_type(int fd, cp_info_t *constant_pool_element)
 
     return 0;
 }
-static int read_constant_utf8(int fd, cp_info_t *constant_pool_element){
+static int read_constant_utf8(class_input_t *in, cp_info_t *constant_pool_element){
     constant_pool_utf8_t* cp_utf8 = &constant_pool_element->u.cp_utf8;
 
-    if (read_bytes(fd, &cp_utf8->length, sizeof(cp_utf8->length))) {
+    if (read_bytes(in, &cp_utf8->length, sizeof(cp_utf8->length))) {
 	fprintf(stderr, "%s: could not read utf8 constant length\n", program);
 	return -1;
     }
     cp_utf8->length = ntohs(cp_utf8->length);
 
-    cp_utf8->bytes = calloc(1 + cp_utf8->length, sizeof(u1_t));
-    if (cp_utf8->bytes == NULL) {
-	fprintf(stderr, "%s: could not allocate %d bytes for string constant\n", program, 1 + cp_utf8->length);
-	return -1;
-    }
-    
-    if (read_bytes(fd, cp_utf8->bytes, cp_utf8->length)) {
+    if (cp_utf8->length > in->end - in->position) {
 	fprintf(stderr, "%s: could not read utf8 constant %d bytes\n", program, cp_utf8->length);
 	return -1;
     }
+    cp_utf8->bytes = in->data + in->position;
+    in->position += cp_utf8->length;
 
     return 0;
 }
-static int read_constant_method_handle(int fd, cp_info_t *constant_pool_element){
+static int read_constant_method_handle(class_input_t *in, cp_info_t *constant_pool_element){
     constant_pool_method_handle_t* cp_method_handle = &constant_pool_element->u.cp_method_handle;
 
-    if (read_bytes(fd, &cp_method_handle->reference_kind, sizeof(cp_method_handle->reference_kind))) {
+    if (read_bytes(in, &cp_method_handle->reference_kind, sizeof(cp_method_handle->reference_kind))) {
 	fprintf(stderr, "%s: could not read method-handle constant reference kind\n", program);
 	return -1;
     }
 
-    if (read_bytes(fd, &cp_method_handle->reference_index, sizeof(cp_method_handle->reference_index))) {
+    if (read_bytes(in, &cp_method_handle->reference_index, sizeof(cp_method_handle->reference_index))) {
 	fprintf(stderr, "%s: could not read method-handle constant reference index\n", program);
 	return -1;
     }
@@ -535,10 +1333,10 @@ static int read_constant_method_handle(int fd, cp_info_t *constant_pool_element)
 
     return 0;
 }
-static int read_constant_method_type(int fd, cp_info_t *constant_pool_element){
+static int read_constant_method_type(class_input_t *in, cp_info_t *constant_pool_element){
     constant_pool_method_type_t* cp_method_type = &constant_pool_element->u.cp_method_type;
 
-    if (read_bytes(fd, &cp_method_type->descriptor_index, sizeof(cp_method_type->descriptor_index))) {
+    if (read_bytes(in, &cp_method_type->descriptor_index, sizeof(cp_method_type->descriptor_index))) {
 	fprintf(stderr, "%s: could not read method-type constant descriptor index\n", program);
 	return -1;
     }
@@ -546,16 +1344,33 @@ static int read_constant_method_type(int fd, cp_info_t *constant_pool_element){
 
     return 0;
 }
-static int read_constant_invoke_dynamic(int fd, cp_info_t *constant_pool_element){
+static int read_constant_dynamic(class_input_t *in, cp_info_t *constant_pool_element){
+    constant_pool_invoke_dynamic_t* cp_dynamic = &constant_pool_element->u.cp_dynamic;
+
+    if (read_bytes(in, &cp_dynamic->bootstrap_method_attr_index, sizeof(cp_dynamic->bootstrap_method_attr_index))) {
+	fprintf(stderr, "%s: could not read dynamic constant bootstrap-method-attr index\n", program);
+	return -1;
+    }
+    cp_dynamic->bootstrap_method_attr_index = ntohs(cp_dynamic->bootstrap_method_attr_index);
+
+    if (read_bytes(in, &cp_dynamic->name_and_type_index, sizeof(cp_dynamic->name_and_type_index))) {
+	fprintf(stderr, "%s: could not read dynamic constant name-and-type index\n", program);
+	return -1;
+    }
+    cp_dynamic->name_and_type_index = ntohs(cp_dynamic->name_and_type_index);
+
+    return 0;
+}
+static int read_constant_invoke_dynamic(class_input_t *in, cp_info_t *constant_pool_element){
     constant_pool_invoke_dynamic_t* cp_invoke_dynamic = &constant_pool_element->u.cp_invoke_dynamic;
 
-    if (read_bytes(fd, &cp_invoke_dynamic->bootstrap_method_attr_index, sizeof(cp_invoke_dynamic->bootstrap_method_attr_index))) {
+    if (read_bytes(in, &cp_invoke_dynamic->bootstrap_method_attr_index, sizeof(cp_invoke_dynamic->bootstrap_method_attr_index))) {
 	fprintf(stderr, "%s: could not read invoke-dynamic constant bootstrap-method-attr index\n", program);
 	return -1;
     }
     cp_invoke_dynamic->bootstrap_method_attr_index = ntohs(cp_invoke_dynamic->bootstrap_method_attr_index);
 
-    if (read_bytes(fd, &cp_invoke_dynamic->name_and_type_index, sizeof(cp_invoke_dynamic->name_and_type_index))) {
+    if (read_bytes(in, &cp_invoke_dynamic->name_and_type_index, sizeof(cp_invoke_dynamic->name_and_type_index))) {
 	fprintf(stderr, "%s: could not read invoke-dynamic constant name-and-type index\n", program);
 	return -1;
     }
@@ -563,6 +1378,28 @@ static int read_constant_invoke_dynamic(int fd, cp_info_t *constant_pool_element
 
     return 0;
 }
+static int read_constant_module(class_input_t *in, cp_info_t *constant_pool_element){
+    constant_pool_module_t* cp_module = &constant_pool_element->u.cp_module;
+
+    if (read_bytes(in, &cp_module->name_index, sizeof(cp_module->name_index))) {
+	fprintf(stderr, "%s: could not read module constant name index\n", program);
+	return -1;
+    }
+    cp_module->name_index = ntohs(cp_module->name_index);
+
+    return 0;
+}
+static int read_constant_package(class_input_t *in, cp_info_t *constant_pool_element){
+    constant_pool_module_t* cp_package = &constant_pool_element->u.cp_package;
+
+    if (read_bytes(in, &cp_package->name_index, sizeof(cp_package->name_index))) {
+	fprintf(stderr, "%s: could not read package constant name index\n", program);
+	return -1;
+    }
+    cp_package->name_index = ntohs(cp_package->name_index);
+
+    return 0;
+}
 
 static void print_class_file (class_file_t *class_file) {
     if (class_file == NULL) {
@@ -625,24 +1462,20 @@ static void print_constant_pool_element(int i, cp_info_t *constant_pool_element)
 		constant_pool_element->u.cp_string.name_index);
 	break;
     case CONSTANT_INTEGER:
-	fprintf(stderr, "%s: [%d] INTEGER, name_index=%d, bytes=%x\n", program, i,
-		constant_pool_element->u.cp_integer.name_index,
+	fprintf(stderr, "%s: [%d] INTEGER, bytes=%x\n", program, i,
 		constant_pool_element->u.cp_integer.bytes);
 	break;
     case CONSTANT_FLOAT:
-	fprintf(stderr, "%s: [%d] FLOAT, name_index=%d, bytes=%x\n", program, i,
-		constant_pool_element->u.cp_integer.name_index,
-		constant_pool_element->u.cp_integer.bytes);
+	fprintf(stderr, "%s: [%d] FLOAT, bytes=%x\n", program, i,
+		constant_pool_element->u.cp_float.bytes);
 	break;
     case CONSTANT_LONG:
-	fprintf(stderr, "%s: [%d] LONG, name_index=%d, high_bytes=%x, low_bytes=%x\n", program, i,
-		constant_pool_element->u.cp_long.name_index,
+	fprintf(stderr, "%s: [%d] LONG, high_bytes=%x, low_bytes=%x\n", program, i,
 		constant_pool_element->u.cp_long.high_bytes,
 		constant_pool_element->u.cp_long.low_bytes);
 	break;
     case CONSTANT_DOUBLE:
-	fprintf(stderr, "%s: [%d] DOUBLE, name_index=%d, high_bytes=%x, low_bytes=%x\n", program, i,
-		constant_pool_element->u.cp_double.name_index,
+	fprintf(stderr, "%s: [%d] DOUBLE, high_bytes=%x, low_bytes=%x\n", program, i,
 		constant_pool_element->u.cp_double.high_bytes,
 		constant_pool_element->u.cp_double.low_bytes);
 	break;
@@ -653,7 +1486,8 @@ static void print_constant_pool_element(int i, cp_info_t *constant_pool_element)
 	break;
     case CONSTANT_UTF8:
 	/* TODO be more careful about UTF8 */
-	fprintf(stderr, "%s: [%d] UTF8, length=%d, bytes='%s'\n", program, i,
+	fprintf(stderr, "%s: [%d] UTF8, length=%d, bytes='%.*s'\n", program, i,
+		constant_pool_element->u.cp_utf8.length,
 		constant_pool_element->u.cp_utf8.length,
 		constant_pool_element->u.cp_utf8.bytes);
 	break;
@@ -666,11 +1500,27 @@ static void print_constant_pool_element(int i, cp_info_t *constant_pool_element)
 	fprintf(stderr, "%s: [%d] METHOD_TYPE, descriptor_index=%d\n", program, i,
 		constant_pool_element->u.cp_method_type.descriptor_index);
 	break;
+    case CONSTANT_DYNAMIC:
+	fprintf(stderr, "%s: [%d] DYNAMIC, bootstrap_method_attr_index=%d, name_and_type_index=%d\n", program, i,
+		constant_pool_element->u.cp_dynamic.bootstrap_method_attr_index,
+		constant_pool_element->u.cp_dynamic.name_and_type_index);
+	break;
     case CONSTANT_INVOKE_DYNAMIC:
 	fprintf(stderr, "%s: [%d] INVOKE_DYNAMIC, bootstrap_method_attr_index=%d, name_and_type_index=%d\n", program, i,
 		constant_pool_element->u.cp_invoke_dynamic.bootstrap_method_attr_index,
 		constant_pool_element->u.cp_invoke_dynamic.name_and_type_index);
 	break;
+    case CONSTANT_MODULE:
+	fprintf(stderr, "%s: [%d] MODULE, name_index=%d\n", program, i,
+		constant_pool_element->u.cp_module.name_index);
+	break;
+    case CONSTANT_PACKAGE:
+	fprintf(stderr, "%s: [%d] PACKAGE, name_index=%d\n", program, i,
+		constant_pool_element->u.cp_package.name_index);
+	break;
+    case 0:
+	/* second slot of a long or double */
+	break;
     default:
 	fprintf(stderr, "%s: unknown constant pool tag %d\n", program, constant_pool_element->tag);
 	break;
@@ -709,9 +1559,10 @@ static void print_this_class(class_file_t *class_file) {
     }
     else {
         cp_info_t *cp = class_file->constant_pool;
-        fprintf(stderr, "%s: THIS_CLASS: [%d] %s\n", program,
+        constant_pool_utf8_t *name = &cp[cp[class_file->this_class-1].u.cp_class_info.name_index-1].u.cp_utf8;
+        fprintf(stderr, "%s: THIS_CLASS: [%d] %.*s\n", program,
                 cp[class_file->this_class-1].u.cp_class_info.name_index,
-                cp[cp[class_file->this_class-1].u.cp_class_info.name_index-1].u.cp_utf8.bytes);
+                name->length, name->bytes);
     }
 }
 
@@ -721,9 +1572,10 @@ static void print_super_class(class_file_t *class_file) {
         fprintf(stderr, "%s: SUPER_CLASS: None!\n", program);
     }
     else {
-        fprintf(stderr, "%s: SUPER_CLASS: [%d] %s\n", program,
+        constant_pool_utf8_t *name = &cp[cp[class_file->super_class-1].u.cp_class_info.name_index-1].u.cp_utf8;
+        fprintf(stderr, "%s: SUPER_CLASS: [%d] %.*s\n", program,
                 cp[class_file->super_class-1].u.cp_class_info.name_index,
-                cp[cp[class_file->super_class-1].u.cp_class_info.name_index-1].u.cp_utf8.bytes);
+                name->length, name->bytes);
     }
 }
 
@@ -765,17 +1617,16 @@ static void print_attributes(u2_t attributes_count, attribute_info_t *attribute)
     int i;
     fprintf(stderr, "attributes = {");
     for (i = 0; i < attributes_count; i++) {
-        fprintf(stderr, "[name=%d, length=%d, value='%s']",
+        fprintf(stderr, "[name=%d, length=%d]",
                 attribute->attribute_name_index,
-                attribute->attribute_length,
-                attribute->info);
+                attribute->attribute_length);
         attribute++;
     }
     fprintf(stderr, "}");
 }
 
 
-static int read_bytes(int fd, void *buffer, int requested) {
+static int read_bytes(class_input_t *in, void *buffer, int requested) {
     if (requested <= 0) {
 	return requested;
     }
@@ -783,23 +1634,12 @@ static int read_bytes(int fd, void *buffer, int requested) {
 	return -1;
     }
 
-    int so_far = 0;
-
-    int bytes_read = read_bytes_or_error(fd, buffer, requested, so_far);
-    while((bytes_read > 0) && (so_far + bytes_read < requested)){
-	so_far += bytes_read;
-	bytes_read = read_bytes_or_error(fd, buffer, requested, so_far);
-    }
-
-    if (bytes_read < 0) {
-	fprintf(stderr, "%s: read_bytes: did not read %d bytes", program, requested);
-	return -1;
-    }
-
-    if ((bytes_read == 0) && (so_far < requested)) {
-	fprintf(stderr, "%s: end of file after reading only %d of %d bytes\n", program, so_far, requested);
+    if (in->end - in->position < (u4_t) requested) {
+	fprintf(stderr, "%s: end of class after reading only %u of %d bytes\n", program, in->end - in->position, requested);
 	return -1;
     }
+    memcpy(buffer, in->data + in->position, requested);
+    in->position += requested;
     
     return 0;
 }
@@ -1,8 +1,18 @@
 #ifndef CJDC_H
 #define CJDC_H 1
 
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/types.h>
+
 #define CLASS_FILE_MAGIC (0xCAFEBABE)
 
+/* sniff_input() decides what an input is from this many bytes */
+#define SNIFF_LENGTH (8)
+
+/* classes this large are worth decoding on several threads */
+#define PARALLEL_CLASS_MIN_LENGTH (256 * 1024)
+
 typedef uint8_t u1_t;
 typedef uint16_t u2_t;
 typedef uint32_t u4_t;
@@ -21,10 +31,72 @@ typedef enum constant_pool_tags_e {
     CONSTANT_UTF8			= 1,
     CONSTANT_METHOD_HANDLE		= 15,
     CONSTANT_METHOD_TYPE		= 16,
-    CONSTANT_INVOKE_DYNAMIC		= 18
+    CONSTANT_DYNAMIC			= 17,
+    CONSTANT_INVOKE_DYNAMIC		= 18,
+    CONSTANT_MODULE			= 19,
+    CONSTANT_PACKAGE			= 20
 } constant_pool_tags_t;
 
+/* attributes that cjdc knows the layout of */
+typedef enum attribute_kind_e {
+    ATTRIBUTE_UNKNOWN = 0,
+    ATTRIBUTE_CONSTANT_VALUE,
+    ATTRIBUTE_CODE,
+    ATTRIBUTE_STACK_MAP_TABLE,
+    ATTRIBUTE_EXCEPTIONS,
+    ATTRIBUTE_INNER_CLASSES,
+    ATTRIBUTE_ENCLOSING_METHOD,
+    ATTRIBUTE_SYNTHETIC,
+    ATTRIBUTE_SIGNATURE,
+    ATTRIBUTE_SOURCE_FILE,
+    ATTRIBUTE_SOURCE_DEBUG_EXTENSION,
+    ATTRIBUTE_LINE_NUMBER_TABLE,
+    ATTRIBUTE_LOCAL_VARIABLE_TABLE,
+    ATTRIBUTE_LOCAL_VARIABLE_TYPE_TABLE,
+    ATTRIBUTE_DEPRECATED,
+    ATTRIBUTE_RUNTIME_VISIBLE_ANNOTATIONS,
+    ATTRIBUTE_RUNTIME_INVISIBLE_ANNOTATIONS,
+    ATTRIBUTE_RUNTIME_VISIBLE_PARAMETER_ANNOTATIONS,
+    ATTRIBUTE_RUNTIME_INVISIBLE_PARAMETER_ANNOTATIONS,
+    ATTRIBUTE_RUNTIME_VISIBLE_TYPE_ANNOTATIONS,
+    ATTRIBUTE_RUNTIME_INVISIBLE_TYPE_ANNOTATIONS,
+    ATTRIBUTE_ANNOTATION_DEFAULT,
+    ATTRIBUTE_BOOTSTRAP_METHODS,
+    ATTRIBUTE_METHOD_PARAMETERS,
+    ATTRIBUTE_MODULE,
+    ATTRIBUTE_MODULE_PACKAGES,
+    ATTRIBUTE_MODULE_MAIN_CLASS,
+    ATTRIBUTE_NEST_HOST,
+    ATTRIBUTE_NEST_MEMBERS,
+    ATTRIBUTE_RECORD,
+    ATTRIBUTE_PERMITTED_SUBCLASSES,
+    ATTRIBUTE_KIND_COUNT
+} attribute_kind_t;
+
+/* opcodes with constant pool operands */
+#define OPCODE_LDC              (0x12)
+#define OPCODE_LDC_W            (0x13)
+#define OPCODE_LDC2_W           (0x14)
+#define OPCODE_TABLESWITCH      (0xaa)
+#define OPCODE_LOOKUPSWITCH     (0xab)
+#define OPCODE_GETSTATIC        (0xb2)
+#define OPCODE_PUTSTATIC        (0xb3)
+#define OPCODE_GETFIELD         (0xb4)
+#define OPCODE_PUTFIELD         (0xb5)
+#define OPCODE_INVOKEVIRTUAL    (0xb6)
+#define OPCODE_INVOKESPECIAL    (0xb7)
+#define OPCODE_INVOKESTATIC     (0xb8)
+#define OPCODE_INVOKEINTERFACE  (0xb9)
+#define OPCODE_INVOKEDYNAMIC    (0xba)
+#define OPCODE_NEW              (0xbb)
+#define OPCODE_ANEWARRAY        (0xbd)
+#define OPCODE_CHECKCAST        (0xc0)
+#define OPCODE_INSTANCEOF       (0xc1)
+#define OPCODE_WIDE             (0xc4)
+#define OPCODE_MULTIANEWARRAY   (0xc5)
+
 #define ACC_PUBLIC(x)      ((x) & 0x0001)
+#define ACC_PRIVATE(x)     ((x) & 0x0002)
 #define ACC_FINAL(x)       ((x) & 0x0010)
 #define ACC_SUPER(x)       ((x) & 0x0020)
 #define ACC_INTERFACE(x)   ((x) & 0x0200)
@@ -49,13 +121,11 @@ typedef struct constant_pool_string_s {
 
 /* integer, float */
 typedef struct constant_pool_number4_s {
-    u2_t name_index;
     u4_t bytes;
 } constant_pool_number4_t;
 
-/* long, double */
+/* long, double; these take up two constant pool slots, the second is left with tag 0 */
 typedef struct constant_pool_number8_s {
-    u2_t name_index;
     u4_t high_bytes;
     u4_t low_bytes;
 } constant_pool_number8_t;
@@ -65,6 +135,7 @@ typedef struct constant_pool_name_and_type_s {
     u2_t descriptor_index;
 } constant_pool_name_and_type_t;
 
+/* bytes point into class_file->source and are not NUL-terminated */
 typedef struct constant_pool_utf8_s {
     u2_t length;
     u1_t *bytes;
@@ -79,11 +150,16 @@ typedef struct constant_pool_method_type_s {
     u2_t descriptor_index;
 } constant_pool_method_type_t;
 
+/* dynamic, invoke_dynamic */
 typedef struct constant_pool_invoke_dynamic_s {
     u2_t bootstrap_method_attr_index;
     u2_t name_and_type_index;
 } constant_pool_invoke_dynamic_t;
 
+/* module, package */
+typedef struct constant_pool_module_s {
+    u2_t name_index;
+} constant_pool_module_t;
 
 
 typedef struct cp_info_s {
@@ -102,22 +178,53 @@ typedef struct cp_info_s {
         constant_pool_utf8_t cp_utf8;
         constant_pool_method_handle_t cp_method_handle;
         constant_pool_method_type_t cp_method_type;
+        constant_pool_invoke_dynamic_t cp_dynamic;
         constant_pool_invoke_dynamic_t cp_invoke_dynamic;
+        constant_pool_module_t cp_module;
+        constant_pool_module_t cp_package;
     } u;
 } cp_info_t;
 
+/* bytes an element occupied in class_file->source; a length of 0 means
+ * the element was changed in memory and has to be re-encoded */
+typedef struct source_range_s {
+    u4_t offset;
+    u4_t length;
+} source_range_t;
+
 typedef struct attribute_info_s {
     u2_t attribute_name_index;
     u4_t attribute_length;
-    u1_t *info;
+    u1_t *info;                 /* points into class_file->source unless re-encoded */
+    source_range_t range;
+    struct code_attribute_s *code;  /* decoded Code attribute, NULL until read_code_attribute() */
 } attribute_info_t;
 
+typedef struct exception_table_entry_s {
+    u2_t start_pc;
+    u2_t end_pc;
+    u2_t handler_pc;
+    u2_t catch_type;
+} exception_table_entry_t;
+
+typedef struct code_attribute_s {
+    u2_t max_stack;
+    u2_t max_locals;
+    u4_t code_length;
+    u1_t *code;
+    u2_t exception_table_length;
+    exception_table_entry_t *exception_table;
+    u2_t attributes_count;
+    attribute_info_t *attributes;
+} code_attribute_t;
+
 typedef struct field_info_s {
     u2_t access_flags;
     u2_t name_index;
     u2_t descriptor_index;
     u2_t attributes_count;
     attribute_info_t *attributes;
+    source_range_t range;
 } field_info_t;
 
 typedef struct method_info_s {
@@ -126,9 +233,18 @@ typedef struct method_info_s {
     u2_t descriptor_index;
     u2_t attributes_count;
     attribute_info_t *attributes;
+    source_range_t range;
 } method_info_t;
 
 typedef struct class_file_s {
+    u1_t *source;               /* the bytes this class was read from, owned unless mapped */
+    u4_t source_length;
+    int source_mapped;          /* source belongs to a mapping, see read_class_mapped() */
+    source_range_t range;           /* the whole class */
+    source_range_t header_range;    /* magic through interfaces */
+    source_range_t fields_range;    /* fields_count and fields */
+    source_range_t methods_range;   /* methods_count and methods */
+    source_range_t attributes_range;/* attributes_count and attributes */
     u4_t magic;
     u2_t minor_version;
     u2_t major_version;
@@ -147,5 +263,426 @@ typedef struct class_file_s {
     attribute_info_t *attributes;
 } class_file_t;
 
+/* what the first SNIFF_LENGTH bytes of an input say it is, see sniff_input() */
+typedef enum input_kind_e {
+    INPUT_OTHER = 0,
+    INPUT_CLASS,
+    INPUT_CLASS_OUT_OF_RANGE,   /* a class whose major version is not wanted */
+    INPUT_JAR
+} input_kind_t;
+
+/* a class walked in place by skim_class_bytes(), see skim.c */
+typedef struct class_skim_s {
+    const u1_t *data;
+    u4_t length;
+    u4_t position;
+    u2_t minor_version;
+    u2_t major_version;
+    u2_t constant_pool_count;
+    u4_t *constant_pool;        /* offset of each entry's tag byte, [constant_pool_count] */
+} class_skim_t;
+
+/*
+ * Classpath index file written by "cjdc index", see index.c.  It is
+ * mmapped and used in place, so integers are in native byte order; an
+ * index written on a machine of the other byte order fails the magic
+ * check.  Offsets are from the start of the file, string offsets from
+ * strings_offset.
+ */
+#define CLASS_INDEX_MAGIC   (0x58444a43)    /* "CJDX" */
+#define CLASS_INDEX_VERSION (2)
+
+typedef struct class_index_header_s {
+    u4_t magic;
+    u4_t version;
+    u4_t containers_count;
+    u4_t classes_count;
+    u4_t containers_offset;     /* class_index_container_t[containers_count] */
+    u4_t displacements_offset;  /* int32_t[classes_count], one per hash bucket */
+    u4_t slots_offset;          /* class_index_slot_t[classes_count] */
+    u4_t shadowed_offset;       /* class_index_slot_t[shadowed_count], hidden by earlier jars */
+    u4_t shadowed_count;
+    u4_t strings_offset;
+    u4_t strings_length;
+    u4_t reserved;
+} class_index_header_t;
+
+/* a jar on the classpath; size and mtime decide whether it is rescanned */
+typedef struct class_index_container_s {
+    u4_t name_offset;
+    u4_t name_length;
+    int64_t size;
+    int64_t mtime_sec;
+    u4_t mtime_nsec;
+    u4_t classes_count;
+} class_index_container_t;
+
+typedef struct class_index_slot_s {
+    u4_t name_offset;
+    u2_t name_length;
+    u2_t reserved;
+    u4_t container;
+    u4_t offset;                /* local header of the class entry in its jar */
+} class_index_slot_t;
+
+typedef struct class_index_s {
+    u1_t *map;
+    size_t size;
+    class_index_header_t *header;
+    class_index_container_t *containers;
+    int32_t *displacements;
+    class_index_slot_t *slots;
+    class_index_slot_t *shadowed;
+    const char *strings;
+} class_index_t;
+
+/*
+ * Annotation index file written by "cjdc annotations", see annotations.c.
+ * Mapped and used in place like the classpath index.  Types are sorted
+ * by name and each owns a run of elements, sorted by class and member.
+ */
+#define ANNOTATION_INDEX_MAGIC      (0x41444a43)    /* "CJDA" */
+#define ANNOTATION_INDEX_VERSION    (1)
+
+#define ANNOTATED_CLASS     (0)
+#define ANNOTATED_FIELD     (1)
+#define ANNOTATED_METHOD    (2)
+
+typedef struct annotation_index_header_s {
+    u4_t magic;
+    u4_t version;
+    u4_t types_count;
+    u4_t elements_count;
+    u4_t types_offset;          /* annotation_index_type_t[types_count] */
+    u4_t elements_offset;       /* annotation_index_element_t[elements_count] */
+    u4_t strings_offset;
+    u4_t strings_length;
+} annotation_index_header_t;
+
+typedef struct annotation_index_type_s {
+    u4_t name_offset;
+    u4_t name_length;
+    u4_t first_element;
+    u4_t elements_count;
+} annotation_index_type_t;
+
+/* member is "name:descriptor" for a field, "namedescriptor" for a method */
+typedef struct annotation_index_element_s {
+    u4_t class_offset;
+    u4_t member_offset;
+    u4_t member_length;
+    u2_t class_length;
+    u1_t kind;                  /* ANNOTATED_* */
+    u1_t visible;               /* RuntimeVisibleAnnotations rather than RuntimeInvisibleAnnotations */
+} annotation_index_element_t;
+
+typedef struct annotation_index_s {
+    u1_t *map;
+    size_t size;
+    annotation_index_header_t *header;
+    annotation_index_type_t *types;
+    annotation_index_element_t *elements;
+    const char *strings;
+} annotation_index_t;
+
+/*
+ * Column files written by "cjdc export", see export.c: one file per
+ * table, a header naming its columns, then chunks of rows.  A chunk is a
+ * column_chunk_header_t followed by each column's data, in column order,
+ * each behind a column_data_header_t and padded to 8 bytes.  Integers
+ * are in native byte order, as in the index files.
+ *
+ * Number columns hold one value per row.  A string column holds a u4
+ * code per row, then the chunk's dictionary: a u4 count, count + 1 u4
+ * offsets and the string bytes.
+ */
+#define COLUMN_FILE_MAGIC       (0x4c444a43)    /* "CJDL" */
+#define COLUMN_FILE_VERSION     (1)
+
+#define COLUMN_U1               (1)
+#define COLUMN_U2               (2)
+#define COLUMN_U4               (3)
+#define COLUMN_I64              (4)
+#define COLUMN_STRING           (5)
+
+#define COLUMN_STORED           (0)
+#define COLUMN_DEFLATED         (1)     /* raw deflate, no zlib header */
+
+typedef struct column_file_header_s {
+    u4_t magic;
+    u4_t version;
+    u4_t columns_count;         /* column_info_t[columns_count] follow */
+    u4_t reserved;
+} column_file_header_t;
+
+typedef struct column_info_s {
+    u4_t type;                  /* COLUMN_U1 ... COLUMN_STRING */
+    char name[28];              /* NUL-terminated */
+} column_info_t;
+
+typedef struct column_chunk_header_s {
+    u4_t rows;
+    u4_t length;                /* of the column data that follows */
+} column_chunk_header_t;
+
+typedef struct column_data_header_s {
+    u4_t codec;                 /* COLUMN_STORED or COLUMN_DEFLATED */
+    u4_t length;                /* as stored, without the padding */
+    u4_t raw_length;
+    u4_t reserved;
+} column_data_header_t;
+
+/*
+ * "cjdc serve" protocol, see server.c.  Requests and replies are frames:
+ * a big-endian u4 length followed by that many bytes.  A request is an
+ * op byte followed by a class binary name, a reply is a status byte
+ * followed by UTF-8 text, one item per line.
+ */
+#define SERVER_OP_DUMP          (1)
+#define SERVER_OP_SUPERS        (2)
+#define SERVER_OP_REFERENCES    (3)
+#define SERVER_OP_CONSTANTS     (4)
+#define SERVER_OP_STATS         (5)    /* the class cache counters, the name is ignored */
+
+#define SERVER_STATUS_OK        (0)
+#define SERVER_STATUS_NOT_FOUND (1)
+#define SERVER_STATUS_ERROR     (2)
+
+#define SERVER_MAX_REQUEST      (0x10000)
+
+/* applied to each class by rewrite_file(), returns the number of changes made or -1 */
+typedef int (*class_transform_t)(class_file_t *class_file, void *context);
+
+/* growable byte buffer used when encoding */
+typedef struct buffer_s {
+    u1_t *data;
+    size_t length;
+    size_t capacity;
+} buffer_t;
+
+/* hash table from byte-string keys to pointers, see table.c; zeroed is empty */
+typedef struct table_entry_s {
+    char *key;                  /* owned copy, NUL-terminated; NULL for a free entry */
+    size_t key_length;
+    uint64_t hash;
+    void *value;
+} table_entry_t;
+
+typedef struct table_s {
+    table_entry_t *entries;     /* [capacity], capacity is a power of two */
+    size_t capacity;
+    size_t count;
+} table_t;
+
+typedef struct jar_entry_s {
+    const char *name;           /* points into the central directory, not NUL-terminated */
+    u2_t name_length;
+    u2_t flags;
+    u2_t method;
+    u4_t crc32;
+    u4_t compressed_size;
+    u4_t uncompressed_size;
+    u4_t local_header_offset;
+    u4_t data_offset;
+    u4_t local_length;          /* local header, data and data descriptor */
+    const u1_t *central_record;
+    u4_t central_length;
+} jar_entry_t;
+
+typedef struct jar_file_s {
+    int fd;
+    u1_t *map;
+    size_t size;
+    u4_t entries_count;
+    jar_entry_t *entries;
+    const u1_t *comment;
+    u2_t comment_length;
+    int entries_unsorted;       /* central directory is not in local header order */
+    int map_owned;              /* map is malloc'd memory, see open_jar_bytes() */
+} jar_file_t;
+
+typedef struct jar_writer_s {
+    int fd;
+    jar_file_t *source;         /* jar that verbatim entries are copied from */
+    off_t offset;
+    off_t pending_offset;       /* source span not yet copied */
+    off_t pending_length;
+    buffer_t central;
+    u4_t entries_count;
+} jar_writer_t;
+
+/* class files, directories and jars cut into jobs for threads, see corpus.c */
+typedef struct corpus_job_s {
+    const char *path;           /* a class file, or NULL for a run of jar entries */
+    jar_file_t *jar_file;
+    u4_t first;
+    u4_t count;
+} corpus_job_t;
+
+typedef struct corpus_s {
+    corpus_job_t *jobs;
+    u4_t jobs_count;
+    u4_t jobs_capacity;
+    u4_t next_job;              /* claimed with __atomic_fetch_add() */
+    u4_t unreadable;            /* classes that failed to read or visit */
+    u4_t skipped;               /* classes outside the major version range */
+    u2_t min_major;
+    u2_t max_major;             /* 0 for no upper limit */
+    char **paths;               /* class files, owned */
+    u4_t paths_count;
+    jar_file_t **jar_files;
+    u4_t jar_files_count;
+} corpus_t;
+
+/* called for each class of a corpus with the thread's context; returns -1 for an unreadable class */
+typedef int (*corpus_visit_t)(void *context, const u1_t *bytes, u4_t length);
+
+/* parsed classes held under a memory budget, see cache.c */
+typedef struct class_cache_s class_cache_t;
+
+typedef struct class_cache_stats_s {
+    uint64_t hits;              /* resident when asked for */
+    uint64_t misses;            /* read from the jars */
+    uint64_t reloads;           /* read back from the spill file */
+    uint64_t evictions;
+    uint64_t spills;            /* classes written to the spill file */
+    uint64_t spill_bytes;
+    uint64_t resident_classes;
+    uint64_t resident_bytes;
+    uint64_t peak_bytes;
+} class_cache_stats_t;
+
+/* cjdc.c */
+extern char *program;
+class_file_t *read_class_file(int fd);
+class_file_t *read_class_bytes(u1_t *bytes, u4_t length);
+class_file_t *read_class_mapped(const u1_t *bytes, u4_t length);
+class_file_t *read_class_bytes_parallel(u1_t *bytes, u4_t length, int threads);
+u1_t *read_fd_bytes(int fd, u4_t *length);
+int read_code_attribute(class_file_t *class_file, attribute_info_t *attribute);
+void free_code_attribute(code_attribute_t *code);
+void free_class_file(class_file_t *class_file);
+cp_info_t *cp_entry(class_file_t *class_file, u2_t index);
+int cp_utf8_equals(class_file_t *class_file, u2_t index, const char *s);
+int cp_utf8(class_file_t *class_file, u2_t index, const u1_t **bytes, u2_t *length);
+int cp_class_name(class_file_t *class_file, u2_t index, const u1_t **bytes, u2_t *length);
+int has_suffix(const char *s, size_t length, const char *suffix);
+attribute_kind_t attribute_kind(class_file_t *class_file, u2_t name_index);
+attribute_kind_t attribute_kind_of_name(const u1_t *bytes, u2_t length);
+const char *attribute_kind_name(attribute_kind_t kind);
+
+/* skim.c */
+int skim_class_bytes(class_skim_t *skim, const u1_t *bytes, u4_t length);
+void skim_free(class_skim_t *skim);
+const u1_t *skim_entry(class_skim_t *skim, u2_t index);
+int skim_utf8(class_skim_t *skim, u2_t index, const u1_t **bytes, u2_t *length);
+int skim_class_name(class_skim_t *skim, u2_t index, const u1_t **bytes, u2_t *length);
+int skim_utf8_is(class_skim_t *skim, u2_t index, const char *s);
+int skim_skip(class_skim_t *skim, u4_t count);
+int skim_u2(class_skim_t *skim, u2_t *value);
+int skim_u4(class_skim_t *skim, u4_t *value);
+int skim_this_class(class_skim_t *skim, const u1_t **bytes, u2_t *length);
+input_kind_t sniff_input(const u1_t *bytes, u4_t length, u2_t min_major, u2_t max_major);
+
+/* bytecode.c */
+int instruction_length(const u1_t *code, u4_t code_length, u4_t pc);
+const char *opcode_name(u1_t opcode);
+
+/* buffer.c */
+int buffer_reserve(buffer_t *buffer, size_t extra);
+int buffer_put_u1(buffer_t *buffer, u1_t value);
+int buffer_put_u2(buffer_t *buffer, u2_t value);
+int buffer_put_u4(buffer_t *buffer, u4_t value);
+int buffer_put_bytes(buffer_t *buffer, const void *bytes, size_t length);
+int buffer_printf(buffer_t *buffer, const char *format, ...) __attribute__((format(printf, 2, 3)));
+int buffer_put_escaped(buffer_t *buffer, const u1_t *bytes, size_t length);
+void buffer_free(buffer_t *buffer);
+
+/* table.c */
+uint64_t table_hash(const void *key, size_t length);
+void **table_find(table_t *table, const void *key, size_t length);
+void **table_insert(table_t *table, const void *key, size_t length);
+void *table_remove(table_t *table, const void *key, size_t length);
+void table_free(table_t *table, void (*free_value)(void *value));
+
+/* write.c */
+int write_class_file(class_file_t *class_file, buffer_t *out);
+int write_file(const char *file_name, const u1_t *bytes, size_t length);
+int rewrite_file(const char *input_name, const char *output_name, class_transform_t transform, void *context, int level);
+
+/* jar.c */
+jar_file_t *open_jar_file(const char *jar_file_name);
+jar_file_t *open_jar_bytes(const char *jar_file_name, u1_t *bytes, size_t length);
+void close_jar_file(jar_file_t *jar_file);
+u1_t *read_jar_entry(jar_file_t *jar_file, jar_entry_t *entry);
+int read_jar_entry_head(jar_file_t *jar_file, jar_entry_t *entry, u1_t *head, u4_t length);
+int is_class_entry(jar_entry_t *entry);
+jar_entry_t *find_jar_entry(jar_file_t *jar_file, u4_t local_header_offset);
+int jar_writer_open(jar_writer_t *writer, jar_file_t *source, const char *jar_file_name);
+int jar_writer_copy_entry(jar_writer_t *writer, jar_entry_t *entry);
+int jar_writer_add_entry(jar_writer_t *writer, jar_entry_t *entry, const u1_t *bytes, u4_t length, int level);
+int jar_writer_close(jar_writer_t *writer);
+int write_fully_at(int fd, const void *bytes, size_t length, off_t offset);
+
+/* strip.c */
+int strip_class_file(class_file_t *class_file, const char **names, int names_count);
+int strip_main(int ac, char **av);
+
+/* compact.c */
+int compact_class_file(class_file_t *class_file);
+int compact_main(int ac, char **av);
+
+/* index.c */
+class_index_t *open_class_index(const char *index_file_name);
+void close_class_index(class_index_t *index);
+class_index_slot_t *class_index_lookup(class_index_t *index, const char *name, size_t length);
+int build_class_index(const char *index_file_name, char **jar_names, int jars_count, int threads, int rebuild);
+int index_main(int ac, char **av);
+int lookup_main(int ac, char **av);
+
+/* cache.c */
+class_cache_t *open_class_cache(u4_t classes_count, uint64_t budget, const char *spill_directory);
+void close_class_cache(class_cache_t *cache);
+class_file_t *class_cache_acquire(class_cache_t *cache, u4_t number);
+class_file_t *class_cache_insert(class_cache_t *cache, u4_t number, u1_t *bytes, u4_t length);
+void class_cache_release(class_cache_t *cache, u4_t number);
+void class_cache_stats(class_cache_t *cache, class_cache_stats_t *stats);
+
+/* server.c */
+int serve_main(int ac, char **av);
+int query_main(int ac, char **av);
+
+/* watch.c */
+int watch_main(int ac, char **av);
+
+/* corpus.c */
+int corpus_add(corpus_t *corpus, const char *path);
+int corpus_set_versions(corpus_t *corpus, const char *range);
+int corpus_run(corpus_t *corpus, int threads, corpus_visit_t visit, void **contexts);
+void corpus_free(corpus_t *corpus);
+
+/* stats.c */
+int stats_main(int ac, char **av);
+
+/* deps.c */
+int deps_main(int ac, char **av);
+
+/* search.c */
+int search_main(int ac, char **av);
+
+/* annotations.c */
+annotation_index_t *open_annotation_index(const char *index_file_name);
+void close_annotation_index(annotation_index_t *index);
+annotation_index_element_t *annotation_index_lookup(annotation_index_t *index, const char *name, size_t length, u4_t *count);
+const char *annotation_index_string(annotation_index_t *index, u4_t offset, u4_t length);
+int annotations_main(int ac, char **av);
+int annotated_main(int ac, char **av);
+
+/* export.c */
+int export_main(int ac, char **av);
+
+/* abi.c */
+int abi_fingerprint(const u1_t *bytes, u4_t length, uint64_t *fingerprint);
+int abi_main(int ac, char **av);
 
 #endif
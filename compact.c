@@ -0,0 +1,880 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <getopt.h>
+
+#include "cjdc.h"
+
+/*
+ * Removes constant pool entries that nothing refers to.
+ *
+ * The same walk over the class is made twice: first to mark every entry
+ * reachable from the header, fields, methods, attributes and bytecode,
+ * then to rewrite every index to its new number.  Entries keep their
+ * order, so new indexes are never larger than old ones and ldc operands
+ * still fit in a byte.  Indexes inside attribute and code bytes are
+ * rewritten in place in class_file->source, so everything after the
+ * constant pool keeps its source range and is still copied verbatim by
+ * write_class_file().
+ *
+ * A class with an attribute whose layout is unknown may refer to entries
+ * we cannot see, so it is left alone, and so is one whose element values
+ * or raw attributes nest deeper than COMPACT_MAX_DEPTH.
+ */
+#define COMPACT_MAX_DEPTH       (64)
+
+typedef struct cp_visitor_s {
+    class_file_t *class_file;
+    u1_t *marked;
+    u2_t *new_index;            /* NULL while marking */
+    int depth;                  /* nested element values and raw attributes */
+} cp_visitor_t;
+
+/* bounds-checked cursor over raw attribute bytes */
+typedef struct raw_cursor_s {
+    u1_t *p;
+    u1_t *end;
+} raw_cursor_t;
+
+static int visit_class(cp_visitor_t *visitor);
+static int visit_member(cp_visitor_t *visitor, u2_t *name_index, u2_t *descriptor_index, source_range_t *range, u2_t attributes_count, attribute_info_t *attributes);
+static int visit_attributes(cp_visitor_t *visitor, u2_t attributes_count, attribute_info_t *attributes);
+static int visit_attribute_info(cp_visitor_t *visitor, attribute_kind_t kind, u1_t *info, u4_t length);
+static int visit_raw_attributes(cp_visitor_t *visitor, raw_cursor_t *cursor);
+static int visit_code(cp_visitor_t *visitor, code_attribute_t *code);
+static int visit_bytecode(cp_visitor_t *visitor, u1_t *code, u4_t code_length);
+static int visit_stack_map_table(cp_visitor_t *visitor, raw_cursor_t *cursor);
+static int visit_verification_types(cp_visitor_t *visitor, raw_cursor_t *cursor, int count);
+static int visit_annotations(cp_visitor_t *visitor, raw_cursor_t *cursor);
+static int visit_annotation(cp_visitor_t *visitor, raw_cursor_t *cursor);
+static int visit_element_value(cp_visitor_t *visitor, raw_cursor_t *cursor);
+static int visit_type_annotation(cp_visitor_t *visitor, raw_cursor_t *cursor);
+static int visit_module(cp_visitor_t *visitor, raw_cursor_t *cursor);
+static int visit_index(cp_visitor_t *visitor, u2_t *index);
+static int visit_raw_index(cp_visitor_t *visitor, raw_cursor_t *cursor);
+static int visit_raw_indexes(cp_visitor_t *visitor, raw_cursor_t *cursor);
+static int mark_entry(cp_visitor_t *visitor, u2_t index);
+static void renumber_entry(cp_visitor_t *visitor, cp_info_t *constant_pool_element);
+
+static int raw_skip(raw_cursor_t *cursor, u4_t count);
+static int raw_u1(raw_cursor_t *cursor, u1_t *value);
+static int raw_u2(raw_cursor_t *cursor, u2_t *value);
+
+static int compact_transform(class_file_t *class_file, void *context);
+
+/* returns the number of entries removed, 0 if the class was left alone */
+int compact_class_file(class_file_t *class_file) {
+    u2_t count = class_file->constant_pool_count;
+    if (count <= 1) {
+        return 0;
+    }
+
+    cp_visitor_t visitor = {class_file, NULL, NULL, 0};
+    visitor.marked = calloc(count, sizeof(u1_t));
+    visitor.new_index = NULL;
+    u2_t *new_index = calloc(count, sizeof(u2_t));
+    cp_info_t *constant_pool = NULL;
+    int result = 0;
+    if ((visitor.marked == NULL) || (new_index == NULL)) {
+        fprintf(stderr, "%s: failed to allocate constant pool maps for %u entries\n", program, count);
+        result = -1;
+        goto RETURN;
+    }
+
+    if (visit_class(&visitor) < 0) {
+        goto RETURN;
+    }
+
+    u4_t next = 1;
+    u4_t i;
+    for (i = 1; i < count; i++) {
+        u1_t tag = class_file->constant_pool[i - 1].tag;
+        if (visitor.marked[i]) {
+            new_index[i] = next;
+            next += ((tag == CONSTANT_LONG) || (tag == CONSTANT_DOUBLE)) ? 2 : 1;
+        }
+        if ((tag == CONSTANT_LONG) || (tag == CONSTANT_DOUBLE)) {
+            i++;
+        }
+    }
+    if (next == count) {
+        goto RETURN;
+    }
+
+    constant_pool = calloc(next, sizeof(cp_info_t));
+    if (constant_pool == NULL) {
+        fprintf(stderr, "%s: failed to allocate %u constant pool entries\n", program, next);
+        result = -1;
+        goto RETURN;
+    }
+
+    /* rewrite the indexes while the old constant pool still names the attributes */
+    visitor.new_index = new_index;
+    if (visit_class(&visitor) < 0) {
+        fprintf(stderr, "%s: failed to renumber constant pool indexes\n", program);
+        result = -1;
+        goto RETURN;
+    }
+
+    for (i = 1; i < count; i++) {
+        if (new_index[i]) {
+            cp_info_t *element = &constant_pool[new_index[i] - 1];
+            *element = class_file->constant_pool[i - 1];
+            renumber_entry(&visitor, element);
+        }
+    }
+    free(class_file->constant_pool);
+    class_file->constant_pool = constant_pool;
+    constant_pool = NULL;
+    class_file->constant_pool_count = next;
+    class_file->header_range.length = 0;
+    class_file->range.length = 0;
+    result = count - next;
+
+RETURN:
+    free(constant_pool);
+    free(new_index);
+    free(visitor.marked);
+    return result;
+}
+
+static int visit_class(cp_visitor_t *visitor) {
+    class_file_t *class_file = visitor->class_file;
+    int i;
+
+    if ((visit_index(visitor, &class_file->this_class) < 0) ||
+        (visit_index(visitor, &class_file->super_class) < 0)) {
+        return -1;
+    }
+    for (i = 0; i < class_file->interfaces_count; i++) {
+        if (visit_index(visitor, &class_file->interfaces[i]) < 0) {
+            return -1;
+        }
+    }
+    for (i = 0; i < class_file->fields_count; i++) {
+        field_info_t *field = &class_file->fields[i];
+        if (visit_member(visitor, &field->name_index, &field->descriptor_index, &field->range,
+                         field->attributes_count, field->attributes) < 0) {
+            return -1;
+        }
+    }
+    for (i = 0; i < class_file->methods_count; i++) {
+        method_info_t *method = &class_file->methods[i];
+        if (visit_member(visitor, &method->name_index, &method->descriptor_index, &method->range,
+                         method->attributes_count, method->attributes) < 0) {
+            return -1;
+        }
+    }
+    return visit_attributes(visitor, class_file->attributes_count, class_file->attributes);
+}
+
+/* members still copied from the source get their indexes rewritten there as well */
+static int visit_member(cp_visitor_t *visitor, u2_t *name_index, u2_t *descriptor_index, source_range_t *range, u2_t attributes_count, attribute_info_t *attributes) {
+    if ((visit_index(visitor, name_index) < 0) ||
+        (visit_index(visitor, descriptor_index) < 0)) {
+        return -1;
+    }
+    if (visitor->new_index && range->length) {
+        u1_t *raw = visitor->class_file->source + range->offset;
+        raw[2] = *name_index >> 8;
+        raw[3] = *name_index;
+        raw[4] = *descriptor_index >> 8;
+        raw[5] = *descriptor_index;
+    }
+    return visit_attributes(visitor, attributes_count, attributes);
+}
+
+static int visit_attributes(cp_visitor_t *visitor, u2_t attributes_count, attribute_info_t *attributes) {
+    int i;
+    for (i = 0; i < attributes_count; i++) {
+        attribute_info_t *attribute = &attributes[i];
+        attribute_kind_t kind = attribute_kind(visitor->class_file, attribute->attribute_name_index);
+        if (kind == ATTRIBUTE_UNKNOWN) {
+            return -1;
+        }
+
+        if (visit_index(visitor, &attribute->attribute_name_index) < 0) {
+            return -1;
+        }
+        if (visitor->new_index && attribute->range.length) {
+            u1_t *raw = visitor->class_file->source + attribute->range.offset;
+            raw[0] = attribute->attribute_name_index >> 8;
+            raw[1] = attribute->attribute_name_index;
+        }
+
+        /* a decoded Code attribute that still has its range is unchanged, walk its bytes instead */
+        if (attribute->code && attribute->range.length) {
+            free_code_attribute(attribute->code);
+            attribute->code = NULL;
+        }
+        if (attribute->code) {
+            if (visit_code(visitor, attribute->code) < 0) {
+                return -1;
+            }
+        }
+        else if (visit_attribute_info(visitor, kind, attribute->info, attribute->attribute_length) < 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static int visit_attribute_info(cp_visitor_t *visitor, attribute_kind_t kind, u1_t *info, u4_t length) {
+    raw_cursor_t raw_cursor = {info, info + length};
+    raw_cursor_t *cursor = &raw_cursor;
+    u2_t count;
+    u1_t count1;
+    u4_t code_length;
+    int i;
+
+    switch (kind) {
+    case ATTRIBUTE_CONSTANT_VALUE:
+    case ATTRIBUTE_SIGNATURE:
+    case ATTRIBUTE_SOURCE_FILE:
+    case ATTRIBUTE_MODULE_MAIN_CLASS:
+    case ATTRIBUTE_NEST_HOST:
+        return visit_raw_index(visitor, cursor);
+    case ATTRIBUTE_EXCEPTIONS:
+    case ATTRIBUTE_NEST_MEMBERS:
+    case ATTRIBUTE_PERMITTED_SUBCLASSES:
+    case ATTRIBUTE_MODULE_PACKAGES:
+        return visit_raw_indexes(visitor, cursor);
+    case ATTRIBUTE_SYNTHETIC:
+    case ATTRIBUTE_DEPRECATED:
+    case ATTRIBUTE_SOURCE_DEBUG_EXTENSION:
+    case ATTRIBUTE_LINE_NUMBER_TABLE:
+        return 0;
+    case ATTRIBUTE_CODE:
+        if ((raw_skip(cursor, 4) < 0) || (cursor->end - cursor->p < 4)) {
+            return -1;
+        }
+        code_length = ((u4_t) cursor->p[0] << 24) | (cursor->p[1] << 16) | (cursor->p[2] << 8) | cursor->p[3];
+        cursor->p += 4;
+        if ((u4_t) (cursor->end - cursor->p) < code_length) {
+            return -1;
+        }
+        if (visit_bytecode(visitor, cursor->p, code_length) < 0) {
+            return -1;
+        }
+        cursor->p += code_length;
+        if (raw_u2(cursor, &count) < 0) {
+            return -1;
+        }
+        for (i = 0; i < count; i++) {
+            if ((raw_skip(cursor, 6) < 0) || (visit_raw_index(visitor, cursor) < 0)) {
+                return -1;
+            }
+        }
+        return visit_raw_attributes(visitor, cursor);
+    case ATTRIBUTE_STACK_MAP_TABLE:
+        return visit_stack_map_table(visitor, cursor);
+    case ATTRIBUTE_INNER_CLASSES:
+        if (raw_u2(cursor, &count) < 0) {
+            return -1;
+        }
+        for (i = 0; i < count; i++) {
+            if ((visit_raw_index(visitor, cursor) < 0) ||
+                (visit_raw_index(visitor, cursor) < 0) ||
+                (visit_raw_index(visitor, cursor) < 0) ||
+                (raw_skip(cursor, 2) < 0)) {
+                return -1;
+            }
+        }
+        return 0;
+    case ATTRIBUTE_ENCLOSING_METHOD:
+        if ((visit_raw_index(visitor, cursor) < 0) || (visit_raw_index(visitor, cursor) < 0)) {
+            return -1;
+        }
+        return 0;
+    case ATTRIBUTE_LOCAL_VARIABLE_TABLE:
+    case ATTRIBUTE_LOCAL_VARIABLE_TYPE_TABLE:
+        if (raw_u2(cursor, &count) < 0) {
+            return -1;
+        }
+        for (i = 0; i < count; i++) {
+            if ((raw_skip(cursor, 4) < 0) ||
+                (visit_raw_index(visitor, cursor) < 0) ||
+                (visit_raw_index(visitor, cursor) < 0) ||
+                (raw_skip(cursor, 2) < 0)) {
+                return -1;
+            }
+        }
+        return 0;
+    case ATTRIBUTE_RUNTIME_VISIBLE_ANNOTATIONS:
+    case ATTRIBUTE_RUNTIME_INVISIBLE_ANNOTATIONS:
+        return visit_annotations(visitor, cursor);
+    case ATTRIBUTE_RUNTIME_VISIBLE_PARAMETER_ANNOTATIONS:
+    case ATTRIBUTE_RUNTIME_INVISIBLE_PARAMETER_ANNOTATIONS:
+        if (raw_u1(cursor, &count1) < 0) {
+            return -1;
+        }
+        for (i = 0; i < count1; i++) {
+            if (visit_annotations(visitor, cursor) < 0) {
+                return -1;
+            }
+        }
+        return 0;
+    case ATTRIBUTE_RUNTIME_VISIBLE_TYPE_ANNOTATIONS:
+    case ATTRIBUTE_RUNTIME_INVISIBLE_TYPE_ANNOTATIONS:
+        if (raw_u2(cursor, &count) < 0) {
+            return -1;
+        }
+        for (i = 0; i < count; i++) {
+            if (visit_type_annotation(visitor, cursor) < 0) {
+                return -1;
+            }
+        }
+        return 0;
+    case ATTRIBUTE_ANNOTATION_DEFAULT:
+        return visit_element_value(visitor, cursor);
+    case ATTRIBUTE_BOOTSTRAP_METHODS:
+        if (raw_u2(cursor, &count) < 0) {
+            return -1;
+        }
+        for (i = 0; i < count; i++) {
+            if ((visit_raw_index(visitor, cursor) < 0) || (visit_raw_indexes(visitor, cursor) < 0)) {
+                return -1;
+            }
+        }
+        return 0;
+    case ATTRIBUTE_METHOD_PARAMETERS:
+        if (raw_u1(cursor, &count1) < 0) {
+            return -1;
+        }
+        for (i = 0; i < count1; i++) {
+            if ((visit_raw_index(visitor, cursor) < 0) || (raw_skip(cursor, 2) < 0)) {
+                return -1;
+            }
+        }
+        return 0;
+    case ATTRIBUTE_MODULE:
+        return visit_module(visitor, cursor);
+    case ATTRIBUTE_RECORD:
+        if (raw_u2(cursor, &count) < 0) {
+            return -1;
+        }
+        for (i = 0; i < count; i++) {
+            if ((visit_raw_index(visitor, cursor) < 0) ||
+                (visit_raw_index(visitor, cursor) < 0) ||
+                (visit_raw_attributes(visitor, cursor) < 0)) {
+                return -1;
+            }
+        }
+        return 0;
+    default:
+        return -1;
+    }
+}
+
+/* attributes nested in raw bytes: Code that was not decoded, and record components */
+static int visit_raw_attributes(cp_visitor_t *visitor, raw_cursor_t *cursor) {
+    u2_t count;
+    if ((visitor->depth > COMPACT_MAX_DEPTH) || (raw_u2(cursor, &count) < 0)) {
+        return -1;
+    }
+    int i;
+    for (i = 0; i < count; i++) {
+        if (cursor->end - cursor->p < 6) {
+            return -1;
+        }
+        u2_t name_index = (cursor->p[0] << 8) | cursor->p[1];
+        attribute_kind_t kind = attribute_kind(visitor->class_file, name_index);
+        if ((kind == ATTRIBUTE_UNKNOWN) || (visit_raw_index(visitor, cursor) < 0)) {
+            return -1;
+        }
+        u4_t length = ((u4_t) cursor->p[0] << 24) | (cursor->p[1] << 16) | (cursor->p[2] << 8) | cursor->p[3];
+        cursor->p += 4;
+        if ((u4_t) (cursor->end - cursor->p) < length) {
+            return -1;
+        }
+        visitor->depth++;
+        int result = visit_attribute_info(visitor, kind, cursor->p, length);
+        visitor->depth--;
+        if (result < 0) {
+            return -1;
+        }
+        cursor->p += length;
+    }
+    return 0;
+}
+
+static int visit_code(cp_visitor_t *visitor, code_attribute_t *code) {
+    if (visit_bytecode(visitor, code->code, code->code_length) < 0) {
+        return -1;
+    }
+    int i;
+    for (i = 0; i < code->exception_table_length; i++) {
+        if (visit_index(visitor, &code->exception_table[i].catch_type) < 0) {
+            return -1;
+        }
+    }
+    return visit_attributes(visitor, code->attributes_count, code->attributes);
+}
+
+static int visit_bytecode(cp_visitor_t *visitor, u1_t *code, u4_t code_length) {
+    u4_t pc = 0;
+    while (pc < code_length) {
+        int length = instruction_length(code, code_length, pc);
+        if (length < 0) {
+            fprintf(stderr, "%s: invalid instruction %#x at pc %u\n", program, code[pc], pc);
+            return -1;
+        }
+        raw_cursor_t operand = {code + pc + 1, code + pc + length};
+        u2_t index;
+
+        switch (code[pc]) {
+        case OPCODE_LDC:
+            index = code[pc + 1];
+            if (visit_index(visitor, &index) < 0) {
+                return -1;
+            }
+            code[pc + 1] = index;
+            break;
+        case OPCODE_LDC_W:
+        case OPCODE_LDC2_W:
+        case OPCODE_GETSTATIC:
+        case OPCODE_PUTSTATIC:
+        case OPCODE_GETFIELD:
+        case OPCODE_PUTFIELD:
+        case OPCODE_INVOKEVIRTUAL:
+        case OPCODE_INVOKESPECIAL:
+        case OPCODE_INVOKESTATIC:
+        case OPCODE_INVOKEINTERFACE:
+        case OPCODE_INVOKEDYNAMIC:
+        case OPCODE_NEW:
+        case OPCODE_ANEWARRAY:
+        case OPCODE_CHECKCAST:
+        case OPCODE_INSTANCEOF:
+        case OPCODE_MULTIANEWARRAY:
+            if (visit_raw_index(visitor, &operand) < 0) {
+                return -1;
+            }
+            break;
+        default:
+            break;
+        }
+        pc += length;
+    }
+    return 0;
+}
+
+static int visit_stack_map_table(cp_visitor_t *visitor, raw_cursor_t *cursor) {
+    u2_t count;
+    if (raw_u2(cursor, &count) < 0) {
+        return -1;
+    }
+    int i;
+    for (i = 0; i < count; i++) {
+        u1_t frame_type;
+        u2_t items;
+        if (raw_u1(cursor, &frame_type) < 0) {
+            return -1;
+        }
+        if (frame_type < 64) {
+            /* same_frame */
+        }
+        else if (frame_type < 128) {
+            if (visit_verification_types(visitor, cursor, 1) < 0) {
+                return -1;
+            }
+        }
+        else if (frame_type < 247) {
+            return -1;
+        }
+        else if (frame_type == 247) {
+            if ((raw_skip(cursor, 2) < 0) || (visit_verification_types(visitor, cursor, 1) < 0)) {
+                return -1;
+            }
+        }
+        else if (frame_type < 252) {
+            /* chop_frame, same_frame_extended */
+            if (raw_skip(cursor, 2) < 0) {
+                return -1;
+            }
+        }
+        else if (frame_type < 255) {
+            if ((raw_skip(cursor, 2) < 0) || (visit_verification_types(visitor, cursor, frame_type - 251) < 0)) {
+                return -1;
+            }
+        }
+        else {
+            if ((raw_skip(cursor, 2) < 0) ||
+                (raw_u2(cursor, &items) < 0) ||
+                (visit_verification_types(visitor, cursor, items) < 0) ||
+                (raw_u2(cursor, &items) < 0) ||
+                (visit_verification_types(visitor, cursor, items) < 0)) {
+                return -1;
+            }
+        }
+    }
+    return 0;
+}
+
+static int visit_verification_types(cp_visitor_t *visitor, raw_cursor_t *cursor, int count) {
+    int i;
+    for (i = 0; i < count; i++) {
+        u1_t tag;
+        if (raw_u1(cursor, &tag) < 0) {
+            return -1;
+        }
+        if (tag == 7) {
+            /* Object_variable_info */
+            if (visit_raw_index(visitor, cursor) < 0) {
+                return -1;
+            }
+        }
+        else if (tag == 8) {
+            /* Uninitialized_variable_info */
+            if (raw_skip(cursor, 2) < 0) {
+                return -1;
+            }
+        }
+        else if (tag > 8) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static int visit_annotations(cp_visitor_t *visitor, raw_cursor_t *cursor) {
+    u2_t count;
+    if (raw_u2(cursor, &count) < 0) {
+        return -1;
+    }
+    int i;
+    for (i = 0; i < count; i++) {
+        if (visit_annotation(visitor, cursor) < 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static int visit_annotation(cp_visitor_t *visitor, raw_cursor_t *cursor) {
+    u2_t pairs;
+    if ((visit_raw_index(visitor, cursor) < 0) || (raw_u2(cursor, &pairs) < 0)) {
+        return -1;
+    }
+    int i;
+    for (i = 0; i < pairs; i++) {
+        if ((visit_raw_index(visitor, cursor) < 0) || (visit_element_value(visitor, cursor) < 0)) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static int visit_element_value(cp_visitor_t *visitor, raw_cursor_t *cursor) {
+    u1_t tag;
+    u2_t count;
+    int result = 0;
+    int i;
+
+    if ((visitor->depth > COMPACT_MAX_DEPTH) || (raw_u1(cursor, &tag) < 0)) {
+        return -1;
+    }
+    switch (tag) {
+    case 'B': case 'C': case 'D': case 'F': case 'I': case 'J': case 'S': case 'Z': case 's':
+    case 'c':
+        return visit_raw_index(visitor, cursor);
+    case 'e':
+        if ((visit_raw_index(visitor, cursor) < 0) || (visit_raw_index(visitor, cursor) < 0)) {
+            return -1;
+        }
+        return 0;
+    case '@':
+        visitor->depth++;
+        result = visit_annotation(visitor, cursor);
+        visitor->depth--;
+        return result;
+    case '[':
+        if (raw_u2(cursor, &count) < 0) {
+            return -1;
+        }
+        visitor->depth++;
+        for (i = 0; (i < count) && (result == 0); i++) {
+            result = visit_element_value(visitor, cursor);
+        }
+        visitor->depth--;
+        return result;
+    default:
+        return -1;
+    }
+}
+
+static int visit_type_annotation(cp_visitor_t *visitor, raw_cursor_t *cursor) {
+    u1_t target_type;
+    u1_t path_length;
+    u2_t count;
+
+    if (raw_u1(cursor, &target_type) < 0) {
+        return -1;
+    }
+    switch (target_type) {
+    case 0x00: case 0x01: case 0x16:
+        if (raw_skip(cursor, 1) < 0) {
+            return -1;
+        }
+        break;
+    case 0x10: case 0x11: case 0x12: case 0x17: case 0x42:
+    case 0x43: case 0x44: case 0x45: case 0x46:
+        if (raw_skip(cursor, 2) < 0) {
+            return -1;
+        }
+        break;
+    case 0x13: case 0x14: case 0x15:
+        break;
+    case 0x40: case 0x41:
+        if ((raw_u2(cursor, &count) < 0) || (raw_skip(cursor, 6 * (u4_t) count) < 0)) {
+            return -1;
+        }
+        break;
+    case 0x47: case 0x48: case 0x49: case 0x4a: case 0x4b:
+        if (raw_skip(cursor, 3) < 0) {
+            return -1;
+        }
+        break;
+    default:
+        return -1;
+    }
+    if ((raw_u1(cursor, &path_length) < 0) || (raw_skip(cursor, 2 * (u4_t) path_length) < 0)) {
+        return -1;
+    }
+    return visit_annotation(visitor, cursor);
+}
+
+static int visit_module(cp_visitor_t *visitor, raw_cursor_t *cursor) {
+    u2_t count;
+    int i;
+
+    /* module_name_index, module_flags, module_version_index */
+    if ((visit_raw_index(visitor, cursor) < 0) ||
+        (raw_skip(cursor, 2) < 0) ||
+        (visit_raw_index(visitor, cursor) < 0)) {
+        return -1;
+    }
+    /* requires */
+    if (raw_u2(cursor, &count) < 0) {
+        return -1;
+    }
+    for (i = 0; i < count; i++) {
+        if ((visit_raw_index(visitor, cursor) < 0) ||
+            (raw_skip(cursor, 2) < 0) ||
+            (visit_raw_index(visitor, cursor) < 0)) {
+            return -1;
+        }
+    }
+    /* exports, then opens */
+    int table;
+    for (table = 0; table < 2; table++) {
+        if (raw_u2(cursor, &count) < 0) {
+            return -1;
+        }
+        for (i = 0; i < count; i++) {
+            if ((visit_raw_index(visitor, cursor) < 0) ||
+                (raw_skip(cursor, 2) < 0) ||
+                (visit_raw_indexes(visitor, cursor) < 0)) {
+                return -1;
+            }
+        }
+    }
+    /* uses */
+    if (visit_raw_indexes(visitor, cursor) < 0) {
+        return -1;
+    }
+    /* provides */
+    if (raw_u2(cursor, &count) < 0) {
+        return -1;
+    }
+    for (i = 0; i < count; i++) {
+        if ((visit_raw_index(visitor, cursor) < 0) || (visit_raw_indexes(visitor, cursor) < 0)) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/* index 0 means "none" wherever the format allows it and is skipped */
+static int visit_index(cp_visitor_t *visitor, u2_t *index) {
+    if (*index == 0) {
+        return 0;
+    }
+    if (visitor->new_index) {
+        *index = visitor->new_index[*index];
+        return 0;
+    }
+    return mark_entry(visitor, *index);
+}
+
+static int visit_raw_index(cp_visitor_t *visitor, raw_cursor_t *cursor) {
+    if (cursor->end - cursor->p < 2) {
+        return -1;
+    }
+    u2_t index = (cursor->p[0] << 8) | cursor->p[1];
+    if (visit_index(visitor, &index) < 0) {
+        return -1;
+    }
+    /* only the renumbering pass writes; marking leaves the source untouched */
+    if (visitor->new_index) {
+        cursor->p[0] = index >> 8;
+        cursor->p[1] = index;
+    }
+    cursor->p += 2;
+    return 0;
+}
+
+/* a u2 count followed by that many indexes */
+static int visit_raw_indexes(cp_visitor_t *visitor, raw_cursor_t *cursor) {
+    u2_t count;
+    if (raw_u2(cursor, &count) < 0) {
+        return -1;
+    }
+    int i;
+    for (i = 0; i < count; i++) {
+        if (visit_raw_index(visitor, cursor) < 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/* entries refer to each other at most four deep, so the recursion stays shallow */
+static int mark_entry(cp_visitor_t *visitor, u2_t index) {
+    class_file_t *class_file = visitor->class_file;
+    cp_info_t *entry = cp_entry(class_file, index);
+    if ((entry == NULL) || (entry->tag == 0)) {
+        fprintf(stderr, "%s: invalid constant pool index %u\n", program, index);
+        return -1;
+    }
+    if (visitor->marked[index]) {
+        return 0;
+    }
+    visitor->marked[index] = 1;
+
+    switch (entry->tag) {
+    case CONSTANT_CLASS:
+        return mark_entry(visitor, entry->u.cp_class_info.name_index);
+    case CONSTANT_FIELDREF:
+    case CONSTANT_METHODREF:
+    case CONSTANT_INTERFACE_METHODREF:
+        if (mark_entry(visitor, entry->u.cp_fieldref.class_index) < 0) {
+            return -1;
+        }
+        return mark_entry(visitor, entry->u.cp_fieldref.name_and_type_index);
+    case CONSTANT_STRING:
+        return mark_entry(visitor, entry->u.cp_string.name_index);
+    case CONSTANT_NAME_AND_TYPE:
+        if (mark_entry(visitor, entry->u.cp_name_and_type.name_index) < 0) {
+            return -1;
+        }
+        return mark_entry(visitor, entry->u.cp_name_and_type.descriptor_index);
+    case CONSTANT_METHOD_HANDLE:
+        return mark_entry(visitor, entry->u.cp_method_handle.reference_index);
+    case CONSTANT_METHOD_TYPE:
+        return mark_entry(visitor, entry->u.cp_method_type.descriptor_index);
+    case CONSTANT_DYNAMIC:
+    case CONSTANT_INVOKE_DYNAMIC:
+        return mark_entry(visitor, entry->u.cp_invoke_dynamic.name_and_type_index);
+    case CONSTANT_MODULE:
+    case CONSTANT_PACKAGE:
+        return mark_entry(visitor, entry->u.cp_module.name_index);
+    default:
+        return 0;
+    }
+}
+
+static void renumber_entry(cp_visitor_t *visitor, cp_info_t *constant_pool_element) {
+    u2_t *new_index = visitor->new_index;
+
+    switch (constant_pool_element->tag) {
+    case CONSTANT_CLASS:
+        constant_pool_element->u.cp_class_info.name_index = new_index[constant_pool_element->u.cp_class_info.name_index];
+        break;
+    case CONSTANT_FIELDREF:
+    case CONSTANT_METHODREF:
+    case CONSTANT_INTERFACE_METHODREF:
+        constant_pool_element->u.cp_fieldref.class_index = new_index[constant_pool_element->u.cp_fieldref.class_index];
+        constant_pool_element->u.cp_fieldref.name_and_type_index = new_index[constant_pool_element->u.cp_fieldref.name_and_type_index];
+        break;
+    case CONSTANT_STRING:
+        constant_pool_element->u.cp_string.name_index = new_index[constant_pool_element->u.cp_string.name_index];
+        break;
+    case CONSTANT_NAME_AND_TYPE:
+        constant_pool_element->u.cp_name_and_type.name_index = new_index[constant_pool_element->u.cp_name_and_type.name_index];
+        constant_pool_element->u.cp_name_and_type.descriptor_index = new_index[constant_pool_element->u.cp_name_and_type.descriptor_index];
+        break;
+    case CONSTANT_METHOD_HANDLE:
+        constant_pool_element->u.cp_method_handle.reference_index = new_index[constant_pool_element->u.cp_method_handle.reference_index];
+        break;
+    case CONSTANT_METHOD_TYPE:
+        constant_pool_element->u.cp_method_type.descriptor_index = new_index[constant_pool_element->u.cp_method_type.descriptor_index];
+        break;
+    case CONSTANT_DYNAMIC:
+    case CONSTANT_INVOKE_DYNAMIC:
+        constant_pool_element->u.cp_invoke_dynamic.name_and_type_index = new_index[constant_pool_element->u.cp_invoke_dynamic.name_and_type_index];
+        break;
+    case CONSTANT_MODULE:
+    case CONSTANT_PACKAGE:
+        constant_pool_element->u.cp_module.name_index = new_index[constant_pool_element->u.cp_module.name_index];
+        break;
+    default:
+        break;
+    }
+}
+
+static int raw_skip(raw_cursor_t *cursor, u4_t count) {
+    if ((u4_t) (cursor->end - cursor->p) < count) {
+        return -1;
+    }
+    cursor->p += count;
+    return 0;
+}
+
+static int raw_u1(raw_cursor_t *cursor, u1_t *value) {
+    if (cursor->p >= cursor->end) {
+        return -1;
+    }
+    *value = *cursor->p++;
+    return 0;
+}
+
+static int raw_u2(raw_cursor_t *cursor, u2_t *value) {
+    if (cursor->end - cursor->p < 2) {
+        return -1;
+    }
+    *value = (cursor->p[0] << 8) | cursor->p[1];
+    cursor->p += 2;
+    return 0;
+}
+
+static int compact_transform(class_file_t *class_file, void *context) {
+    (void) context;
+    return compact_class_file(class_file);
+}
+
+int compact_main(int ac, char **av) {
+    int level = 6;
+    int c;
+
+    while ((c = getopt(ac, av, "l:")) != -1) {
+        switch (c) {
+        case 'l':
+            level = atoi(optarg);
+            if ((level < 0) || (level > 9)) {
+                fprintf(stderr, "%s: compression level must be between 0 and 9\n", program);
+                return 1;
+            }
+            break;
+        default:
+            fprintf(stderr, "usage: %s compact [-l level] {input} {output}\n", program);
+            return 1;
+        }
+    }
+    if (ac - optind != 2) {
+        fprintf(stderr, "usage: %s compact [-l level] {input} {output}\n", program);
+        return 1;
+    }
+
+    return rewrite_file(av[optind], av[optind + 1], compact_transform, NULL, level) < 0;
+}
@@ -0,0 +1,425 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <limits.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+#include "cjdc.h"
+
+/*
+ * A corpus is every class in a set of class files, directories and jars,
+ * cut into jobs that threads claim one at a time: a class file, or a run
+ * of CORPUS_JAR_ENTRIES entries of a jar so that one big jar does not end
+ * up on one thread.  corpus_run() hands the bytes of each class to a
+ * visitor along with the calling thread's own context.
+ *
+ * Inputs are sniffed before they are read: a class file or a stored jar
+ * entry is checked from its first bytes, a class outside the major
+ * version range is skipped without being read or inflated (so is a
+ * META-INF/versions/N/ entry, by its name), and anything that turns out
+ * to be a jar, including a jar inside a jar, is read as one.  Names only
+ * pick which files of a directory are looked at.  A file that is not
+ * what it claims to be, or a jar that does not open, is reported and
+ * counted as unreadable; it never stops the run.
+ */
+
+#define CORPUS_JAR_ENTRIES      (256)
+#define CORPUS_MAX_NESTING      (4)
+
+typedef struct corpus_thread_s {
+    corpus_t *corpus;
+    corpus_visit_t visit;
+    void *context;
+} corpus_thread_t;
+
+static int add_directory(corpus_t *corpus, const char *path);
+static int add_file(corpus_t *corpus, const char *path);
+static int add_class_file(corpus_t *corpus, const char *path);
+static int add_jar_file(corpus_t *corpus, const char *path);
+static corpus_job_t *add_job(corpus_t *corpus);
+static void *corpus_worker(void *arg);
+static void run_job(corpus_thread_t *thread, corpus_job_t *job);
+static void run_jar_entries(corpus_thread_t *thread, jar_file_t *jar_file, u4_t first, u4_t count, int depth);
+static void run_nested_jar(corpus_thread_t *thread, jar_file_t *jar_file, jar_entry_t *entry, int depth);
+static int versioned_entry_in_range(corpus_t *corpus, jar_entry_t *entry);
+static void visit(corpus_thread_t *thread, u1_t *bytes, u4_t length, const char *name, int name_length);
+
+int corpus_add(corpus_t *corpus, const char *path) {
+    struct stat st;
+    if (stat(path, &st) < 0) {
+        fprintf(stderr, "%s: failed to stat '%s': %s\n", program, path, strerror(errno));
+        return -1;
+    }
+    if (S_ISDIR(st.st_mode)) {
+        return add_directory(corpus, path);
+    }
+    return add_file(corpus, path);
+}
+
+/* range is "min-max", "min-", "-max" or a single major version */
+int corpus_set_versions(corpus_t *corpus, const char *range) {
+    const char *dash = strchr(range, '-');
+    char *end;
+    long min = 0;
+    long max = 0xffff;
+    if (dash == NULL) {
+        min = max = strtol(range, &end, 10);
+    }
+    else {
+        if (dash > range) {
+            min = strtol(range, &end, 10);
+            if (end != dash) {
+                goto ERR_RETURN;
+            }
+        }
+        end = (char *) dash + 1;
+        if (dash[1]) {
+            max = strtol(dash + 1, &end, 10);
+        }
+    }
+    if ((*end != '\0') || (min < 0) || (max > 0xffff) || (min > max)) {
+        goto ERR_RETURN;
+    }
+    corpus->min_major = min;
+    corpus->max_major = max;
+    return 0;
+
+ERR_RETURN:
+    fprintf(stderr, "%s: bad major version range '%s'\n", program, range);
+    return -1;
+}
+
+/*
+ * Visits every class on threads threads; contexts holds one context per
+ * thread.  A class the visitor fails on is reported and counted in
+ * corpus->unreadable.
+ */
+int corpus_run(corpus_t *corpus, int threads, corpus_visit_t visit, void **contexts) {
+    if (threads < 1) {
+        threads = 1;
+    }
+    if (corpus->max_major == 0) {
+        corpus->max_major = 0xffff;
+    }
+    corpus_thread_t *states = calloc(threads, sizeof(corpus_thread_t));
+    pthread_t *workers = calloc(threads, sizeof(pthread_t));
+    if ((states == NULL) || (workers == NULL)) {
+        fprintf(stderr, "%s: failed to allocate %d threads\n", program, threads);
+        free(states);
+        free(workers);
+        return -1;
+    }
+    int i;
+    for (i = 0; i < threads; i++) {
+        states[i].corpus = corpus;
+        states[i].visit = visit;
+        states[i].context = contexts[i];
+    }
+    int started = 0;
+    while (started < threads) {
+        if (pthread_create(&workers[started], NULL, corpus_worker, &states[started]) != 0) {
+            break;
+        }
+        started++;
+    }
+    if (started == 0) {
+        /* no threads to be had, visit here */
+        corpus_worker(&states[0]);
+    }
+    for (i = 0; i < started; i++) {
+        pthread_join(workers[i], NULL);
+    }
+    free(states);
+    free(workers);
+    return 0;
+}
+
+void corpus_free(corpus_t *corpus) {
+    u4_t i;
+    for (i = 0; i < corpus->paths_count; i++) {
+        free(corpus->paths[i]);
+    }
+    free(corpus->paths);
+    for (i = 0; i < corpus->jar_files_count; i++) {
+        close_jar_file(corpus->jar_files[i]);
+    }
+    free(corpus->jar_files);
+    free(corpus->jobs);
+    memset(corpus, 0, sizeof(*corpus));
+}
+
+/* class files and jars anywhere below path */
+static int add_directory(corpus_t *corpus, const char *path) {
+    DIR *dir = opendir(path);
+    if (dir == NULL) {
+        fprintf(stderr, "%s: failed to open directory '%s': %s\n", program, path, strerror(errno));
+        return -1;
+    }
+    int result = 0;
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if ((strcmp(entry->d_name, ".") == 0) || (strcmp(entry->d_name, "..") == 0)) {
+            continue;
+        }
+        char child[PATH_MAX];
+        if (snprintf(child, sizeof(child), "%s/%s", path, entry->d_name) >= (int) sizeof(child)) {
+            fprintf(stderr, "%s: path '%s/%s' is too long\n", program, path, entry->d_name);
+            continue;
+        }
+        size_t length = strlen(entry->d_name);
+        int is_directory = (entry->d_type == DT_DIR);
+        if (entry->d_type == DT_UNKNOWN) {
+            struct stat st;
+            is_directory = (lstat(child, &st) == 0) && S_ISDIR(st.st_mode);
+        }
+        if (is_directory) {
+            result |= add_directory(corpus, child);
+        }
+        else if (has_suffix(entry->d_name, length, ".class") || has_suffix(entry->d_name, length, ".jar")) {
+            result |= add_file(corpus, child);
+        }
+    }
+    closedir(dir);
+    return result;
+}
+
+/* a jar is opened now so that its entries can be split into jobs, anything else is left for run_job() */
+static int add_file(corpus_t *corpus, const char *path) {
+    u1_t head[SNIFF_LENGTH];
+    ssize_t head_length = -1;
+    int fd = open(path, O_RDONLY);
+    if (fd >= 0) {
+        head_length = pread(fd, head, sizeof(head), 0);
+        close(fd);
+    }
+    if ((head_length > 0) && (sniff_input(head, head_length, 0, 0xffff) == INPUT_JAR)) {
+        return add_jar_file(corpus, path);
+    }
+    return add_class_file(corpus, path);
+}
+
+static int add_class_file(corpus_t *corpus, const char *path) {
+    if ((corpus->paths_count & (corpus->paths_count - 1)) == 0) {
+        char **paths = realloc(corpus->paths, (corpus->paths_count ? 2 * corpus->paths_count : 1) * sizeof(char *));
+        if (paths == NULL) {
+            fprintf(stderr, "%s: failed to grow the list of class files\n", program);
+            return -1;
+        }
+        corpus->paths = paths;
+    }
+    char *copy = strdup(path);
+    corpus_job_t *job = copy ? add_job(corpus) : NULL;
+    if (job == NULL) {
+        free(copy);
+        return -1;
+    }
+    corpus->paths[corpus->paths_count++] = copy;
+    job->path = copy;
+    return 0;
+}
+
+static int add_jar_file(corpus_t *corpus, const char *path) {
+    if ((corpus->jar_files_count & (corpus->jar_files_count - 1)) == 0) {
+        jar_file_t **jar_files = realloc(corpus->jar_files,
+                                         (corpus->jar_files_count ? 2 * corpus->jar_files_count : 1) * sizeof(jar_file_t *));
+        if (jar_files == NULL) {
+            fprintf(stderr, "%s: failed to grow the list of jars\n", program);
+            return -1;
+        }
+        corpus->jar_files = jar_files;
+    }
+    jar_file_t *jar_file = open_jar_file(path);
+    if (jar_file == NULL) {
+        fprintf(stderr, "%s: skipping unreadable jar '%s'\n", program, path);
+        corpus->unreadable++;
+        return 0;
+    }
+    corpus->jar_files[corpus->jar_files_count++] = jar_file;
+
+    u4_t first;
+    for (first = 0; first < jar_file->entries_count; first += CORPUS_JAR_ENTRIES) {
+        corpus_job_t *job = add_job(corpus);
+        if (job == NULL) {
+            return -1;
+        }
+        job->jar_file = jar_file;
+        job->first = first;
+        job->count = jar_file->entries_count - first;
+        if (job->count > CORPUS_JAR_ENTRIES) {
+            job->count = CORPUS_JAR_ENTRIES;
+        }
+    }
+    return 0;
+}
+
+static corpus_job_t *add_job(corpus_t *corpus) {
+    if (corpus->jobs_count == corpus->jobs_capacity) {
+        u4_t capacity = corpus->jobs_capacity ? 2 * corpus->jobs_capacity : 256;
+        corpus_job_t *jobs = realloc(corpus->jobs, capacity * sizeof(corpus_job_t));
+        if (jobs == NULL) {
+            fprintf(stderr, "%s: failed to grow the list of jobs to %u\n", program, capacity);
+            return NULL;
+        }
+        corpus->jobs = jobs;
+        corpus->jobs_capacity = capacity;
+    }
+    corpus_job_t *job = &corpus->jobs[corpus->jobs_count++];
+    memset(job, 0, sizeof(*job));
+    return job;
+}
+
+static void *corpus_worker(void *arg) {
+    corpus_thread_t *thread = arg;
+    corpus_t *corpus = thread->corpus;
+    for (;;) {
+        u4_t job = __atomic_fetch_add(&corpus->next_job, 1, __ATOMIC_RELAXED);
+        if (job >= corpus->jobs_count) {
+            return NULL;
+        }
+        run_job(thread, &corpus->jobs[job]);
+    }
+}
+
+static void run_job(corpus_thread_t *thread, corpus_job_t *job) {
+    corpus_t *corpus = thread->corpus;
+    u1_t head[SNIFF_LENGTH];
+    u4_t length;
+
+    if (job->jar_file) {
+        run_jar_entries(thread, job->jar_file, job->first, job->count, 0);
+        return;
+    }
+
+    int fd = open(job->path, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "%s: failed to open '%s': %s\n", program, job->path, strerror(errno));
+        visit(thread, NULL, 0, job->path, strlen(job->path));
+        return;
+    }
+    ssize_t head_length = pread(fd, head, sizeof(head), 0);
+    switch (sniff_input(head, head_length > 0 ? head_length : 0, corpus->min_major, corpus->max_major)) {
+    case INPUT_CLASS: {
+        u1_t *bytes = read_fd_bytes(fd, &length);
+        close(fd);
+        visit(thread, bytes, length, job->path, strlen(job->path));
+        return;
+    }
+    case INPUT_CLASS_OUT_OF_RANGE:
+        __atomic_fetch_add(&corpus->skipped, 1, __ATOMIC_RELAXED);
+        break;
+    case INPUT_JAR: {
+        jar_file_t *jar_file = open_jar_file(job->path);
+        if (jar_file == NULL) {
+            fprintf(stderr, "%s: skipping unreadable jar '%s'\n", program, job->path);
+            __atomic_fetch_add(&corpus->unreadable, 1, __ATOMIC_RELAXED);
+            break;
+        }
+        run_jar_entries(thread, jar_file, 0, jar_file->entries_count, 1);
+        close_jar_file(jar_file);
+        break;
+    }
+    default:
+        fprintf(stderr, "%s: '%s' is not a class file\n", program, job->path);
+        visit(thread, NULL, 0, job->path, strlen(job->path));
+        break;
+    }
+    close(fd);
+}
+
+static void run_jar_entries(corpus_thread_t *thread, jar_file_t *jar_file, u4_t first, u4_t count, int depth) {
+    corpus_t *corpus = thread->corpus;
+    u1_t head[SNIFF_LENGTH];
+    u4_t i;
+    for (i = first; i < first + count; i++) {
+        jar_entry_t *entry = &jar_file->entries[i];
+        if (has_suffix(entry->name, entry->name_length, ".jar")) {
+            run_nested_jar(thread, jar_file, entry, depth);
+            continue;
+        }
+        if (!is_class_entry(entry)) {
+            continue;
+        }
+        if (!versioned_entry_in_range(corpus, entry)) {
+            __atomic_fetch_add(&corpus->skipped, 1, __ATOMIC_RELAXED);
+            continue;
+        }
+        /* only the head is inflated until the entry sniffs as a class in range */
+        int head_length = read_jar_entry_head(jar_file, entry, head, sizeof(head));
+        u1_t *bytes = NULL;
+        if (head_length >= 0) {
+            input_kind_t kind = sniff_input(head, head_length, corpus->min_major, corpus->max_major);
+            if (kind == INPUT_CLASS_OUT_OF_RANGE) {
+                __atomic_fetch_add(&corpus->skipped, 1, __ATOMIC_RELAXED);
+                continue;
+            }
+            if (kind == INPUT_CLASS) {
+                bytes = read_jar_entry(jar_file, entry);
+            }
+            else {
+                fprintf(stderr, "%s: '%.*s' is not a class file\n", program, entry->name_length, entry->name);
+            }
+        }
+        visit(thread, bytes, entry->uncompressed_size, entry->name, entry->name_length);
+    }
+}
+
+/* a jar inside a jar is read into memory and run on this thread */
+static void run_nested_jar(corpus_thread_t *thread, jar_file_t *jar_file, jar_entry_t *entry, int depth) {
+    char name[PATH_MAX];
+    u1_t head[SNIFF_LENGTH];
+    if (depth >= CORPUS_MAX_NESTING) {
+        fprintf(stderr, "%s: skipping '%.*s', jars nested more than %d deep\n", program, entry->name_length, entry->name, CORPUS_MAX_NESTING);
+        return;
+    }
+    int head_length = read_jar_entry_head(jar_file, entry, head, sizeof(head));
+    if ((head_length >= 0) && (sniff_input(head, head_length, 0, 0xffff) != INPUT_JAR)) {
+        fprintf(stderr, "%s: skipping '%.*s', not a jar\n", program, entry->name_length, entry->name);
+        __atomic_fetch_add(&thread->corpus->unreadable, 1, __ATOMIC_RELAXED);
+        return;
+    }
+    snprintf(name, sizeof(name), "%.*s", entry->name_length, entry->name);
+    u1_t *bytes = (head_length >= 0) ? read_jar_entry(jar_file, entry) : NULL;
+    jar_file_t *nested = bytes ? open_jar_bytes(name, bytes, entry->uncompressed_size) : NULL;
+    if (nested == NULL) {
+        fprintf(stderr, "%s: skipping unreadable jar '%s'\n", program, name);
+        __atomic_fetch_add(&thread->corpus->unreadable, 1, __ATOMIC_RELAXED);
+        return;
+    }
+    run_jar_entries(thread, nested, 0, nested->entries_count, depth + 1);
+    close_jar_file(nested);
+}
+
+/* META-INF/versions/N/ holds classes for Java N, major version N + 44 */
+static int versioned_entry_in_range(corpus_t *corpus, jar_entry_t *entry) {
+    static const char prefix[] = "META-INF/versions/";
+    size_t prefix_length = sizeof(prefix) - 1;
+    if ((entry->name_length <= prefix_length) || (memcmp(entry->name, prefix, prefix_length) != 0)) {
+        return 1;
+    }
+    u4_t release = 0;
+    size_t i;
+    for (i = prefix_length; (i < entry->name_length) && (entry->name[i] >= '0') && (entry->name[i] <= '9'); i++) {
+        release = release * 10 + (entry->name[i] - '0');
+        if (release > 0xffff) {
+            return 1;
+        }
+    }
+    if ((i == prefix_length) || (i == entry->name_length) || (entry->name[i] != '/')) {
+        return 1;
+    }
+    return (release + 44 >= corpus->min_major) && (release + 44 <= corpus->max_major);
+}
+
+/* bytes of NULL counts the class as unreadable; frees bytes */
+static void visit(corpus_thread_t *thread, u1_t *bytes, u4_t length, const char *name, int name_length) {
+    if ((bytes == NULL) || (thread->visit(thread->context, bytes, length) < 0)) {
+        fprintf(stderr, "%s: skipping unreadable class '%.*s'\n", program, name_length, name);
+        __atomic_fetch_add(&thread->corpus->unreadable, 1, __ATOMIC_RELAXED);
+    }
+    free(bytes);
+}
@@ -0,0 +1,504 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "cjdc.h"
+
+/*
+ * cjdc deps lists the classes each class depends on, jdeps-style, read
+ * straight from the skimmed constant pool: Class entries, the
+ * descriptors of NameAndType and MethodType entries and of the class's
+ * own fields and methods, and Signature attributes.  Every name found is
+ * a span of the class bytes, so nothing is copied until the edges of a
+ * class are known.  Each thread keeps its own table of edges, and the
+ * tables are merged and sorted at the end.
+ */
+
+#define DEPS_UNNAMED_PACKAGE    "<unnamed>"
+
+typedef struct name_span_s {
+    const u1_t *bytes;
+    u2_t length;
+} name_span_t;
+
+typedef struct deps_worker_s {
+    int packages;               /* aggregate by package instead of by class */
+    table_t edges;              /* "from to" -> number of class edges */
+    name_span_t *names;         /* the current class's dependencies */
+    u4_t names_count;
+    u4_t names_capacity;
+    int names_failed;           /* add_name() could not grow names, set while scanning */
+    buffer_t key;
+} deps_worker_t;
+
+/* a descriptor or signature being scanned for class names */
+typedef struct signature_cursor_s {
+    const u1_t *bytes;
+    u2_t length;
+    u2_t position;
+} signature_cursor_t;
+
+static int deps_class(void *context, const u1_t *bytes, u4_t length);
+static int deps_attributes(deps_worker_t *worker, class_skim_t *skim);
+static int add_name(deps_worker_t *worker, const u1_t *bytes, u2_t length);
+static int add_class_entry_name(deps_worker_t *worker, const u1_t *bytes, u2_t length);
+static int add_signature(deps_worker_t *worker, class_skim_t *skim, u2_t index);
+static int scan_signature(deps_worker_t *worker, signature_cursor_t *cursor);
+static int scan_type_parameters(deps_worker_t *worker, signature_cursor_t *cursor);
+static int scan_type(deps_worker_t *worker, signature_cursor_t *cursor);
+static int scan_class_type(deps_worker_t *worker, signature_cursor_t *cursor);
+static int add_edge(deps_worker_t *worker, const u1_t *from, u2_t from_length, const u1_t *to, u2_t to_length);
+static u2_t package_length(const u1_t *name, u2_t length);
+static int compare_spans(const void *a, const void *b);
+static int compare_keys(const void *a, const void *b);
+
+static int deps_class(void *context, const u1_t *bytes, u4_t length) {
+    deps_worker_t *worker = context;
+    class_skim_t skim;
+    const u1_t *this_name;
+    const u1_t *name;
+    u2_t this_length;
+    u2_t name_length;
+    u2_t count;
+    u2_t descriptor_index;
+    u4_t i;
+
+    if (skim_class_bytes(&skim, bytes, length) < 0) {
+        return -1;
+    }
+    worker->names_count = 0;
+    worker->names_failed = 0;
+
+    for (i = 1; i < skim.constant_pool_count; i++) {
+        if (skim.constant_pool[i] == 0) {
+            continue;           /* second slot of a long or double */
+        }
+        const u1_t *entry = skim_entry(&skim, i);
+        switch (entry[0]) {
+        case CONSTANT_CLASS:
+            if (skim_utf8(&skim, (entry[1] << 8) | entry[2], &name, &name_length) < 0) {
+                goto ERR_RETURN;
+            }
+            if (add_class_entry_name(worker, name, name_length) < 0) {
+                goto ERR_RETURN;
+            }
+            break;
+        case CONSTANT_NAME_AND_TYPE:
+            if (add_signature(worker, &skim, (entry[3] << 8) | entry[4]) < 0) {
+                goto ERR_RETURN;
+            }
+            break;
+        case CONSTANT_METHOD_TYPE:
+            if (add_signature(worker, &skim, (entry[1] << 8) | entry[2]) < 0) {
+                goto ERR_RETURN;
+            }
+            break;
+        default:
+            break;
+        }
+    }
+
+    if ((skim_this_class(&skim, &this_name, &this_length) < 0) ||
+        (skim_u2(&skim, &count) < 0) ||
+        (skim_skip(&skim, 2 * (u4_t) count) < 0)) {
+        goto ERR_RETURN;
+    }
+    int members;
+    for (members = 0; members < 2; members++) {
+        if (skim_u2(&skim, &count) < 0) {
+            goto ERR_RETURN;
+        }
+        for (i = 0; i < count; i++) {
+            if ((skim_skip(&skim, 4) < 0) ||
+                (skim_u2(&skim, &descriptor_index) < 0) ||
+                (add_signature(worker, &skim, descriptor_index) < 0) ||
+                (deps_attributes(worker, &skim) < 0)) {
+                goto ERR_RETURN;
+            }
+        }
+    }
+    if (deps_attributes(worker, &skim) < 0) {
+        goto ERR_RETURN;
+    }
+
+    qsort(worker->names, worker->names_count, sizeof(name_span_t), compare_spans);
+    for (i = 0; i < worker->names_count; i++) {
+        name_span_t *span = &worker->names[i];
+        if (((i > 0) && (compare_spans(span, span - 1) == 0)) ||
+            ((span->length == this_length) && (memcmp(span->bytes, this_name, this_length) == 0))) {
+            continue;
+        }
+        if (add_edge(worker, this_name, this_length, span->bytes, span->length) < 0) {
+            goto ERR_RETURN;
+        }
+    }
+    skim_free(&skim);
+    return 0;
+
+ERR_RETURN:
+    skim_free(&skim);
+    return -1;
+}
+
+/* only Signature attributes name classes that the constant pool walk has not seen */
+static int deps_attributes(deps_worker_t *worker, class_skim_t *skim) {
+    u2_t count;
+    u2_t i;
+    if (skim_u2(skim, &count) < 0) {
+        return -1;
+    }
+    for (i = 0; i < count; i++) {
+        u2_t name_index;
+        u2_t signature_index;
+        u4_t length;
+        if ((skim_u2(skim, &name_index) < 0) || (skim_u4(skim, &length) < 0)) {
+            return -1;
+        }
+        if ((length == 2) && skim_utf8_is(skim, name_index, "Signature")) {
+            if ((skim_u2(skim, &signature_index) < 0) ||
+                (add_signature(worker, skim, signature_index) < 0)) {
+                return -1;
+            }
+        }
+        else if (skim_skip(skim, length) < 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static int add_name(deps_worker_t *worker, const u1_t *bytes, u2_t length) {
+    if (length == 0) {
+        return 0;
+    }
+    if (worker->names_count == worker->names_capacity) {
+        u4_t capacity = worker->names_capacity ? 2 * worker->names_capacity : 256;
+        name_span_t *names = realloc(worker->names, capacity * sizeof(name_span_t));
+        if (names == NULL) {
+            fprintf(stderr, "%s: failed to grow the list of names to %u\n", program, capacity);
+            worker->names_failed = 1;
+            return -1;
+        }
+        worker->names = names;
+        worker->names_capacity = capacity;
+    }
+    worker->names[worker->names_count].bytes = bytes;
+    worker->names[worker->names_count].length = length;
+    worker->names_count++;
+    return 0;
+}
+
+/* a Class entry holds a plain name or, for arrays, a descriptor */
+static int add_class_entry_name(deps_worker_t *worker, const u1_t *bytes, u2_t length) {
+    if ((length > 0) && (bytes[0] == '[')) {
+        signature_cursor_t cursor = {bytes, length, 0};
+        scan_type(worker, &cursor);
+        return worker->names_failed ? -1 : 0;
+    }
+    return add_name(worker, bytes, length);
+}
+
+/*
+ * A malformed descriptor or signature contributes what was found before
+ * the error; only running out of memory fails the class.
+ */
+static int add_signature(deps_worker_t *worker, class_skim_t *skim, u2_t index) {
+    signature_cursor_t cursor;
+    if (skim_utf8(skim, index, &cursor.bytes, &cursor.length) < 0) {
+        return 0;
+    }
+    cursor.position = 0;
+    scan_signature(worker, &cursor);
+    return worker->names_failed ? -1 : 0;
+}
+
+/*
+ * Field and method descriptors and the three kinds of signatures share
+ * enough of their grammar to be scanned alike: optional type parameters,
+ * then types, with "(", ")", "^" and "V" in between for methods.
+ */
+static int scan_signature(deps_worker_t *worker, signature_cursor_t *cursor) {
+    if ((cursor->length > 0) && (cursor->bytes[0] == '<') && (scan_type_parameters(worker, cursor) < 0)) {
+        return -1;
+    }
+    while (cursor->position < cursor->length) {
+        u1_t c = cursor->bytes[cursor->position];
+        if ((c == '(') || (c == ')') || (c == '^') || (c == 'V')) {
+            cursor->position++;
+        }
+        else if (scan_type(worker, cursor) < 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/* <T:Ljava/lang/Object;U::Ljava/lang/Comparable<TU;>;> */
+static int scan_type_parameters(deps_worker_t *worker, signature_cursor_t *cursor) {
+    cursor->position++;
+    while ((cursor->position < cursor->length) && (cursor->bytes[cursor->position] != '>')) {
+        while ((cursor->position < cursor->length) && (cursor->bytes[cursor->position] != ':')) {
+            cursor->position++;
+        }
+        while ((cursor->position < cursor->length) && (cursor->bytes[cursor->position] == ':')) {
+            cursor->position++;
+            if ((cursor->position < cursor->length) &&
+                (cursor->bytes[cursor->position] != ':') && (cursor->bytes[cursor->position] != '>') &&
+                (scan_type(worker, cursor) < 0)) {
+                return -1;
+            }
+        }
+    }
+    if (cursor->position >= cursor->length) {
+        return -1;
+    }
+    cursor->position++;
+    return 0;
+}
+
+static int scan_type(deps_worker_t *worker, signature_cursor_t *cursor) {
+    while ((cursor->position < cursor->length) && (cursor->bytes[cursor->position] == '[')) {
+        cursor->position++;
+    }
+    if (cursor->position >= cursor->length) {
+        return -1;
+    }
+    switch (cursor->bytes[cursor->position]) {
+    case 'B':
+    case 'C':
+    case 'D':
+    case 'F':
+    case 'I':
+    case 'J':
+    case 'S':
+    case 'Z':
+        cursor->position++;
+        return 0;
+    case 'T':
+        /* a type variable */
+        while ((cursor->position < cursor->length) && (cursor->bytes[cursor->position] != ';')) {
+            cursor->position++;
+        }
+        if (cursor->position >= cursor->length) {
+            return -1;
+        }
+        cursor->position++;
+        return 0;
+    case 'L':
+        return scan_class_type(worker, cursor);
+    default:
+        return -1;
+    }
+}
+
+/*
+ * Lpkg/Outer<TT;>.Inner<...>;  Only the outermost name is taken from a
+ * nested generic type; the inner class has a Class entry of its own in
+ * any class that uses it.
+ */
+static int scan_class_type(deps_worker_t *worker, signature_cursor_t *cursor) {
+    u2_t start = ++cursor->position;
+    while ((cursor->position < cursor->length) &&
+           (cursor->bytes[cursor->position] != ';') &&
+           (cursor->bytes[cursor->position] != '<') &&
+           (cursor->bytes[cursor->position] != '.')) {
+        cursor->position++;
+    }
+    if ((cursor->position >= cursor->length) ||
+        (add_name(worker, cursor->bytes + start, cursor->position - start) < 0)) {
+        return -1;
+    }
+    for (;;) {
+        if (cursor->position >= cursor->length) {
+            return -1;
+        }
+        u1_t c = cursor->bytes[cursor->position];
+        if (c == ';') {
+            cursor->position++;
+            return 0;
+        }
+        if (c == '<') {
+            cursor->position++;
+            while ((cursor->position < cursor->length) && (cursor->bytes[cursor->position] != '>')) {
+                c = cursor->bytes[cursor->position];
+                if (c == '*') {
+                    cursor->position++;
+                    continue;
+                }
+                if ((c == '+') || (c == '-')) {
+                    cursor->position++;
+                }
+                if (scan_type(worker, cursor) < 0) {
+                    return -1;
+                }
+            }
+            cursor->position++;
+        }
+        else {
+            /* '.' and the simple name of an inner class, or part of one */
+            cursor->position++;
+        }
+    }
+}
+
+static int add_edge(deps_worker_t *worker, const u1_t *from, u2_t from_length, const u1_t *to, u2_t to_length) {
+    worker->key.length = 0;
+    if (worker->packages) {
+        u2_t from_package = package_length(from, from_length);
+        u2_t to_package = package_length(to, to_length);
+        if ((from_package == to_package) && (memcmp(from, to, from_package) == 0)) {
+            return 0;
+        }
+        if ((buffer_printf(&worker->key, "%.*s %.*s",
+                           from_package ? from_package : (int) strlen(DEPS_UNNAMED_PACKAGE),
+                           from_package ? (const char *) from : DEPS_UNNAMED_PACKAGE,
+                           to_package ? to_package : (int) strlen(DEPS_UNNAMED_PACKAGE),
+                           to_package ? (const char *) to : DEPS_UNNAMED_PACKAGE) < 0)) {
+            return -1;
+        }
+    }
+    else if (buffer_printf(&worker->key, "%.*s %.*s", from_length, from, to_length, to) < 0) {
+        return -1;
+    }
+    void **slot = table_insert(&worker->edges, worker->key.data, worker->key.length);
+    if (slot == NULL) {
+        return -1;
+    }
+    *slot = (void *) ((uintptr_t) *slot + 1);
+    return 0;
+}
+
+/* the length of the package part of an internal name, 0 for the unnamed package */
+static u2_t package_length(const u1_t *name, u2_t length) {
+    while (length > 0) {
+        if (name[--length] == '/') {
+            return length;
+        }
+    }
+    return 0;
+}
+
+static int compare_spans(const void *a, const void *b) {
+    const name_span_t *x = a;
+    const name_span_t *y = b;
+    int order = memcmp(x->bytes, y->bytes, (x->length < y->length) ? x->length : y->length);
+    if (order) {
+        return order;
+    }
+    return (int) x->length - (int) y->length;
+}
+
+static int compare_keys(const void *a, const void *b) {
+    return strcmp((*(table_entry_t * const *) a)->key, (*(table_entry_t * const *) b)->key);
+}
+
+int deps_main(int ac, char **av) {
+    corpus_t corpus;
+    int threads = sysconf(_SC_NPROCESSORS_ONLN);
+    int packages = 0;
+    int result = 1;
+    int c;
+    int i;
+
+    memset(&corpus, 0, sizeof(corpus));
+    while ((c = getopt(ac, av, "j:pV:")) != -1) {
+        switch (c) {
+        case 'j':
+            threads = atoi(optarg);
+            break;
+        case 'p':
+            packages = 1;
+            break;
+        case 'V':
+            if (corpus_set_versions(&corpus, optarg) < 0) {
+                return 1;
+            }
+            break;
+        default:
+            fprintf(stderr, "usage: %s deps [-p] [-j threads] [-V versions] {.class-file|directory|jar}...\n", program);
+            return 1;
+        }
+    }
+    if (optind >= ac) {
+        fprintf(stderr, "usage: %s deps [-p] [-j threads] [-V versions] {.class-file|directory|jar}...\n", program);
+        return 1;
+    }
+    if (threads < 1) {
+        threads = 1;
+    }
+
+    table_entry_t **sorted = NULL;
+    deps_worker_t *workers = calloc(threads, sizeof(deps_worker_t));
+    void **contexts = calloc(threads, sizeof(void *));
+    if ((workers == NULL) || (contexts == NULL)) {
+        fprintf(stderr, "%s: failed to allocate %d workers\n", program, threads);
+        goto RETURN;
+    }
+    for (i = optind; i < ac; i++) {
+        if (corpus_add(&corpus, av[i]) < 0) {
+            goto RETURN;
+        }
+    }
+    for (i = 0; i < threads; i++) {
+        workers[i].packages = packages;
+        contexts[i] = &workers[i];
+    }
+    if (corpus_run(&corpus, threads, deps_class, contexts) < 0) {
+        goto RETURN;
+    }
+
+    /* a class found in more than one place adds its edges once per copy */
+    table_t *edges = &workers[0].edges;
+    for (i = 1; i < threads; i++) {
+        size_t j;
+        for (j = 0; j < workers[i].edges.capacity; j++) {
+            table_entry_t *entry = &workers[i].edges.entries[j];
+            if (entry->key) {
+                void **slot = table_insert(edges, entry->key, entry->key_length);
+                if (slot == NULL) {
+                    goto RETURN;
+                }
+                *slot = (void *) ((uintptr_t) *slot + (uintptr_t) entry->value);
+            }
+        }
+        table_free(&workers[i].edges, NULL);
+    }
+
+    sorted = malloc((edges->count ? edges->count : 1) * sizeof(table_entry_t *));
+    if (sorted == NULL) {
+        fprintf(stderr, "%s: failed to sort %zu edges\n", program, edges->count);
+        goto RETURN;
+    }
+    size_t count = 0;
+    size_t j;
+    for (j = 0; j < edges->capacity; j++) {
+        if (edges->entries[j].key) {
+            sorted[count++] = &edges->entries[j];
+        }
+    }
+    qsort(sorted, count, sizeof(table_entry_t *), compare_keys);
+    for (j = 0; j < count; j++) {
+        if (packages) {
+            printf("%s %llu\n", sorted[j]->key, (unsigned long long) (uintptr_t) sorted[j]->value);
+        }
+        else {
+            printf("%s\n", sorted[j]->key);
+        }
+    }
+    result = corpus.unreadable ? 1 : 0;
+
+RETURN:
+    free(sorted);
+    if (workers) {
+        for (i = 0; i < threads; i++) {
+            table_free(&workers[i].edges, NULL);
+            free(workers[i].names);
+            buffer_free(&workers[i].key);
+        }
+    }
+    free(workers);
+    free(contexts);
+    corpus_free(&corpus);
+    return result;
+}
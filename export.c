@@ -0,0 +1,742 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <limits.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include <zlib.h>
+
+#include "cjdc.h"
+
+/*
+ * cjdc export writes the metadata of every class of a classpath as five
+ * column files: classes, fields, methods, constants and references (the
+ * Fieldref, Methodref and InterfaceMethodref entries, resolved).  The
+ * format is described with column_file_header_t in cjdc.h.
+ *
+ * Classes are skimmed, never decoded.  Each thread appends rows to its
+ * own column buffers and, once a table has EXPORT_CHUNK_ROWS rows or
+ * EXPORT_CHUNK_BYTES of strings, encodes them as one chunk: string
+ * columns get a dictionary of their own per chunk, every column is
+ * deflated on its own, and the chunk is written with a single pwrite at
+ * an offset claimed atomically, so threads never wait on each other.
+ * Rows of a class always land in one chunk per table, and the rows of a
+ * class that turns out to be malformed are dropped.
+ */
+
+#define EXPORT_CHUNK_ROWS       (64 * 1024)
+#define EXPORT_CHUNK_BYTES      (16 * 1024 * 1024)
+
+enum {
+    EXPORT_CLASSES,
+    EXPORT_FIELDS,
+    EXPORT_METHODS,
+    EXPORT_CONSTANTS,
+    EXPORT_REFERENCES,
+    EXPORT_TABLES_COUNT
+};
+
+typedef struct export_column_s {
+    const char *name;
+    u4_t type;
+} export_column_t;
+
+typedef struct export_table_s {
+    const char *file_name;
+    const export_column_t *columns;
+    int columns_count;
+} export_table_t;
+
+/* rows are appended in column order, see export_class() */
+static const export_column_t class_columns[] = {
+    {"id", COLUMN_U4},
+    {"name", COLUMN_STRING},
+    {"super", COLUMN_STRING},
+    {"access_flags", COLUMN_U2},
+    {"major_version", COLUMN_U2},
+    {"minor_version", COLUMN_U2},
+    {"constants_count", COLUMN_U2},
+    {"interfaces_count", COLUMN_U2},
+    {"fields_count", COLUMN_U2},
+    {"methods_count", COLUMN_U2},
+    {"length", COLUMN_U4},
+};
+
+static const export_column_t field_columns[] = {
+    {"class", COLUMN_U4},
+    {"name", COLUMN_STRING},
+    {"descriptor", COLUMN_STRING},
+    {"access_flags", COLUMN_U2},
+};
+
+/* code_length is 0 for a method without code */
+static const export_column_t method_columns[] = {
+    {"class", COLUMN_U4},
+    {"name", COLUMN_STRING},
+    {"descriptor", COLUMN_STRING},
+    {"access_flags", COLUMN_U2},
+    {"max_stack", COLUMN_U2},
+    {"max_locals", COLUMN_U2},
+    {"code_length", COLUMN_U4},
+};
+
+/* the operands of an entry as they are in the class; number holds the bits of a float or double */
+static const export_column_t constant_columns[] = {
+    {"class", COLUMN_U4},
+    {"index", COLUMN_U2},
+    {"tag", COLUMN_U1},
+    {"operand1", COLUMN_U2},
+    {"operand2", COLUMN_U2},
+    {"number", COLUMN_I64},
+    {"text", COLUMN_STRING},
+};
+
+static const export_column_t reference_columns[] = {
+    {"class", COLUMN_U4},
+    {"tag", COLUMN_U1},
+    {"owner", COLUMN_STRING},
+    {"name", COLUMN_STRING},
+    {"descriptor", COLUMN_STRING},
+};
+
+#define COLUMNS(columns)    columns, (int) (sizeof(columns) / sizeof(columns[0]))
+
+static const export_table_t export_tables[EXPORT_TABLES_COUNT] = {
+    {"classes.col", COLUMNS(class_columns)},
+    {"fields.col", COLUMNS(field_columns)},
+    {"methods.col", COLUMNS(method_columns)},
+    {"constants.col", COLUMNS(constant_columns)},
+    {"references.col", COLUMNS(reference_columns)},
+};
+
+typedef struct export_s {
+    int fds[EXPORT_TABLES_COUNT];
+    off_t offsets[EXPORT_TABLES_COUNT];     /* claimed atomically by the writers */
+    int level;
+    u4_t next_class;
+    int failed;
+} export_t;
+
+typedef struct column_buffer_s {
+    u4_t type;
+    buffer_t values;
+    table_t dictionary;         /* string -> code + 1 */
+    buffer_t strings;
+    buffer_t ends;              /* u4 end offset of each string */
+    u4_t strings_count;
+    size_t mark;                /* values.length before the current class */
+} column_buffer_t;
+
+typedef struct table_buffer_s {
+    u4_t rows;
+    u4_t mark;                  /* rows before the current class */
+    column_buffer_t *columns;
+} table_buffer_t;
+
+typedef struct export_worker_s {
+    export_t *export;
+    table_buffer_t tables[EXPORT_TABLES_COUNT];
+    buffer_t raw;
+    buffer_t chunk;
+} export_worker_t;
+
+static int export_class(void *context, const u1_t *bytes, u4_t length);
+static int export_constants(export_worker_t *worker, class_skim_t *skim, u4_t id);
+static int export_members(export_worker_t *worker, class_skim_t *skim, u4_t id, int methods, u2_t *count);
+static int put_number(column_buffer_t *column, uint64_t value);
+static int put_string(column_buffer_t *column, const u1_t *bytes, u4_t length);
+static void mark_tables(export_worker_t *worker);
+static void rollback_tables(export_worker_t *worker);
+static int table_is_full(table_buffer_t *table, int columns_count);
+static int flush_table(export_worker_t *worker, int t);
+static int put_column_data(export_worker_t *worker, const u1_t *raw, size_t raw_length);
+static int open_column_file(const char *directory, const export_table_t *table);
+static int init_worker(export_worker_t *worker, export_t *export);
+static void free_worker(export_worker_t *worker);
+
+static int export_class(void *context, const u1_t *bytes, u4_t length) {
+    export_worker_t *worker = context;
+    table_buffer_t *classes = &worker->tables[EXPORT_CLASSES];
+    class_skim_t skim;
+    const u1_t *name;
+    const u1_t *super_name = (const u1_t *) "";
+    u2_t name_length;
+    u2_t super_length = 0;
+    u2_t access_flags;
+    u2_t this_class;
+    u2_t super_class;
+    u2_t interfaces_count;
+    u2_t fields_count;
+    u2_t methods_count;
+    int t;
+
+    if (skim_class_bytes(&skim, bytes, length) < 0) {
+        return -1;
+    }
+    mark_tables(worker);
+    u4_t id = __atomic_fetch_add(&worker->export->next_class, 1, __ATOMIC_RELAXED);
+    if ((export_constants(worker, &skim, id) < 0) ||
+        (skim_u2(&skim, &access_flags) < 0) ||
+        (skim_u2(&skim, &this_class) < 0) ||
+        (skim_class_name(&skim, this_class, &name, &name_length) < 0) ||
+        (skim_u2(&skim, &super_class) < 0) ||
+        (super_class && (skim_class_name(&skim, super_class, &super_name, &super_length) < 0)) ||
+        (skim_u2(&skim, &interfaces_count) < 0) ||
+        (skim_skip(&skim, 2 * (u4_t) interfaces_count) < 0) ||
+        (export_members(worker, &skim, id, 0, &fields_count) < 0) ||
+        (export_members(worker, &skim, id, 1, &methods_count) < 0)) {
+        goto ERR_RETURN;
+    }
+
+    column_buffer_t *column = classes->columns;
+    if ((put_number(column++, id) < 0) ||
+        (put_string(column++, name, name_length) < 0) ||
+        (put_string(column++, super_name, super_length) < 0) ||
+        (put_number(column++, access_flags) < 0) ||
+        (put_number(column++, skim.major_version) < 0) ||
+        (put_number(column++, skim.minor_version) < 0) ||
+        (put_number(column++, skim.constant_pool_count) < 0) ||
+        (put_number(column++, interfaces_count) < 0) ||
+        (put_number(column++, fields_count) < 0) ||
+        (put_number(column++, methods_count) < 0) ||
+        (put_number(column++, length) < 0)) {
+        goto ERR_RETURN;
+    }
+    classes->rows++;
+    skim_free(&skim);
+
+    for (t = 0; t < EXPORT_TABLES_COUNT; t++) {
+        if (table_is_full(&worker->tables[t], export_tables[t].columns_count) &&
+            (flush_table(worker, t) < 0)) {
+            worker->export->failed = 1;
+        }
+    }
+    return 0;
+
+ERR_RETURN:
+    rollback_tables(worker);
+    skim_free(&skim);
+    return -1;
+}
+
+/* rows for the constants table, and for the references table from the member references */
+static int export_constants(export_worker_t *worker, class_skim_t *skim, u4_t id) {
+    table_buffer_t *constants = &worker->tables[EXPORT_CONSTANTS];
+    table_buffer_t *references = &worker->tables[EXPORT_REFERENCES];
+    u4_t i;
+
+    for (i = 1; i < skim->constant_pool_count; i++) {
+        if (skim->constant_pool[i] == 0) {
+            continue;           /* second slot of a long or double */
+        }
+        const u1_t *entry = skim_entry(skim, i);
+        const u1_t *text = (const u1_t *) "";
+        u4_t text_length = 0;
+        u2_t operand1 = 0;
+        u2_t operand2 = 0;
+        uint64_t number = 0;
+        switch (entry[0]) {
+        case CONSTANT_UTF8:
+            text = entry + 3;
+            text_length = (entry[1] << 8) | entry[2];
+            break;
+        case CONSTANT_INTEGER:
+            number = (int64_t) (int32_t) (((u4_t) entry[1] << 24) | (entry[2] << 16) | (entry[3] << 8) | entry[4]);
+            break;
+        case CONSTANT_FLOAT:
+            number = ((u4_t) entry[1] << 24) | (entry[2] << 16) | (entry[3] << 8) | entry[4];
+            break;
+        case CONSTANT_LONG:
+        case CONSTANT_DOUBLE: {
+            int j;
+            for (j = 1; j <= 8; j++) {
+                number = (number << 8) | entry[j];
+            }
+            break;
+        }
+        case CONSTANT_CLASS:
+        case CONSTANT_STRING:
+        case CONSTANT_METHOD_TYPE:
+        case CONSTANT_MODULE:
+        case CONSTANT_PACKAGE:
+            operand1 = (entry[1] << 8) | entry[2];
+            break;
+        case CONSTANT_METHOD_HANDLE:
+            operand1 = entry[1];
+            operand2 = (entry[2] << 8) | entry[3];
+            break;
+        default:
+            operand1 = (entry[1] << 8) | entry[2];
+            operand2 = (entry[3] << 8) | entry[4];
+            break;
+        }
+
+        column_buffer_t *column = constants->columns;
+        if ((put_number(column++, id) < 0) ||
+            (put_number(column++, i) < 0) ||
+            (put_number(column++, entry[0]) < 0) ||
+            (put_number(column++, operand1) < 0) ||
+            (put_number(column++, operand2) < 0) ||
+            (put_number(column++, number) < 0) ||
+            (put_string(column++, text, text_length) < 0)) {
+            return -1;
+        }
+        constants->rows++;
+
+        if ((entry[0] == CONSTANT_FIELDREF) || (entry[0] == CONSTANT_METHODREF) ||
+            (entry[0] == CONSTANT_INTERFACE_METHODREF)) {
+            const u1_t *owner;
+            const u1_t *name;
+            const u1_t *descriptor;
+            u2_t owner_length;
+            u2_t name_length;
+            u2_t descriptor_length;
+            const u1_t *name_and_type = skim_entry(skim, operand2);
+            if ((name_and_type == NULL) || (name_and_type[0] != CONSTANT_NAME_AND_TYPE)) {
+                fprintf(stderr, "%s: constant pool index %u is not a NameAndType entry\n", program, operand2);
+                return -1;
+            }
+            if ((skim_class_name(skim, operand1, &owner, &owner_length) < 0) ||
+                (skim_utf8(skim, (name_and_type[1] << 8) | name_and_type[2], &name, &name_length) < 0) ||
+                (skim_utf8(skim, (name_and_type[3] << 8) | name_and_type[4], &descriptor, &descriptor_length) < 0)) {
+                return -1;
+            }
+            column = references->columns;
+            if ((put_number(column++, id) < 0) ||
+                (put_number(column++, entry[0]) < 0) ||
+                (put_string(column++, owner, owner_length) < 0) ||
+                (put_string(column++, name, name_length) < 0) ||
+                (put_string(column++, descriptor, descriptor_length) < 0)) {
+                return -1;
+            }
+            references->rows++;
+        }
+    }
+    return 0;
+}
+
+static int export_members(export_worker_t *worker, class_skim_t *skim, u4_t id, int methods, u2_t *count) {
+    table_buffer_t *table = &worker->tables[methods ? EXPORT_METHODS : EXPORT_FIELDS];
+    u2_t i;
+
+    if (skim_u2(skim, count) < 0) {
+        return -1;
+    }
+    for (i = 0; i < *count; i++) {
+        const u1_t *name;
+        const u1_t *descriptor;
+        u2_t name_length;
+        u2_t descriptor_length;
+        u2_t access_flags;
+        u2_t name_index;
+        u2_t descriptor_index;
+        u2_t attributes_count;
+        u2_t max_stack = 0;
+        u2_t max_locals = 0;
+        u4_t code_length = 0;
+        u2_t j;
+
+        if ((skim_u2(skim, &access_flags) < 0) ||
+            (skim_u2(skim, &name_index) < 0) ||
+            (skim_u2(skim, &descriptor_index) < 0) ||
+            (skim_utf8(skim, name_index, &name, &name_length) < 0) ||
+            (skim_utf8(skim, descriptor_index, &descriptor, &descriptor_length) < 0) ||
+            (skim_u2(skim, &attributes_count) < 0)) {
+            return -1;
+        }
+        for (j = 0; j < attributes_count; j++) {
+            u2_t attribute_name_index;
+            u4_t length;
+            if ((skim_u2(skim, &attribute_name_index) < 0) || (skim_u4(skim, &length) < 0)) {
+                return -1;
+            }
+            if (methods && (length >= 8) && skim_utf8_is(skim, attribute_name_index, "Code")) {
+                if ((skim_u2(skim, &max_stack) < 0) ||
+                    (skim_u2(skim, &max_locals) < 0) ||
+                    (skim_u4(skim, &code_length) < 0)) {
+                    return -1;
+                }
+                length -= 8;
+            }
+            if (skim_skip(skim, length) < 0) {
+                return -1;
+            }
+        }
+
+        column_buffer_t *column = table->columns;
+        if ((put_number(column++, id) < 0) ||
+            (put_string(column++, name, name_length) < 0) ||
+            (put_string(column++, descriptor, descriptor_length) < 0) ||
+            (put_number(column++, access_flags) < 0)) {
+            return -1;
+        }
+        if (methods &&
+            ((put_number(column++, max_stack) < 0) ||
+             (put_number(column++, max_locals) < 0) ||
+             (put_number(column++, code_length) < 0))) {
+            return -1;
+        }
+        table->rows++;
+    }
+    return 0;
+}
+
+static int put_number(column_buffer_t *column, uint64_t value) {
+    u1_t u1 = value;
+    u2_t u2 = value;
+    u4_t u4 = value;
+    switch (column->type) {
+    case COLUMN_U1:
+        return buffer_put_bytes(&column->values, &u1, sizeof(u1));
+    case COLUMN_U2:
+        return buffer_put_bytes(&column->values, &u2, sizeof(u2));
+    case COLUMN_U4:
+        return buffer_put_bytes(&column->values, &u4, sizeof(u4));
+    default:
+        return buffer_put_bytes(&column->values, &value, sizeof(value));
+    }
+}
+
+/* appends the string's code, adding it to the chunk's dictionary on first use */
+static int put_string(column_buffer_t *column, const u1_t *bytes, u4_t length) {
+    void **slot = table_insert(&column->dictionary, bytes, length);
+    if (slot == NULL) {
+        return -1;
+    }
+    if (*slot == NULL) {
+        if (buffer_put_bytes(&column->strings, bytes, length) < 0) {
+            return -1;
+        }
+        u4_t end = column->strings.length;
+        if (buffer_put_bytes(&column->ends, &end, sizeof(end)) < 0) {
+            return -1;
+        }
+        *slot = (void *) (uintptr_t) ++column->strings_count;
+    }
+    u4_t code = (uintptr_t) *slot - 1;
+    return buffer_put_bytes(&column->values, &code, sizeof(code));
+}
+
+static void mark_tables(export_worker_t *worker) {
+    int t;
+    int c;
+    for (t = 0; t < EXPORT_TABLES_COUNT; t++) {
+        table_buffer_t *table = &worker->tables[t];
+        table->mark = table->rows;
+        for (c = 0; c < export_tables[t].columns_count; c++) {
+            table->columns[c].mark = table->columns[c].values.length;
+        }
+    }
+}
+
+/* strings the dropped rows added stay in the dictionaries, unused */
+static void rollback_tables(export_worker_t *worker) {
+    int t;
+    int c;
+    for (t = 0; t < EXPORT_TABLES_COUNT; t++) {
+        table_buffer_t *table = &worker->tables[t];
+        table->rows = table->mark;
+        for (c = 0; c < export_tables[t].columns_count; c++) {
+            table->columns[c].values.length = table->columns[c].mark;
+        }
+    }
+}
+
+static int table_is_full(table_buffer_t *table, int columns_count) {
+    int c;
+    if (table->rows >= EXPORT_CHUNK_ROWS) {
+        return 1;
+    }
+    for (c = 0; c < columns_count; c++) {
+        if (table->columns[c].strings.length >= EXPORT_CHUNK_BYTES) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/* encodes the buffered rows of table t as one chunk and writes it */
+static int flush_table(export_worker_t *worker, int t) {
+    table_buffer_t *table = &worker->tables[t];
+    column_chunk_header_t header;
+    int c;
+
+    if (table->rows == 0) {
+        return 0;
+    }
+    worker->chunk.length = 0;
+    memset(&header, 0, sizeof(header));
+    if (buffer_put_bytes(&worker->chunk, &header, sizeof(header)) < 0) {
+        return -1;
+    }
+    for (c = 0; c < export_tables[t].columns_count; c++) {
+        column_buffer_t *column = &table->columns[c];
+        if (column->type != COLUMN_STRING) {
+            if (put_column_data(worker, column->values.data, column->values.length) < 0) {
+                return -1;
+            }
+            continue;
+        }
+        u4_t start = 0;
+        worker->raw.length = 0;
+        if ((buffer_put_bytes(&worker->raw, column->values.data, column->values.length) < 0) ||
+            (buffer_put_bytes(&worker->raw, &column->strings_count, sizeof(u4_t)) < 0) ||
+            (buffer_put_bytes(&worker->raw, &start, sizeof(start)) < 0) ||
+            (buffer_put_bytes(&worker->raw, column->ends.data, column->ends.length) < 0) ||
+            (buffer_put_bytes(&worker->raw, column->strings.data, column->strings.length) < 0) ||
+            (put_column_data(worker, worker->raw.data, worker->raw.length) < 0)) {
+            return -1;
+        }
+    }
+    if (worker->chunk.length > UINT32_MAX) {
+        fprintf(stderr, "%s: chunk of %zu bytes is too large\n", program, worker->chunk.length);
+        return -1;
+    }
+    header.rows = table->rows;
+    header.length = worker->chunk.length - sizeof(header);
+    memcpy(worker->chunk.data, &header, sizeof(header));
+
+    export_t *export = worker->export;
+    off_t offset = __atomic_fetch_add(&export->offsets[t], (off_t) worker->chunk.length, __ATOMIC_RELAXED);
+    if (write_fully_at(export->fds[t], worker->chunk.data, worker->chunk.length, offset) < 0) {
+        return -1;
+    }
+
+    table->rows = 0;
+    for (c = 0; c < export_tables[t].columns_count; c++) {
+        column_buffer_t *column = &table->columns[c];
+        column->values.length = 0;
+        if (column->type == COLUMN_STRING) {
+            table_free(&column->dictionary, NULL);
+            column->strings.length = 0;
+            column->ends.length = 0;
+            column->strings_count = 0;
+        }
+    }
+    return 0;
+}
+
+/* one column of a chunk, deflated unless that does not make it smaller */
+static int put_column_data(export_worker_t *worker, const u1_t *raw, size_t raw_length) {
+    static const u1_t padding[8];
+    column_data_header_t header;
+    buffer_t *chunk = &worker->chunk;
+    int level = worker->export->level;
+
+    memset(&header, 0, sizeof(header));
+    header.codec = COLUMN_STORED;
+    header.length = raw_length;
+    header.raw_length = raw_length;
+    uLong bound = level ? deflateBound(NULL, raw_length) : raw_length;
+    if (buffer_reserve(chunk, sizeof(header) + (bound > raw_length ? bound : raw_length) + sizeof(padding)) < 0) {
+        return -1;
+    }
+    size_t header_offset = chunk->length;
+    u1_t *data = chunk->data + header_offset + sizeof(header);
+    if (level && raw_length) {
+        z_stream stream;
+        memset(&stream, 0, sizeof(stream));
+        if (deflateInit2(&stream, level, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+            fprintf(stderr, "%s: failed to initialize deflate\n", program);
+            return -1;
+        }
+        stream.next_in = (u1_t *) raw;
+        stream.avail_in = raw_length;
+        stream.next_out = data;
+        stream.avail_out = bound;
+        int rc = deflate(&stream, Z_FINISH);
+        u4_t compressed_length = stream.total_out;
+        deflateEnd(&stream);
+        if (rc != Z_STREAM_END) {
+            fprintf(stderr, "%s: failed to deflate a column of %zu bytes\n", program, raw_length);
+            return -1;
+        }
+        if (compressed_length < raw_length) {
+            header.codec = COLUMN_DEFLATED;
+            header.length = compressed_length;
+        }
+    }
+    if (header.codec == COLUMN_STORED) {
+        memcpy(data, raw, raw_length);
+    }
+    memcpy(chunk->data + header_offset, &header, sizeof(header));
+    chunk->length += sizeof(header) + header.length;
+    return buffer_put_bytes(chunk, padding, (8 - header.length % 8) % 8);
+}
+
+static int open_column_file(const char *directory, const export_table_t *table) {
+    char path[PATH_MAX];
+    if (snprintf(path, sizeof(path), "%s/%s", directory, table->file_name) >= (int) sizeof(path)) {
+        fprintf(stderr, "%s: path '%s/%s' is too long\n", program, directory, table->file_name);
+        return -1;
+    }
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        fprintf(stderr, "%s: failed to create '%s': %s\n", program, path, strerror(errno));
+        return -1;
+    }
+
+    column_file_header_t header;
+    column_info_t columns[16];
+    int c;
+    memset(&header, 0, sizeof(header));
+    memset(columns, 0, sizeof(columns));
+    header.magic = COLUMN_FILE_MAGIC;
+    header.version = COLUMN_FILE_VERSION;
+    header.columns_count = table->columns_count;
+    for (c = 0; c < table->columns_count; c++) {
+        columns[c].type = table->columns[c].type;
+        strncpy(columns[c].name, table->columns[c].name, sizeof(columns[c].name) - 1);
+    }
+    if ((write_fully_at(fd, &header, sizeof(header), 0) < 0) ||
+        (write_fully_at(fd, columns, table->columns_count * sizeof(column_info_t), sizeof(header)) < 0)) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static int init_worker(export_worker_t *worker, export_t *export) {
+    int t;
+    int c;
+    worker->export = export;
+    for (t = 0; t < EXPORT_TABLES_COUNT; t++) {
+        worker->tables[t].columns = calloc(export_tables[t].columns_count, sizeof(column_buffer_t));
+        if (worker->tables[t].columns == NULL) {
+            fprintf(stderr, "%s: failed to allocate the columns of '%s'\n", program, export_tables[t].file_name);
+            return -1;
+        }
+        for (c = 0; c < export_tables[t].columns_count; c++) {
+            worker->tables[t].columns[c].type = export_tables[t].columns[c].type;
+        }
+    }
+    return 0;
+}
+
+static void free_worker(export_worker_t *worker) {
+    int t;
+    int c;
+    for (t = 0; t < EXPORT_TABLES_COUNT; t++) {
+        column_buffer_t *columns = worker->tables[t].columns;
+        if (columns == NULL) {
+            continue;
+        }
+        for (c = 0; c < export_tables[t].columns_count; c++) {
+            buffer_free(&columns[c].values);
+            table_free(&columns[c].dictionary, NULL);
+            buffer_free(&columns[c].strings);
+            buffer_free(&columns[c].ends);
+        }
+        free(columns);
+    }
+    buffer_free(&worker->raw);
+    buffer_free(&worker->chunk);
+}
+
+int export_main(int ac, char **av) {
+    export_t export;
+    corpus_t corpus;
+    int threads = sysconf(_SC_NPROCESSORS_ONLN);
+    int result = 1;
+    int c;
+    int i;
+    int t;
+
+    memset(&export, 0, sizeof(export));
+    export.level = 1;
+    memset(&corpus, 0, sizeof(corpus));
+    while ((c = getopt(ac, av, "j:l:V:")) != -1) {
+        switch (c) {
+        case 'j':
+            threads = atoi(optarg);
+            break;
+        case 'l':
+            export.level = atoi(optarg);
+            if ((export.level < 0) || (export.level > 9)) {
+                fprintf(stderr, "%s: compression level must be between 0 and 9\n", program);
+                return 1;
+            }
+            break;
+        case 'V':
+            if (corpus_set_versions(&corpus, optarg) < 0) {
+                return 1;
+            }
+            break;
+        default:
+            fprintf(stderr, "usage: %s export [-j threads] [-l level] [-V versions] {directory} {.class-file|directory|jar}...\n", program);
+            return 1;
+        }
+    }
+    if (ac - optind < 2) {
+        fprintf(stderr, "usage: %s export [-j threads] [-l level] [-V versions] {directory} {.class-file|directory|jar}...\n", program);
+        return 1;
+    }
+    if (threads < 1) {
+        threads = 1;
+    }
+
+    const char *directory = av[optind];
+    for (t = 0; t < EXPORT_TABLES_COUNT; t++) {
+        export.fds[t] = -1;
+    }
+    export_worker_t *workers = calloc(threads, sizeof(export_worker_t));
+    void **contexts = calloc(threads, sizeof(void *));
+    if ((workers == NULL) || (contexts == NULL)) {
+        fprintf(stderr, "%s: failed to allocate %d workers\n", program, threads);
+        goto RETURN;
+    }
+    for (i = optind + 1; i < ac; i++) {
+        if (corpus_add(&corpus, av[i]) < 0) {
+            goto RETURN;
+        }
+    }
+    if ((mkdir(directory, 0755) < 0) && (errno != EEXIST)) {
+        fprintf(stderr, "%s: failed to create directory '%s': %s\n", program, directory, strerror(errno));
+        goto RETURN;
+    }
+    for (t = 0; t < EXPORT_TABLES_COUNT; t++) {
+        export.fds[t] = open_column_file(directory, &export_tables[t]);
+        if (export.fds[t] < 0) {
+            goto RETURN;
+        }
+        export.offsets[t] = sizeof(column_file_header_t) + export_tables[t].columns_count * sizeof(column_info_t);
+    }
+    for (i = 0; i < threads; i++) {
+        if (init_worker(&workers[i], &export) < 0) {
+            goto RETURN;
+        }
+        contexts[i] = &workers[i];
+    }
+    if (corpus_run(&corpus, threads, export_class, contexts) < 0) {
+        goto RETURN;
+    }
+    for (i = 0; i < threads; i++) {
+        for (t = 0; t < EXPORT_TABLES_COUNT; t++) {
+            if (flush_table(&workers[i], t) < 0) {
+                export.failed = 1;
+            }
+        }
+    }
+    if (!export.failed) {
+        result = corpus.unreadable ? 1 : 0;
+    }
+
+RETURN:
+    for (t = 0; t < EXPORT_TABLES_COUNT; t++) {
+        if ((export.fds[t] >= 0) && (close(export.fds[t]) < 0)) {
+            fprintf(stderr, "%s: failed to close '%s/%s': %s\n", program, directory, export_tables[t].file_name, strerror(errno));
+            result = 1;
+        }
+    }
+    if (workers) {
+        for (i = 0; i < threads; i++) {
+            free_worker(&workers[i]);
+        }
+    }
+    free(workers);
+    free(contexts);
+    corpus_free(&corpus);
+    return result;
+}
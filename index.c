@@ -0,0 +1,813 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <limits.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#include "cjdc.h"
+
+/*
+ * Classpath symbol table: maps the binary name of every class on a
+ * classpath (this_class, not the entry name) to its jar and the offset
+ * of its local header.
+ *
+ * Lookups go through a minimal perfect hash built with hash-and-displace:
+ * the name hash picks a bucket, the bucket's displacement picks the slot,
+ * so a lookup reads one displacement and one slot before comparing the
+ * name.  A bucket holding a single class stores its slot directly as a
+ * negative displacement.
+ *
+ * Jars are scanned in parallel, one jar per job.  When the index file
+ * already exists, jars whose size and mtime have not changed are not
+ * opened again; their classes are taken from the old index.  Earlier
+ * jars on the classpath win over later ones, as with the JVM; the classes
+ * they hide are kept in a separate table that lookups never see, so that
+ * they come back when the jar hiding them changes.
+ */
+#define INDEX_HASH_GOLDEN       (0x9e3779b97f4a7c15ULL)
+#define INDEX_MAX_DISPLACEMENT  (1 << 24)
+
+typedef struct index_class_s {
+    const u1_t *name;
+    u4_t name_offset;           /* into the container's names until the jobs are done */
+    u2_t name_length;
+    u4_t container;
+    u4_t offset;
+    uint64_t hash;
+} index_class_t;
+
+typedef struct index_container_s {
+    char *path;
+    int64_t size;
+    int64_t mtime_sec;
+    u4_t mtime_nsec;
+    const u1_t *names_base;     /* old index strings, or names.data */
+    buffer_t names;
+    index_class_t *classes;
+    u4_t classes_count;
+    u4_t classes_capacity;
+    int reused;
+    int result;
+} index_container_t;
+
+typedef struct index_build_s {
+    index_container_t *containers;
+    u4_t containers_count;
+    u4_t *jobs;                 /* containers that have to be scanned */
+    u4_t jobs_count;
+    u4_t next_job;
+} index_build_t;
+
+static int stat_container(index_container_t *container, const char *file_name);
+static void reuse_containers(index_build_t *build, class_index_t *old_index);
+static int scan_containers(index_build_t *build, int threads);
+static void *scan_worker(void *arg);
+static int scan_container(index_container_t *container);
+static int add_class(index_container_t *container, u4_t name_offset, u2_t name_length, u4_t offset);
+static index_class_t *collect_classes(index_build_t *build, u4_t *count);
+static int remove_duplicates(index_class_t *classes, u4_t count, u4_t *kept);
+static int build_perfect_hash(index_class_t *classes, u4_t count, int32_t *displacements, u4_t *slot_of);
+static int write_class_index(const char *index_file_name, index_build_t *build, index_class_t *classes, u4_t count, u4_t shadowed_count);
+static void free_build(index_build_t *build);
+
+static uint64_t index_hash(const u1_t *bytes, size_t length);
+static uint64_t index_mix(uint64_t x);
+static u4_t index_slot(uint64_t hash, int32_t displacement, u4_t count);
+
+class_index_t *open_class_index(const char *index_file_name) {
+    class_index_t *index = calloc(1, sizeof(class_index_t));
+    if (index == NULL) {
+        fprintf(stderr, "%s: failed to malloc %zu bytes.\n", program, sizeof(class_index_t));
+        return NULL;
+    }
+    int fd = open(index_file_name, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "%s: failed to open '%s': %s.\n", program, index_file_name, strerror(errno));
+        goto ERR_RETURN;
+    }
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        fprintf(stderr, "%s: failed to stat '%s': %s.\n", program, index_file_name, strerror(errno));
+        close(fd);
+        goto ERR_RETURN;
+    }
+    if ((st.st_size < (off_t) sizeof(class_index_header_t)) || (st.st_size > UINT32_MAX)) {
+        fprintf(stderr, "%s: '%s' is not a class index\n", program, index_file_name);
+        close(fd);
+        goto ERR_RETURN;
+    }
+    index->size = st.st_size;
+    index->map = mmap(NULL, index->size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (index->map == MAP_FAILED) {
+        index->map = NULL;
+        fprintf(stderr, "%s: failed to map '%s': %s.\n", program, index_file_name, strerror(errno));
+        goto ERR_RETURN;
+    }
+
+    class_index_header_t *header = (class_index_header_t *) index->map;
+    if ((header->magic != CLASS_INDEX_MAGIC) || (header->version != CLASS_INDEX_VERSION)) {
+        fprintf(stderr, "%s: '%s' is not a class index of version %d\n", program, index_file_name, CLASS_INDEX_VERSION);
+        goto ERR_RETURN;
+    }
+    uint64_t size = index->size;
+    if (((uint64_t) header->containers_offset + (uint64_t) header->containers_count * sizeof(class_index_container_t) > size) ||
+        ((uint64_t) header->displacements_offset + (uint64_t) header->classes_count * sizeof(int32_t) > size) ||
+        ((uint64_t) header->slots_offset + (uint64_t) header->classes_count * sizeof(class_index_slot_t) > size) ||
+        ((uint64_t) header->shadowed_offset + (uint64_t) header->shadowed_count * sizeof(class_index_slot_t) > size) ||
+        ((uint64_t) header->strings_offset + header->strings_length > size) ||
+        (header->containers_offset % 8) || (header->displacements_offset % 4) || (header->slots_offset % 4) || (header->shadowed_offset % 4)) {
+        fprintf(stderr, "%s: '%s' is a corrupt class index\n", program, index_file_name);
+        goto ERR_RETURN;
+    }
+    index->header = header;
+    index->containers = (class_index_container_t *) (index->map + header->containers_offset);
+    index->displacements = (int32_t *) (index->map + header->displacements_offset);
+    index->slots = (class_index_slot_t *) (index->map + header->slots_offset);
+    index->shadowed = (class_index_slot_t *) (index->map + header->shadowed_offset);
+    index->strings = (const char *) index->map + header->strings_offset;
+    return index;
+
+ERR_RETURN:
+    close_class_index(index);
+    return NULL;
+}
+
+void close_class_index(class_index_t *index) {
+    if (index == NULL) {
+        return;
+    }
+    if (index->map) {
+        munmap(index->map, index->size);
+    }
+    free(index);
+}
+
+/* NULL when the class is not on the classpath */
+class_index_slot_t *class_index_lookup(class_index_t *index, const char *name, size_t length) {
+    u4_t count = index->header->classes_count;
+    if ((count == 0) || (length > 0xffff)) {
+        return NULL;
+    }
+    uint64_t hash = index_hash((const u1_t *) name, length);
+    int32_t displacement = index->displacements[hash % count];
+    if (displacement == 0) {
+        return NULL;
+    }
+    u4_t slot = index_slot(hash, displacement, count);
+    if (slot >= count) {
+        return NULL;
+    }
+    class_index_slot_t *result = &index->slots[slot];
+    if ((result->name_length != length) ||
+        ((uint64_t) result->name_offset + length > index->header->strings_length) ||
+        (memcmp(index->strings + result->name_offset, name, length) != 0)) {
+        return NULL;
+    }
+    return result;
+}
+
+static int stat_container(index_container_t *container, const char *file_name) {
+    char path[PATH_MAX];
+    struct stat st;
+
+    if (realpath(file_name, path) == NULL) {
+        fprintf(stderr, "%s: failed to resolve '%s': %s.\n", program, file_name, strerror(errno));
+        return -1;
+    }
+    if (stat(path, &st) < 0) {
+        fprintf(stderr, "%s: failed to stat '%s': %s.\n", program, path, strerror(errno));
+        return -1;
+    }
+    container->path = strdup(path);
+    if (container->path == NULL) {
+        fprintf(stderr, "%s: failed to copy path '%s'\n", program, path);
+        return -1;
+    }
+    container->size = st.st_size;
+    container->mtime_sec = st.st_mtim.tv_sec;
+    container->mtime_nsec = st.st_mtim.tv_nsec;
+    return 0;
+}
+
+/* takes the classes of unchanged jars from the old index, queues the rest */
+static void reuse_containers(index_build_t *build, class_index_t *old_index) {
+    u4_t *old_to_new = NULL;
+    u4_t i;
+
+    if (old_index) {
+        u4_t old_count = old_index->header->containers_count;
+        old_to_new = malloc((old_count ? old_count : 1) * sizeof(u4_t));
+        if (old_to_new == NULL) {
+            old_index = NULL;
+        }
+        else {
+            for (i = 0; i < old_count; i++) {
+                old_to_new[i] = UINT32_MAX;
+            }
+        }
+    }
+    for (i = 0; old_index && (i < build->containers_count); i++) {
+        index_container_t *container = &build->containers[i];
+        size_t length = strlen(container->path);
+        u4_t j;
+        for (j = 0; j < old_index->header->containers_count; j++) {
+            class_index_container_t *old = &old_index->containers[j];
+            if ((old->name_length == length) &&
+                ((uint64_t) old->name_offset + length <= old_index->header->strings_length) &&
+                (memcmp(old_index->strings + old->name_offset, container->path, length) == 0) &&
+                (old->size == container->size) &&
+                (old->mtime_sec == container->mtime_sec) &&
+                (old->mtime_nsec == container->mtime_nsec) &&
+                (old_to_new[j] == UINT32_MAX)) {
+                old_to_new[j] = i;
+                container->reused = 1;
+                container->names_base = (const u1_t *) old_index->strings;
+                break;
+            }
+        }
+    }
+    u4_t slots_count = old_index ? old_index->header->classes_count : 0;
+    u4_t shadowed_count = old_index ? old_index->header->shadowed_count : 0;
+    if (old_index) {
+        for (i = 0; i < slots_count + shadowed_count; i++) {
+            class_index_slot_t *slot = (i < slots_count) ? &old_index->slots[i] : &old_index->shadowed[i - slots_count];
+            if ((slot->container >= old_index->header->containers_count) ||
+                (old_to_new[slot->container] == UINT32_MAX) ||
+                ((uint64_t) slot->name_offset + slot->name_length > old_index->header->strings_length)) {
+                continue;
+            }
+            index_container_t *container = &build->containers[old_to_new[slot->container]];
+            if (add_class(container, slot->name_offset, slot->name_length, slot->offset) < 0) {
+                container->reused = 0;
+            }
+        }
+    }
+    free(old_to_new);
+
+    for (i = 0; i < build->containers_count; i++) {
+        index_container_t *container = &build->containers[i];
+        if (!container->reused) {
+            container->classes_count = 0;
+            container->names_base = NULL;
+            build->jobs[build->jobs_count++] = i;
+        }
+    }
+}
+
+static int scan_containers(index_build_t *build, int threads) {
+    if (threads > (int) build->jobs_count) {
+        threads = build->jobs_count;
+    }
+    pthread_t *workers = calloc(threads ? threads : 1, sizeof(pthread_t));
+    if (workers == NULL) {
+        fprintf(stderr, "%s: failed to allocate %d threads\n", program, threads);
+        return -1;
+    }
+    int started = 0;
+    while (started < threads) {
+        if (pthread_create(&workers[started], NULL, scan_worker, build) != 0) {
+            break;
+        }
+        started++;
+    }
+    if ((started == 0) && build->jobs_count) {
+        /* no threads to be had, scan here */
+        scan_worker(build);
+    }
+    int i;
+    for (i = 0; i < started; i++) {
+        pthread_join(workers[i], NULL);
+    }
+    free(workers);
+
+    int result = 0;
+    u4_t j;
+    for (j = 0; j < build->jobs_count; j++) {
+        index_container_t *container = &build->containers[build->jobs[j]];
+        if (container->result < 0) {
+            result = -1;
+        }
+        container->names_base = container->names.data;
+    }
+    return result;
+}
+
+static void *scan_worker(void *arg) {
+    index_build_t *build = arg;
+    for (;;) {
+        u4_t job = __atomic_fetch_add(&build->next_job, 1, __ATOMIC_RELAXED);
+        if (job >= build->jobs_count) {
+            return NULL;
+        }
+        index_container_t *container = &build->containers[build->jobs[job]];
+        container->result = scan_container(container);
+    }
+}
+
+/* versioned classes under META-INF/ would shadow the base ones, so they are left out */
+static int scan_container(index_container_t *container) {
+    jar_file_t *jar_file = open_jar_file(container->path);
+    if (jar_file == NULL) {
+        return -1;
+    }
+    int result = 0;
+    u4_t i;
+    for (i = 0; (i < jar_file->entries_count) && (result == 0); i++) {
+        jar_entry_t *entry = &jar_file->entries[i];
+        if (!is_class_entry(entry) ||
+            ((entry->name_length >= 9) && (memcmp(entry->name, "META-INF/", 9) == 0))) {
+            continue;
+        }
+        u1_t *bytes = read_jar_entry(jar_file, entry);
+        class_skim_t skim;
+        const u1_t *name;
+        u2_t name_length;
+        if ((bytes == NULL) || (skim_class_bytes(&skim, bytes, entry->uncompressed_size) < 0)) {
+            fprintf(stderr, "%s: skipping unreadable class '%.*s' in '%s'\n", program, entry->name_length, entry->name, container->path);
+            free(bytes);
+            continue;
+        }
+        if (skim_this_class(&skim, &name, &name_length) < 0) {
+            fprintf(stderr, "%s: skipping class '%.*s' without a name in '%s'\n", program, entry->name_length, entry->name, container->path);
+        }
+        else if (buffer_put_bytes(&container->names, name, name_length) < 0) {
+            result = -1;
+        }
+        else {
+            result = add_class(container, container->names.length - name_length, name_length, entry->local_header_offset);
+        }
+        skim_free(&skim);
+        free(bytes);
+    }
+    close_jar_file(jar_file);
+    return result;
+}
+
+static int add_class(index_container_t *container, u4_t name_offset, u2_t name_length, u4_t offset) {
+    if (container->classes_count == container->classes_capacity) {
+        u4_t capacity = container->classes_capacity ? 2 * container->classes_capacity : 64;
+        index_class_t *classes = realloc(container->classes, capacity * sizeof(index_class_t));
+        if (classes == NULL) {
+            fprintf(stderr, "%s: failed to allocate %u classes\n", program, capacity);
+            return -1;
+        }
+        container->classes = classes;
+        container->classes_capacity = capacity;
+    }
+    index_class_t *class = &container->classes[container->classes_count++];
+    memset(class, 0, sizeof(*class));
+    class->name_offset = name_offset;
+    class->name_length = name_length;
+    class->offset = offset;
+    return 0;
+}
+
+/* all classes in classpath order, with names resolved and hashed */
+static index_class_t *collect_classes(index_build_t *build, u4_t *count) {
+    size_t total = 0;
+    u4_t i;
+    for (i = 0; i < build->containers_count; i++) {
+        total += build->containers[i].classes_count;
+    }
+    if (total >= INT32_MAX) {
+        fprintf(stderr, "%s: %zu classes are too many for one index\n", program, total);
+        return NULL;
+    }
+    index_class_t *classes = malloc((total ? total : 1) * sizeof(index_class_t));
+    if (classes == NULL) {
+        fprintf(stderr, "%s: failed to allocate %zu classes\n", program, total);
+        return NULL;
+    }
+    u4_t n = 0;
+    for (i = 0; i < build->containers_count; i++) {
+        index_container_t *container = &build->containers[i];
+        u4_t j;
+        for (j = 0; j < container->classes_count; j++) {
+            index_class_t *class = &classes[n++];
+            *class = container->classes[j];
+            class->name = container->names_base + class->name_offset;
+            class->container = i;
+            class->hash = index_hash(class->name, class->name_length);
+        }
+    }
+    *count = n;
+    return classes;
+}
+
+/* moves all but the first class of each name behind the others, keeping their order */
+static int remove_duplicates(index_class_t *classes, u4_t count, u4_t *kept) {
+    size_t table_size = 16;
+    while (table_size < 2 * (size_t) count) {
+        table_size *= 2;
+    }
+    u4_t *table = calloc(table_size, sizeof(u4_t));
+    index_class_t *duplicates = malloc((count ? count : 1) * sizeof(index_class_t));
+    if ((table == NULL) || (duplicates == NULL)) {
+        fprintf(stderr, "%s: failed to allocate duplicate table for %u classes\n", program, count);
+        free(table);
+        free(duplicates);
+        return -1;
+    }
+    u4_t unique = 0;
+    u4_t duplicates_count = 0;
+    u4_t i;
+    for (i = 0; i < count; i++) {
+        index_class_t *class = &classes[i];
+        size_t probe = class->hash & (table_size - 1);
+        int duplicate = 0;
+        while (table[probe]) {
+            index_class_t *other = &classes[table[probe] - 1];
+            if ((other->hash == class->hash) && (other->name_length == class->name_length) &&
+                (memcmp(other->name, class->name, class->name_length) == 0)) {
+                duplicate = 1;
+                break;
+            }
+            probe = (probe + 1) & (table_size - 1);
+        }
+        if (duplicate) {
+            duplicates[duplicates_count++] = *class;
+            continue;
+        }
+        classes[unique] = *class;
+        table[probe] = ++unique;
+    }
+    memcpy(classes + unique, duplicates, duplicates_count * sizeof(index_class_t));
+    free(duplicates);
+    free(table);
+    *kept = unique;
+    return 0;
+}
+
+static int build_perfect_hash(index_class_t *classes, u4_t count, int32_t *displacements, u4_t *slot_of) {
+    u4_t *bucket_start = calloc(count + 2, sizeof(u4_t));
+    u4_t *members = malloc(count * sizeof(u4_t));
+    u4_t *size_start = NULL;
+    u4_t *buckets = malloc(count * sizeof(u4_t));
+    u1_t *taken = calloc(count, sizeof(u1_t));
+    u4_t trial[64];
+    u4_t max_size = 0;
+    int result = -1;
+    u4_t i;
+
+    if ((bucket_start == NULL) || (members == NULL) || (buckets == NULL) || (taken == NULL)) {
+        fprintf(stderr, "%s: failed to allocate perfect hash tables for %u classes\n", program, count);
+        goto RETURN;
+    }
+
+    /* group classes by bucket */
+    for (i = 0; i < count; i++) {
+        bucket_start[classes[i].hash % count + 2]++;
+    }
+    for (i = 0; i < count; i++) {
+        u4_t size = bucket_start[i + 2];
+        if (size > max_size) {
+            max_size = size;
+        }
+        bucket_start[i + 2] += bucket_start[i + 1];
+    }
+    for (i = 0; i < count; i++) {
+        members[bucket_start[classes[i].hash % count + 1]++] = i;
+    }
+    if (max_size > sizeof(trial) / sizeof(trial[0])) {
+        fprintf(stderr, "%s: %u names hash to one bucket\n", program, max_size);
+        goto RETURN;
+    }
+
+    /* largest buckets first, while most slots are still free */
+    size_start = calloc(max_size + 2, sizeof(u4_t));
+    if (size_start == NULL) {
+        fprintf(stderr, "%s: failed to allocate perfect hash tables for %u classes\n", program, count);
+        goto RETURN;
+    }
+    for (i = 0; i < count; i++) {
+        size_start[max_size - (bucket_start[i + 1] - bucket_start[i]) + 1]++;
+    }
+    for (i = 0; i <= max_size; i++) {
+        size_start[i + 1] += size_start[i];
+    }
+    for (i = 0; i < count; i++) {
+        buckets[size_start[max_size - (bucket_start[i + 1] - bucket_start[i])]++] = i;
+    }
+
+    u4_t next_free = 0;
+    for (i = 0; i < count; i++) {
+        u4_t bucket = buckets[i];
+        u4_t *bucket_members = &members[bucket_start[bucket]];
+        u4_t size = bucket_start[bucket + 1] - bucket_start[bucket];
+        u4_t j;
+        u4_t k;
+
+        if (size == 0) {
+            displacements[bucket] = 0;
+            continue;
+        }
+        if (size == 1) {
+            while (taken[next_free]) {
+                next_free++;
+            }
+            taken[next_free] = 1;
+            slot_of[bucket_members[0]] = next_free;
+            displacements[bucket] = -(int32_t) next_free - 1;
+            continue;
+        }
+
+        int32_t displacement;
+        for (displacement = 1; displacement < INDEX_MAX_DISPLACEMENT; displacement++) {
+            for (j = 0; j < size; j++) {
+                trial[j] = index_slot(classes[bucket_members[j]].hash, displacement, count);
+                if (taken[trial[j]]) {
+                    break;
+                }
+                for (k = 0; (k < j) && (trial[k] != trial[j]); k++) {
+                }
+                if (k < j) {
+                    break;
+                }
+            }
+            if (j == size) {
+                break;
+            }
+        }
+        if (displacement == INDEX_MAX_DISPLACEMENT) {
+            fprintf(stderr, "%s: failed to place a bucket of %u names\n", program, size);
+            goto RETURN;
+        }
+        for (j = 0; j < size; j++) {
+            taken[trial[j]] = 1;
+            slot_of[bucket_members[j]] = trial[j];
+        }
+        displacements[bucket] = displacement;
+    }
+    result = 0;
+
+RETURN:
+    free(bucket_start);
+    free(members);
+    free(size_start);
+    free(buckets);
+    free(taken);
+    return result;
+}
+
+/* written to a temporary file and renamed, so readers never map a half-written index */
+static int write_class_index(const char *index_file_name, index_build_t *build, index_class_t *classes, u4_t count, u4_t shadowed_count) {
+    buffer_t out = {NULL, 0, 0};
+    int32_t *displacements = calloc(count ? count : 1, sizeof(int32_t));
+    u4_t *slot_of = malloc((count ? count : 1) * sizeof(u4_t));
+    u4_t *class_at = malloc((count ? count : 1) * sizeof(u4_t));
+    class_index_container_t *containers = calloc(build->containers_count ? build->containers_count : 1, sizeof(class_index_container_t));
+    char *temporary_name = NULL;
+    int result = -1;
+    u4_t i;
+
+    if ((displacements == NULL) || (slot_of == NULL) || (class_at == NULL) || (containers == NULL)) {
+        fprintf(stderr, "%s: failed to allocate index tables for %u classes\n", program, count);
+        goto RETURN;
+    }
+    if (count && (build_perfect_hash(classes, count, displacements, slot_of) < 0)) {
+        goto RETURN;
+    }
+    for (i = 0; i < count; i++) {
+        class_at[slot_of[i]] = i;
+    }
+    for (i = 0; i < count + shadowed_count; i++) {
+        containers[classes[i].container].classes_count++;
+    }
+
+    class_index_header_t header;
+    memset(&header, 0, sizeof(header));
+    header.magic = CLASS_INDEX_MAGIC;
+    header.version = CLASS_INDEX_VERSION;
+    header.containers_count = build->containers_count;
+    header.classes_count = count;
+    header.containers_offset = sizeof(header);
+    header.displacements_offset = header.containers_offset + build->containers_count * sizeof(class_index_container_t);
+    header.slots_offset = header.displacements_offset + count * sizeof(int32_t);
+    header.shadowed_offset = header.slots_offset + count * sizeof(class_index_slot_t);
+    header.shadowed_count = shadowed_count;
+
+    /* strings: jar paths, then class names in slot order so a slot and its name are near each other */
+    u4_t strings_length = 0;
+    for (i = 0; i < build->containers_count; i++) {
+        containers[i].name_offset = strings_length;
+        containers[i].name_length = strlen(build->containers[i].path);
+        containers[i].size = build->containers[i].size;
+        containers[i].mtime_sec = build->containers[i].mtime_sec;
+        containers[i].mtime_nsec = build->containers[i].mtime_nsec;
+        strings_length += containers[i].name_length;
+    }
+    header.strings_offset = header.shadowed_offset + shadowed_count * sizeof(class_index_slot_t);
+
+    if ((buffer_put_bytes(&out, &header, sizeof(header)) < 0) ||
+        (buffer_put_bytes(&out, containers, build->containers_count * sizeof(class_index_container_t)) < 0) ||
+        (buffer_put_bytes(&out, displacements, count * sizeof(int32_t)) < 0)) {
+        goto RETURN;
+    }
+    for (i = 0; i < count + shadowed_count; i++) {
+        index_class_t *class = (i < count) ? &classes[class_at[i]] : &classes[i];
+        class_index_slot_t slot;
+        memset(&slot, 0, sizeof(slot));
+        slot.name_offset = strings_length;
+        slot.name_length = class->name_length;
+        slot.container = class->container;
+        slot.offset = class->offset;
+        strings_length += class->name_length;
+        if (buffer_put_bytes(&out, &slot, sizeof(slot)) < 0) {
+            goto RETURN;
+        }
+    }
+    for (i = 0; i < build->containers_count; i++) {
+        if (buffer_put_bytes(&out, build->containers[i].path, containers[i].name_length) < 0) {
+            goto RETURN;
+        }
+    }
+    for (i = 0; i < count + shadowed_count; i++) {
+        index_class_t *class = (i < count) ? &classes[class_at[i]] : &classes[i];
+        if (buffer_put_bytes(&out, class->name, class->name_length) < 0) {
+            goto RETURN;
+        }
+    }
+    if (out.length > UINT32_MAX) {
+        fprintf(stderr, "%s: index of %zu bytes is too large\n", program, out.length);
+        goto RETURN;
+    }
+    ((class_index_header_t *) out.data)->strings_length = strings_length;
+
+    size_t name_length = strlen(index_file_name);
+    temporary_name = malloc(name_length + 32);
+    if (temporary_name == NULL) {
+        fprintf(stderr, "%s: failed to malloc %zu bytes.\n", program, name_length + 32);
+        goto RETURN;
+    }
+    snprintf(temporary_name, name_length + 32, "%s.%d.tmp", index_file_name, (int) getpid());
+    if (write_file(temporary_name, out.data, out.length) < 0) {
+        unlink(temporary_name);
+        goto RETURN;
+    }
+    if (rename(temporary_name, index_file_name) < 0) {
+        fprintf(stderr, "%s: failed to rename '%s' to '%s': %s\n", program, temporary_name, index_file_name, strerror(errno));
+        unlink(temporary_name);
+        goto RETURN;
+    }
+    result = 0;
+
+RETURN:
+    free(temporary_name);
+    buffer_free(&out);
+    free(containers);
+    free(class_at);
+    free(slot_of);
+    free(displacements);
+    return result;
+}
+
+static void free_build(index_build_t *build) {
+    u4_t i;
+    for (i = 0; i < build->containers_count; i++) {
+        free(build->containers[i].path);
+        free(build->containers[i].classes);
+        buffer_free(&build->containers[i].names);
+    }
+    free(build->containers);
+    free(build->jobs);
+}
+
+/* FNV-1a, finished with the splitmix64 mixer so that hash % count is usable */
+static uint64_t index_hash(const u1_t *bytes, size_t length) {
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    size_t i;
+    for (i = 0; i < length; i++) {
+        hash ^= bytes[i];
+        hash *= 0x00000100000001b3ULL;
+    }
+    return index_mix(hash);
+}
+
+static uint64_t index_mix(uint64_t x) {
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebULL;
+    x ^= x >> 31;
+    return x;
+}
+
+static u4_t index_slot(uint64_t hash, int32_t displacement, u4_t count) {
+    if (displacement < 0) {
+        return -(displacement + 1);
+    }
+    return index_mix(hash + displacement * INDEX_HASH_GOLDEN) % count;
+}
+
+/*
+ * Writes the index of jar_names to index_file_name, reusing the existing
+ * index for unchanged jars unless rebuild is set.
+ */
+int build_class_index(const char *index_file_name, char **jar_names, int jars_count, int threads, int rebuild) {
+    index_build_t build;
+    memset(&build, 0, sizeof(build));
+    build.containers_count = jars_count;
+    build.containers = calloc(build.containers_count ? build.containers_count : 1, sizeof(index_container_t));
+    build.jobs = calloc(build.containers_count ? build.containers_count : 1, sizeof(u4_t));
+    if ((build.containers == NULL) || (build.jobs == NULL)) {
+        fprintf(stderr, "%s: failed to allocate %u containers\n", program, build.containers_count);
+        free_build(&build);
+        return -1;
+    }
+
+    int result = -1;
+    class_index_t *old_index = NULL;
+    index_class_t *classes = NULL;
+    u4_t i;
+    for (i = 0; i < build.containers_count; i++) {
+        if (stat_container(&build.containers[i], jar_names[i]) < 0) {
+            goto RETURN;
+        }
+    }
+    if (!rebuild && (access(index_file_name, F_OK) == 0)) {
+        old_index = open_class_index(index_file_name);
+        if (old_index == NULL) {
+            fprintf(stderr, "%s: rebuilding '%s' from scratch\n", program, index_file_name);
+        }
+    }
+    reuse_containers(&build, old_index);
+    if (scan_containers(&build, threads < 1 ? 1 : threads) < 0) {
+        goto RETURN;
+    }
+
+    u4_t total;
+    u4_t count;
+    classes = collect_classes(&build, &total);
+    if ((classes == NULL) || (remove_duplicates(classes, total, &count) < 0) ||
+        (write_class_index(index_file_name, &build, classes, count, total - count) < 0)) {
+        goto RETURN;
+    }
+    fprintf(stderr, "%s: indexed %u classes from %u jars, %u rescanned\n", program, count, build.containers_count, build.jobs_count);
+    result = 0;
+
+RETURN:
+    free(classes);
+    /* names of reused jars point into the old index until the new one is written */
+    close_class_index(old_index);
+    free_build(&build);
+    return result;
+}
+
+int index_main(int ac, char **av) {
+    int threads = sysconf(_SC_NPROCESSORS_ONLN);
+    int rebuild = 0;
+    int c;
+
+    while ((c = getopt(ac, av, "fj:")) != -1) {
+        switch (c) {
+        case 'f':
+            rebuild = 1;
+            break;
+        case 'j':
+            threads = atoi(optarg);
+            break;
+        default:
+            fprintf(stderr, "usage: %s index [-f] [-j threads] {index} {jar}...\n", program);
+            return 1;
+        }
+    }
+    if (ac - optind < 1) {
+        fprintf(stderr, "usage: %s index [-f] [-j threads] {index} {jar}...\n", program);
+        return 1;
+    }
+
+    return build_class_index(av[optind], av + optind + 1, ac - optind - 1, threads, rebuild) < 0;
+}
+
+/* prints "name  jar  offset" for each class found */
+int lookup_main(int ac, char **av) {
+    if (ac < 3) {
+        fprintf(stderr, "usage: %s lookup {index} {class-name}...\n", program);
+        return 1;
+    }
+    class_index_t *index = open_class_index(av[1]);
+    if (index == NULL) {
+        return 1;
+    }
+    int result = 0;
+    int i;
+    for (i = 2; i < ac; i++) {
+        class_index_slot_t *slot = class_index_lookup(index, av[i], strlen(av[i]));
+        if ((slot == NULL) || (slot->container >= index->header->containers_count)) {
+            fprintf(stderr, "%s: class '%s' not found\n", program, av[i]);
+            result = 1;
+            continue;
+        }
+        class_index_container_t *container = &index->containers[slot->container];
+        printf("%s  %.*s  %u\n", av[i], (int) container->name_length, index->strings + container->name_offset, slot->offset);
+    }
+    close_class_index(index);
+    return result;
+}
@@ -0,0 +1,579 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <zlib.h>
+
+#include "cjdc.h"
+
+#define ZIP_LOCAL_HEADER_SIGNATURE      (0x04034b50)
+#define ZIP_CENTRAL_HEADER_SIGNATURE    (0x02014b50)
+#define ZIP_END_OF_CENTRAL_SIGNATURE    (0x06054b50)
+#define ZIP_DATA_DESCRIPTOR_SIGNATURE   (0x08074b50)
+
+#define ZIP_LOCAL_HEADER_SIZE   (30)
+#define ZIP_CENTRAL_HEADER_SIZE (46)
+#define ZIP_END_OF_CENTRAL_SIZE (22)
+
+#define ZIP_FLAG_DATA_DESCRIPTOR (0x0008)
+#define ZIP_FLAG_UTF8            (0x0800)
+
+#define ZIP_METHOD_STORED   (0)
+#define ZIP_METHOD_DEFLATED (8)
+
+/* deflate cannot expand by more than this, about 258 bytes per 2 bits */
+#define ZIP_MAX_INFLATE_RATIO (1032)
+
+static int read_central_directory(jar_file_t *jar_file, const char *jar_file_name);
+static int flush_pending_entries(jar_writer_t *writer);
+static int put_le16(buffer_t *buffer, u2_t value);
+static int put_le32(buffer_t *buffer, u4_t value);
+
+/* zip fields are little-endian, unlike class files */
+static u2_t get_le16(const u1_t *p) {
+    return p[0] | (p[1] << 8);
+}
+
+static u4_t get_le32(const u1_t *p) {
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((u4_t) p[3] << 24);
+}
+
+static void set_le16(u1_t *p, u2_t value) {
+    p[0] = value;
+    p[1] = value >> 8;
+}
+
+static void set_le32(u1_t *p, u4_t value) {
+    p[0] = value;
+    p[1] = value >> 8;
+    p[2] = value >> 16;
+    p[3] = value >> 24;
+}
+
+jar_file_t *open_jar_file(const char *jar_file_name) {
+    jar_file_t *result = calloc(1, sizeof(jar_file_t));
+    if (result == NULL) {
+        fprintf(stderr, "%s: failed to malloc %zu bytes.\n", program, sizeof(jar_file_t));
+        return NULL;
+    }
+    result->fd = open(jar_file_name, O_RDONLY);
+    if (result->fd < 0) {
+        fprintf(stderr, "%s: failed to open '%s': %s.\n", program, jar_file_name, strerror(errno));
+        goto ERR_RETURN;
+    }
+
+    struct stat st;
+    if (fstat(result->fd, &st) < 0) {
+        fprintf(stderr, "%s: failed to stat '%s': %s.\n", program, jar_file_name, strerror(errno));
+        goto ERR_RETURN;
+    }
+    if (st.st_size < ZIP_END_OF_CENTRAL_SIZE) {
+        fprintf(stderr, "%s: '%s' is too short to be a jar\n", program, jar_file_name);
+        goto ERR_RETURN;
+    }
+    result->size = st.st_size;
+
+    result->map = mmap(NULL, result->size, PROT_READ, MAP_PRIVATE, result->fd, 0);
+    if (result->map == MAP_FAILED) {
+        result->map = NULL;
+        fprintf(stderr, "%s: failed to map '%s': %s.\n", program, jar_file_name, strerror(errno));
+        goto ERR_RETURN;
+    }
+
+    if (read_central_directory(result, jar_file_name) < 0) {
+        goto ERR_RETURN;
+    }
+    return result;
+
+ERR_RETURN:
+    close_jar_file(result);
+    return NULL;
+}
+
+/* a jar held in memory, such as an entry of another jar; takes ownership of bytes, which must come from malloc() */
+jar_file_t *open_jar_bytes(const char *jar_file_name, u1_t *bytes, size_t length) {
+    jar_file_t *result = calloc(1, sizeof(jar_file_t));
+    if (result == NULL) {
+        fprintf(stderr, "%s: failed to malloc %zu bytes.\n", program, sizeof(jar_file_t));
+        free(bytes);
+        return NULL;
+    }
+    result->fd = -1;
+    result->map = bytes;
+    result->size = length;
+    result->map_owned = 1;
+    if (length < ZIP_END_OF_CENTRAL_SIZE) {
+        fprintf(stderr, "%s: '%s' is too short to be a jar\n", program, jar_file_name);
+        goto ERR_RETURN;
+    }
+    if (read_central_directory(result, jar_file_name) < 0) {
+        goto ERR_RETURN;
+    }
+    return result;
+
+ERR_RETURN:
+    close_jar_file(result);
+    return NULL;
+}
+
+static int read_central_directory(jar_file_t *jar_file, const char *jar_file_name) {
+    const u1_t *map = jar_file->map;
+    const u1_t *end = NULL;
+
+    /* the end of central directory record is followed by a comment of up to 64k */
+    size_t position = jar_file->size - ZIP_END_OF_CENTRAL_SIZE;
+    size_t lowest = (position > 0xffff) ? position - 0xffff : 0;
+    for (;;) {
+        if (get_le32(map + position) == ZIP_END_OF_CENTRAL_SIGNATURE) {
+            end = map + position;
+            break;
+        }
+        if (position == lowest) {
+            break;
+        }
+        position--;
+    }
+    if (end == NULL) {
+        fprintf(stderr, "%s: '%s' has no zip central directory\n", program, jar_file_name);
+        return -1;
+    }
+
+    u2_t entries_count = get_le16(end + 10);
+    u4_t central_size = get_le32(end + 12);
+    u4_t central_offset = get_le32(end + 16);
+    jar_file->comment_length = get_le16(end + 20);
+    jar_file->comment = end + ZIP_END_OF_CENTRAL_SIZE;
+    if ((entries_count == 0xffff) || (central_offset == 0xffffffff)) {
+        fprintf(stderr, "%s: '%s' is a zip64 archive, which is not supported\n", program, jar_file_name);
+        return -1;
+    }
+    if (((size_t) central_offset + central_size > position) ||
+        (jar_file->comment + jar_file->comment_length > map + jar_file->size)) {
+        fprintf(stderr, "%s: '%s' has a corrupt zip central directory\n", program, jar_file_name);
+        return -1;
+    }
+
+    if (entries_count) {
+        jar_file->entries = calloc(entries_count, sizeof(jar_entry_t));
+        if (jar_file->entries == NULL) {
+            fprintf(stderr, "%s: failed to allocate %u jar entries\n", program, entries_count);
+            return -1;
+        }
+    }
+
+    const u1_t *p = map + central_offset;
+    const u1_t *central_end = p + central_size;
+    int i;
+    for (i = 0; i < entries_count; i++) {
+        jar_entry_t *entry = &jar_file->entries[i];
+        if ((p + ZIP_CENTRAL_HEADER_SIZE > central_end) || (get_le32(p) != ZIP_CENTRAL_HEADER_SIGNATURE)) {
+            fprintf(stderr, "%s: '%s' has a corrupt central directory entry %d\n", program, jar_file_name, i);
+            return -1;
+        }
+        entry->flags = get_le16(p + 8);
+        entry->method = get_le16(p + 10);
+        entry->crc32 = get_le32(p + 16);
+        entry->compressed_size = get_le32(p + 20);
+        entry->uncompressed_size = get_le32(p + 24);
+        entry->name_length = get_le16(p + 28);
+        u2_t extra_length = get_le16(p + 30);
+        u2_t comment_length = get_le16(p + 32);
+        entry->local_header_offset = get_le32(p + 42);
+        entry->name = (const char *) p + ZIP_CENTRAL_HEADER_SIZE;
+        entry->central_record = p;
+        entry->central_length = ZIP_CENTRAL_HEADER_SIZE + entry->name_length + extra_length + comment_length;
+        if (p + entry->central_length > central_end) {
+            fprintf(stderr, "%s: '%s' has a truncated central directory entry %d\n", program, jar_file_name, i);
+            return -1;
+        }
+        p += entry->central_length;
+
+        const u1_t *local = map + entry->local_header_offset;
+        if (((size_t) entry->local_header_offset + ZIP_LOCAL_HEADER_SIZE > central_offset) ||
+            (get_le32(local) != ZIP_LOCAL_HEADER_SIGNATURE)) {
+            fprintf(stderr, "%s: '%s' has a corrupt local header for entry %d\n", program, jar_file_name, i);
+            return -1;
+        }
+        entry->data_offset = entry->local_header_offset + ZIP_LOCAL_HEADER_SIZE + get_le16(local + 26) + get_le16(local + 28);
+        size_t data_end = (size_t) entry->data_offset + entry->compressed_size;
+        if (data_end > central_offset) {
+            fprintf(stderr, "%s: '%s' entry %d runs into the central directory\n", program, jar_file_name, i);
+            return -1;
+        }
+        if (entry->flags & ZIP_FLAG_DATA_DESCRIPTOR) {
+            if ((data_end + 4 <= central_offset) && (get_le32(map + data_end) == ZIP_DATA_DESCRIPTOR_SIGNATURE)) {
+                data_end += 16;
+            }
+            else {
+                data_end += 12;
+            }
+        }
+        entry->local_length = data_end - entry->local_header_offset;
+        if (i && (entry->local_header_offset <= entry[-1].local_header_offset)) {
+            jar_file->entries_unsorted = 1;
+        }
+    }
+    jar_file->entries_count = entries_count;
+    return 0;
+}
+
+void close_jar_file(jar_file_t *jar_file) {
+    if (jar_file == NULL) {
+        return;
+    }
+    if (jar_file->map_owned) {
+        free(jar_file->map);
+    }
+    else if (jar_file->map) {
+        munmap(jar_file->map, jar_file->size);
+    }
+    if (jar_file->fd >= 0) {
+        close(jar_file->fd);
+    }
+    free(jar_file->entries);
+    free(jar_file);
+}
+
+/* returns the uncompressed bytes of entry, which the caller frees */
+u1_t *read_jar_entry(jar_file_t *jar_file, jar_entry_t *entry) {
+    /* the sizes come from the central directory, so they are checked before anything is allocated */
+    if ((entry->method == ZIP_METHOD_STORED) && (entry->compressed_size != entry->uncompressed_size)) {
+        fprintf(stderr, "%s: stored entry '%.*s' has mismatched sizes\n", program, entry->name_length, entry->name);
+        return NULL;
+    }
+    if ((entry->method != ZIP_METHOD_STORED) && (entry->method != ZIP_METHOD_DEFLATED)) {
+        fprintf(stderr, "%s: entry '%.*s' uses unsupported compression method %d\n", program, entry->name_length, entry->name, entry->method);
+        return NULL;
+    }
+    if ((uint64_t) entry->uncompressed_size > (uint64_t) entry->compressed_size * ZIP_MAX_INFLATE_RATIO) {
+        fprintf(stderr, "%s: entry '%.*s' claims to inflate %u bytes to %u\n", program, entry->name_length, entry->name, entry->compressed_size, entry->uncompressed_size);
+        return NULL;
+    }
+
+    u1_t *result = malloc(entry->uncompressed_size ? entry->uncompressed_size : 1);
+    if (result == NULL) {
+        fprintf(stderr, "%s: failed to malloc %u bytes for '%.*s'\n", program, entry->uncompressed_size, entry->name_length, entry->name);
+        return NULL;
+    }
+    if (entry->method == ZIP_METHOD_STORED) {
+        memcpy(result, jar_file->map + entry->data_offset, entry->uncompressed_size);
+        return result;
+    }
+
+    z_stream stream;
+    memset(&stream, 0, sizeof(stream));
+    if (inflateInit2(&stream, -MAX_WBITS) != Z_OK) {
+        fprintf(stderr, "%s: failed to initialize inflate\n", program);
+        free(result);
+        return NULL;
+    }
+    stream.next_in = jar_file->map + entry->data_offset;
+    stream.avail_in = entry->compressed_size;
+    stream.next_out = result;
+    stream.avail_out = entry->uncompressed_size;
+    int rc = inflate(&stream, Z_FINISH);
+    inflateEnd(&stream);
+    if ((rc != Z_STREAM_END) || (stream.total_out != entry->uncompressed_size)) {
+        fprintf(stderr, "%s: failed to inflate '%.*s'\n", program, entry->name_length, entry->name);
+        free(result);
+        return NULL;
+    }
+    return result;
+}
+
+/*
+ * Up to length bytes from the start of the entry, inflating no more than
+ * that; the number of bytes read, or -1.  Nothing is allocated for the
+ * entry, so its sizes need not be trusted yet.
+ */
+int read_jar_entry_head(jar_file_t *jar_file, jar_entry_t *entry, u1_t *head, u4_t length) {
+    if (length > entry->uncompressed_size) {
+        length = entry->uncompressed_size;
+    }
+    if (entry->method == ZIP_METHOD_STORED) {
+        if (entry->compressed_size != entry->uncompressed_size) {
+            fprintf(stderr, "%s: stored entry '%.*s' has mismatched sizes\n", program, entry->name_length, entry->name);
+            return -1;
+        }
+        memcpy(head, jar_file->map + entry->data_offset, length);
+        return length;
+    }
+    if (entry->method != ZIP_METHOD_DEFLATED) {
+        fprintf(stderr, "%s: entry '%.*s' uses unsupported compression method %d\n", program, entry->name_length, entry->name, entry->method);
+        return -1;
+    }
+
+    z_stream stream;
+    memset(&stream, 0, sizeof(stream));
+    if (inflateInit2(&stream, -MAX_WBITS) != Z_OK) {
+        fprintf(stderr, "%s: failed to initialize inflate\n", program);
+        return -1;
+    }
+    stream.next_in = jar_file->map + entry->data_offset;
+    stream.avail_in = entry->compressed_size;
+    stream.next_out = head;
+    stream.avail_out = length;
+    int rc = Z_OK;
+    while ((rc == Z_OK) && (stream.avail_out > 0)) {
+        rc = inflate(&stream, Z_SYNC_FLUSH);
+    }
+    inflateEnd(&stream);
+    if ((rc != Z_OK) && (rc != Z_STREAM_END) && (rc != Z_BUF_ERROR)) {
+        fprintf(stderr, "%s: failed to inflate '%.*s'\n", program, entry->name_length, entry->name);
+        return -1;
+    }
+    return stream.total_out;
+}
+
+/* the entry whose local header is at local_header_offset, NULL if there is none */
+jar_entry_t *find_jar_entry(jar_file_t *jar_file, u4_t local_header_offset) {
+    u4_t i;
+    if (jar_file->entries_unsorted) {
+        for (i = 0; i < jar_file->entries_count; i++) {
+            if (jar_file->entries[i].local_header_offset == local_header_offset) {
+                return &jar_file->entries[i];
+            }
+        }
+        return NULL;
+    }
+    u4_t low = 0;
+    u4_t high = jar_file->entries_count;
+    while (low < high) {
+        i = low + (high - low) / 2;
+        u4_t offset = jar_file->entries[i].local_header_offset;
+        if (offset == local_header_offset) {
+            return &jar_file->entries[i];
+        }
+        if (offset < local_header_offset) {
+            low = i + 1;
+        }
+        else {
+            high = i;
+        }
+    }
+    return NULL;
+}
+
+int is_class_entry(jar_entry_t *entry) {
+    return has_suffix(entry->name, entry->name_length, ".class");
+}
+
+int jar_writer_open(jar_writer_t *writer, jar_file_t *source, const char *jar_file_name) {
+    memset(writer, 0, sizeof(jar_writer_t));
+    writer->source = source;
+    writer->fd = open(jar_file_name, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (writer->fd < 0) {
+        fprintf(stderr, "%s: failed to create '%s': %s\n", program, jar_file_name, strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+/* entries copied back to back from the source jar are written with a single copy */
+int jar_writer_copy_entry(jar_writer_t *writer, jar_entry_t *entry) {
+    off_t output_offset = writer->offset + writer->pending_length;
+    if (output_offset > 0xffffffffLL) {
+        fprintf(stderr, "%s: output jar needs zip64, which is not supported\n", program);
+        return -1;
+    }
+
+    if (buffer_put_bytes(&writer->central, entry->central_record, entry->central_length) < 0) {
+        return -1;
+    }
+    set_le32(writer->central.data + writer->central.length - entry->central_length + 42, output_offset);
+    writer->entries_count++;
+
+    if (writer->pending_length && (writer->pending_offset + writer->pending_length == entry->local_header_offset)) {
+        writer->pending_length += entry->local_length;
+        return 0;
+    }
+    if (flush_pending_entries(writer) < 0) {
+        return -1;
+    }
+    writer->pending_offset = entry->local_header_offset;
+    writer->pending_length = entry->local_length;
+    return 0;
+}
+
+/* writes bytes as the new contents of entry; a level of 0 stores them uncompressed */
+int jar_writer_add_entry(jar_writer_t *writer, jar_entry_t *entry, const u1_t *bytes, u4_t length, int level) {
+    if (flush_pending_entries(writer) < 0) {
+        return -1;
+    }
+    if (writer->offset > 0xffffffffLL) {
+        fprintf(stderr, "%s: output jar needs zip64, which is not supported\n", program);
+        return -1;
+    }
+
+    u2_t method = level ? ZIP_METHOD_DEFLATED : ZIP_METHOD_STORED;
+    u4_t crc = crc32(crc32(0L, Z_NULL, 0), bytes, length);
+    buffer_t local = {NULL, 0, 0};
+    u4_t compressed_size = length;
+
+    uLong bound = level ? deflateBound(NULL, length) : length;
+    if (buffer_reserve(&local, ZIP_LOCAL_HEADER_SIZE + entry->name_length + bound) < 0) {
+        return -1;
+    }
+    u1_t *data = local.data + ZIP_LOCAL_HEADER_SIZE + entry->name_length;
+    if (level) {
+        z_stream stream;
+        memset(&stream, 0, sizeof(stream));
+        if (deflateInit2(&stream, level, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+            fprintf(stderr, "%s: failed to initialize deflate\n", program);
+            buffer_free(&local);
+            return -1;
+        }
+        stream.next_in = (u1_t *) bytes;
+        stream.avail_in = length;
+        stream.next_out = data;
+        stream.avail_out = bound;
+        int rc = deflate(&stream, Z_FINISH);
+        compressed_size = stream.total_out;
+        deflateEnd(&stream);
+        if (rc != Z_STREAM_END) {
+            fprintf(stderr, "%s: failed to deflate '%.*s'\n", program, entry->name_length, entry->name);
+            buffer_free(&local);
+            return -1;
+        }
+    }
+    else {
+        memcpy(data, bytes, length);
+    }
+
+    u2_t flags = entry->flags & ZIP_FLAG_UTF8;
+    const u1_t *central = entry->central_record;
+    put_le32(&local, ZIP_LOCAL_HEADER_SIGNATURE);
+    put_le16(&local, 20);
+    put_le16(&local, flags);
+    put_le16(&local, method);
+    put_le16(&local, get_le16(central + 12));
+    put_le16(&local, get_le16(central + 14));
+    put_le32(&local, crc);
+    put_le32(&local, compressed_size);
+    put_le32(&local, length);
+    put_le16(&local, entry->name_length);
+    put_le16(&local, 0);
+    buffer_put_bytes(&local, entry->name, entry->name_length);
+    local.length += compressed_size;
+
+    int result = write_fully_at(writer->fd, local.data, local.length, writer->offset);
+    buffer_free(&local);
+    if (result < 0) {
+        return -1;
+    }
+
+    if (buffer_put_bytes(&writer->central, entry->central_record, entry->central_length) < 0) {
+        return -1;
+    }
+    u1_t *record = writer->central.data + writer->central.length - entry->central_length;
+    set_le16(record + 8, flags);
+    set_le16(record + 10, method);
+    set_le32(record + 16, crc);
+    set_le32(record + 20, compressed_size);
+    set_le32(record + 24, length);
+    set_le32(record + 42, writer->offset);
+    writer->entries_count++;
+
+    writer->offset += ZIP_LOCAL_HEADER_SIZE + entry->name_length + compressed_size;
+    return 0;
+}
+
+int jar_writer_close(jar_writer_t *writer) {
+    int result = flush_pending_entries(writer);
+
+    if ((result == 0) && ((writer->entries_count > 0xffff) || (writer->offset > 0xffffffffLL))) {
+        fprintf(stderr, "%s: output jar needs zip64, which is not supported\n", program);
+        result = -1;
+    }
+    if (result == 0) {
+        buffer_t *central = &writer->central;
+        u4_t central_size = central->length;
+        u2_t comment_length = writer->source ? writer->source->comment_length : 0;
+        if ((put_le32(central, ZIP_END_OF_CENTRAL_SIGNATURE) < 0) ||
+            (put_le16(central, 0) < 0) ||
+            (put_le16(central, 0) < 0) ||
+            (put_le16(central, writer->entries_count) < 0) ||
+            (put_le16(central, writer->entries_count) < 0) ||
+            (put_le32(central, central_size) < 0) ||
+            (put_le32(central, writer->offset) < 0) ||
+            (put_le16(central, comment_length) < 0) ||
+            (comment_length && (buffer_put_bytes(central, writer->source->comment, comment_length) < 0))) {
+            result = -1;
+        }
+        else {
+            result = write_fully_at(writer->fd, central->data, central->length, writer->offset);
+        }
+    }
+
+    buffer_free(&writer->central);
+    if (close(writer->fd) < 0) {
+        fprintf(stderr, "%s: failed to close output jar: %s\n", program, strerror(errno));
+        result = -1;
+    }
+    return result;
+}
+
+/* copy_file_range() keeps the data in the kernel; fall back to writing from the mapping */
+static int flush_pending_entries(jar_writer_t *writer) {
+    if (writer->pending_length == 0) {
+        return 0;
+    }
+    loff_t in_offset = writer->pending_offset;
+    loff_t out_offset = writer->offset;
+    off_t remaining = writer->pending_length;
+    while (remaining > 0) {
+        ssize_t copied = copy_file_range(writer->source->fd, &in_offset, writer->fd, &out_offset, remaining, 0);
+        if (copied <= 0) {
+            if ((copied < 0) && (errno == EINTR)) {
+                continue;
+            }
+            if (write_fully_at(writer->fd, writer->source->map + in_offset, remaining, out_offset) < 0) {
+                return -1;
+            }
+            break;
+        }
+        remaining -= copied;
+    }
+    writer->offset += writer->pending_length;
+    writer->pending_length = 0;
+    return 0;
+}
+
+int write_fully_at(int fd, const void *bytes, size_t length, off_t offset) {
+    size_t so_far = 0;
+    while (so_far < length) {
+        ssize_t written = pwrite(fd, (const u1_t *) bytes + so_far, length - so_far, offset + so_far);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            fprintf(stderr, "%s: failed to write %zu bytes: %s\n", program, length, strerror(errno));
+            return -1;
+        }
+        so_far += written;
+    }
+    return 0;
+}
+
+static int put_le16(buffer_t *buffer, u2_t value) {
+    if (buffer_reserve(buffer, 2) < 0) {
+        return -1;
+    }
+    set_le16(buffer->data + buffer->length, value);
+    buffer->length += 2;
+    return 0;
+}
+
+static int put_le32(buffer_t *buffer, u4_t value) {
+    if (buffer_reserve(buffer, 4) < 0) {
+        return -1;
+    }
+    set_le32(buffer->data + buffer->length, value);
+    buffer->length += 4;
+    return 0;
+}
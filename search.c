@@ -0,0 +1,489 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+
+#include "cjdc.h"
+
+/*
+ * cjdc search looks for many literal patterns at once in the UTF8
+ * constants of every class of a classpath.  The patterns are compiled
+ * into an Aho-Corasick automaton whose goto and failure links are folded
+ * into one transition table, so a UTF8 constant is scanned with one
+ * table load per byte whatever the number of patterns.  Bytes that occur
+ * in no pattern share a single column, which keeps the table small
+ * enough to stay in cache for the usual few hundred patterns.
+ *
+ * -s and -n restrict the search to UTF8 constants used as String
+ * literals, or as class and member names; each match is printed as
+ *
+ *     class context pattern value
+ *
+ * where context is "string", "name" or "utf8" for anything else.
+ */
+
+#define SEARCH_FLUSH_LENGTH     (64 * 1024)
+
+#define SEARCH_STRING           (1 << 0)
+#define SEARCH_NAME             (1 << 1)
+#define SEARCH_OTHER            (1 << 2)
+
+typedef struct pattern_s {
+    const u1_t *bytes;
+    u4_t length;
+} pattern_t;
+
+typedef struct automaton_s {
+    pattern_t *patterns;
+    u4_t patterns_count;
+    u4_t patterns_capacity;
+    u2_t byte_class[256];       /* column of each byte, 0 for bytes in no pattern; up to 256 */
+    u4_t classes_count;
+    u4_t states_count;
+    u4_t *delta;                /* [states_count * classes_count] */
+    u4_t *match;                /* pattern ending at each state, plus one; 0 for none */
+    u4_t *output;               /* next state along the failure links with a match */
+} automaton_t;
+
+typedef struct search_worker_s {
+    automaton_t *automaton;
+    int contexts;               /* SEARCH_* contexts to search */
+    u1_t *usage;                /* SEARCH_* usage of each constant of the current class */
+    u4_t usage_capacity;
+    u4_t *reported;             /* the serial of the last constant each pattern was reported for */
+    u4_t serial;
+    buffer_t out;
+} search_worker_t;
+
+static int add_pattern(automaton_t *automaton, const u1_t *bytes, u4_t length);
+static int add_pattern_file(automaton_t *automaton, const char *path, u1_t **file_bytes);
+static int build_automaton(automaton_t *automaton);
+static void free_automaton(automaton_t *automaton);
+static int search_class(void *context, const u1_t *bytes, u4_t length);
+static int mark_usage(search_worker_t *worker, class_skim_t *skim);
+static int search_utf8(search_worker_t *worker, const u1_t *name, u2_t name_length,
+                       int usage, const u1_t *bytes, u2_t length);
+static void flush_worker(search_worker_t *worker);
+
+static int add_pattern(automaton_t *automaton, const u1_t *bytes, u4_t length) {
+    if (length == 0) {
+        return 0;
+    }
+    if (automaton->patterns_count == automaton->patterns_capacity) {
+        u4_t capacity = automaton->patterns_capacity ? 2 * automaton->patterns_capacity : 64;
+        pattern_t *patterns = realloc(automaton->patterns, capacity * sizeof(pattern_t));
+        if (patterns == NULL) {
+            fprintf(stderr, "%s: failed to grow the list of patterns to %u\n", program, capacity);
+            return -1;
+        }
+        automaton->patterns = patterns;
+        automaton->patterns_capacity = capacity;
+    }
+    automaton->patterns[automaton->patterns_count].bytes = bytes;
+    automaton->patterns[automaton->patterns_count].length = length;
+    automaton->patterns_count++;
+    return 0;
+}
+
+/* one pattern per line; the patterns point into *file_bytes */
+static int add_pattern_file(automaton_t *automaton, const char *path, u1_t **file_bytes) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "%s: failed to open '%s': %s\n", program, path, strerror(errno));
+        return -1;
+    }
+    u4_t length;
+    u1_t *bytes = read_fd_bytes(fd, &length);
+    close(fd);
+    if (bytes == NULL) {
+        return -1;
+    }
+    *file_bytes = bytes;
+    u4_t start = 0;
+    u4_t i;
+    for (i = 0; i <= length; i++) {
+        if ((i == length) || (bytes[i] == '\n')) {
+            u4_t end = i;
+            if ((end > start) && (bytes[end - 1] == '\r')) {
+                end--;
+            }
+            if (add_pattern(automaton, bytes + start, end - start) < 0) {
+                return -1;
+            }
+            start = i + 1;
+        }
+    }
+    return 0;
+}
+
+static int build_automaton(automaton_t *automaton) {
+    u4_t i;
+    u4_t j;
+    u4_t c;
+
+    automaton->classes_count = 1;
+    for (i = 0; i < automaton->patterns_count; i++) {
+        for (j = 0; j < automaton->patterns[i].length; j++) {
+            u1_t b = automaton->patterns[i].bytes[j];
+            if (automaton->byte_class[b] == 0) {
+                automaton->byte_class[b] = automaton->classes_count++;
+            }
+        }
+    }
+
+    /* the trie, with room for one state per pattern byte */
+    u4_t max_states = 1;
+    for (i = 0; i < automaton->patterns_count; i++) {
+        max_states += automaton->patterns[i].length;
+    }
+    u4_t classes = automaton->classes_count;
+    automaton->delta = calloc((size_t) max_states * classes, sizeof(u4_t));
+    automaton->match = calloc(max_states, sizeof(u4_t));
+    automaton->output = calloc(max_states, sizeof(u4_t));
+    u4_t *fail = calloc(max_states, sizeof(u4_t));
+    u4_t *queue = calloc(max_states, sizeof(u4_t));
+    if ((automaton->delta == NULL) || (automaton->match == NULL) || (automaton->output == NULL) ||
+        (fail == NULL) || (queue == NULL)) {
+        fprintf(stderr, "%s: failed to allocate an automaton of %u states\n", program, max_states);
+        free(fail);
+        free(queue);
+        return -1;
+    }
+    u4_t *delta = automaton->delta;
+    automaton->states_count = 1;
+    for (i = 0; i < automaton->patterns_count; i++) {
+        u4_t state = 0;
+        for (j = 0; j < automaton->patterns[i].length; j++) {
+            u4_t *next = &delta[state * classes + automaton->byte_class[automaton->patterns[i].bytes[j]]];
+            if (*next == 0) {
+                *next = automaton->states_count++;
+            }
+            state = *next;
+        }
+        if (automaton->match[state] == 0) {
+            automaton->match[state] = i + 1;    /* a repeated pattern is reported as its first copy */
+        }
+    }
+
+    /*
+     * Breadth first, so a state's failure state is complete before the
+     * state is: missing transitions become those of the failure state.
+     */
+    u4_t head = 0;
+    u4_t tail = 0;
+    queue[tail++] = 0;
+    while (head < tail) {
+        u4_t state = queue[head++];
+        u4_t *row = &delta[state * classes];
+        u4_t *fail_row = &delta[fail[state] * classes];
+        for (c = 0; c < classes; c++) {
+            u4_t next = row[c];
+            if (next) {
+                fail[next] = state ? fail_row[c] : 0;
+                automaton->output[next] = automaton->match[fail[next]] ? fail[next] : automaton->output[fail[next]];
+                queue[tail++] = next;
+            }
+            else if (state) {
+                row[c] = fail_row[c];
+            }
+        }
+    }
+    free(fail);
+    free(queue);
+    return 0;
+}
+
+static void free_automaton(automaton_t *automaton) {
+    free(automaton->patterns);
+    free(automaton->delta);
+    free(automaton->match);
+    free(automaton->output);
+    memset(automaton, 0, sizeof(*automaton));
+}
+
+static int search_class(void *context, const u1_t *bytes, u4_t length) {
+    search_worker_t *worker = context;
+    class_skim_t skim;
+    const u1_t *name;
+    u2_t name_length;
+    u4_t i;
+
+    if (skim_class_bytes(&skim, bytes, length) < 0) {
+        return -1;
+    }
+    if ((mark_usage(worker, &skim) < 0) ||
+        (skim_this_class(&skim, &name, &name_length) < 0)) {
+        goto ERR_RETURN;
+    }
+    for (i = 1; i < skim.constant_pool_count; i++) {
+        const u1_t *entry;
+        int usage = worker->usage[i] ? worker->usage[i] : SEARCH_OTHER;
+        if ((skim.constant_pool[i] == 0) || ((usage & worker->contexts) == 0)) {
+            continue;
+        }
+        entry = skim_entry(&skim, i);
+        if ((entry[0] == CONSTANT_UTF8) &&
+            (search_utf8(worker, name, name_length, usage, entry + 3, (entry[1] << 8) | entry[2]) < 0)) {
+            goto ERR_RETURN;
+        }
+    }
+    if (worker->out.length >= SEARCH_FLUSH_LENGTH) {
+        flush_worker(worker);
+    }
+    skim_free(&skim);
+    return 0;
+
+ERR_RETURN:
+    skim_free(&skim);
+    return -1;
+}
+
+/*
+ * Which UTF8 constants are String literals and which are class or member
+ * names, from the constant pool and the class's own fields and methods.
+ * Needed for every search, since each match is labelled with its usage.
+ * Leaves the skim where it found it.
+ */
+static int mark_usage(search_worker_t *worker, class_skim_t *skim) {
+    u4_t i;
+    if (worker->usage_capacity < skim->constant_pool_count) {
+        u1_t *usage = realloc(worker->usage, skim->constant_pool_count);
+        if (usage == NULL) {
+            fprintf(stderr, "%s: failed to malloc %u bytes.\n", program, skim->constant_pool_count);
+            return -1;
+        }
+        worker->usage = usage;
+        worker->usage_capacity = skim->constant_pool_count;
+    }
+    memset(worker->usage, 0, skim->constant_pool_count);
+
+    for (i = 1; i < skim->constant_pool_count; i++) {
+        if (skim->constant_pool[i] == 0) {
+            continue;
+        }
+        const u1_t *entry = skim_entry(skim, i);
+        u2_t index = (entry[1] << 8) | entry[2];
+        if (index >= skim->constant_pool_count) {
+            continue;
+        }
+        switch (entry[0]) {
+        case CONSTANT_STRING:
+            worker->usage[index] |= SEARCH_STRING;
+            break;
+        case CONSTANT_CLASS:
+        case CONSTANT_NAME_AND_TYPE:
+            worker->usage[index] |= SEARCH_NAME;
+            break;
+        default:
+            break;
+        }
+    }
+    /* with -s alone, member names are filtered out whether marked or not */
+    if ((worker->contexts & SEARCH_NAME) == 0) {
+        return 0;
+    }
+
+    u4_t position = skim->position;
+    u2_t count;
+    int members;
+    if ((skim_skip(skim, 6) < 0) ||
+        (skim_u2(skim, &count) < 0) ||
+        (skim_skip(skim, 2 * (u4_t) count) < 0)) {
+        return -1;
+    }
+    for (members = 0; members < 2; members++) {
+        if (skim_u2(skim, &count) < 0) {
+            return -1;
+        }
+        for (i = 0; i < count; i++) {
+            u2_t name_index;
+            u2_t attributes_count;
+            u2_t j;
+            if ((skim_skip(skim, 2) < 0) ||
+                (skim_u2(skim, &name_index) < 0) ||
+                (skim_skip(skim, 2) < 0) ||
+                (skim_u2(skim, &attributes_count) < 0)) {
+                return -1;
+            }
+            if (name_index < skim->constant_pool_count) {
+                worker->usage[name_index] |= SEARCH_NAME;
+            }
+            for (j = 0; j < attributes_count; j++) {
+                u4_t length;
+                if ((skim_skip(skim, 2) < 0) ||
+                    (skim_u4(skim, &length) < 0) ||
+                    (skim_skip(skim, length) < 0)) {
+                    return -1;
+                }
+            }
+        }
+    }
+    skim->position = position;
+    return 0;
+}
+
+/* reports each pattern found in bytes once */
+static int search_utf8(search_worker_t *worker, const u1_t *name, u2_t name_length,
+                       int usage, const u1_t *bytes, u2_t length) {
+    automaton_t *automaton = worker->automaton;
+    const u4_t *delta = automaton->delta;
+    const u4_t *match = automaton->match;
+    const u4_t *output = automaton->output;
+    const u2_t *byte_class = automaton->byte_class;
+    u4_t classes = automaton->classes_count;
+    u4_t state = 0;
+    u4_t serial = ++worker->serial;
+    u2_t i;
+
+    for (i = 0; i < length; i++) {
+        state = delta[state * classes + byte_class[bytes[i]]];
+        if ((match[state] | output[state]) == 0) {
+            continue;
+        }
+        u4_t found = match[state] ? state : output[state];
+        while (found) {
+            u4_t pattern = match[found] - 1;
+            found = output[found];
+            if (worker->reported[pattern] == serial) {
+                continue;
+            }
+            worker->reported[pattern] = serial;
+            const char *context = (usage & SEARCH_STRING) ? "string" : (usage & SEARCH_NAME) ? "name" : "utf8";
+            if ((buffer_printf(&worker->out, "%.*s %s ", name_length, name, context) < 0) ||
+                (buffer_put_escaped(&worker->out, automaton->patterns[pattern].bytes,
+                                    automaton->patterns[pattern].length) < 0) ||
+                (buffer_put_u1(&worker->out, ' ') < 0) ||
+                (buffer_put_escaped(&worker->out, bytes, length) < 0) ||
+                (buffer_put_u1(&worker->out, '\n') < 0)) {
+                return -1;
+            }
+        }
+    }
+    return 0;
+}
+
+/* whole lines at a time; stdio keeps the writes of threads apart */
+static void flush_worker(search_worker_t *worker) {
+    if (worker->out.length) {
+        fwrite(worker->out.data, 1, worker->out.length, stdout);
+        worker->out.length = 0;
+    }
+}
+
+int search_main(int ac, char **av) {
+    automaton_t automaton;
+    corpus_t corpus;
+    u1_t **pattern_files = NULL;
+    int pattern_files_count = 0;
+    int threads = sysconf(_SC_NPROCESSORS_ONLN);
+    int contexts = 0;
+    int result = 1;
+    int c;
+    int i;
+
+    memset(&automaton, 0, sizeof(automaton));
+    memset(&corpus, 0, sizeof(corpus));
+    search_worker_t *workers = NULL;
+    void **worker_contexts = NULL;
+    pattern_files = calloc(ac, sizeof(u1_t *));
+    if (pattern_files == NULL) {
+        fprintf(stderr, "%s: failed to allocate the list of pattern files\n", program);
+        return 1;
+    }
+    while ((c = getopt(ac, av, "e:f:j:nsV:")) != -1) {
+        switch (c) {
+        case 'e':
+            if (add_pattern(&automaton, (const u1_t *) optarg, strlen(optarg)) < 0) {
+                goto RETURN;
+            }
+            break;
+        case 'f':
+            if (add_pattern_file(&automaton, optarg, &pattern_files[pattern_files_count++]) < 0) {
+                goto RETURN;
+            }
+            break;
+        case 'j':
+            threads = atoi(optarg);
+            break;
+        case 'n':
+            contexts |= SEARCH_NAME;
+            break;
+        case 's':
+            contexts |= SEARCH_STRING;
+            break;
+        case 'V':
+            if (corpus_set_versions(&corpus, optarg) < 0) {
+                goto RETURN;
+            }
+            break;
+        default:
+            goto USAGE;
+        }
+    }
+    if ((optind >= ac) || (automaton.patterns_count == 0)) {
+        goto USAGE;
+    }
+    if (contexts == 0) {
+        contexts = SEARCH_STRING | SEARCH_NAME | SEARCH_OTHER;
+    }
+    if (threads < 1) {
+        threads = 1;
+    }
+    if (build_automaton(&automaton) < 0) {
+        goto RETURN;
+    }
+
+    workers = calloc(threads, sizeof(search_worker_t));
+    worker_contexts = calloc(threads, sizeof(void *));
+    if ((workers == NULL) || (worker_contexts == NULL)) {
+        fprintf(stderr, "%s: failed to allocate %d workers\n", program, threads);
+        goto RETURN;
+    }
+    for (i = 0; i < threads; i++) {
+        workers[i].automaton = &automaton;
+        workers[i].contexts = contexts;
+        workers[i].reported = calloc(automaton.patterns_count, sizeof(u4_t));
+        if (workers[i].reported == NULL) {
+            fprintf(stderr, "%s: failed to allocate %d workers\n", program, threads);
+            goto RETURN;
+        }
+        worker_contexts[i] = &workers[i];
+    }
+    for (i = optind; i < ac; i++) {
+        if (corpus_add(&corpus, av[i]) < 0) {
+            goto RETURN;
+        }
+    }
+    if (corpus_run(&corpus, threads, search_class, worker_contexts) < 0) {
+        goto RETURN;
+    }
+    for (i = 0; i < threads; i++) {
+        flush_worker(&workers[i]);
+    }
+    result = corpus.unreadable ? 1 : 0;
+    goto RETURN;
+
+USAGE:
+    fprintf(stderr, "usage: %s search [-s] [-n] [-j threads] [-V versions] {-e pattern|-f pattern-file}... "
+            "{.class-file|directory|jar}...\n", program);
+
+RETURN:
+    if (workers) {
+        for (i = 0; i < threads; i++) {
+            free(workers[i].usage);
+            free(workers[i].reported);
+            buffer_free(&workers[i].out);
+        }
+    }
+    free(workers);
+    free(worker_contexts);
+    free_automaton(&automaton);
+    for (i = 0; i < pattern_files_count; i++) {
+        free(pattern_files[i]);
+    }
+    free(pattern_files);
+    corpus_free(&corpus);
+    return result;
+}
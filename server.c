@@ -0,0 +1,1194 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+
+#include "cjdc.h"
+
+/*
+ * "cjdc serve" keeps a classpath open and answers queries about its
+ * classes over a Unix domain socket, see the protocol in cjdc.h.
+ *
+ * One thread runs an epoll loop that accepts clients, reads request
+ * frames and writes replies.  Requests are handed to a pool of worker
+ * threads, which post the finished replies back to the loop through an
+ * eventfd.  A client has at most one request with the workers; further
+ * requests wait in its input buffer.  No new request starts while more
+ * than SERVER_MAX_OUTPUT bytes of replies wait to be sent, and a stalled
+ * connection is not read once its input holds a frame of the largest
+ * size, so a client that pipelines without reading cannot grow either
+ * buffer without limit.  A client that shuts down its side after sending
+ * still gets the replies to every complete request it sent.
+ *
+ * The classpath is the mmapped index from index.c plus the opened jars.
+ * Classes are parsed on first use and kept in a class cache, which with
+ * -m holds them under a memory budget and spills the least recently used
+ * ones to a file in the -T directory, see cache.c.  Once a second the loop
+ * checks the jars against the sizes and mtimes in the index; when one
+ * changed, a worker rebuilds the index incrementally and swaps in a new
+ * classpath.  Requests still using the old classpath hold a reference
+ * that keeps it alive until they finish.
+ */
+#define SERVER_CHECK_INTERVAL_MS    (1000)
+#define SERVER_MAX_EVENTS           (64)
+#define SERVER_MAX_SUPERS           (256)
+#define SERVER_MAX_INPUT            (4 + SERVER_MAX_REQUEST)    /* buffered while a connection is stalled */
+#define SERVER_MAX_OUTPUT           (1024 * 1024)                /* unsent replies that stall a connection */
+
+typedef struct classpath_s {
+    class_index_t *index;
+    jar_file_t **jars;          /* [containers_count], NULL for a jar that failed to open */
+    class_cache_t *classes;     /* by slot number, parsed on first use */
+    int references;             /* under server->lock */
+} classpath_t;
+
+typedef struct connection_s {
+    int fd;
+    buffer_t input;
+    buffer_t output;
+    size_t output_sent;
+    int writing;                /* registered for EPOLLOUT */
+    int paused;                 /* not registered for EPOLLIN: half closed, or the input is full while stalled */
+    int half_closed;            /* the client sent end of file, closed once nothing is left to answer */
+    int busy;                   /* a request is with the workers */
+    int closed;                 /* went away while busy, freed when the reply comes back */
+    struct connection_s *next_closed;
+} connection_t;
+
+/* a request for the workers; a job without a connection rebuilds the classpath */
+typedef struct server_job_s {
+    struct server_job_s *next;
+    connection_t *connection;
+    u1_t op;
+    char *name;
+    size_t name_length;
+    u1_t status;
+    buffer_t reply;
+} server_job_t;
+
+typedef struct server_s {
+    const char *index_file_name;
+    char **jar_names;
+    int jars_count;
+    int threads;
+    uint64_t budget;            /* bytes of parsed classes, 0 for no limit */
+    const char *spill_directory;
+    int epoll_fd;
+    int listen_fd;
+    int event_fd;
+    pthread_mutex_t lock;       /* everything below */
+    pthread_cond_t wakeup;
+    classpath_t *classpath;
+    server_job_t *pending;
+    server_job_t *pending_tail;
+    server_job_t *done;
+    connection_t *closed;       /* loop thread only: freed after each round of events */
+    int stopping;
+    int reloading;
+} server_t;
+
+static volatile sig_atomic_t stop_requested;
+
+static classpath_t *open_classpath(server_t *server);
+static void free_classpath(classpath_t *classpath);
+static classpath_t *acquire_classpath(server_t *server);
+static void release_classpath(server_t *server, classpath_t *classpath);
+static class_file_t *classpath_class(classpath_t *classpath, class_index_slot_t *slot);
+static void classpath_release_class(classpath_t *classpath, class_index_slot_t *slot);
+static int classpath_changed(classpath_t *classpath);
+
+static int run_event_loop(server_t *server);
+static void accept_connections(server_t *server);
+static void read_connection(server_t *server, connection_t *connection);
+static void process_input(server_t *server, connection_t *connection);
+static void flush_output(server_t *server, connection_t *connection);
+static void update_events(server_t *server, connection_t *connection);
+static int stalled(connection_t *connection);
+static int has_request(connection_t *connection);
+static void close_connection(server_t *server, connection_t *connection);
+static void free_connection(connection_t *connection);
+static void finish_jobs(server_t *server);
+static void queue_job(server_t *server, server_job_t *job);
+static void free_job(server_job_t *job);
+
+static void *server_worker(void *arg);
+static void run_job(server_t *server, server_job_t *job);
+static void reload_classpath(server_t *server);
+static int reply_dump(class_file_t *class_file, buffer_t *reply);
+static int reply_supers(classpath_t *classpath, class_file_t *class_file, buffer_t *reply);
+static int reply_references(class_file_t *class_file, buffer_t *reply);
+static int reply_constants(class_file_t *class_file, buffer_t *reply);
+static void reply_stats(classpath_t *classpath, buffer_t *reply);
+static int parse_budget(const char *text, uint64_t *budget);
+
+static int create_socket(const char *socket_name);
+static int connect_socket(const char *socket_name);
+static int send_fully(int fd, const u1_t *bytes, size_t length);
+static int receive_fully(int fd, u1_t *bytes, size_t length);
+static uint64_t now_ms(void);
+static void on_stop_signal(int signal_number);
+
+static classpath_t *open_classpath(server_t *server) {
+    classpath_t *classpath = calloc(1, sizeof(classpath_t));
+    if (classpath == NULL) {
+        fprintf(stderr, "%s: failed to malloc %zu bytes.\n", program, sizeof(classpath_t));
+        return NULL;
+    }
+    classpath->index = open_class_index(server->index_file_name);
+    if (classpath->index == NULL) {
+        goto ERR_RETURN;
+    }
+    class_index_header_t *header = classpath->index->header;
+    classpath->jars = calloc(header->containers_count ? header->containers_count : 1, sizeof(jar_file_t *));
+    if (classpath->jars == NULL) {
+        fprintf(stderr, "%s: failed to allocate classpath of %u jars\n", program, header->containers_count);
+        goto ERR_RETURN;
+    }
+    classpath->classes = open_class_cache(header->classes_count, server->budget, server->spill_directory);
+    if (classpath->classes == NULL) {
+        goto ERR_RETURN;
+    }
+    u4_t i;
+    for (i = 0; i < header->containers_count; i++) {
+        class_index_container_t *container = &classpath->index->containers[i];
+        char *path = strndup(classpath->index->strings + container->name_offset, container->name_length);
+        if (path == NULL) {
+            goto ERR_RETURN;
+        }
+        classpath->jars[i] = open_jar_file(path);
+        free(path);
+    }
+    return classpath;
+
+ERR_RETURN:
+    free_classpath(classpath);
+    return NULL;
+}
+
+static void free_classpath(classpath_t *classpath) {
+    if (classpath == NULL) {
+        return;
+    }
+    u4_t i;
+    close_class_cache(classpath->classes);
+    if (classpath->index && classpath->jars) {
+        for (i = 0; i < classpath->index->header->containers_count; i++) {
+            close_jar_file(classpath->jars[i]);
+        }
+    }
+    free(classpath->jars);
+    close_class_index(classpath->index);
+    free(classpath);
+}
+
+static classpath_t *acquire_classpath(server_t *server) {
+    pthread_mutex_lock(&server->lock);
+    classpath_t *classpath = server->classpath;
+    classpath->references++;
+    pthread_mutex_unlock(&server->lock);
+    return classpath;
+}
+
+static void release_classpath(server_t *server, classpath_t *classpath) {
+    pthread_mutex_lock(&server->lock);
+    int references = --classpath->references;
+    pthread_mutex_unlock(&server->lock);
+    if (references == 0) {
+        free_classpath(classpath);
+    }
+}
+
+/* the class pinned in the cache until classpath_release_class() */
+static class_file_t *classpath_class(classpath_t *classpath, class_index_slot_t *slot) {
+    u4_t number = slot - classpath->index->slots;
+    class_file_t *class_file = class_cache_acquire(classpath->classes, number);
+    if (class_file) {
+        return class_file;
+    }
+
+    jar_file_t *jar_file = (slot->container < classpath->index->header->containers_count) ? classpath->jars[slot->container] : NULL;
+    jar_entry_t *entry = jar_file ? find_jar_entry(jar_file, slot->offset) : NULL;
+    if (entry == NULL) {
+        return NULL;
+    }
+    u1_t *bytes = read_jar_entry(jar_file, entry);
+    return bytes ? class_cache_insert(classpath->classes, number, bytes, entry->uncompressed_size) : NULL;
+}
+
+static void classpath_release_class(classpath_t *classpath, class_index_slot_t *slot) {
+    class_cache_release(classpath->classes, slot - classpath->index->slots);
+}
+
+static int classpath_changed(classpath_t *classpath) {
+    class_index_t *index = classpath->index;
+    char path[PATH_MAX];
+    u4_t i;
+    for (i = 0; i < index->header->containers_count; i++) {
+        class_index_container_t *container = &index->containers[i];
+        struct stat st;
+        if (container->name_length >= sizeof(path)) {
+            continue;
+        }
+        memcpy(path, index->strings + container->name_offset, container->name_length);
+        path[container->name_length] = '\0';
+        if ((stat(path, &st) < 0) ||
+            (st.st_size != container->size) ||
+            (st.st_mtim.tv_sec != container->mtime_sec) ||
+            (st.st_mtim.tv_nsec != container->mtime_nsec)) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static int run_event_loop(server_t *server) {
+    struct epoll_event events[SERVER_MAX_EVENTS];
+    uint64_t last_check = now_ms();
+
+    while (!stop_requested) {
+        int count = epoll_wait(server->epoll_fd, events, SERVER_MAX_EVENTS, SERVER_CHECK_INTERVAL_MS);
+        if (count < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            fprintf(stderr, "%s: epoll_wait failed: %s\n", program, strerror(errno));
+            return -1;
+        }
+
+        int i;
+        for (i = 0; i < count; i++) {
+            void *source = events[i].data.ptr;
+            if (source == &server->listen_fd) {
+                accept_connections(server);
+            }
+            else if (source == &server->event_fd) {
+                uint64_t value;
+                if (read(server->event_fd, &value, sizeof(value)) < 0 && (errno != EAGAIN)) {
+                    fprintf(stderr, "%s: failed to read eventfd: %s\n", program, strerror(errno));
+                }
+                finish_jobs(server);
+            }
+            else {
+                connection_t *connection = source;
+                if (connection->paused && (events[i].events & (EPOLLHUP | EPOLLERR))) {
+                    close_connection(server, connection);
+                }
+                else if (events[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)) {
+                    read_connection(server, connection);
+                }
+                if ((connection->fd >= 0) && (events[i].events & EPOLLOUT)) {
+                    flush_output(server, connection);
+                    if (connection->fd >= 0) {
+                        process_input(server, connection);
+                        update_events(server, connection);
+                    }
+                }
+            }
+        }
+        while (server->closed) {
+            connection_t *connection = server->closed;
+            server->closed = connection->next_closed;
+            free_connection(connection);
+        }
+
+        uint64_t now = now_ms();
+        if (now - last_check >= SERVER_CHECK_INTERVAL_MS) {
+            last_check = now;
+            if (!server->reloading) {
+                classpath_t *classpath = acquire_classpath(server);
+                int changed = classpath_changed(classpath);
+                release_classpath(server, classpath);
+                if (changed) {
+                    server_job_t *job = calloc(1, sizeof(server_job_t));
+                    if (job) {
+                        server->reloading = 1;
+                        queue_job(server, job);
+                    }
+                }
+            }
+        }
+    }
+    return 0;
+}
+
+static void accept_connections(server_t *server) {
+    for (;;) {
+        int fd = accept4(server->listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            if ((errno != EAGAIN) && (errno != EWOULDBLOCK) && (errno != EINTR)) {
+                fprintf(stderr, "%s: accept failed: %s\n", program, strerror(errno));
+            }
+            return;
+        }
+        connection_t *connection = calloc(1, sizeof(connection_t));
+        if (connection == NULL) {
+            close(fd);
+            continue;
+        }
+        connection->fd = fd;
+        struct epoll_event event = {EPOLLIN | EPOLLRDHUP, {.ptr = connection}};
+        if (epoll_ctl(server->epoll_fd, EPOLL_CTL_ADD, fd, &event) < 0) {
+            fprintf(stderr, "%s: failed to watch client: %s\n", program, strerror(errno));
+            close(fd);
+            free(connection);
+        }
+    }
+}
+
+static void read_connection(server_t *server, connection_t *connection) {
+    for (;;) {
+        if (stalled(connection) && (connection->input.length >= SERVER_MAX_INPUT)) {
+            break;
+        }
+        if (buffer_reserve(&connection->input, 4096) < 0) {
+            close_connection(server, connection);
+            return;
+        }
+        ssize_t got = read(connection->fd, connection->input.data + connection->input.length,
+                           connection->input.capacity - connection->input.length);
+        if (got > 0) {
+            connection->input.length += got;
+            continue;
+        }
+        if ((got < 0) && (errno == EINTR)) {
+            continue;
+        }
+        if ((got < 0) && ((errno == EAGAIN) || (errno == EWOULDBLOCK))) {
+            break;
+        }
+        if (got == 0) {
+            connection->half_closed = 1;
+            break;
+        }
+        close_connection(server, connection);
+        return;
+    }
+    process_input(server, connection);
+    update_events(server, connection);
+}
+
+/* hands the next complete request frame to the workers */
+static void process_input(server_t *server, connection_t *connection) {
+    if (stalled(connection) || (connection->input.length < 4)) {
+        return;
+    }
+    u1_t *p = connection->input.data;
+    u4_t length = ((u4_t) p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+    if ((length == 0) || (length > SERVER_MAX_REQUEST)) {
+        close_connection(server, connection);
+        return;
+    }
+    if (connection->input.length < 4 + (size_t) length) {
+        return;
+    }
+
+    server_job_t *job = calloc(1, sizeof(server_job_t));
+    char *name = malloc(length);
+    if ((job == NULL) || (name == NULL)) {
+        free(job);
+        free(name);
+        close_connection(server, connection);
+        return;
+    }
+    job->connection = connection;
+    job->op = p[4];
+    job->name_length = length - 1;
+    memcpy(name, p + 5, job->name_length);
+    name[job->name_length] = '\0';
+    job->name = name;
+
+    memmove(p, p + 4 + length, connection->input.length - 4 - length);
+    connection->input.length -= 4 + length;
+    connection->busy = 1;
+    queue_job(server, job);
+}
+
+static void flush_output(server_t *server, connection_t *connection) {
+    while (connection->output_sent < connection->output.length) {
+        ssize_t sent = send(connection->fd, connection->output.data + connection->output_sent,
+                            connection->output.length - connection->output_sent, MSG_NOSIGNAL);
+        if (sent < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if ((errno == EAGAIN) || (errno == EWOULDBLOCK)) {
+                break;
+            }
+            close_connection(server, connection);
+            return;
+        }
+        connection->output_sent += sent;
+    }
+
+    if (connection->output_sent == connection->output.length) {
+        connection->output.length = 0;
+        connection->output_sent = 0;
+    }
+    else if (connection->output_sent >= SERVER_MAX_OUTPUT) {
+        /* a client that never quite catches up must not keep what was sent */
+        memmove(connection->output.data, connection->output.data + connection->output_sent,
+                connection->output.length - connection->output_sent);
+        connection->output.length -= connection->output_sent;
+        connection->output_sent = 0;
+    }
+    update_events(server, connection);
+}
+
+/*
+ * EPOLLOUT while output is pending; no EPOLLIN once the client sent end of
+ * file or while a stalled connection holds a full input buffer.  A half
+ * closed connection is closed when it has nothing left to answer.
+ */
+static void update_events(server_t *server, connection_t *connection) {
+    if (connection->fd < 0) {
+        return;
+    }
+    int writing = connection->output_sent < connection->output.length;
+    if (connection->half_closed && !writing && !connection->busy && !has_request(connection)) {
+        close_connection(server, connection);
+        return;
+    }
+    int paused = connection->half_closed || (stalled(connection) && (connection->input.length >= SERVER_MAX_INPUT));
+    if ((writing == connection->writing) && (paused == connection->paused)) {
+        return;
+    }
+    struct epoll_event event = {(paused ? 0 : EPOLLIN | EPOLLRDHUP) | (writing ? EPOLLOUT : 0), {.ptr = connection}};
+    epoll_ctl(server->epoll_fd, EPOLL_CTL_MOD, connection->fd, &event);
+    connection->writing = writing;
+    connection->paused = paused;
+}
+
+/* a request is with the workers, or the client is behind on reading replies */
+static int stalled(connection_t *connection) {
+    return connection->busy || (connection->output.length - connection->output_sent > SERVER_MAX_OUTPUT);
+}
+
+/* a whole frame is buffered, or a bad length that process_input() will reject */
+static int has_request(connection_t *connection) {
+    if (connection->input.length < 4) {
+        return 0;
+    }
+    u1_t *p = connection->input.data;
+    u4_t length = ((u4_t) p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+    return (length == 0) || (length > SERVER_MAX_REQUEST) || (connection->input.length >= 4 + (size_t) length);
+}
+
+static void close_connection(server_t *server, connection_t *connection) {
+    if (connection->fd < 0) {
+        return;
+    }
+    epoll_ctl(server->epoll_fd, EPOLL_CTL_DEL, connection->fd, NULL);
+    close(connection->fd);
+    connection->fd = -1;
+    if (connection->busy) {
+        connection->closed = 1;
+    }
+    else {
+        connection->next_closed = server->closed;
+        server->closed = connection;
+    }
+}
+
+static void free_connection(connection_t *connection) {
+    buffer_free(&connection->input);
+    buffer_free(&connection->output);
+    free(connection);
+}
+
+/* runs in the loop thread: sends back the replies the workers finished */
+static void finish_jobs(server_t *server) {
+    pthread_mutex_lock(&server->lock);
+    server_job_t *job = server->done;
+    server->done = NULL;
+    pthread_mutex_unlock(&server->lock);
+
+    while (job) {
+        server_job_t *next = job->next;
+        connection_t *connection = job->connection;
+        if (connection == NULL) {
+            server->reloading = 0;
+        }
+        else if (connection->closed) {
+            free_connection(connection);
+        }
+        else {
+            connection->busy = 0;
+            if ((buffer_put_u4(&connection->output, job->reply.length + 1) < 0) ||
+                (buffer_put_u1(&connection->output, job->status) < 0) ||
+                (buffer_put_bytes(&connection->output, job->reply.data, job->reply.length) < 0)) {
+                close_connection(server, connection);
+            }
+            else {
+                flush_output(server, connection);
+                if (connection->fd >= 0) {
+                    process_input(server, connection);
+                    update_events(server, connection);
+                }
+            }
+        }
+        free_job(job);
+        job = next;
+    }
+}
+
+static void queue_job(server_t *server, server_job_t *job) {
+    pthread_mutex_lock(&server->lock);
+    job->next = NULL;
+    if (server->pending_tail) {
+        server->pending_tail->next = job;
+    }
+    else {
+        server->pending = job;
+    }
+    server->pending_tail = job;
+    pthread_cond_signal(&server->wakeup);
+    pthread_mutex_unlock(&server->lock);
+}
+
+static void free_job(server_job_t *job) {
+    free(job->name);
+    buffer_free(&job->reply);
+    free(job);
+}
+
+static void *server_worker(void *arg) {
+    server_t *server = arg;
+    for (;;) {
+        pthread_mutex_lock(&server->lock);
+        while ((server->pending == NULL) && !server->stopping) {
+            pthread_cond_wait(&server->wakeup, &server->lock);
+        }
+        if (server->stopping) {
+            pthread_mutex_unlock(&server->lock);
+            return NULL;
+        }
+        server_job_t *job = server->pending;
+        server->pending = job->next;
+        if (server->pending == NULL) {
+            server->pending_tail = NULL;
+        }
+        pthread_mutex_unlock(&server->lock);
+
+        if (job->connection) {
+            run_job(server, job);
+        }
+        else {
+            reload_classpath(server);
+        }
+
+        pthread_mutex_lock(&server->lock);
+        job->next = server->done;
+        server->done = job;
+        pthread_mutex_unlock(&server->lock);
+        uint64_t one = 1;
+        if (write(server->event_fd, &one, sizeof(one)) < 0) {
+            fprintf(stderr, "%s: failed to write eventfd: %s\n", program, strerror(errno));
+        }
+    }
+}
+
+static void run_job(server_t *server, server_job_t *job) {
+    classpath_t *classpath = acquire_classpath(server);
+    if (job->op == SERVER_OP_STATS) {
+        reply_stats(classpath, &job->reply);
+        release_classpath(server, classpath);
+        job->status = SERVER_STATUS_OK;
+        return;
+    }
+    class_index_slot_t *slot = class_index_lookup(classpath->index, job->name, job->name_length);
+    class_file_t *class_file = slot ? classpath_class(classpath, slot) : NULL;
+    int result = -1;
+
+    if (slot == NULL) {
+        job->status = SERVER_STATUS_NOT_FOUND;
+        buffer_printf(&job->reply, "%s: not on the classpath\n", job->name);
+        release_classpath(server, classpath);
+        return;
+    }
+    if (class_file == NULL) {
+        job->status = SERVER_STATUS_ERROR;
+        buffer_printf(&job->reply, "%s: failed to read the class\n", job->name);
+        release_classpath(server, classpath);
+        return;
+    }
+
+    switch (job->op) {
+    case SERVER_OP_DUMP:
+        result = reply_dump(class_file, &job->reply);
+        break;
+    case SERVER_OP_SUPERS:
+        result = reply_supers(classpath, class_file, &job->reply);
+        break;
+    case SERVER_OP_REFERENCES:
+        result = reply_references(class_file, &job->reply);
+        break;
+    case SERVER_OP_CONSTANTS:
+        result = reply_constants(class_file, &job->reply);
+        break;
+    default:
+        break;
+    }
+    classpath_release_class(classpath, slot);
+    release_classpath(server, classpath);
+
+    job->status = SERVER_STATUS_OK;
+    if (result < 0) {
+        job->reply.length = 0;
+        job->status = SERVER_STATUS_ERROR;
+        buffer_printf(&job->reply, "%s: request %u failed\n", job->name, job->op);
+    }
+}
+
+static void reload_classpath(server_t *server) {
+    if (build_class_index(server->index_file_name, server->jar_names, server->jars_count, server->threads, 0) < 0) {
+        fprintf(stderr, "%s: keeping the previous classpath\n", program);
+        return;
+    }
+    classpath_t *classpath = open_classpath(server);
+    if (classpath == NULL) {
+        fprintf(stderr, "%s: keeping the previous classpath\n", program);
+        return;
+    }
+    classpath->references = 1;
+
+    pthread_mutex_lock(&server->lock);
+    classpath_t *old = server->classpath;
+    server->classpath = classpath;
+    pthread_mutex_unlock(&server->lock);
+    release_classpath(server, old);
+}
+
+static int reply_dump(class_file_t *class_file, buffer_t *reply) {
+    const u1_t *name;
+    const u1_t *descriptor;
+    u2_t name_length;
+    u2_t descriptor_length;
+    int i;
+
+    if (cp_class_name(class_file, class_file->this_class, &name, &name_length) < 0) {
+        return -1;
+    }
+    buffer_printf(reply, "class %.*s\n", name_length, name);
+    buffer_printf(reply, "version %u.%u\n", class_file->major_version, class_file->minor_version);
+    buffer_printf(reply, "flags 0x%04x\n", class_file->access_flags);
+    if (class_file->super_class) {
+        if (cp_class_name(class_file, class_file->super_class, &name, &name_length) < 0) {
+            return -1;
+        }
+        buffer_printf(reply, "super %.*s\n", name_length, name);
+    }
+    for (i = 0; i < class_file->interfaces_count; i++) {
+        if (cp_class_name(class_file, class_file->interfaces[i], &name, &name_length) < 0) {
+            return -1;
+        }
+        buffer_printf(reply, "interface %.*s\n", name_length, name);
+    }
+    for (i = 0; i < class_file->fields_count; i++) {
+        field_info_t *field = &class_file->fields[i];
+        if ((cp_utf8(class_file, field->name_index, &name, &name_length) < 0) ||
+            (cp_utf8(class_file, field->descriptor_index, &descriptor, &descriptor_length) < 0)) {
+            return -1;
+        }
+        buffer_printf(reply, "field 0x%04x %.*s %.*s\n", field->access_flags, name_length, name, descriptor_length, descriptor);
+    }
+    for (i = 0; i < class_file->methods_count; i++) {
+        method_info_t *method = &class_file->methods[i];
+        if ((cp_utf8(class_file, method->name_index, &name, &name_length) < 0) ||
+            (cp_utf8(class_file, method->descriptor_index, &descriptor, &descriptor_length) < 0)) {
+            return -1;
+        }
+        buffer_printf(reply, "method 0x%04x %.*s%.*s\n", method->access_flags, name_length, name, descriptor_length, descriptor);
+    }
+    for (i = 0; i < class_file->attributes_count; i++) {
+        if (cp_utf8(class_file, class_file->attributes[i].attribute_name_index, &name, &name_length) < 0) {
+            return -1;
+        }
+        buffer_printf(reply, "attribute %.*s %u\n", name_length, name, class_file->attributes[i].attribute_length);
+    }
+    return 0;
+}
+
+/* the superclasses of a class, nearest first; the chain ends at the first one not on the classpath */
+static int reply_supers(classpath_t *classpath, class_file_t *class_file, buffer_t *reply) {
+    class_index_slot_t *held = NULL;    /* the superclass being read, the caller holds the class itself */
+    int result = 0;
+    int depth;
+    for (depth = 0; class_file && class_file->super_class && (depth < SERVER_MAX_SUPERS); depth++) {
+        const u1_t *name;
+        u2_t name_length;
+        if (cp_class_name(class_file, class_file->super_class, &name, &name_length) < 0) {
+            result = -1;
+            break;
+        }
+        buffer_printf(reply, "%.*s\n", name_length, name);
+        class_index_slot_t *slot = class_index_lookup(classpath->index, (const char *) name, name_length);
+        class_file = slot ? classpath_class(classpath, slot) : NULL;
+        if (held) {
+            classpath_release_class(classpath, held);
+        }
+        held = class_file ? slot : NULL;
+    }
+    if (held) {
+        classpath_release_class(classpath, held);
+    }
+    return result;
+}
+
+static int reply_references(class_file_t *class_file, buffer_t *reply) {
+    const u1_t *owner;
+    const u1_t *name;
+    const u1_t *descriptor;
+    u2_t owner_length;
+    u2_t name_length;
+    u2_t descriptor_length;
+    int i;
+
+    for (i = 1; i < class_file->constant_pool_count; i++) {
+        cp_info_t *entry = &class_file->constant_pool[i - 1];
+        cp_info_t *name_and_type;
+        switch (entry->tag) {
+        case CONSTANT_CLASS:
+            if (i == class_file->this_class) {
+                break;
+            }
+            if (cp_class_name(class_file, i, &name, &name_length) < 0) {
+                return -1;
+            }
+            buffer_printf(reply, "class %.*s\n", name_length, name);
+            break;
+        case CONSTANT_FIELDREF:
+        case CONSTANT_METHODREF:
+        case CONSTANT_INTERFACE_METHODREF:
+            name_and_type = cp_entry(class_file, entry->u.cp_fieldref.name_and_type_index);
+            if ((name_and_type == NULL) || (name_and_type->tag != CONSTANT_NAME_AND_TYPE) ||
+                (cp_class_name(class_file, entry->u.cp_fieldref.class_index, &owner, &owner_length) < 0) ||
+                (cp_utf8(class_file, name_and_type->u.cp_name_and_type.name_index, &name, &name_length) < 0) ||
+                (cp_utf8(class_file, name_and_type->u.cp_name_and_type.descriptor_index, &descriptor, &descriptor_length) < 0)) {
+                return -1;
+            }
+            buffer_printf(reply, "%s %.*s.%.*s%s%.*s\n", (entry->tag == CONSTANT_FIELDREF) ? "field" : "method",
+                          owner_length, owner, name_length, name, (entry->tag == CONSTANT_FIELDREF) ? ":" : "",
+                          descriptor_length, descriptor);
+            break;
+        default:
+            break;
+        }
+    }
+    return 0;
+}
+
+static int reply_constants(class_file_t *class_file, buffer_t *reply) {
+    int i;
+    for (i = 1; i < class_file->constant_pool_count; i++) {
+        cp_info_t *entry = &class_file->constant_pool[i - 1];
+        const u1_t *bytes;
+        u2_t length;
+        uint64_t bits;
+        float float_value;
+        double double_value;
+        u4_t int_bits;
+
+        switch (entry->tag) {
+        case CONSTANT_STRING:
+            if (cp_utf8(class_file, entry->u.cp_string.name_index, &bytes, &length) < 0) {
+                return -1;
+            }
+            buffer_printf(reply, "string ");
+            buffer_put_escaped(reply, bytes, length);
+            buffer_printf(reply, "\n");
+            break;
+        case CONSTANT_INTEGER:
+            buffer_printf(reply, "int %d\n", (int32_t) entry->u.cp_integer.bytes);
+            break;
+        case CONSTANT_FLOAT:
+            int_bits = entry->u.cp_float.bytes;
+            memcpy(&float_value, &int_bits, sizeof(float_value));
+            buffer_printf(reply, "float %.9g\n", float_value);
+            break;
+        case CONSTANT_LONG:
+            bits = ((uint64_t) entry->u.cp_long.high_bytes << 32) | entry->u.cp_long.low_bytes;
+            buffer_printf(reply, "long %lld\n", (long long) (int64_t) bits);
+            break;
+        case CONSTANT_DOUBLE:
+            bits = ((uint64_t) entry->u.cp_double.high_bytes << 32) | entry->u.cp_double.low_bytes;
+            memcpy(&double_value, &bits, sizeof(double_value));
+            buffer_printf(reply, "double %.17g\n", double_value);
+            break;
+        default:
+            break;
+        }
+    }
+    return 0;
+}
+
+static void reply_stats(classpath_t *classpath, buffer_t *reply) {
+    class_cache_stats_t stats;
+    class_cache_stats(classpath->classes, &stats);
+    buffer_printf(reply, "hits %llu\n", (unsigned long long) stats.hits);
+    buffer_printf(reply, "misses %llu\n", (unsigned long long) stats.misses);
+    buffer_printf(reply, "reloads %llu\n", (unsigned long long) stats.reloads);
+    buffer_printf(reply, "evictions %llu\n", (unsigned long long) stats.evictions);
+    buffer_printf(reply, "spills %llu\n", (unsigned long long) stats.spills);
+    buffer_printf(reply, "spill_bytes %llu\n", (unsigned long long) stats.spill_bytes);
+    buffer_printf(reply, "resident_classes %llu\n", (unsigned long long) stats.resident_classes);
+    buffer_printf(reply, "resident_bytes %llu\n", (unsigned long long) stats.resident_bytes);
+    buffer_printf(reply, "peak_bytes %llu\n", (unsigned long long) stats.peak_bytes);
+}
+
+/* a number of bytes with an optional k, m or g suffix */
+static int parse_budget(const char *text, uint64_t *budget) {
+    char *end;
+    errno = 0;
+    unsigned long long value = strtoull(text, &end, 10);
+    int shift = 0;
+    switch (*end) {
+    case 'k': case 'K':
+        shift = 10;
+        end++;
+        break;
+    case 'm': case 'M':
+        shift = 20;
+        end++;
+        break;
+    case 'g': case 'G':
+        shift = 30;
+        end++;
+        break;
+    default:
+        break;
+    }
+    if ((end == text) || (*end != '\0') || errno || (value > (UINT64_MAX >> shift))) {
+        fprintf(stderr, "%s: bad memory budget '%s'\n", program, text);
+        return -1;
+    }
+    *budget = (uint64_t) value << shift;
+    return 0;
+}
+
+static int create_socket(const char *socket_name) {
+    struct sockaddr_un address;
+    if (strlen(socket_name) >= sizeof(address.sun_path)) {
+        fprintf(stderr, "%s: socket path '%s' is too long\n", program, socket_name);
+        return -1;
+    }
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strcpy(address.sun_path, socket_name);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        fprintf(stderr, "%s: failed to create socket: %s\n", program, strerror(errno));
+        return -1;
+    }
+    /* a socket left behind by a previous server */
+    struct stat st;
+    if ((stat(socket_name, &st) == 0) && S_ISSOCK(st.st_mode)) {
+        unlink(socket_name);
+    }
+    if ((bind(fd, (struct sockaddr *) &address, sizeof(address)) < 0) || (listen(fd, 128) < 0)) {
+        fprintf(stderr, "%s: failed to listen on '%s': %s\n", program, socket_name, strerror(errno));
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static int connect_socket(const char *socket_name) {
+    struct sockaddr_un address;
+    if (strlen(socket_name) >= sizeof(address.sun_path)) {
+        fprintf(stderr, "%s: socket path '%s' is too long\n", program, socket_name);
+        return -1;
+    }
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strcpy(address.sun_path, socket_name);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        fprintf(stderr, "%s: failed to create socket: %s\n", program, strerror(errno));
+        return -1;
+    }
+    if (connect(fd, (struct sockaddr *) &address, sizeof(address)) < 0) {
+        fprintf(stderr, "%s: failed to connect to '%s': %s\n", program, socket_name, strerror(errno));
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static int send_fully(int fd, const u1_t *bytes, size_t length) {
+    while (length) {
+        ssize_t sent = send(fd, bytes, length, MSG_NOSIGNAL);
+        if (sent < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            fprintf(stderr, "%s: failed to send request: %s\n", program, strerror(errno));
+            return -1;
+        }
+        bytes += sent;
+        length -= sent;
+    }
+    return 0;
+}
+
+static int receive_fully(int fd, u1_t *bytes, size_t length) {
+    while (length) {
+        ssize_t got = recv(fd, bytes, length, 0);
+        if (got < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            fprintf(stderr, "%s: failed to receive reply: %s\n", program, strerror(errno));
+            return -1;
+        }
+        if (got == 0) {
+            fprintf(stderr, "%s: server closed the connection\n", program);
+            return -1;
+        }
+        bytes += got;
+        length -= got;
+    }
+    return 0;
+}
+
+static uint64_t now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static void on_stop_signal(int signal_number) {
+    (void) signal_number;
+    stop_requested = 1;
+}
+
+int serve_main(int ac, char **av) {
+    server_t server;
+    int threads = sysconf(_SC_NPROCESSORS_ONLN);
+    uint64_t budget = 0;
+    const char *spill_directory = getenv("TMPDIR");
+    int c;
+
+    while ((c = getopt(ac, av, "j:m:T:")) != -1) {
+        switch (c) {
+        case 'j':
+            threads = atoi(optarg);
+            break;
+        case 'm':
+            if (parse_budget(optarg, &budget) < 0) {
+                return 1;
+            }
+            break;
+        case 'T':
+            spill_directory = optarg;
+            break;
+        default:
+            fprintf(stderr, "usage: %s serve [-j threads] [-m budget] [-T spill-directory] {socket} {index} {jar}...\n", program);
+            return 1;
+        }
+    }
+    if (ac - optind < 2) {
+        fprintf(stderr, "usage: %s serve [-j threads] [-m budget] [-T spill-directory] {socket} {index} {jar}...\n", program);
+        return 1;
+    }
+    /* one worker may be busy rebuilding the index */
+    if (threads < 2) {
+        threads = 2;
+    }
+
+    memset(&server, 0, sizeof(server));
+    const char *socket_name = av[optind];
+    server.index_file_name = av[optind + 1];
+    server.jar_names = av + optind + 2;
+    server.jars_count = ac - optind - 2;
+    server.threads = threads;
+    server.budget = budget;
+    server.spill_directory = spill_directory ? spill_directory : "/tmp";
+    server.epoll_fd = -1;
+    server.listen_fd = -1;
+    server.event_fd = -1;
+    pthread_mutex_init(&server.lock, NULL);
+    pthread_cond_init(&server.wakeup, NULL);
+
+    pthread_t *workers = calloc(threads, sizeof(pthread_t));
+    int started = 0;
+    int result = 1;
+    if (workers == NULL) {
+        fprintf(stderr, "%s: failed to allocate %d threads\n", program, threads);
+        goto RETURN;
+    }
+
+    if (build_class_index(server.index_file_name, server.jar_names, server.jars_count, threads, 0) < 0) {
+        goto RETURN;
+    }
+    server.classpath = open_classpath(&server);
+    if (server.classpath == NULL) {
+        goto RETURN;
+    }
+    server.classpath->references = 1;
+
+    server.listen_fd = create_socket(socket_name);
+    server.event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    server.epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if ((server.listen_fd < 0) || (server.event_fd < 0) || (server.epoll_fd < 0)) {
+        fprintf(stderr, "%s: failed to set up the server: %s\n", program, strerror(errno));
+        goto RETURN;
+    }
+    struct epoll_event listen_event = {EPOLLIN, {.ptr = &server.listen_fd}};
+    struct epoll_event job_event = {EPOLLIN, {.ptr = &server.event_fd}};
+    if ((epoll_ctl(server.epoll_fd, EPOLL_CTL_ADD, server.listen_fd, &listen_event) < 0) ||
+        (epoll_ctl(server.epoll_fd, EPOLL_CTL_ADD, server.event_fd, &job_event) < 0)) {
+        fprintf(stderr, "%s: failed to set up epoll: %s\n", program, strerror(errno));
+        goto RETURN;
+    }
+
+    for (started = 0; started < threads; started++) {
+        if (pthread_create(&workers[started], NULL, server_worker, &server) != 0) {
+            fprintf(stderr, "%s: failed to start worker thread\n", program);
+            goto RETURN;
+        }
+    }
+
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = on_stop_signal;
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    fprintf(stderr, "%s: serving %u classes on '%s'\n", program, server.classpath->index->header->classes_count, socket_name);
+    result = run_event_loop(&server) < 0;
+
+RETURN:
+    pthread_mutex_lock(&server.lock);
+    server.stopping = 1;
+    pthread_cond_broadcast(&server.wakeup);
+    pthread_mutex_unlock(&server.lock);
+    int i;
+    for (i = 0; i < started; i++) {
+        pthread_join(workers[i], NULL);
+    }
+    free(workers);
+    /* connections still open are reclaimed by the exit */
+    while (server.pending) {
+        server_job_t *job = server.pending;
+        server.pending = job->next;
+        free_job(job);
+    }
+    while (server.done) {
+        server_job_t *job = server.done;
+        server.done = job->next;
+        free_job(job);
+    }
+    if (server.listen_fd >= 0) {
+        close(server.listen_fd);
+        unlink(socket_name);
+    }
+    if (server.event_fd >= 0) {
+        close(server.event_fd);
+    }
+    if (server.epoll_fd >= 0) {
+        close(server.epoll_fd);
+    }
+    if (server.classpath && budget) {
+        class_cache_stats_t stats;
+        class_cache_stats(server.classpath->classes, &stats);
+        fprintf(stderr, "%s: %llu hits, %llu misses, %llu reloads, %llu evictions, %llu classes spilled in %llu bytes\n", program,
+                (unsigned long long) stats.hits, (unsigned long long) stats.misses, (unsigned long long) stats.reloads,
+                (unsigned long long) stats.evictions, (unsigned long long) stats.spills, (unsigned long long) stats.spill_bytes);
+    }
+    free_classpath(server.classpath);
+    pthread_cond_destroy(&server.wakeup);
+    pthread_mutex_destroy(&server.lock);
+    return result;
+}
+
+/* sends each class name as one request and prints the replies; stats takes no names */
+int query_main(int ac, char **av) {
+    static const char *ops[] = {NULL, "dump", "supers", "references", "constants", "stats"};
+    static char *no_names[] = {""};
+
+    if (ac < 3) {
+        fprintf(stderr, "usage: %s query {socket} {dump|supers|references|constants|stats} {class-name}...\n", program);
+        return 1;
+    }
+    u1_t op;
+    for (op = SERVER_OP_DUMP; op <= SERVER_OP_STATS; op++) {
+        if (strcmp(av[2], ops[op]) == 0) {
+            break;
+        }
+    }
+    if (op > SERVER_OP_STATS) {
+        fprintf(stderr, "%s: unknown query '%s'\n", program, av[2]);
+        return 1;
+    }
+    char **names = av + 3;
+    int names_count = ac - 3;
+    if (op == SERVER_OP_STATS) {
+        names = no_names;
+        names_count = 1;
+    }
+    if (names_count == 0) {
+        fprintf(stderr, "usage: %s query {socket} {dump|supers|references|constants|stats} {class-name}...\n", program);
+        return 1;
+    }
+
+    int fd = connect_socket(av[1]);
+    if (fd < 0) {
+        return 1;
+    }
+    buffer_t frame = {NULL, 0, 0};
+    int result = 0;
+    int i;
+    for (i = 0; i < names_count; i++) {
+        size_t length = strlen(names[i]);
+        u1_t header[5];
+        if (length + 1 > SERVER_MAX_REQUEST) {
+            fprintf(stderr, "%s: class name '%s' is too long\n", program, names[i]);
+            result = 1;
+            break;
+        }
+        frame.length = 0;
+        if ((buffer_put_u4(&frame, length + 1) < 0) ||
+            (buffer_put_u1(&frame, op) < 0) ||
+            (buffer_put_bytes(&frame, names[i], length) < 0) ||
+            (send_fully(fd, frame.data, frame.length) < 0) ||
+            (receive_fully(fd, header, 5) < 0)) {
+            result = 1;
+            break;
+        }
+        u4_t reply_length = ((u4_t) header[0] << 24) | (header[1] << 16) | (header[2] << 8) | header[3];
+        if (reply_length == 0) {
+            fprintf(stderr, "%s: empty reply\n", program);
+            result = 1;
+            break;
+        }
+        frame.length = 0;
+        if ((buffer_reserve(&frame, reply_length) < 0) ||
+            (receive_fully(fd, frame.data, reply_length - 1) < 0)) {
+            result = 1;
+            break;
+        }
+        fwrite(frame.data, 1, reply_length - 1, (header[4] == SERVER_STATUS_OK) ? stdout : stderr);
+        if (header[4] != SERVER_STATUS_OK) {
+            result = 1;
+        }
+    }
+    buffer_free(&frame);
+    close(fd);
+    return result;
+}
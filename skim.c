@@ -0,0 +1,201 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <endian.h>
+
+#include "cjdc.h"
+
+/*
+ * Reading a class without decoding it.  skim_class_bytes() checks the
+ * magic, reads the versions and reduces the constant pool to a table of
+ * offsets, leaving the cursor at access_flags; callers then walk the
+ * rest themselves with skim_u2()/skim_u4()/skim_skip() and resolve names
+ * through the offsets.  Nothing is copied out of the class bytes.
+ */
+int skim_class_bytes(class_skim_t *skim, const u1_t *bytes, u4_t length) {
+    u4_t magic;
+
+    memset(skim, 0, sizeof(*skim));
+    skim->data = bytes;
+    skim->length = length;
+    if ((skim_u4(skim, &magic) < 0) || (magic != CLASS_FILE_MAGIC)) {
+        fprintf(stderr, "%s: not a class file\n", program);
+        return -1;
+    }
+    if ((skim_u2(skim, &skim->minor_version) < 0) ||
+        (skim_u2(skim, &skim->major_version) < 0) ||
+        (skim_u2(skim, &skim->constant_pool_count) < 0)) {
+        return -1;
+    }
+
+    skim->constant_pool = calloc(skim->constant_pool_count ? skim->constant_pool_count : 1, sizeof(u4_t));
+    if (skim->constant_pool == NULL) {
+        fprintf(stderr, "%s: failed to allocate %u constant pool offsets\n", program, skim->constant_pool_count);
+        return -1;
+    }
+
+    u4_t i;
+    for (i = 1; i < skim->constant_pool_count; i++) {
+        u2_t utf8_length;
+        if (skim->position >= skim->length) {
+            fprintf(stderr, "%s: truncated constant pool\n", program);
+            goto ERR_RETURN;
+        }
+        skim->constant_pool[i] = skim->position;
+        u1_t tag = skim->data[skim->position++];
+        switch (tag) {
+        case CONSTANT_UTF8:
+            if ((skim_u2(skim, &utf8_length) < 0) || (skim_skip(skim, utf8_length) < 0)) {
+                goto ERR_RETURN;
+            }
+            break;
+        case CONSTANT_CLASS:
+        case CONSTANT_STRING:
+        case CONSTANT_METHOD_TYPE:
+        case CONSTANT_MODULE:
+        case CONSTANT_PACKAGE:
+            if (skim_skip(skim, 2) < 0) {
+                goto ERR_RETURN;
+            }
+            break;
+        case CONSTANT_METHOD_HANDLE:
+            if (skim_skip(skim, 3) < 0) {
+                goto ERR_RETURN;
+            }
+            break;
+        case CONSTANT_INTEGER:
+        case CONSTANT_FLOAT:
+        case CONSTANT_FIELDREF:
+        case CONSTANT_METHODREF:
+        case CONSTANT_INTERFACE_METHODREF:
+        case CONSTANT_NAME_AND_TYPE:
+        case CONSTANT_DYNAMIC:
+        case CONSTANT_INVOKE_DYNAMIC:
+            if (skim_skip(skim, 4) < 0) {
+                goto ERR_RETURN;
+            }
+            break;
+        case CONSTANT_LONG:
+        case CONSTANT_DOUBLE:
+            if (skim_skip(skim, 8) < 0) {
+                goto ERR_RETURN;
+            }
+            i++;
+            break;
+        default:
+            fprintf(stderr, "%s: unknown constant pool tag %u at index %u\n", program, tag, i);
+            goto ERR_RETURN;
+        }
+    }
+    return 0;
+
+ERR_RETURN:
+    skim_free(skim);
+    return -1;
+}
+
+void skim_free(class_skim_t *skim) {
+    free(skim->constant_pool);
+    skim->constant_pool = NULL;
+}
+
+/* the tag byte of a constant pool entry followed by its body, NULL for an invalid index */
+const u1_t *skim_entry(class_skim_t *skim, u2_t index) {
+    if ((index == 0) || (index >= skim->constant_pool_count)) {
+        return NULL;
+    }
+    return skim->data + skim->constant_pool[index];
+}
+
+int skim_utf8(class_skim_t *skim, u2_t index, const u1_t **bytes, u2_t *length) {
+    const u1_t *entry = skim_entry(skim, index);
+    if ((entry == NULL) || (entry[0] != CONSTANT_UTF8)) {
+        fprintf(stderr, "%s: constant pool index %u is not a UTF8 entry\n", program, index);
+        return -1;
+    }
+    *length = (entry[1] << 8) | entry[2];
+    *bytes = entry + 3;
+    return 0;
+}
+
+int skim_class_name(class_skim_t *skim, u2_t index, const u1_t **bytes, u2_t *length) {
+    const u1_t *entry = skim_entry(skim, index);
+    if ((entry == NULL) || (entry[0] != CONSTANT_CLASS)) {
+        fprintf(stderr, "%s: constant pool index %u is not a Class entry\n", program, index);
+        return -1;
+    }
+    return skim_utf8(skim, (entry[1] << 8) | entry[2], bytes, length);
+}
+
+int skim_utf8_is(class_skim_t *skim, u2_t index, const char *s) {
+    const u1_t *entry = skim_entry(skim, index);
+    size_t length = strlen(s);
+    return entry && (entry[0] == CONSTANT_UTF8) &&
+        ((size_t) ((entry[1] << 8) | entry[2]) == length) &&
+        (memcmp(entry + 3, s, length) == 0);
+}
+
+int skim_skip(class_skim_t *skim, u4_t count) {
+    if (skim->length - skim->position < count) {
+        fprintf(stderr, "%s: truncated class file at offset %u\n", program, skim->position);
+        return -1;
+    }
+    skim->position += count;
+    return 0;
+}
+
+int skim_u2(class_skim_t *skim, u2_t *value) {
+    if (skim_skip(skim, 2) < 0) {
+        return -1;
+    }
+    const u1_t *p = skim->data + skim->position - 2;
+    *value = (p[0] << 8) | p[1];
+    return 0;
+}
+
+int skim_u4(class_skim_t *skim, u4_t *value) {
+    if (skim_skip(skim, 4) < 0) {
+        return -1;
+    }
+    const u1_t *p = skim->data + skim->position - 4;
+    *value = ((u4_t) p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+    return 0;
+}
+
+/* this_class of a skimmed class; the cursor is left after super_class */
+int skim_this_class(class_skim_t *skim, const u1_t **bytes, u2_t *length) {
+    u2_t this_class;
+    if ((skim_skip(skim, 2) < 0) ||
+        (skim_u2(skim, &this_class) < 0) ||
+        (skim_skip(skim, 2) < 0)) {
+        return -1;
+    }
+    return skim_class_name(skim, this_class, bytes, length);
+}
+
+/*
+ * What an input is, from one load of its first SNIFF_LENGTH bytes: a
+ * class with a major version in [min_major, max_major], a class outside
+ * that range, a jar, or something else.  Lets callers turn away what
+ * they do not want before allocating or inflating anything for it.
+ */
+input_kind_t sniff_input(const u1_t *bytes, u4_t length, u2_t min_major, u2_t max_major) {
+    uint64_t head;
+    if (length < SNIFF_LENGTH) {
+        return INPUT_OTHER;
+    }
+    memcpy(&head, bytes, sizeof(head));
+    head = be64toh(head);
+    if ((head >> 32) == CLASS_FILE_MAGIC) {
+        u2_t major_version = head & 0xffff;
+        if ((major_version < min_major) || (major_version > max_major)) {
+            return INPUT_CLASS_OUT_OF_RANGE;
+        }
+        return INPUT_CLASS;
+    }
+    /* a local file header, or the end of central directory of an empty zip */
+    if (((head >> 32) == 0x504b0304) || ((head >> 32) == 0x504b0506)) {
+        return INPUT_JAR;
+    }
+    return INPUT_OTHER;
+}
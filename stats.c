@@ -0,0 +1,409 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "cjdc.h"
+
+/*
+ * cjdc stats streams over class files, directories and jars and adds up
+ * opcode, constant pool, attribute and size counts.  Classes are walked
+ * with the skim, so no class_file_t is built; each thread keeps its own
+ * counters and they are summed once all classes are done.
+ */
+
+#define STATS_BUCKETS           (33)    /* 0, 1, 2-3, 4-7, ... */
+#define STATS_CONSTANT_TAGS     (32)
+#define STATS_MAJOR_VERSIONS    (256)
+
+/* nothing but uint64_t counters, merge_stats() relies on it */
+typedef struct class_stats_s {
+    uint64_t classes;
+    uint64_t unreadable;
+    uint64_t skipped;           /* outside the -V range */
+    uint64_t bytes;
+    uint64_t fields;
+    uint64_t methods;
+    uint64_t code_attributes;
+    uint64_t code_bytes;
+    uint64_t instructions;
+    uint64_t bad_code;
+    uint64_t major_versions[STATS_MAJOR_VERSIONS];
+    uint64_t other_versions;    /* major version STATS_MAJOR_VERSIONS or above */
+    uint64_t constants[STATS_CONSTANT_TAGS];
+    uint64_t attributes[ATTRIBUTE_KIND_COUNT];
+    uint64_t opcodes[256];
+    uint64_t utf8_lengths[STATS_BUCKETS];
+    uint64_t string_lengths[STATS_BUCKETS];
+    uint64_t code_lengths[STATS_BUCKETS];
+} class_stats_t;
+
+typedef struct stats_worker_s {
+    class_stats_t stats;
+    u1_t *kinds;                /* attribute kind of each constant pool index, 0xff until looked up */
+    u4_t kinds_capacity;
+} stats_worker_t;
+
+typedef struct opcode_count_s {
+    int opcode;
+    uint64_t count;
+} opcode_count_t;
+
+static const char *constant_tag_names[STATS_CONSTANT_TAGS] = {
+    [CONSTANT_UTF8] = "Utf8",
+    [CONSTANT_INTEGER] = "Integer",
+    [CONSTANT_FLOAT] = "Float",
+    [CONSTANT_LONG] = "Long",
+    [CONSTANT_DOUBLE] = "Double",
+    [CONSTANT_CLASS] = "Class",
+    [CONSTANT_STRING] = "String",
+    [CONSTANT_FIELDREF] = "Fieldref",
+    [CONSTANT_METHODREF] = "Methodref",
+    [CONSTANT_INTERFACE_METHODREF] = "InterfaceMethodref",
+    [CONSTANT_NAME_AND_TYPE] = "NameAndType",
+    [CONSTANT_METHOD_HANDLE] = "MethodHandle",
+    [CONSTANT_METHOD_TYPE] = "MethodType",
+    [CONSTANT_DYNAMIC] = "Dynamic",
+    [CONSTANT_INVOKE_DYNAMIC] = "InvokeDynamic",
+    [CONSTANT_MODULE] = "Module",
+    [CONSTANT_PACKAGE] = "Package",
+};
+
+static int stats_class(void *context, const u1_t *bytes, u4_t length);
+static int stats_members(stats_worker_t *worker, class_skim_t *skim, uint64_t *members);
+static int stats_attributes(stats_worker_t *worker, class_skim_t *skim);
+static int stats_code(stats_worker_t *worker, class_skim_t *skim, u4_t end);
+static attribute_kind_t skim_attribute_kind(stats_worker_t *worker, class_skim_t *skim, u2_t name_index);
+static int bucket(uint64_t value);
+
+static void merge_stats(class_stats_t *total, class_stats_t *stats);
+static void print_stats(class_stats_t *stats);
+static void print_buckets(const char *section, uint64_t *buckets);
+static int compare_opcodes(const void *a, const void *b);
+
+/* a malformed class keeps what was counted before the error; corpus_run() counts it as unreadable */
+static int stats_class(void *context, const u1_t *bytes, u4_t length) {
+    stats_worker_t *worker = context;
+    class_stats_t *stats = &worker->stats;
+    class_skim_t skim;
+    u2_t interfaces_count;
+    u4_t i;
+
+    if (skim_class_bytes(&skim, bytes, length) < 0) {
+        return -1;
+    }
+    if (skim.constant_pool_count > worker->kinds_capacity) {
+        u1_t *kinds = realloc(worker->kinds, skim.constant_pool_count);
+        if (kinds == NULL) {
+            fprintf(stderr, "%s: failed to malloc %u bytes.\n", program, skim.constant_pool_count);
+            goto ERR_RETURN;
+        }
+        worker->kinds = kinds;
+        worker->kinds_capacity = skim.constant_pool_count;
+    }
+    memset(worker->kinds, 0xff, skim.constant_pool_count);
+
+    for (i = 1; i < skim.constant_pool_count; i++) {
+        const u1_t *utf8;
+        u2_t utf8_length;
+        if (skim.constant_pool[i] == 0) {
+            continue;           /* second slot of a long or double */
+        }
+        const u1_t *entry = skim_entry(&skim, i);
+        stats->constants[entry[0]]++;
+        if (entry[0] == CONSTANT_UTF8) {
+            stats->utf8_lengths[bucket((entry[1] << 8) | entry[2])]++;
+        }
+        else if (entry[0] == CONSTANT_STRING) {
+            if (skim_utf8(&skim, (entry[1] << 8) | entry[2], &utf8, &utf8_length) < 0) {
+                goto ERR_RETURN;
+            }
+            stats->string_lengths[bucket(utf8_length)]++;
+        }
+    }
+
+    if ((skim_skip(&skim, 6) < 0) ||
+        (skim_u2(&skim, &interfaces_count) < 0) ||
+        (skim_skip(&skim, 2 * (u4_t) interfaces_count) < 0) ||
+        (stats_members(worker, &skim, &stats->fields) < 0) ||
+        (stats_members(worker, &skim, &stats->methods) < 0) ||
+        (stats_attributes(worker, &skim) < 0)) {
+        goto ERR_RETURN;
+    }
+    if (skim.major_version < STATS_MAJOR_VERSIONS) {
+        stats->major_versions[skim.major_version]++;
+    }
+    else {
+        stats->other_versions++;
+    }
+    stats->classes++;
+    stats->bytes += length;
+    skim_free(&skim);
+    return 0;
+
+ERR_RETURN:
+    skim_free(&skim);
+    return -1;
+}
+
+/* the fields or the methods of a class */
+static int stats_members(stats_worker_t *worker, class_skim_t *skim, uint64_t *members) {
+    u2_t count;
+    u2_t i;
+    if (skim_u2(skim, &count) < 0) {
+        return -1;
+    }
+    *members += count;
+    for (i = 0; i < count; i++) {
+        if ((skim_skip(skim, 6) < 0) || (stats_attributes(worker, skim) < 0)) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static int stats_attributes(stats_worker_t *worker, class_skim_t *skim) {
+    u2_t count;
+    u2_t i;
+    if (skim_u2(skim, &count) < 0) {
+        return -1;
+    }
+    for (i = 0; i < count; i++) {
+        u2_t name_index;
+        u4_t length;
+        if ((skim_u2(skim, &name_index) < 0) ||
+            (skim_u4(skim, &length) < 0)) {
+            return -1;
+        }
+        if (length > skim->length - skim->position) {
+            fprintf(stderr, "%s: attribute of %u bytes runs past the end of the class\n", program, length);
+            return -1;
+        }
+        u4_t end = skim->position + length;
+        attribute_kind_t kind = skim_attribute_kind(worker, skim, name_index);
+        worker->stats.attributes[kind]++;
+        if ((kind == ATTRIBUTE_CODE) && (stats_code(worker, skim, end) < 0)) {
+            return -1;
+        }
+        skim->position = end;
+    }
+    return 0;
+}
+
+static int stats_code(stats_worker_t *worker, class_skim_t *skim, u4_t end) {
+    class_stats_t *stats = &worker->stats;
+    u4_t code_length;
+    u2_t exception_table_length;
+
+    if ((skim_skip(skim, 4) < 0) || (skim_u4(skim, &code_length) < 0) ||
+        (code_length > end - skim->position)) {
+        return -1;
+    }
+    const u1_t *code = skim->data + skim->position;
+    stats->code_attributes++;
+    stats->code_bytes += code_length;
+    stats->code_lengths[bucket(code_length)]++;
+
+    u4_t pc = 0;
+    while (pc < code_length) {
+        int length = instruction_length(code, code_length, pc);
+        if (length < 0) {
+            stats->bad_code++;
+            break;
+        }
+        stats->opcodes[code[pc]]++;
+        stats->instructions++;
+        pc += length;
+    }
+
+    /* LineNumberTable and the like nest in Code */
+    if ((skim_skip(skim, code_length) < 0) ||
+        (skim_u2(skim, &exception_table_length) < 0) ||
+        (skim_skip(skim, 8 * (u4_t) exception_table_length) < 0) ||
+        (stats_attributes(worker, skim) < 0) ||
+        (skim->position > end)) {
+        return -1;
+    }
+    return 0;
+}
+
+static attribute_kind_t skim_attribute_kind(stats_worker_t *worker, class_skim_t *skim, u2_t name_index) {
+    const u1_t *name;
+    u2_t length;
+    if (name_index >= skim->constant_pool_count) {
+        return ATTRIBUTE_UNKNOWN;
+    }
+    if (worker->kinds[name_index] == 0xff) {
+        const u1_t *entry = skim_entry(skim, name_index);
+        if ((entry == NULL) || (entry[0] != CONSTANT_UTF8)) {
+            worker->kinds[name_index] = ATTRIBUTE_UNKNOWN;
+        }
+        else {
+            length = (entry[1] << 8) | entry[2];
+            name = entry + 3;
+            worker->kinds[name_index] = attribute_kind_of_name(name, length);
+        }
+    }
+    return worker->kinds[name_index];
+}
+
+/* 0 for 0, otherwise one more than the index of the highest bit set */
+static int bucket(uint64_t value) {
+    return value ? 64 - __builtin_clzll(value) : 0;
+}
+
+static void merge_stats(class_stats_t *total, class_stats_t *stats) {
+    uint64_t *to = (uint64_t *) total;
+    uint64_t *from = (uint64_t *) stats;
+    size_t i;
+    for (i = 0; i < sizeof(class_stats_t) / sizeof(uint64_t); i++) {
+        to[i] += from[i];
+    }
+}
+
+/* one "section key count" line per counter that is not zero */
+static void print_stats(class_stats_t *stats) {
+    int i;
+
+    printf("total classes %llu\n", (unsigned long long) stats->classes);
+    printf("total unreadable %llu\n", (unsigned long long) stats->unreadable);
+    printf("total skipped %llu\n", (unsigned long long) stats->skipped);
+    printf("total bytes %llu\n", (unsigned long long) stats->bytes);
+    printf("total code-attributes %llu\n", (unsigned long long) stats->code_attributes);
+    printf("total code-bytes %llu\n", (unsigned long long) stats->code_bytes);
+    printf("total instructions %llu\n", (unsigned long long) stats->instructions);
+    printf("total bad-code %llu\n", (unsigned long long) stats->bad_code);
+    for (i = 0; i < STATS_MAJOR_VERSIONS; i++) {
+        if (stats->major_versions[i]) {
+            printf("version %d %llu\n", i, (unsigned long long) stats->major_versions[i]);
+        }
+    }
+    if (stats->other_versions) {
+        printf("version other %llu\n", (unsigned long long) stats->other_versions);
+    }
+    for (i = 0; i < STATS_CONSTANT_TAGS; i++) {
+        if (stats->constants[i]) {
+            printf("constant %s %llu\n", constant_tag_names[i] ? constant_tag_names[i] : "(unknown)",
+                   (unsigned long long) stats->constants[i]);
+        }
+    }
+    for (i = 0; i < ATTRIBUTE_KIND_COUNT; i++) {
+        if (stats->attributes[i]) {
+            printf("attribute %s %llu\n", attribute_kind_name(i), (unsigned long long) stats->attributes[i]);
+        }
+    }
+    print_buckets("utf8-length", stats->utf8_lengths);
+    print_buckets("string-length", stats->string_lengths);
+    print_buckets("code-length", stats->code_lengths);
+
+    /* most frequent first */
+    opcode_count_t opcodes[256];
+    for (i = 0; i < 256; i++) {
+        opcodes[i].opcode = i;
+        opcodes[i].count = stats->opcodes[i];
+    }
+    qsort(opcodes, 256, sizeof(opcode_count_t), compare_opcodes);
+    for (i = 0; (i < 256) && opcodes[i].count; i++) {
+        const char *name = opcode_name(opcodes[i].opcode);
+        if (name) {
+            printf("opcode %s %llu\n", name, (unsigned long long) opcodes[i].count);
+        }
+        else {
+            printf("opcode 0x%02x %llu\n", opcodes[i].opcode, (unsigned long long) opcodes[i].count);
+        }
+    }
+}
+
+static void print_buckets(const char *section, uint64_t *buckets) {
+    int i;
+    for (i = 0; i < STATS_BUCKETS; i++) {
+        if (buckets[i] == 0) {
+            continue;
+        }
+        if (i < 2) {
+            printf("%s %d %llu\n", section, i, (unsigned long long) buckets[i]);
+        }
+        else {
+            printf("%s %llu-%llu %llu\n", section, 1ULL << (i - 1), (1ULL << i) - 1, (unsigned long long) buckets[i]);
+        }
+    }
+}
+
+static int compare_opcodes(const void *a, const void *b) {
+    const opcode_count_t *x = a;
+    const opcode_count_t *y = b;
+    if (x->count != y->count) {
+        return (x->count > y->count) ? -1 : 1;
+    }
+    return x->opcode - y->opcode;
+}
+
+int stats_main(int ac, char **av) {
+    corpus_t corpus;
+    int threads = sysconf(_SC_NPROCESSORS_ONLN);
+    int result = 1;
+    int c;
+    int i;
+
+    memset(&corpus, 0, sizeof(corpus));
+    while ((c = getopt(ac, av, "j:V:")) != -1) {
+        switch (c) {
+        case 'j':
+            threads = atoi(optarg);
+            break;
+        case 'V':
+            if (corpus_set_versions(&corpus, optarg) < 0) {
+                return 1;
+            }
+            break;
+        default:
+            fprintf(stderr, "usage: %s stats [-j threads] [-V versions] {.class-file|directory|jar}...\n", program);
+            return 1;
+        }
+    }
+    if (optind >= ac) {
+        fprintf(stderr, "usage: %s stats [-j threads] [-V versions] {.class-file|directory|jar}...\n", program);
+        return 1;
+    }
+    if (threads < 1) {
+        threads = 1;
+    }
+
+    stats_worker_t *workers = calloc(threads, sizeof(stats_worker_t));
+    void **contexts = calloc(threads, sizeof(void *));
+    class_stats_t *total = calloc(1, sizeof(class_stats_t));
+    if ((workers == NULL) || (contexts == NULL) || (total == NULL)) {
+        fprintf(stderr, "%s: failed to allocate %d workers\n", program, threads);
+        goto RETURN;
+    }
+    for (i = optind; i < ac; i++) {
+        if (corpus_add(&corpus, av[i]) < 0) {
+            goto RETURN;
+        }
+    }
+    for (i = 0; i < threads; i++) {
+        contexts[i] = &workers[i];
+    }
+    if (corpus_run(&corpus, threads, stats_class, contexts) < 0) {
+        goto RETURN;
+    }
+    for (i = 0; i < threads; i++) {
+        merge_stats(total, &workers[i].stats);
+    }
+    total->unreadable = corpus.unreadable;
+    total->skipped = corpus.skipped;
+    print_stats(total);
+    result = 0;
+
+RETURN:
+    if (workers) {
+        for (i = 0; i < threads; i++) {
+            free(workers[i].kinds);
+        }
+    }
+    free(workers);
+    free(contexts);
+    free(total);
+    corpus_free(&corpus);
+    return result;
+}
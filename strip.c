@@ -0,0 +1,205 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <getopt.h>
+
+#include "cjdc.h"
+
+/* debug information that the JVM does not need to run a class */
+static const char *default_strip_names[] = {
+    "SourceFile",
+    "SourceDebugExtension",
+    "LineNumberTable",
+    "LocalVariableTable",
+    "LocalVariableTypeTable",
+};
+
+#define DEFAULT_STRIP_NAMES_COUNT (sizeof(default_strip_names) / sizeof(default_strip_names[0]))
+
+typedef struct strip_options_s {
+    const char **names;
+    int names_count;
+    int compact;
+} strip_options_t;
+
+static int strip_attributes(class_file_t *class_file, u1_t *stripped, u2_t *attributes_count, attribute_info_t *attributes);
+static int strip_code_attributes(class_file_t *class_file, u1_t *stripped, u2_t attributes_count, attribute_info_t *attributes);
+static int strip_transform(class_file_t *class_file, void *context);
+static int split_names(char *list, const char ***names);
+
+/*
+ * Removes the attributes called one of names everywhere in class_file,
+ * including inside Code attributes.  Whatever is removed loses its source
+ * range, so write_class_file() re-encodes just that and copies the rest.
+ * Returns the number of attributes removed.
+ */
+int strip_class_file(class_file_t *class_file, const char **names, int names_count) {
+    /* the names are looked up once per class, attributes are then matched by index */
+    u1_t *stripped = calloc(class_file->constant_pool_count ? class_file->constant_pool_count : 1, 1);
+    if (stripped == NULL) {
+        fprintf(stderr, "%s: failed to allocate %u bytes\n", program, class_file->constant_pool_count);
+        return -1;
+    }
+    int any = 0;
+    int i, j;
+    for (i = 1; i < class_file->constant_pool_count; i++) {
+        for (j = 0; j < names_count; j++) {
+            if (cp_utf8_equals(class_file, i, names[j])) {
+                stripped[i] = 1;
+                any = 1;
+                break;
+            }
+        }
+    }
+    if (!any) {
+        free(stripped);
+        return 0;
+    }
+
+    int result = 0;
+    int removed;
+    for (i = 0; i < class_file->fields_count; i++) {
+        field_info_t *field = &class_file->fields[i];
+        removed = strip_attributes(class_file, stripped, &field->attributes_count, field->attributes);
+        if (removed) {
+            field->range.length = 0;
+            class_file->fields_range.length = 0;
+            result += removed;
+        }
+    }
+
+    for (i = 0; i < class_file->methods_count; i++) {
+        method_info_t *method = &class_file->methods[i];
+        removed = strip_attributes(class_file, stripped, &method->attributes_count, method->attributes);
+        int code_removed = strip_code_attributes(class_file, stripped, method->attributes_count, method->attributes);
+        if (code_removed < 0) {
+            free(stripped);
+            return -1;
+        }
+        removed += code_removed;
+        if (removed) {
+            method->range.length = 0;
+            class_file->methods_range.length = 0;
+            result += removed;
+        }
+    }
+
+    removed = strip_attributes(class_file, stripped, &class_file->attributes_count, class_file->attributes);
+    if (removed) {
+        class_file->attributes_range.length = 0;
+        result += removed;
+    }
+
+    if (result) {
+        class_file->range.length = 0;
+    }
+    free(stripped);
+    return result;
+}
+
+static int strip_attributes(class_file_t *class_file, u1_t *stripped, u2_t *attributes_count, attribute_info_t *attributes) {
+    int kept = 0;
+    int i;
+    for (i = 0; i < *attributes_count; i++) {
+        /* a name index outside the constant pool names nothing to strip */
+        u2_t name_index = attributes[i].attribute_name_index;
+        if ((name_index < class_file->constant_pool_count) && stripped[name_index]) {
+            free_code_attribute(attributes[i].code);
+            continue;
+        }
+        attributes[kept++] = attributes[i];
+    }
+    int removed = *attributes_count - kept;
+    *attributes_count = kept;
+    return removed;
+}
+
+static int strip_code_attributes(class_file_t *class_file, u1_t *stripped, u2_t attributes_count, attribute_info_t *attributes) {
+    int result = 0;
+    int i;
+    for (i = 0; i < attributes_count; i++) {
+        attribute_info_t *attribute = &attributes[i];
+        if (!cp_utf8_equals(class_file, attribute->attribute_name_index, "Code")) {
+            continue;
+        }
+        if (read_code_attribute(class_file, attribute) < 0) {
+            return -1;
+        }
+        int removed = strip_attributes(class_file, stripped, &attribute->code->attributes_count, attribute->code->attributes);
+        if (removed) {
+            attribute->range.length = 0;
+            result += removed;
+        }
+    }
+    return result;
+}
+
+int strip_main(int ac, char **av) {
+    strip_options_t options = {default_strip_names, DEFAULT_STRIP_NAMES_COUNT, 0};
+    int level = 6;
+    int c;
+
+    while ((c = getopt(ac, av, "a:cl:")) != -1) {
+        switch (c) {
+        case 'a':
+            options.names_count = split_names(optarg, &options.names);
+            if (options.names_count < 0) {
+                return 1;
+            }
+            break;
+        case 'c':
+            options.compact = 1;
+            break;
+        case 'l':
+            level = atoi(optarg);
+            if ((level < 0) || (level > 9)) {
+                fprintf(stderr, "%s: compression level must be between 0 and 9\n", program);
+                return 1;
+            }
+            break;
+        default:
+            fprintf(stderr, "usage: %s strip [-a attribute[,attribute...]] [-c] [-l level] {input} {output}\n", program);
+            return 1;
+        }
+    }
+    if (ac - optind != 2) {
+        fprintf(stderr, "usage: %s strip [-a attribute[,attribute...]] [-c] [-l level] {input} {output}\n", program);
+        return 1;
+    }
+
+    return rewrite_file(av[optind], av[optind + 1], strip_transform, &options, level) < 0;
+}
+
+static int strip_transform(class_file_t *class_file, void *context) {
+    strip_options_t *options = context;
+    int result = strip_class_file(class_file, options->names, options->names_count);
+    if ((result >= 0) && options->compact) {
+        int removed = compact_class_file(class_file);
+        result = (removed < 0) ? -1 : result + removed;
+    }
+    return result;
+}
+
+/* splits a comma separated list in place */
+static int split_names(char *list, const char ***names) {
+    int count = 1;
+    char *p;
+    for (p = list; *p; p++) {
+        if (*p == ',') {
+            count++;
+        }
+    }
+    const char **result = calloc(count, sizeof(char *));
+    if (result == NULL) {
+        fprintf(stderr, "%s: failed to allocate %d names\n", program, count);
+        return -1;
+    }
+    int i = 0;
+    char *name;
+    for (name = strtok(list, ","); name; name = strtok(NULL, ",")) {
+        result[i++] = name;
+    }
+    *names = result;
+    return i;
+}
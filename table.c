@@ -0,0 +1,143 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "cjdc.h"
+
+/*
+ * Hash table from byte-string keys to pointers, open addressing with
+ * linear probing.  Keys are copied and NUL-terminated; removal shifts
+ * the following entries back instead of leaving tombstones, so lookups
+ * never slow down on a table that churns.
+ */
+static int table_grow(table_t *table);
+static table_entry_t *table_probe(table_t *table, const void *key, size_t length, uint64_t hash);
+
+uint64_t table_hash(const void *key, size_t length) {
+    const u1_t *bytes = key;
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    size_t i;
+    for (i = 0; i < length; i++) {
+        hash ^= bytes[i];
+        hash *= 0x00000100000001b3ULL;
+    }
+    hash ^= hash >> 32;
+    return hash;
+}
+
+/* the value slot for key, NULL if it is not in the table */
+void **table_find(table_t *table, const void *key, size_t length) {
+    if (table->count == 0) {
+        return NULL;
+    }
+    table_entry_t *entry = table_probe(table, key, length, table_hash(key, length));
+    return entry->key ? &entry->value : NULL;
+}
+
+/* the value slot for key, added with a NULL value if needed; NULL when out of memory */
+void **table_insert(table_t *table, const void *key, size_t length) {
+    if ((2 * (table->count + 1) > table->capacity) && (table_grow(table) < 0)) {
+        return NULL;
+    }
+    uint64_t hash = table_hash(key, length);
+    table_entry_t *entry = table_probe(table, key, length, hash);
+    if (entry->key) {
+        return &entry->value;
+    }
+    entry->key = malloc(length + 1);
+    if (entry->key == NULL) {
+        fprintf(stderr, "%s: failed to malloc %zu bytes.\n", program, length + 1);
+        return NULL;
+    }
+    memcpy(entry->key, key, length);
+    entry->key[length] = '\0';
+    entry->key_length = length;
+    entry->hash = hash;
+    entry->value = NULL;
+    table->count++;
+    return &entry->value;
+}
+
+/* returns the value that was stored, NULL if the key was not there */
+void *table_remove(table_t *table, const void *key, size_t length) {
+    if (table->count == 0) {
+        return NULL;
+    }
+    table_entry_t *entry = table_probe(table, key, length, table_hash(key, length));
+    if (entry->key == NULL) {
+        return NULL;
+    }
+    void *value = entry->value;
+    free(entry->key);
+    entry->key = NULL;
+    table->count--;
+
+    /* move back the entries that probed past the hole */
+    size_t mask = table->capacity - 1;
+    size_t hole = entry - table->entries;
+    size_t i = (hole + 1) & mask;
+    while (table->entries[i].key) {
+        size_t home = table->entries[i].hash & mask;
+        if (((i - home) & mask) >= ((i - hole) & mask)) {
+            table->entries[hole] = table->entries[i];
+            table->entries[i].key = NULL;
+            hole = i;
+        }
+        i = (i + 1) & mask;
+    }
+    return value;
+}
+
+void table_free(table_t *table, void (*free_value)(void *value)) {
+    size_t i;
+    for (i = 0; i < table->capacity; i++) {
+        if (table->entries[i].key) {
+            if (free_value) {
+                free_value(table->entries[i].value);
+            }
+            free(table->entries[i].key);
+        }
+    }
+    free(table->entries);
+    table->entries = NULL;
+    table->capacity = 0;
+    table->count = 0;
+}
+
+static int table_grow(table_t *table) {
+    size_t capacity = table->capacity ? 2 * table->capacity : 64;
+    table_entry_t *entries = calloc(capacity, sizeof(table_entry_t));
+    if (entries == NULL) {
+        fprintf(stderr, "%s: failed to grow table to %zu entries\n", program, capacity);
+        return -1;
+    }
+    size_t i;
+    for (i = 0; i < table->capacity; i++) {
+        table_entry_t *entry = &table->entries[i];
+        if (entry->key) {
+            size_t j = entry->hash & (capacity - 1);
+            while (entries[j].key) {
+                j = (j + 1) & (capacity - 1);
+            }
+            entries[j] = *entry;
+        }
+    }
+    free(table->entries);
+    table->entries = entries;
+    table->capacity = capacity;
+    return 0;
+}
+
+/* the entry holding key, or the empty entry where it would go */
+static table_entry_t *table_probe(table_t *table, const void *key, size_t length, uint64_t hash) {
+    size_t mask = table->capacity - 1;
+    size_t i = hash & mask;
+    for (;;) {
+        table_entry_t *entry = &table->entries[i];
+        if ((entry->key == NULL) ||
+            ((entry->hash == hash) && (entry->key_length == length) && (memcmp(entry->key, key, length) == 0))) {
+            return entry;
+        }
+        i = (i + 1) & mask;
+    }
+}
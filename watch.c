@@ -0,0 +1,843 @@
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <limits.h>
+#include <signal.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/inotify.h>
+
+#include "cjdc.h"
+
+/*
+ * cjdc watch keeps the facts derived from a set of class directories and
+ * jars up to date as they change.  Each class contributes a sorted list
+ * of facts - "class A", "extends A B", "implements A I", "references A
+ * method O.nd", "string s" - and the classpath holds a count per fact.
+ * When inotify reports a change only the affected class files or jar
+ * entries are parsed again, and the old and new fact lists are merged so
+ * that just the facts which appear or disappear are printed, as
+ * "+ fact" and "- fact" lines.
+ */
+
+#define WATCH_DIRECTORY_EVENTS  (IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_CREATE | IN_DELETE)
+
+/* what one class file or jar entry contributes */
+typedef struct watch_unit_s {
+    char *text;                 /* the facts, each NUL-terminated */
+    char **facts;               /* [facts_count] into text, sorted and unique */
+    u4_t facts_count;
+    u4_t generation;            /* last scan that saw the unit */
+    u4_t crc32;                 /* jar entries: skip the entry while it is unchanged */
+    off_t size;                 /* class files: skip the file on rescans while it is unchanged */
+    struct timespec mtime;
+} watch_unit_t;
+
+typedef struct watch_jar_s {
+    char *path;
+    table_t units;              /* entry name -> watch_unit_t */
+    u4_t generation;            /* bumped by every scan of the jar */
+} watch_jar_t;
+
+/* indexed by inotify watch descriptor */
+typedef struct watch_directory_s {
+    char *path;                 /* NULL once the watch is gone */
+    int classes;                /* class files here are watched, not just jars */
+} watch_directory_t;
+
+typedef struct watch_s {
+    int fd;
+    watch_directory_t *directories;
+    int directories_count;
+    char **roots;               /* class directories given on the command line */
+    int roots_count;
+    table_t files;              /* path -> watch_unit_t */
+    table_t jars;               /* path -> watch_jar_t */
+    table_t facts;              /* fact -> number of units stating it */
+    u4_t generation;
+    int quiet;                  /* counting facts without printing them */
+    u4_t changes;
+} watch_t;
+
+static volatile sig_atomic_t stop_requested;
+
+static int add_directory(watch_t *watch, const char *path);
+static int add_jar(watch_t *watch, const char *path);
+static int watch_directory(watch_t *watch, const char *path, int classes);
+static void unwatch_directory(watch_t *watch, const char *path);
+static int scan_directory(watch_t *watch, const char *path, int force);
+static int scan_file(watch_t *watch, const char *path, int force);
+static void drop_file(watch_t *watch, const char *path);
+static void drop_directory(watch_t *watch, const char *path);
+static int scan_jar(watch_t *watch, watch_jar_t *jar);
+static void drop_jar(watch_t *watch, watch_jar_t *jar);
+static void rescan_all(watch_t *watch);
+
+static int process_events(watch_t *watch);
+static void process_event(watch_t *watch, struct inotify_event *event);
+
+static watch_unit_t *read_unit(u1_t *bytes, u4_t length, const char *source);
+static int class_facts(class_file_t *class_file, buffer_t *text);
+static int put_fact(buffer_t *text, const char *kind, const u1_t *from, u2_t from_length, const char *format, ...)
+    __attribute__((format(printf, 5, 6)));
+static int compare_facts(const void *a, const void *b);
+static void apply_units(watch_t *watch, watch_unit_t *old, watch_unit_t *new);
+static void add_fact(watch_t *watch, const char *fact);
+static void remove_fact(watch_t *watch, const char *fact);
+static void free_unit(void *unit);
+static void free_jar(void *jar);
+static void on_stop_signal(int signal_number);
+
+/* the class directory holding path, which is itself watched */
+static int add_directory(watch_t *watch, const char *path) {
+    char **roots = realloc(watch->roots, (watch->roots_count + 1) * sizeof(char *));
+    if (roots == NULL) {
+        fprintf(stderr, "%s: failed to grow the list of directories\n", program);
+        return -1;
+    }
+    watch->roots = roots;
+    watch->roots[watch->roots_count] = strdup(path);
+    if (watch->roots[watch->roots_count] == NULL) {
+        return -1;
+    }
+    watch->roots_count++;
+    return scan_directory(watch, path, 0);
+}
+
+/* jars are often replaced by a rename, so it is their directory that is watched */
+static int add_jar(watch_t *watch, const char *path) {
+    void **slot = table_insert(&watch->jars, path, strlen(path));
+    if (slot == NULL) {
+        return -1;
+    }
+    if (*slot) {
+        return 0;
+    }
+    watch_jar_t *jar = calloc(1, sizeof(watch_jar_t));
+    if (jar == NULL) {
+        fprintf(stderr, "%s: failed to malloc %zu bytes.\n", program, sizeof(watch_jar_t));
+        table_remove(&watch->jars, path, strlen(path));
+        return -1;
+    }
+    jar->path = strdup(path);
+    *slot = jar;
+    if (jar->path == NULL) {
+        return -1;
+    }
+
+    char *directory = strdup(path);
+    if (directory == NULL) {
+        return -1;
+    }
+    char *slash = strrchr(directory, '/');
+    if (slash == directory) {
+        slash[1] = '\0';
+    }
+    else {
+        *slash = '\0';
+    }
+    int result = watch_directory(watch, directory, 0);
+    free(directory);
+    if (result < 0) {
+        return -1;
+    }
+    return scan_jar(watch, jar);
+}
+
+static int watch_directory(watch_t *watch, const char *path, int classes) {
+    int wd = inotify_add_watch(watch->fd, path, WATCH_DIRECTORY_EVENTS | IN_ONLYDIR);
+    if (wd < 0) {
+        fprintf(stderr, "%s: failed to watch '%s': %s\n", program, path, strerror(errno));
+        return -1;
+    }
+    if (wd >= watch->directories_count) {
+        int count = watch->directories_count ? watch->directories_count : 64;
+        while (count <= wd) {
+            count *= 2;
+        }
+        watch_directory_t *directories = realloc(watch->directories, count * sizeof(watch_directory_t));
+        if (directories == NULL) {
+            fprintf(stderr, "%s: failed to grow the list of watches to %d\n", program, count);
+            return -1;
+        }
+        memset(directories + watch->directories_count, 0,
+               (count - watch->directories_count) * sizeof(watch_directory_t));
+        watch->directories = directories;
+        watch->directories_count = count;
+    }
+
+    /* the same directory may come back under a new name after a move */
+    watch_directory_t *directory = &watch->directories[wd];
+    if ((directory->path == NULL) || (strcmp(directory->path, path) != 0)) {
+        char *copy = strdup(path);
+        if (copy == NULL) {
+            return -1;
+        }
+        free(directory->path);
+        directory->path = copy;
+    }
+    directory->classes |= classes;
+    return 0;
+}
+
+/* path and every directory below it */
+static void unwatch_directory(watch_t *watch, const char *path) {
+    size_t length = strlen(path);
+    int wd;
+    for (wd = 0; wd < watch->directories_count; wd++) {
+        watch_directory_t *directory = &watch->directories[wd];
+        if ((directory->path == NULL) || (strncmp(directory->path, path, length) != 0) ||
+            ((directory->path[length] != '\0') && (directory->path[length] != '/'))) {
+            continue;
+        }
+        inotify_rm_watch(watch->fd, wd);
+        free(directory->path);
+        directory->path = NULL;
+        directory->classes = 0;
+    }
+}
+
+/*
+ * Watches the directory before reading it, so a file that appears in
+ * between is seen by both and parsed twice rather than missed.
+ */
+static int scan_directory(watch_t *watch, const char *path, int force) {
+    if (watch_directory(watch, path, 1) < 0) {
+        return -1;
+    }
+    DIR *dir = opendir(path);
+    if (dir == NULL) {
+        fprintf(stderr, "%s: failed to open directory '%s': %s\n", program, path, strerror(errno));
+        return -1;
+    }
+    int result = 0;
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if ((strcmp(entry->d_name, ".") == 0) || (strcmp(entry->d_name, "..") == 0)) {
+            continue;
+        }
+        char child[PATH_MAX];
+        if (snprintf(child, sizeof(child), "%s/%s", path, entry->d_name) >= (int) sizeof(child)) {
+            fprintf(stderr, "%s: path '%s/%s' is too long\n", program, path, entry->d_name);
+            continue;
+        }
+        int is_directory = (entry->d_type == DT_DIR);
+        if (entry->d_type == DT_UNKNOWN) {
+            struct stat st;
+            is_directory = (lstat(child, &st) == 0) && S_ISDIR(st.st_mode);
+        }
+        if (is_directory) {
+            if (scan_directory(watch, child, force) < 0) {
+                result = -1;
+            }
+        }
+        else if (has_suffix(entry->d_name, strlen(entry->d_name), ".class")) {
+            if (scan_file(watch, child, force) < 0) {
+                result = -1;
+            }
+        }
+    }
+    closedir(dir);
+    return result;
+}
+
+/*
+ * Unless forced, a file whose size and modification time are what they
+ * were is not read again; inotify events always force, since a rewrite
+ * can land within the same timestamp tick.
+ */
+static int scan_file(watch_t *watch, const char *path, int force) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        if (errno == ENOENT) {
+            drop_file(watch, path);
+            return 0;
+        }
+        fprintf(stderr, "%s: failed to open '%s': %s\n", program, path, strerror(errno));
+        return -1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        fprintf(stderr, "%s: failed to stat '%s': %s\n", program, path, strerror(errno));
+        close(fd);
+        return -1;
+    }
+    void **slot = table_find(&watch->files, path, strlen(path));
+    watch_unit_t *old = slot ? *slot : NULL;
+    if (old && !force && (old->size == st.st_size) &&
+        (old->mtime.tv_sec == st.st_mtim.tv_sec) && (old->mtime.tv_nsec == st.st_mtim.tv_nsec)) {
+        old->generation = watch->generation;
+        close(fd);
+        return 0;
+    }
+
+    u4_t length;
+    u1_t *bytes = read_fd_bytes(fd, &length);
+    close(fd);
+    if (bytes == NULL) {
+        return -1;
+    }
+    watch_unit_t *unit = read_unit(bytes, length, path);
+    if (unit == NULL) {
+        return -1;
+    }
+    unit->generation = watch->generation;
+    unit->size = st.st_size;
+    unit->mtime = st.st_mtim;
+
+    slot = table_insert(&watch->files, path, strlen(path));
+    if (slot == NULL) {
+        free_unit(unit);
+        return -1;
+    }
+    apply_units(watch, old, unit);
+    free_unit(old);
+    *slot = unit;
+    return 0;
+}
+
+static void drop_file(watch_t *watch, const char *path) {
+    watch_unit_t *unit = table_remove(&watch->files, path, strlen(path));
+    if (unit) {
+        apply_units(watch, unit, NULL);
+        free_unit(unit);
+    }
+}
+
+/* a directory that was deleted or moved away, with everything below it */
+static void drop_directory(watch_t *watch, const char *path) {
+    size_t length = strlen(path);
+    char **paths = malloc((watch->files.count ? watch->files.count : 1) * sizeof(char *));
+    size_t count = 0;
+    size_t i;
+
+    unwatch_directory(watch, path);
+    if (paths == NULL) {
+        fprintf(stderr, "%s: failed to drop the classes under '%s'\n", program, path);
+        return;
+    }
+    /* removing from the table moves entries around, so collect first */
+    for (i = 0; i < watch->files.capacity; i++) {
+        char *key = watch->files.entries[i].key;
+        if (key && (strncmp(key, path, length) == 0) && (key[length] == '/') && ((paths[count] = strdup(key)) != NULL)) {
+            count++;
+        }
+    }
+    for (i = 0; i < count; i++) {
+        drop_file(watch, paths[i]);
+        free(paths[i]);
+    }
+    free(paths);
+}
+
+/*
+ * The central directory is read again, but an entry is only inflated and
+ * parsed when its CRC has changed; entries that are gone are dropped.
+ */
+static int scan_jar(watch_t *watch, watch_jar_t *jar) {
+    jar_file_t *jar_file = open_jar_file(jar->path);
+    if (jar_file == NULL) {
+        return -1;
+    }
+    jar->generation++;
+    int result = 0;
+    u4_t i;
+    for (i = 0; i < jar_file->entries_count; i++) {
+        jar_entry_t *entry = &jar_file->entries[i];
+        if (!is_class_entry(entry) ||
+            ((entry->name_length >= 9) && (memcmp(entry->name, "META-INF/", 9) == 0))) {
+            continue;
+        }
+        void **slot = table_find(&jar->units, entry->name, entry->name_length);
+        watch_unit_t *old = slot ? *slot : NULL;
+        if (old && (old->crc32 == entry->crc32) && (old->size == entry->uncompressed_size)) {
+            old->generation = jar->generation;
+            continue;
+        }
+
+        u1_t *bytes = read_jar_entry(jar_file, entry);
+        if (bytes == NULL) {
+            result = -1;
+            continue;
+        }
+        char source[PATH_MAX];
+        snprintf(source, sizeof(source), "%s!%.*s", jar->path, (int) entry->name_length, entry->name);
+        watch_unit_t *unit = read_unit(bytes, entry->uncompressed_size, source);
+        if (unit == NULL) {
+            result = -1;
+            continue;
+        }
+        unit->generation = jar->generation;
+        unit->crc32 = entry->crc32;
+        unit->size = entry->uncompressed_size;
+
+        slot = table_insert(&jar->units, entry->name, entry->name_length);
+        if (slot == NULL) {
+            free_unit(unit);
+            result = -1;
+            continue;
+        }
+        apply_units(watch, old, unit);
+        free_unit(old);
+        *slot = unit;
+    }
+    close_jar_file(jar_file);
+
+    /* entries this scan did not see are gone */
+    char **names = malloc((jar->units.count ? jar->units.count : 1) * sizeof(char *));
+    size_t count = 0;
+    size_t j;
+    if (names == NULL) {
+        fprintf(stderr, "%s: failed to drop the removed classes of '%s'\n", program, jar->path);
+        return -1;
+    }
+    for (j = 0; j < jar->units.capacity; j++) {
+        table_entry_t *table_entry = &jar->units.entries[j];
+        if (table_entry->key && (((watch_unit_t *) table_entry->value)->generation != jar->generation) &&
+            ((names[count] = strdup(table_entry->key)) != NULL)) {
+            count++;
+        }
+    }
+    for (j = 0; j < count; j++) {
+        watch_unit_t *unit = table_remove(&jar->units, names[j], strlen(names[j]));
+        apply_units(watch, unit, NULL);
+        free_unit(unit);
+        free(names[j]);
+    }
+    free(names);
+    return result;
+}
+
+static void drop_jar(watch_t *watch, watch_jar_t *jar) {
+    size_t i;
+    for (i = 0; i < jar->units.capacity; i++) {
+        if (jar->units.entries[i].key) {
+            apply_units(watch, jar->units.entries[i].value, NULL);
+        }
+    }
+    table_free(&jar->units, free_unit);
+}
+
+/* after the kernel dropped events: everything is checked, but unchanged files are not read */
+static void rescan_all(watch_t *watch) {
+    size_t i;
+    int j;
+
+    fprintf(stderr, "%s: inotify queue overflowed, rescanning\n", program);
+    watch->generation++;
+    for (j = 0; j < watch->roots_count; j++) {
+        scan_directory(watch, watch->roots[j], 0);
+    }
+    for (i = 0; i < watch->jars.capacity; i++) {
+        if (watch->jars.entries[i].key) {
+            scan_jar(watch, watch->jars.entries[i].value);
+        }
+    }
+
+    char **paths = malloc((watch->files.count ? watch->files.count : 1) * sizeof(char *));
+    size_t count = 0;
+    if (paths == NULL) {
+        return;
+    }
+    for (i = 0; i < watch->files.capacity; i++) {
+        table_entry_t *entry = &watch->files.entries[i];
+        if (entry->key && (((watch_unit_t *) entry->value)->generation != watch->generation) &&
+            ((paths[count] = strdup(entry->key)) != NULL)) {
+            count++;
+        }
+    }
+    for (i = 0; i < count; i++) {
+        drop_file(watch, paths[i]);
+        free(paths[i]);
+    }
+    free(paths);
+}
+
+static int process_events(watch_t *watch) {
+    char events[64 * 1024] __attribute__((aligned(__alignof__(struct inotify_event))));
+
+    ssize_t length = read(watch->fd, events, sizeof(events));
+    if (length < 0) {
+        if (errno == EINTR) {
+            return 0;
+        }
+        fprintf(stderr, "%s: failed to read inotify events: %s\n", program, strerror(errno));
+        return -1;
+    }
+    watch->changes = 0;
+    char *position = events;
+    while (position < events + length) {
+        struct inotify_event *event = (struct inotify_event *) position;
+        process_event(watch, event);
+        position += sizeof(struct inotify_event) + event->len;
+    }
+    if (watch->changes) {
+        fflush(stdout);
+    }
+    return 0;
+}
+
+static void process_event(watch_t *watch, struct inotify_event *event) {
+    if (event->mask & IN_Q_OVERFLOW) {
+        rescan_all(watch);
+        return;
+    }
+    if ((event->wd < 0) || (event->wd >= watch->directories_count)) {
+        return;
+    }
+    watch_directory_t *directory = &watch->directories[event->wd];
+    if (event->mask & IN_IGNORED) {
+        free(directory->path);
+        directory->path = NULL;
+        directory->classes = 0;
+        return;
+    }
+    if ((directory->path == NULL) || (event->len == 0)) {
+        return;
+    }
+
+    char path[PATH_MAX];
+    if (snprintf(path, sizeof(path), "%s/%s", directory->path, event->name) >= (int) sizeof(path)) {
+        return;
+    }
+    int gone = (event->mask & (IN_DELETE | IN_MOVED_FROM)) != 0;
+
+    void **slot = table_find(&watch->jars, path, strlen(path));
+    if (slot) {
+        watch_jar_t *jar = *slot;
+        if (gone) {
+            drop_jar(watch, jar);
+        }
+        else if (event->mask & (IN_CLOSE_WRITE | IN_MOVED_TO)) {
+            scan_jar(watch, jar);
+        }
+        return;
+    }
+    if (!directory->classes) {
+        return;
+    }
+    if (event->mask & IN_ISDIR) {
+        if (gone) {
+            drop_directory(watch, path);
+        }
+        else {
+            scan_directory(watch, path, 1);
+        }
+    }
+    else if (has_suffix(event->name, strlen(event->name), ".class")) {
+        if (gone) {
+            drop_file(watch, path);
+        }
+        else if (event->mask & (IN_CLOSE_WRITE | IN_MOVED_TO)) {
+            scan_file(watch, path, 1);
+        }
+    }
+}
+
+/*
+ * Takes over bytes.  A file that does not parse contributes no facts,
+ * but still gets a unit so it is not read again until it changes.
+ */
+static watch_unit_t *read_unit(u1_t *bytes, u4_t length, const char *source) {
+    watch_unit_t *unit = calloc(1, sizeof(watch_unit_t));
+    if (unit == NULL) {
+        fprintf(stderr, "%s: failed to malloc %zu bytes.\n", program, sizeof(watch_unit_t));
+        free(bytes);
+        return NULL;
+    }
+    class_file_t *class_file = read_class_bytes(bytes, length);
+    if (class_file == NULL) {
+        fprintf(stderr, "%s: ignoring '%s', it is not a class file\n", program, source);
+        return unit;
+    }
+
+    buffer_t text = {0};
+    if (class_facts(class_file, &text) < 0) {
+        fprintf(stderr, "%s: ignoring '%s', its constant pool is malformed\n", program, source);
+        free_class_file(class_file);
+        buffer_free(&text);
+        return unit;
+    }
+    free_class_file(class_file);
+
+    u4_t count = 0;
+    size_t i;
+    for (i = 0; i < text.length; i++) {
+        count += (text.data[i] == '\0');
+    }
+    unit->text = (char *) text.data;
+    unit->facts = malloc((count ? count : 1) * sizeof(char *));
+    if (unit->facts == NULL) {
+        fprintf(stderr, "%s: failed to malloc %u facts\n", program, count);
+        free_unit(unit);
+        return NULL;
+    }
+    char *fact = unit->text;
+    for (i = 0; i < count; i++) {
+        unit->facts[i] = fact;
+        fact += strlen(fact) + 1;
+    }
+    qsort(unit->facts, count, sizeof(char *), compare_facts);
+    for (i = 0; i < count; i++) {
+        if ((unit->facts_count == 0) || (strcmp(unit->facts[unit->facts_count - 1], unit->facts[i]) != 0)) {
+            unit->facts[unit->facts_count++] = unit->facts[i];
+        }
+    }
+    return unit;
+}
+
+static int class_facts(class_file_t *class_file, buffer_t *text) {
+    const u1_t *this_name;
+    const u1_t *name;
+    const u1_t *owner;
+    const u1_t *descriptor;
+    u2_t this_length;
+    u2_t name_length;
+    u2_t owner_length;
+    u2_t descriptor_length;
+    int i;
+
+    if (cp_class_name(class_file, class_file->this_class, &this_name, &this_length) < 0) {
+        return -1;
+    }
+    if (put_fact(text, "class", this_name, this_length, NULL) < 0) {
+        return -1;
+    }
+    if (class_file->super_class) {
+        if ((cp_class_name(class_file, class_file->super_class, &name, &name_length) < 0) ||
+            (put_fact(text, "extends", this_name, this_length, "%.*s", name_length, name) < 0)) {
+            return -1;
+        }
+    }
+    for (i = 0; i < class_file->interfaces_count; i++) {
+        if ((cp_class_name(class_file, class_file->interfaces[i], &name, &name_length) < 0) ||
+            (put_fact(text, "implements", this_name, this_length, "%.*s", name_length, name) < 0)) {
+            return -1;
+        }
+    }
+
+    for (i = 1; i < class_file->constant_pool_count; i++) {
+        cp_info_t *entry = &class_file->constant_pool[i - 1];
+        cp_info_t *name_and_type;
+        switch (entry->tag) {
+        case CONSTANT_CLASS:
+            if (i == class_file->this_class) {
+                break;
+            }
+            if ((cp_class_name(class_file, i, &name, &name_length) < 0) ||
+                (put_fact(text, "references", this_name, this_length, "class %.*s", name_length, name) < 0)) {
+                return -1;
+            }
+            break;
+        case CONSTANT_FIELDREF:
+        case CONSTANT_METHODREF:
+        case CONSTANT_INTERFACE_METHODREF:
+            name_and_type = cp_entry(class_file, entry->u.cp_fieldref.name_and_type_index);
+            if ((name_and_type == NULL) || (name_and_type->tag != CONSTANT_NAME_AND_TYPE) ||
+                (cp_class_name(class_file, entry->u.cp_fieldref.class_index, &owner, &owner_length) < 0) ||
+                (cp_utf8(class_file, name_and_type->u.cp_name_and_type.name_index, &name, &name_length) < 0) ||
+                (cp_utf8(class_file, name_and_type->u.cp_name_and_type.descriptor_index, &descriptor, &descriptor_length) < 0)) {
+                return -1;
+            }
+            if (put_fact(text, "references", this_name, this_length, "%s %.*s.%.*s%s%.*s",
+                         (entry->tag == CONSTANT_FIELDREF) ? "field" : "method",
+                         owner_length, owner, name_length, name, (entry->tag == CONSTANT_FIELDREF) ? ":" : "",
+                         descriptor_length, descriptor) < 0) {
+                return -1;
+            }
+            break;
+        case CONSTANT_STRING:
+            /* the string table is shared, so these facts name no class */
+            if ((cp_utf8(class_file, entry->u.cp_string.name_index, &name, &name_length) < 0) ||
+                (buffer_printf(text, "string ") < 0) ||
+                (buffer_put_escaped(text, name, name_length) < 0) ||
+                (buffer_put_u1(text, '\0') < 0)) {
+                return -1;
+            }
+            break;
+        default:
+            break;
+        }
+    }
+    return 0;
+}
+
+/* "kind from" followed by the formatted target, if any; class names hold no spaces or NULs */
+static int put_fact(buffer_t *text, const char *kind, const u1_t *from, u2_t from_length, const char *format, ...) {
+    if (buffer_printf(text, "%s %.*s", kind, from_length, from) < 0) {
+        return -1;
+    }
+    if (format) {
+        va_list ap;
+        va_start(ap, format);
+        int length = vsnprintf(NULL, 0, format, ap);
+        va_end(ap);
+        if ((length < 0) || (buffer_reserve(text, length + 2) < 0)) {
+            return -1;
+        }
+        text->data[text->length++] = ' ';
+        va_start(ap, format);
+        vsnprintf((char *) text->data + text->length, length + 1, format, ap);
+        va_end(ap);
+        text->length += length;
+    }
+    return buffer_put_u1(text, '\0');
+}
+
+static int compare_facts(const void *a, const void *b) {
+    return strcmp(*(char * const *) a, *(char * const *) b);
+}
+
+/* the cost is the size of the two units, not of the classpath */
+static void apply_units(watch_t *watch, watch_unit_t *old, watch_unit_t *new) {
+    u4_t old_count = old ? old->facts_count : 0;
+    u4_t new_count = new ? new->facts_count : 0;
+    u4_t i = 0;
+    u4_t j = 0;
+
+    while ((i < old_count) || (j < new_count)) {
+        int order = (i == old_count) ? 1 : (j == new_count) ? -1 : strcmp(old->facts[i], new->facts[j]);
+        if (order < 0) {
+            remove_fact(watch, old->facts[i++]);
+        }
+        else if (order > 0) {
+            add_fact(watch, new->facts[j++]);
+        }
+        else {
+            i++;
+            j++;
+        }
+    }
+}
+
+static void add_fact(watch_t *watch, const char *fact) {
+    void **slot = table_insert(&watch->facts, fact, strlen(fact));
+    if (slot == NULL) {
+        return;
+    }
+    uintptr_t count = (uintptr_t) *slot + 1;
+    *slot = (void *) count;
+    if ((count == 1) && !watch->quiet) {
+        printf("+ %s\n", fact);
+        watch->changes++;
+    }
+}
+
+static void remove_fact(watch_t *watch, const char *fact) {
+    void **slot = table_find(&watch->facts, fact, strlen(fact));
+    if (slot == NULL) {
+        return;
+    }
+    uintptr_t count = (uintptr_t) *slot - 1;
+    if (count) {
+        *slot = (void *) count;
+        return;
+    }
+    table_remove(&watch->facts, fact, strlen(fact));
+    if (!watch->quiet) {
+        printf("- %s\n", fact);
+        watch->changes++;
+    }
+}
+
+static void free_unit(void *value) {
+    watch_unit_t *unit = value;
+    if (unit) {
+        free(unit->facts);
+        free(unit->text);
+        free(unit);
+    }
+}
+
+static void free_jar(void *value) {
+    watch_jar_t *jar = value;
+    if (jar) {
+        table_free(&jar->units, free_unit);
+        free(jar->path);
+        free(jar);
+    }
+}
+
+static void on_stop_signal(int signal_number) {
+    (void) signal_number;
+    stop_requested = 1;
+}
+
+int watch_main(int ac, char **av) {
+    watch_t watch;
+    int initial = 0;
+    int result = 1;
+    int c;
+    int i;
+
+    while ((c = getopt(ac, av, "i")) != -1) {
+        switch (c) {
+        case 'i':
+            initial = 1;
+            break;
+        default:
+            fprintf(stderr, "usage: %s watch [-i] {class-directory|jar}...\n", program);
+            return 1;
+        }
+    }
+    if (optind >= ac) {
+        fprintf(stderr, "usage: %s watch [-i] {class-directory|jar}...\n", program);
+        return 1;
+    }
+
+    memset(&watch, 0, sizeof(watch));
+    watch.quiet = !initial;
+    watch.fd = inotify_init1(IN_CLOEXEC);
+    if (watch.fd < 0) {
+        fprintf(stderr, "%s: failed to initialize inotify: %s\n", program, strerror(errno));
+        return 1;
+    }
+
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = on_stop_signal;
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+
+    for (i = optind; i < ac; i++) {
+        char path[PATH_MAX];
+        struct stat st;
+        if ((realpath(av[i], path) == NULL) || (stat(path, &st) < 0)) {
+            fprintf(stderr, "%s: failed to find '%s': %s\n", program, av[i], strerror(errno));
+            goto RETURN;
+        }
+        if ((S_ISDIR(st.st_mode) ? add_directory(&watch, path) : add_jar(&watch, path)) < 0) {
+            goto RETURN;
+        }
+    }
+    fflush(stdout);
+    watch.quiet = 0;
+    fprintf(stderr, "%s: watching %zu class files and %zu jars, %zu facts\n",
+            program, watch.files.count, watch.jars.count, watch.facts.count);
+
+    while (!stop_requested) {
+        if (process_events(&watch) < 0) {
+            goto RETURN;
+        }
+    }
+    result = 0;
+
+RETURN:
+    close(watch.fd);
+    for (i = 0; i < watch.directories_count; i++) {
+        free(watch.directories[i].path);
+    }
+    free(watch.directories);
+    for (i = 0; i < watch.roots_count; i++) {
+        free(watch.roots[i]);
+    }
+    free(watch.roots);
+    table_free(&watch.files, free_unit);
+    table_free(&watch.jars, free_jar);
+    table_free(&watch.facts, NULL);
+    return result;
+}
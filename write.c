@@ -0,0 +1,484 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+
+#include "cjdc.h"
+
+/*
+ * Serializes a class_file_t.  Anything that still has a source range is
+ * copied from class_file->source as it is, adjacent ranges being coalesced
+ * into a single copy, so an untouched class costs one memcpy; only elements
+ * whose range was cleared are encoded again.
+ */
+typedef struct class_writer_s {
+    class_file_t *class_file;
+    buffer_t *out;
+    u4_t pending_offset;
+    u4_t pending_length;
+} class_writer_t;
+
+static int write_header(class_writer_t *writer);
+static int write_constant_pool_element(class_writer_t *writer, cp_info_t *constant_pool_element);
+static int write_field_info_element(class_writer_t *writer, field_info_t *field_info_element);
+static int write_method_info_element(class_writer_t *writer, method_info_t *method_info_element);
+static int write_attributes(class_writer_t *writer, u2_t attributes_count, attribute_info_t *attributes);
+static int write_code_attribute(class_writer_t *writer, attribute_info_t *attribute);
+
+static int rewrite_class(const char *input_name, const char *output_name, class_transform_t transform, void *context);
+static int rewrite_jar(const char *input_name, const char *output_name, class_transform_t transform, void *context, int level);
+
+static int copy_range(class_writer_t *writer, source_range_t *range);
+static int flush_pending(class_writer_t *writer);
+static int put_u1(class_writer_t *writer, u1_t value);
+static int put_u2(class_writer_t *writer, u2_t value);
+static int put_u4(class_writer_t *writer, u4_t value);
+static int put_bytes(class_writer_t *writer, const void *bytes, size_t length);
+
+int write_class_file(class_file_t *class_file, buffer_t *out) {
+    class_writer_t class_writer = {class_file, out, 0, 0};
+    class_writer_t *writer = &class_writer;
+    int i;
+
+    if (class_file->range.length) {
+        if (copy_range(writer, &class_file->range) < 0) {
+            return -1;
+        }
+        return flush_pending(writer);
+    }
+
+    if (class_file->header_range.length) {
+        if (copy_range(writer, &class_file->header_range) < 0) {
+            return -1;
+        }
+    }
+    else if (write_header(writer) < 0) {
+        return -1;
+    }
+
+    if (class_file->fields_range.length) {
+        if (copy_range(writer, &class_file->fields_range) < 0) {
+            return -1;
+        }
+    }
+    else {
+        if (put_u2(writer, class_file->fields_count) < 0) {
+            return -1;
+        }
+        for (i = 0; i < class_file->fields_count; i++) {
+            if (write_field_info_element(writer, &class_file->fields[i]) < 0) {
+                fprintf(stderr, "%s: failed to write fields[%d]\n", program, i);
+                return -1;
+            }
+        }
+    }
+
+    if (class_file->methods_range.length) {
+        if (copy_range(writer, &class_file->methods_range) < 0) {
+            return -1;
+        }
+    }
+    else {
+        if (put_u2(writer, class_file->methods_count) < 0) {
+            return -1;
+        }
+        for (i = 0; i < class_file->methods_count; i++) {
+            if (write_method_info_element(writer, &class_file->methods[i]) < 0) {
+                fprintf(stderr, "%s: failed to write methods[%d]\n", program, i);
+                return -1;
+            }
+        }
+    }
+
+    if (class_file->attributes_range.length) {
+        if (copy_range(writer, &class_file->attributes_range) < 0) {
+            return -1;
+        }
+    }
+    else {
+        if (put_u2(writer, class_file->attributes_count) < 0) {
+            return -1;
+        }
+        if (write_attributes(writer, class_file->attributes_count, class_file->attributes) < 0) {
+            fprintf(stderr, "%s: failed to write attributes of class\n", program);
+            return -1;
+        }
+    }
+
+    return flush_pending(writer);
+}
+
+static int write_header(class_writer_t *writer) {
+    class_file_t *class_file = writer->class_file;
+
+    if ((put_u4(writer, class_file->magic) < 0) ||
+        (put_u2(writer, class_file->minor_version) < 0) ||
+        (put_u2(writer, class_file->major_version) < 0) ||
+        (put_u2(writer, class_file->constant_pool_count) < 0)) {
+        return -1;
+    }
+
+    int i;
+    for (i = 1; i < class_file->constant_pool_count; i++) {
+        if (write_constant_pool_element(writer, &class_file->constant_pool[i - 1]) < 0) {
+            fprintf(stderr, "%s: failed to write constant pool element %d\n", program, i);
+            return -1;
+        }
+    }
+
+    if ((put_u2(writer, class_file->access_flags) < 0) ||
+        (put_u2(writer, class_file->this_class) < 0) ||
+        (put_u2(writer, class_file->super_class) < 0) ||
+        (put_u2(writer, class_file->interfaces_count) < 0)) {
+        return -1;
+    }
+    for (i = 0; i < class_file->interfaces_count; i++) {
+        if (put_u2(writer, class_file->interfaces[i]) < 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static int write_constant_pool_element(class_writer_t *writer, cp_info_t *constant_pool_element) {
+    if (constant_pool_element->tag == 0) {
+        /* second slot of a long or double */
+        return 0;
+    }
+    if (put_u1(writer, constant_pool_element->tag) < 0) {
+        return -1;
+    }
+
+    int result = 0;
+    switch (constant_pool_element->tag) {
+    case CONSTANT_CLASS:
+        result = put_u2(writer, constant_pool_element->u.cp_class_info.name_index);
+        break;
+    case CONSTANT_FIELDREF:
+    case CONSTANT_METHODREF:
+    case CONSTANT_INTERFACE_METHODREF:
+        result = put_u2(writer, constant_pool_element->u.cp_fieldref.class_index);
+        if (result == 0) {
+            result = put_u2(writer, constant_pool_element->u.cp_fieldref.name_and_type_index);
+        }
+        break;
+    case CONSTANT_STRING:
+        result = put_u2(writer, constant_pool_element->u.cp_string.name_index);
+        break;
+    case CONSTANT_INTEGER:
+    case CONSTANT_FLOAT:
+        result = put_u4(writer, constant_pool_element->u.cp_integer.bytes);
+        break;
+    case CONSTANT_LONG:
+    case CONSTANT_DOUBLE:
+        result = put_u4(writer, constant_pool_element->u.cp_long.high_bytes);
+        if (result == 0) {
+            result = put_u4(writer, constant_pool_element->u.cp_long.low_bytes);
+        }
+        break;
+    case CONSTANT_NAME_AND_TYPE:
+        result = put_u2(writer, constant_pool_element->u.cp_name_and_type.name_index);
+        if (result == 0) {
+            result = put_u2(writer, constant_pool_element->u.cp_name_and_type.descriptor_index);
+        }
+        break;
+    case CONSTANT_UTF8:
+        result = put_u2(writer, constant_pool_element->u.cp_utf8.length);
+        if (result == 0) {
+            result = put_bytes(writer, constant_pool_element->u.cp_utf8.bytes, constant_pool_element->u.cp_utf8.length);
+        }
+        break;
+    case CONSTANT_METHOD_HANDLE:
+        result = put_u1(writer, constant_pool_element->u.cp_method_handle.reference_kind);
+        if (result == 0) {
+            result = put_u2(writer, constant_pool_element->u.cp_method_handle.reference_index);
+        }
+        break;
+    case CONSTANT_METHOD_TYPE:
+        result = put_u2(writer, constant_pool_element->u.cp_method_type.descriptor_index);
+        break;
+    case CONSTANT_DYNAMIC:
+    case CONSTANT_INVOKE_DYNAMIC:
+        result = put_u2(writer, constant_pool_element->u.cp_invoke_dynamic.bootstrap_method_attr_index);
+        if (result == 0) {
+            result = put_u2(writer, constant_pool_element->u.cp_invoke_dynamic.name_and_type_index);
+        }
+        break;
+    case CONSTANT_MODULE:
+    case CONSTANT_PACKAGE:
+        result = put_u2(writer, constant_pool_element->u.cp_module.name_index);
+        break;
+    default:
+        fprintf(stderr, "%s: cannot write unknown constant pool tag %d\n", program, constant_pool_element->tag);
+        result = -1;
+        break;
+    }
+    return result;
+}
+
+static int write_field_info_element(class_writer_t *writer, field_info_t *field_info_element) {
+    if (field_info_element->range.length) {
+        return copy_range(writer, &field_info_element->range);
+    }
+    if ((put_u2(writer, field_info_element->access_flags) < 0) ||
+        (put_u2(writer, field_info_element->name_index) < 0) ||
+        (put_u2(writer, field_info_element->descriptor_index) < 0) ||
+        (put_u2(writer, field_info_element->attributes_count) < 0)) {
+        return -1;
+    }
+    return write_attributes(writer, field_info_element->attributes_count, field_info_element->attributes);
+}
+
+static int write_method_info_element(class_writer_t *writer, method_info_t *method_info_element) {
+    if (method_info_element->range.length) {
+        return copy_range(writer, &method_info_element->range);
+    }
+    if ((put_u2(writer, method_info_element->access_flags) < 0) ||
+        (put_u2(writer, method_info_element->name_index) < 0) ||
+        (put_u2(writer, method_info_element->descriptor_index) < 0) ||
+        (put_u2(writer, method_info_element->attributes_count) < 0)) {
+        return -1;
+    }
+    return write_attributes(writer, method_info_element->attributes_count, method_info_element->attributes);
+}
+
+static int write_attributes(class_writer_t *writer, u2_t attributes_count, attribute_info_t *attributes) {
+    int i;
+    for (i = 0; i < attributes_count; i++) {
+        attribute_info_t *attribute = &attributes[i];
+        int result;
+        if (attribute->range.length) {
+            result = copy_range(writer, &attribute->range);
+        }
+        else if (attribute->code) {
+            result = write_code_attribute(writer, attribute);
+        }
+        else {
+            result = put_u2(writer, attribute->attribute_name_index);
+            if (result == 0) {
+                result = put_u4(writer, attribute->attribute_length);
+            }
+            if (result == 0) {
+                result = put_bytes(writer, attribute->info, attribute->attribute_length);
+            }
+        }
+        if (result < 0) {
+            fprintf(stderr, "%s: failed to write attribute %d\n", program, i);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/* attribute_length is patched in once the nested attributes are written */
+static int write_code_attribute(class_writer_t *writer, attribute_info_t *attribute) {
+    code_attribute_t *code = attribute->code;
+
+    if (put_u2(writer, attribute->attribute_name_index) < 0) {
+        return -1;
+    }
+    size_t length_position = writer->out->length;
+    if ((put_u4(writer, 0) < 0) ||
+        (put_u2(writer, code->max_stack) < 0) ||
+        (put_u2(writer, code->max_locals) < 0) ||
+        (put_u4(writer, code->code_length) < 0) ||
+        (put_bytes(writer, code->code, code->code_length) < 0) ||
+        (put_u2(writer, code->exception_table_length) < 0)) {
+        return -1;
+    }
+    int i;
+    for (i = 0; i < code->exception_table_length; i++) {
+        exception_table_entry_t *entry = &code->exception_table[i];
+        if ((put_u2(writer, entry->start_pc) < 0) ||
+            (put_u2(writer, entry->end_pc) < 0) ||
+            (put_u2(writer, entry->handler_pc) < 0) ||
+            (put_u2(writer, entry->catch_type) < 0)) {
+            return -1;
+        }
+    }
+    if ((put_u2(writer, code->attributes_count) < 0) ||
+        (write_attributes(writer, code->attributes_count, code->attributes) < 0) ||
+        (flush_pending(writer) < 0)) {
+        return -1;
+    }
+
+    u4_t length = writer->out->length - length_position - 4;
+    u1_t *p = writer->out->data + length_position;
+    p[0] = length >> 24;
+    p[1] = length >> 16;
+    p[2] = length >> 8;
+    p[3] = length;
+    attribute->attribute_length = length;
+    return 0;
+}
+
+static int copy_range(class_writer_t *writer, source_range_t *range) {
+    if (writer->pending_length && (writer->pending_offset + writer->pending_length == range->offset)) {
+        writer->pending_length += range->length;
+        return 0;
+    }
+    if (flush_pending(writer) < 0) {
+        return -1;
+    }
+    writer->pending_offset = range->offset;
+    writer->pending_length = range->length;
+    return 0;
+}
+
+static int flush_pending(class_writer_t *writer) {
+    if (writer->pending_length == 0) {
+        return 0;
+    }
+    int result = buffer_put_bytes(writer->out, writer->class_file->source + writer->pending_offset, writer->pending_length);
+    writer->pending_length = 0;
+    return result;
+}
+
+static int put_u1(class_writer_t *writer, u1_t value) {
+    if (flush_pending(writer) < 0) {
+        return -1;
+    }
+    return buffer_put_u1(writer->out, value);
+}
+
+static int put_u2(class_writer_t *writer, u2_t value) {
+    if (flush_pending(writer) < 0) {
+        return -1;
+    }
+    return buffer_put_u2(writer->out, value);
+}
+
+static int put_u4(class_writer_t *writer, u4_t value) {
+    if (flush_pending(writer) < 0) {
+        return -1;
+    }
+    return buffer_put_u4(writer->out, value);
+}
+
+static int put_bytes(class_writer_t *writer, const void *bytes, size_t length) {
+    if (flush_pending(writer) < 0) {
+        return -1;
+    }
+    return buffer_put_bytes(writer->out, bytes, length);
+}
+
+int write_file(const char *file_name, const u1_t *bytes, size_t length) {
+    int fd = open(file_name, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        fprintf(stderr, "%s: failed to create '%s': %s\n", program, file_name, strerror(errno));
+        return -1;
+    }
+    size_t so_far = 0;
+    while (so_far < length) {
+        ssize_t written = write(fd, bytes + so_far, length - so_far);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            fprintf(stderr, "%s: failed to write '%s': %s\n", program, file_name, strerror(errno));
+            close(fd);
+            return -1;
+        }
+        so_far += written;
+    }
+    if (close(fd) < 0) {
+        fprintf(stderr, "%s: failed to close '%s': %s\n", program, file_name, strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * Reads a .class or a jar, applies transform to every class and writes
+ * the result.  transform returns how many changes it made; jar entries
+ * with no changes, and entries that are not classes, are copied still
+ * compressed.
+ */
+int rewrite_file(const char *input_name, const char *output_name, class_transform_t transform, void *context, int level) {
+    size_t length = strlen(input_name);
+    if (has_suffix(input_name, length, ".jar") || has_suffix(input_name, length, ".zip")) {
+        return rewrite_jar(input_name, output_name, transform, context, level);
+    }
+    return rewrite_class(input_name, output_name, transform, context);
+}
+
+static int rewrite_class(const char *input_name, const char *output_name, class_transform_t transform, void *context) {
+    int fd = open(input_name, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "%s: failed to open '%s': %s.\n", program, input_name, strerror(errno));
+        return -1;
+    }
+    class_file_t *class_file = read_class_file(fd);
+    close(fd);
+    if (class_file == NULL) {
+        fprintf(stderr, "%s: failed to read class file '%s'.\n", program, input_name);
+        return -1;
+    }
+
+    buffer_t out = {NULL, 0, 0};
+    int result = -1;
+    if ((transform(class_file, context) >= 0) &&
+        (write_class_file(class_file, &out) >= 0)) {
+        result = write_file(output_name, out.data, out.length);
+    }
+    buffer_free(&out);
+    free_class_file(class_file);
+    return result;
+}
+
+static int rewrite_jar(const char *input_name, const char *output_name, class_transform_t transform, void *context, int level) {
+    jar_file_t *jar_file = open_jar_file(input_name);
+    if (jar_file == NULL) {
+        return -1;
+    }
+    jar_writer_t writer;
+    if (jar_writer_open(&writer, jar_file, output_name) < 0) {
+        close_jar_file(jar_file);
+        return -1;
+    }
+
+    buffer_t out = {NULL, 0, 0};
+    int threads = sysconf(_SC_NPROCESSORS_ONLN);
+    int result = 0;
+    u4_t i;
+    for (i = 0; (i < jar_file->entries_count) && (result == 0); i++) {
+        jar_entry_t *entry = &jar_file->entries[i];
+        if (!is_class_entry(entry)) {
+            result = jar_writer_copy_entry(&writer, entry);
+            continue;
+        }
+
+        u1_t *bytes = read_jar_entry(jar_file, entry);
+        class_file_t *class_file = bytes ? read_class_bytes_parallel(bytes, entry->uncompressed_size, threads) : NULL;
+        if (class_file == NULL) {
+            fprintf(stderr, "%s: copying unreadable class '%.*s' unchanged\n", program, entry->name_length, entry->name);
+            result = jar_writer_copy_entry(&writer, entry);
+            continue;
+        }
+
+        int changes = transform(class_file, context);
+        if (changes < 0) {
+            result = -1;
+        }
+        else if (changes == 0) {
+            result = jar_writer_copy_entry(&writer, entry);
+        }
+        else {
+            out.length = 0;
+            result = write_class_file(class_file, &out);
+            if (result == 0) {
+                result = jar_writer_add_entry(&writer, entry, out.data, out.length, level);
+            }
+        }
+        free_class_file(class_file);
+    }
+
+    if (jar_writer_close(&writer) < 0) {
+        result = -1;
+    }
+    buffer_free(&out);
+    close_jar_file(jar_file);
+    return result;
+}